@@ -0,0 +1,481 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "corpus.h"
+#include "common/convert.h"
+#include "internal/buffer.h"
+#include "internal/packbits.h"
+#include "internal/pixel.h"
+#include "pict/pict.h"
+#include "pict/pict_writer.h"
+
+/* Measures each stage of decoding over a synthetic corpus of pictures.
+ *
+ *   qdbench [-q] [-r repetitions] [-w warmup] [-f filter] [-d corpus-dir]
+ *
+ * Each result is written to stdout as a single line of JSON, so that the output
+ * of two builds can be compared directly. Times are per operation, and each
+ * repetition runs the operation enough times to take at least a few milliseconds.
+ * The minimum is the figure to compare, as it is the least affected by noise. */
+
+#if !defined(QD_BENCH_CFLAGS)
+#define QD_BENCH_CFLAGS ""
+#endif
+
+#define QD_BENCH_MIN_REP_NS     5000000ULL
+
+struct qd_bench_options
+{
+    unsigned int repetitions;
+    unsigned int warmup;
+    const char *filter;
+    const char *corpus_dir;
+    uint32_t max_size;
+};
+
+typedef int qd_bench_fn(void *context);
+
+// MARK: - Timing
+
+static inline uint64_t qd_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int qd_bench_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Times an operation, reporting it along with the number of bytes and pixels that
+ * a single operation processes. */
+static int qd_bench_run(
+    const struct qd_bench_options *options,
+    const char *stage,
+    const char *name,
+    qd_bench_fn *fn,
+    void *context,
+    uint64_t bytes,
+    uint64_t pixels,
+    double ratio
+) {
+    if (options->filter && !strstr(stage, options->filter) && !strstr(name, options->filter)) {
+        return 0;
+    }
+
+    // Work out how many operations make up a repetition, warming up as we go.
+    uint64_t iterations = 1;
+    for (;;) {
+        uint64_t start = qd_bench_now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            if (fn(context)) {
+                fprintf(stderr, "qdbench: %s %s failed\n", stage, name);
+                return 1;
+            }
+        }
+        uint64_t elapsed = qd_bench_now() - start;
+        if (elapsed >= QD_BENCH_MIN_REP_NS) {
+            break;
+        }
+        iterations *= (elapsed == 0) ? 16 : (QD_BENCH_MIN_REP_NS / elapsed) + 1;
+    }
+
+    for (unsigned int n = 0; n < options->warmup; ++n) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn(context);
+        }
+    }
+
+    uint64_t *times = calloc(options->repetitions, sizeof(*times));
+    if (!times) {
+        return 1;
+    }
+    for (unsigned int n = 0; n < options->repetitions; ++n) {
+        uint64_t start = qd_bench_now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn(context);
+        }
+        times[n] = (qd_bench_now() - start) / iterations;
+    }
+    qsort(times, options->repetitions, sizeof(*times), qd_bench_compare);
+
+    uint64_t min = times[0] ? times[0] : 1;
+    uint64_t median = times[options->repetitions / 2];
+    printf("{\"stage\":\"%s\",\"case\":\"%s\",\"bytes\":%llu,\"pixels\":%llu,\"ratio\":%.3f,"
+        "\"iterations\":%llu,\"repetitions\":%u,\"min_ns\":%llu,\"median_ns\":%llu,\"max_ns\":%llu,"
+        "\"mb_per_s\":%.2f,\"mpixels_per_s\":%.2f}\n",
+        stage, name, (unsigned long long)bytes, (unsigned long long)pixels, ratio,
+        (unsigned long long)iterations, options->repetitions, (unsigned long long)times[0],
+        (unsigned long long)median, (unsigned long long)times[options->repetitions - 1],
+        (double)bytes * 1000.0 / (double)min, (double)pixels * 1000.0 / (double)min);
+    fflush(stdout);
+
+    free(times);
+    return 0;
+}
+
+// MARK: - Buffer Stage
+
+struct qd_bench_file
+{
+    char path[1024];
+};
+
+static int qd_bench_buffer_open(void *context)
+{
+    struct qd_bench_file *file = context;
+    struct qd_buffer *buffer = qd_buffer_open(file->path);
+    if (!buffer) {
+        return 1;
+    }
+    qd_buffer_free(buffer);
+    return 0;
+}
+
+static int qd_bench_buffer_stage(const struct qd_bench_options *options, struct qd_bench_picture *pictures, size_t count)
+{
+    mkdir(options->corpus_dir, 0755);
+
+    int err = 0;
+    for (size_t n = 0; n < count && !err; ++n) {
+        struct qd_bench_file file;
+        snprintf(file.path, sizeof(file.path), "%s/%s.pict", options->corpus_dir, pictures[n].name);
+
+        FILE *f = fopen(file.path, "wb");
+        if (!f || fwrite(pictures[n].data, 1, pictures[n].size, f) != pictures[n].size) {
+            fprintf(stderr, "qdbench: failed to write '%s'\n", file.path);
+            if (f) {
+                fclose(f);
+            }
+            return 1;
+        }
+        fclose(f);
+
+        uint64_t pixels = (uint64_t)pictures[n].width * pictures[n].height;
+        err = qd_bench_run(options, "buffer_open", pictures[n].name, qd_bench_buffer_open, &file, pictures[n].size, pixels, 1.0);
+    }
+
+    return err;
+}
+
+// MARK: - PackBits Stage
+
+struct qd_bench_packbits
+{
+    uint8_t *packed;
+    size_t *lengths;
+    uint8_t *out;
+    uint32_t rows;
+    int value_size;
+};
+
+static int qd_bench_packbits_decode(void *context)
+{
+    struct qd_bench_packbits *bench = context;
+    const uint8_t *packed = bench->packed;
+    for (uint32_t row = 0; row < bench->rows; ++row) {
+        qd_packbits_decode(bench->out, packed, bench->lengths[row], bench->value_size);
+        packed += bench->lengths[row];
+    }
+    return 0;
+}
+
+static int qd_bench_packbits_stage(const struct qd_bench_options *options)
+{
+    static const char *contents[] = { "flat", "gradient", "noise" };
+    const size_t row_bytes = 4096;
+    const uint32_t rows = 256;
+
+    int err = 0;
+    for (int content = 0; content < 3 && !err; ++content) {
+        for (int value_size = 1; value_size <= 2 && !err; ++value_size) {
+            struct qd_bench_packbits bench = { 0 };
+            uint8_t *row = malloc(row_bytes);
+            bench.packed = malloc((row_bytes + row_bytes / 128 + 2) * rows);
+            bench.lengths = calloc(rows, sizeof(*bench.lengths));
+            bench.out = malloc(row_bytes);
+            bench.rows = rows;
+            bench.value_size = value_size;
+            if (!row || !bench.packed || !bench.lengths || !bench.out) {
+                err = 1;
+            }
+
+            // Rows with the same runs as the corpus pictures of the same content.
+            uint32_t state = 0x2545F491;
+            size_t total = 0;
+            for (uint32_t y = 0; y < rows && !err; ++y) {
+                for (size_t x = 0; x < row_bytes; ++x) {
+                    if (content == 0) {
+                        row[x] = 0x5A;
+                    }
+                    else if (content == 1) {
+                        row[x] = (uint8_t)((x / value_size) * 255 / (row_bytes / value_size) / 2 + y / 4);
+                    }
+                    else {
+                        state ^= state << 13;
+                        state ^= state >> 17;
+                        state ^= state << 5;
+                        row[x] = (uint8_t)state;
+                    }
+                }
+                bench.lengths[y] = qd_packbits_encode(bench.packed + total, row, row_bytes, value_size);
+                total += bench.lengths[y];
+            }
+
+            if (!err) {
+                char name[64];
+                snprintf(name, sizeof(name), "%s_%d", contents[content], value_size * 8);
+                uint64_t bytes = (uint64_t)row_bytes * rows;
+                err = qd_bench_run(options, "packbits_decode", name, qd_bench_packbits_decode, &bench, bytes, bytes / value_size, (double)bytes / (double)total);
+            }
+
+            free(row);
+            free(bench.packed);
+            free(bench.lengths);
+            free(bench.out);
+        }
+    }
+
+    return err;
+}
+
+// MARK: - Conversion Stage
+
+struct qd_bench_convert
+{
+    struct qd_converter converter;
+    uint8_t *src;
+    uint8_t *dst;
+    size_t src_row_bytes;
+    uint32_t width;
+    uint32_t height;
+};
+
+static int qd_bench_convert_pixels(void *context)
+{
+    struct qd_bench_convert *bench = context;
+    qd_convert(&bench->converter, bench->dst, (size_t)bench->width * 4, bench->src, bench->src_row_bytes, bench->width, bench->height);
+    return 0;
+}
+
+static int qd_bench_convert_stage(const struct qd_bench_options *options)
+{
+    static const struct { const char *name; uint32_t format; uint32_t depth; } formats[] = {
+        { "1_to_rgba", qd_1_monochrome_pixel_format, 1 },
+        { "8_to_rgba", qd_8_indexed_pixel_format, 8 },
+        { "555_to_rgba", qd_16_555_pixel_format, 16 },
+        { "rgb_to_rgba", qd_24_rgb_pixel_format, 24 },
+        { "argb_to_rgba", qd_32_argb_pixel_format, 32 },
+    };
+
+    uint32_t palette[256];
+    for (int i = 0; i < 256; ++i) {
+        palette[i] = qd_pixel_pack((uint8_t)i, (uint8_t)(255 - i), (uint8_t)(i * 7), UINT8_MAX);
+    }
+
+    int err = 0;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(*formats) && !err; ++f) {
+        struct qd_bench_convert bench = { .width = 1024, .height = 256 };
+        bench.src_row_bytes = ((size_t)bench.width * formats[f].depth + 7) / 8;
+        bench.src = malloc(bench.src_row_bytes * bench.height);
+        bench.dst = malloc((size_t)bench.width * 4 * bench.height);
+        if (!bench.src || !bench.dst || qd_converter_init(&bench.converter, formats[f].format, qd_32_rgba_pixel_format, palette, NULL)) {
+            free(bench.src);
+            free(bench.dst);
+            return 1;
+        }
+
+        uint32_t state = 0x6C078965;
+        for (size_t i = 0; i < bench.src_row_bytes * bench.height; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            bench.src[i] = (uint8_t)state;
+        }
+
+        uint64_t pixels = (uint64_t)bench.width * bench.height;
+        err = qd_bench_run(options, "convert", formats[f].name, qd_bench_convert_pixels, &bench, pixels * 4, pixels, 1.0);
+
+        qd_converter_destroy(&bench.converter);
+        free(bench.src);
+        free(bench.dst);
+    }
+
+    return err;
+}
+
+// MARK: - Parse Stage
+
+static int qd_bench_pict_parse(void *context)
+{
+    struct qd_bench_picture *picture = context;
+    struct qd_buffer buffer = { picture->data, 0, picture->size, qd_buffer_borrowed };
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, &buffer);
+    qd_pict_free(pict);
+    return err;
+}
+
+static int qd_bench_parse_stage(const struct qd_bench_options *options, struct qd_bench_picture *pictures, size_t count)
+{
+    int err = 0;
+    for (size_t n = 0; n < count && !err; ++n) {
+        struct qd_bench_picture *picture = &pictures[n];
+        uint64_t pixels = (uint64_t)picture->width * picture->height;
+        double ratio = picture->packed_bytes ? (double)picture->pixel_bytes / (double)picture->packed_bytes : 1.0;
+        err = qd_bench_run(options, "pict_parse", picture->name, qd_bench_pict_parse, picture, picture->size, pixels, ratio);
+    }
+    return err;
+}
+
+// MARK: - Write Stage
+
+struct qd_bench_write
+{
+    struct qd_surface surface;
+    struct qd_pixmap pm;
+    struct qd_color_spec specs[256];
+    struct qd_color_table clut;
+    struct qd_pict_write_options options;
+};
+
+static int qd_bench_pict_write(void *context)
+{
+    struct qd_bench_write *bench = context;
+    struct qd_buffer *buffer = NULL;
+    int err = qd_pict_write(&buffer, &bench->surface, &bench->options);
+    qd_buffer_free(buffer);
+    return err;
+}
+
+/* Writes each decoded corpus picture back out in the layout that it was read
+ * from, so that encoding can be compared with decoding picture for picture. */
+static int qd_bench_write_stage(const struct qd_bench_options *options, struct qd_bench_picture *pictures, size_t count)
+{
+    static const short layouts[][3] = {
+        { 32, 4, 3 }, { 32, 2, 3 }, { 32, 1, 3 }, { 16, 3, 3 }, { 8, 0, 1 }, { 1, 0, 1 },
+    };
+
+    struct qd_bench_write *bench = calloc(1, sizeof(*bench));
+    if (!bench) {
+        return 1;
+    }
+
+    int err = 0;
+    for (size_t n = 0; n < count && !err; ++n) {
+        struct qd_bench_picture *picture = &pictures[n];
+        struct qd_buffer buffer = { picture->data, 0, picture->size, qd_buffer_borrowed };
+        struct qd_pict *pict = NULL;
+        if (qd_pict_parse(&pict, &buffer)) {
+            qd_pict_free(pict);
+            err = 1;
+            break;
+        }
+
+        // The same gray ramp color table as the corpus pictures.
+        bench->pm = (struct qd_pixmap){ 0 };
+        bench->pm.pixel_size = layouts[picture->layout][0];
+        bench->pm.pack_type = layouts[picture->layout][1];
+        bench->pm.cmp_count = layouts[picture->layout][2];
+        int colors = 1 << (bench->pm.pixel_size <= 8 ? bench->pm.pixel_size : 1);
+        for (int i = 0; i < colors; ++i) {
+            uint16_t level = (uint16_t)(0xFFFF - i * (0xFFFF / (colors - 1)));
+            bench->specs[i] = (struct qd_color_spec){ (unsigned short)i, { level, level, level } };
+        }
+        bench->clut = (struct qd_color_table){ 0, 0, (short)(colors - 1), bench->specs };
+        bench->surface = (struct qd_surface){ pict->surface, pict->width, pict->height, pict->row_bytes };
+        bench->options = (struct qd_pict_write_options){ .pm = &bench->pm, .clut = &bench->clut };
+
+        uint64_t pixels = (uint64_t)picture->width * picture->height;
+        double ratio = picture->packed_bytes ? (double)picture->pixel_bytes / (double)picture->packed_bytes : 1.0;
+        err = qd_bench_run(options, "pict_write", picture->name, qd_bench_pict_write, bench, picture->size, pixels, ratio);
+        qd_pict_free(pict);
+    }
+
+    free(bench);
+    return err;
+}
+
+// MARK: - Main
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: qdbench [-q] [-r repetitions] [-w warmup] [-f filter] [-d corpus-dir]\n");
+}
+
+int main(int argc, const char **argv)
+{
+    struct qd_bench_options options = { 10, 2, NULL, "bench/corpus", 2048 };
+
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-q") == 0) {
+            options.max_size = 512;
+        }
+        else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+            options.repetitions = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-w") == 0 && arg + 1 < argc) {
+            options.warmup = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+            options.filter = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+            options.corpus_dir = argv[++arg];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.repetitions == 0) {
+        options.repetitions = 1;
+    }
+
+    struct qd_bench_picture *pictures = NULL;
+    size_t count = qd_bench_corpus_generate(&pictures, options.max_size);
+    if (count == 0) {
+        return 1;
+    }
+
+    printf("{\"stage\":\"meta\",\"format\":1,\"cflags\":\"%s\",\"repetitions\":%u,\"warmup\":%u,\"pictures\":%zu}\n",
+        QD_BENCH_CFLAGS, options.repetitions, options.warmup, count);
+
+    int err = qd_bench_buffer_stage(&options, pictures, count)
+        || qd_bench_packbits_stage(&options)
+        || qd_bench_convert_stage(&options)
+        || qd_bench_parse_stage(&options, pictures, count)
+        || qd_bench_write_stage(&options, pictures, count);
+
+    qd_bench_corpus_free(pictures, count);
+    return err;
+}
@@ -0,0 +1,378 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "internal/packbits.h"
+
+// MARK: - PICT Writer
+
+struct qd_bench_writer
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+};
+
+static uint8_t *qd_bench_reserve(struct qd_bench_writer *w, size_t size)
+{
+    if (w->size + size > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : 4096;
+        while (capacity < w->size + size) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(w->data, capacity);
+        if (!data) {
+            w->failed = 1;
+            return NULL;
+        }
+        w->data = data;
+        w->capacity = capacity;
+    }
+
+    uint8_t *p = w->data + w->size;
+    w->size += size;
+    return p;
+}
+
+static void put8(struct qd_bench_writer *w, uint8_t v)
+{
+    uint8_t *p = qd_bench_reserve(w, 1);
+    if (p) {
+        p[0] = v;
+    }
+}
+
+static void put16(struct qd_bench_writer *w, uint16_t v)
+{
+    put8(w, (uint8_t)(v >> 8));
+    put8(w, (uint8_t)v);
+}
+
+static void put32(struct qd_bench_writer *w, uint32_t v)
+{
+    put16(w, (uint16_t)(v >> 16));
+    put16(w, (uint16_t)v);
+}
+
+static void put_rect(struct qd_bench_writer *w, short top, short left, short bottom, short right)
+{
+    put16(w, top);
+    put16(w, left);
+    put16(w, bottom);
+    put16(w, right);
+}
+
+static void put_bytes(struct qd_bench_writer *w, const uint8_t *bytes, size_t size)
+{
+    uint8_t *p = qd_bench_reserve(w, size);
+    if (p) {
+        memcpy(p, bytes, size);
+    }
+}
+
+static void put_header(struct qd_bench_writer *w, short width, short height)
+{
+    put16(w, 0);
+    put_rect(w, 0, 0, height, width);
+    put32(w, 0x001102FF);
+    put16(w, 0x0C00);
+    put32(w, 0xFFFFFFFF);
+    put32(w, 0);
+    put32(w, 0);
+    put32(w, (uint32_t)width << 16);
+    put32(w, (uint32_t)height << 16);
+    put32(w, 0);
+}
+
+static void put_pixmap(struct qd_bench_writer *w, short row_bytes, short width, short height, short pack_type, short pixel_type, short pixel_size, short cmp_count, short cmp_size)
+{
+    put16(w, 0x8000 | row_bytes);
+    put_rect(w, 0, 0, height, width);
+    put16(w, 0);                        // version
+    put16(w, pack_type);
+    put32(w, 0);                        // pack size
+    put32(w, 0x00480000);               // h res
+    put32(w, 0x00480000);               // v res
+    put16(w, pixel_type);
+    put16(w, pixel_size);
+    put16(w, cmp_count);
+    put16(w, cmp_size);
+    put32(w, 0);                        // pixel format
+    put32(w, 0);                        // color table
+    put32(w, 0);                        // reserved
+}
+
+// MARK: - PackBits
+
+static void put_packed_row(struct qd_bench_writer *w, const uint8_t *row, size_t length, size_t row_bytes, int value_size, uint8_t *scratch, size_t *packed_bytes)
+{
+    // The packed length is a word when the rows of the PixMap are wide, whatever
+    // the length of the data in them.
+    length = qd_packbits_encode(scratch, row, length, value_size);
+    if (row_bytes > 250) {
+        put16(w, (uint16_t)length);
+    }
+    else {
+        put8(w, (uint8_t)length);
+    }
+    put_bytes(w, scratch, length);
+    *packed_bytes += length;
+}
+
+// MARK: - Content
+
+static inline uint32_t qd_bench_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Returns the color of a pixel as 0x00RRGGBB.
+static uint32_t qd_bench_pixel(int content, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t *state)
+{
+    switch (content) {
+        case qd_bench_flat:
+            return 0x003366CC;
+        case qd_bench_gradient:
+            return ((x * 255 / width) << 16) | ((y * 255 / height) << 8) | (((x + y) * 127 / (width + height)) & 0xFF);
+        default:
+            return qd_bench_random(state) & 0x00FFFFFF;
+    }
+}
+
+static const char *qd_bench_layout_names[] = {
+    "direct32_pack4", "direct32_pack2", "direct32_pack1", "direct16_pack3", "indexed8", "indexed1"
+};
+
+static const char *qd_bench_content_names[] = {
+    "flat", "gradient", "noise"
+};
+
+// MARK: - Picture Generation
+
+static int qd_bench_generate(struct qd_bench_picture *picture)
+{
+    struct qd_bench_writer w = { 0 };
+    uint32_t width = picture->width;
+    uint32_t height = picture->height;
+    uint32_t state = 0x9E3779B9 ^ (width * 31 + (uint32_t)picture->content);
+
+    put_header(&w, (short)width, (short)height);
+
+    // Every layout is written as a single bitmap opcode covering the frame.
+    int value_size = 1;
+    int packed = 1;
+    size_t row_bytes = 0;
+    switch (picture->layout) {
+        case qd_bench_direct32_pack4:
+            row_bytes = (size_t)width * 4;
+            put16(&w, 0x009A);
+            put32(&w, 0x000000FF);
+            put_pixmap(&w, (short)row_bytes, width, height, 4, 16, 32, 3, 8);
+            break;
+        case qd_bench_direct32_pack2:
+            row_bytes = (size_t)width * 4;
+            packed = 0;
+            put16(&w, 0x009A);
+            put32(&w, 0x000000FF);
+            put_pixmap(&w, (short)row_bytes, width, height, 2, 16, 32, 3, 8);
+            break;
+        case qd_bench_direct32_pack1:
+            row_bytes = (size_t)width * 4;
+            packed = 0;
+            put16(&w, 0x009A);
+            put32(&w, 0x000000FF);
+            put_pixmap(&w, (short)row_bytes, width, height, 1, 16, 32, 3, 8);
+            break;
+        case qd_bench_direct16_pack3:
+            row_bytes = (size_t)width * 2;
+            value_size = 2;
+            put16(&w, 0x009A);
+            put32(&w, 0x000000FF);
+            put_pixmap(&w, (short)row_bytes, width, height, 3, 16, 16, 3, 5);
+            break;
+        case qd_bench_indexed8:
+        case qd_bench_indexed1: {
+            int depth = (picture->layout == qd_bench_indexed8) ? 8 : 1;
+            row_bytes = ((size_t)width * depth + 7) / 8;
+            row_bytes = (row_bytes + 1) & ~(size_t)1;
+            put16(&w, 0x0098);
+            put_pixmap(&w, (short)row_bytes, width, height, 0, 0, depth, 1, depth);
+
+            // A gray ramp color table with an entry for every pixel value.
+            int colors = 1 << depth;
+            put32(&w, 0);
+            put16(&w, 0);
+            put16(&w, (uint16_t)(colors - 1));
+            for (int i = 0; i < colors; ++i) {
+                uint16_t level = (uint16_t)(0xFFFF - i * (0xFFFF / (colors - 1)));
+                put16(&w, (uint16_t)i);
+                put16(&w, level);
+                put16(&w, level);
+                put16(&w, level);
+            }
+            break;
+        }
+        default:
+            return 1;
+    }
+
+    put_rect(&w, 0, 0, height, width);
+    put_rect(&w, 0, 0, height, width);
+    put16(&w, 0);
+
+    uint8_t *row = calloc(row_bytes, 1);
+    uint8_t *scratch = malloc(row_bytes + row_bytes / 128 + 2);
+    if (!row || !scratch) {
+        free(row);
+        free(scratch);
+        free(w.data);
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < height; ++y) {
+        memset(row, 0, row_bytes);
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t rgb = qd_bench_pixel(picture->content, x, y, width, height, &state);
+            uint8_t r = (uint8_t)(rgb >> 16), g = (uint8_t)(rgb >> 8), b = (uint8_t)rgb;
+            switch (picture->layout) {
+                case qd_bench_direct32_pack4:
+                    // Planar components, one plane after another.
+                    row[x] = r;
+                    row[width + x] = g;
+                    row[2 * width + x] = b;
+                    break;
+                case qd_bench_direct32_pack2:
+                    row[3 * x] = r;
+                    row[3 * x + 1] = g;
+                    row[3 * x + 2] = b;
+                    break;
+                case qd_bench_direct32_pack1:
+                    row[4 * x + 1] = r;
+                    row[4 * x + 2] = g;
+                    row[4 * x + 3] = b;
+                    break;
+                case qd_bench_direct16_pack3: {
+                    uint16_t v = (uint16_t)(((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3));
+                    row[2 * x] = (uint8_t)(v >> 8);
+                    row[2 * x + 1] = (uint8_t)v;
+                    break;
+                }
+                case qd_bench_indexed8:
+                    row[x] = (uint8_t)((r + g + b) / 3);
+                    break;
+                case qd_bench_indexed1:
+                    if ((r + g + b) / 3 < 128) {
+                        row[x >> 3] |= (uint8_t)(0x80 >> (x & 7));
+                    }
+                    break;
+            }
+        }
+
+        // Pack type 4 stores three planes of the row, with no pad plane.
+        size_t length = (picture->layout == qd_bench_direct32_pack4) ? (size_t)width * 3
+            : (picture->layout == qd_bench_direct32_pack2) ? (size_t)width * 3 : row_bytes;
+        if (packed) {
+            put_packed_row(&w, row, length, row_bytes, value_size, scratch, &picture->packed_bytes);
+        }
+        else {
+            put_bytes(&w, row, length);
+            picture->packed_bytes += length;
+        }
+        picture->pixel_bytes += length;
+    }
+
+    if (w.size & 1) {
+        put8(&w, 0);
+    }
+    put16(&w, 0x00FF);
+
+    free(row);
+    free(scratch);
+    if (w.failed) {
+        free(w.data);
+        return 1;
+    }
+
+    picture->data = w.data;
+    picture->size = w.size;
+    return 0;
+}
+
+size_t qd_bench_corpus_generate(struct qd_bench_picture **pictures, uint32_t max_size)
+{
+    static const uint32_t sizes[] = { 64, 512, 2048 };
+    size_t layouts = sizeof(qd_bench_layout_names) / sizeof(*qd_bench_layout_names);
+    size_t contents = sizeof(qd_bench_content_names) / sizeof(*qd_bench_content_names);
+    size_t capacity = layouts * contents * (sizeof(sizes) / sizeof(*sizes));
+
+    struct qd_bench_picture *list = calloc(capacity, sizeof(*list));
+    if (!list) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes) && sizes[s] <= max_size; ++s) {
+        for (size_t l = 0; l < layouts; ++l) {
+            for (size_t c = 0; c < contents; ++c) {
+                // Unpacked layouts take the same time whatever their content.
+                if ((l == qd_bench_direct32_pack2 || l == qd_bench_direct32_pack1) && c != qd_bench_gradient) {
+                    continue;
+                }
+
+                struct qd_bench_picture *picture = &list[count];
+                picture->layout = (int)l;
+                picture->content = (int)c;
+                picture->width = sizes[s];
+                picture->height = sizes[s];
+                snprintf(picture->name, sizeof(picture->name), "%s_%s_%ux%u",
+                    qd_bench_layout_names[l], qd_bench_content_names[c], sizes[s], sizes[s]);
+
+                if (qd_bench_generate(picture)) {
+                    fprintf(stderr, "Failed to generate benchmark picture '%s'.\n", picture->name);
+                    qd_bench_corpus_free(list, count);
+                    return 0;
+                }
+                ++count;
+            }
+        }
+    }
+
+    *pictures = list;
+    return count;
+}
+
+void qd_bench_corpus_free(struct qd_bench_picture *pictures, size_t count)
+{
+    if (pictures) {
+        for (size_t n = 0; n < count; ++n) {
+            free(pictures[n].data);
+        }
+        free(pictures);
+    }
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(libQuickDraw_BenchCorpus)
+#define libQuickDraw_BenchCorpus
+
+/* The kind of content that a synthetic picture is filled with, which determines
+ * how well its rows compress. */
+enum
+{
+    qd_bench_flat = 0,
+    qd_bench_gradient = 1,
+    qd_bench_noise = 2,
+};
+
+/* How the pixels of a synthetic picture are stored. */
+enum
+{
+    qd_bench_direct32_pack4 = 0,
+    qd_bench_direct32_pack2 = 1,
+    qd_bench_direct32_pack1 = 2,
+    qd_bench_direct16_pack3 = 3,
+    qd_bench_indexed8 = 4,
+    qd_bench_indexed1 = 5,
+};
+
+struct qd_bench_picture
+{
+    char name[64];
+    int layout;
+    int content;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *data;
+    size_t size;
+    size_t pixel_bytes;
+    size_t packed_bytes;
+};
+
+/* Generates a PICT for every combination of layout, content and size, up to the
+ * given largest size. Returns the number of pictures, or 0 on failure. */
+size_t qd_bench_corpus_generate(struct qd_bench_picture **pictures, uint32_t max_size);
+void qd_bench_corpus_free(struct qd_bench_picture *pictures, size_t count);
+
+#endif
@@ -0,0 +1,351 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atlas/atlas.h"
+#include "common/geometry.h"
+#include "internal/threads.h"
+#include "pict/pict.h"
+
+// MARK: - Skyline Packing
+
+/* The skyline is the top edge of everything that has been packed so far, as a run
+ * of segments from left to right that together cover the width of the atlas. Each
+ * picture is placed where its bottom edge ends up highest, resting on the
+ * skyline, and the skyline is raised to its bottom edge. Pictures are packed from
+ * the tallest down, which keeps the skyline flat. */
+struct qd_atlas_skyline
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+};
+
+struct qd_atlas_item
+{
+    size_t index;
+    uint32_t width;
+    uint32_t height;
+    uint32_t x;
+    uint32_t y;
+};
+
+static int qd_atlas_item_compare(const void *lhs, const void *rhs)
+{
+    const struct qd_atlas_item *a = lhs;
+    const struct qd_atlas_item *b = rhs;
+    if (a->height != b->height) {
+        return a->height > b->height ? -1 : 1;
+    }
+    if (a->width != b->width) {
+        return a->width > b->width ? -1 : 1;
+    }
+    return a->index < b->index ? -1 : (a->index > b->index);
+}
+
+/* Returns the lowest y at which something of the given width can rest on the
+ * skyline with its left edge at the start of a segment, or UINT32_MAX if it would
+ * run off the right of the atlas. */
+static uint32_t qd_atlas_skyline_fit(const struct qd_atlas_skyline *skyline, size_t index, uint32_t width, uint32_t atlas_width)
+{
+    if (width > atlas_width - skyline[index].x) {
+        return UINT32_MAX;
+    }
+
+    uint32_t y = 0;
+    for (uint32_t remaining = width; remaining > 0; ++index) {
+        y = skyline[index].y > y ? skyline[index].y : y;
+        remaining = skyline[index].width >= remaining ? 0 : remaining - skyline[index].width;
+    }
+    return y;
+}
+
+/* Raises the skyline to bottom across the given width, starting at the segment at
+ * index. There is room for one more segment than there are already. */
+static void qd_atlas_skyline_raise(struct qd_atlas_skyline *skyline, size_t *count, size_t index, uint32_t width, uint32_t bottom)
+{
+    struct qd_atlas_skyline segment = { skyline[index].x, bottom, width };
+    uint32_t end = segment.x + width;
+
+    // Segments that are wholly covered are replaced by the new one, and one that is
+    // partly covered is cut back to start where the new one ends.
+    size_t n = index;
+    while (n < *count && skyline[n].x + skyline[n].width <= end) {
+        ++n;
+    }
+    if (n < *count && skyline[n].x < end) {
+        skyline[n].width -= end - skyline[n].x;
+        skyline[n].x = end;
+    }
+
+    if (n == index) {
+        memmove(skyline + index + 1, skyline + index, (*count - index) * sizeof(*skyline));
+        ++*count;
+    }
+    else if (n > index + 1) {
+        memmove(skyline + index + 1, skyline + n, (*count - n) * sizeof(*skyline));
+        *count -= n - index - 1;
+    }
+    skyline[index] = segment;
+
+    // Neighbouring segments at the same height are merged.
+    for (size_t i = 0; i + 1 < *count;) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            memmove(skyline + i + 1, skyline + i + 2, (*count - i - 2) * sizeof(*skyline));
+            --*count;
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+/* Chooses a width for the atlas when none was given: the smallest power of two
+ * that is as wide as the widest picture and whose square holds all of them. */
+static uint32_t qd_atlas_choose_width(const struct qd_atlas_item *items, size_t count)
+{
+    uint64_t area = 0;
+    uint32_t widest = 1;
+    for (size_t n = 0; n < count; ++n) {
+        area += (uint64_t)items[n].width * items[n].height;
+        widest = items[n].width > widest ? items[n].width : widest;
+    }
+
+    uint64_t width = 1;
+    while (width < widest || width * width < area) {
+        width <<= 1;
+    }
+    return width > UINT32_MAX ? UINT32_MAX : (uint32_t)width;
+}
+
+/* Packs the items, which are sorted by packing order, into an atlas of the given
+ * width, returning the height that they take up. */
+static int qd_atlas_pack(struct qd_atlas_item *items, size_t count, uint32_t width, uint32_t *height)
+{
+    struct qd_atlas_skyline *skyline = malloc((count + 1) * sizeof(*skyline));
+    if (!skyline) {
+        return 1;
+    }
+
+    size_t segments = 1;
+    skyline[0] = (struct qd_atlas_skyline){ 0, 0, width };
+    *height = 0;
+
+    for (size_t n = 0; n < count; ++n) {
+        struct qd_atlas_item *item = &items[n];
+        if (item->width == 0 || item->height == 0) {
+            continue;
+        }
+
+        size_t best = SIZE_MAX;
+        uint64_t best_bottom = UINT64_MAX;
+        for (size_t i = 0; i < segments; ++i) {
+            uint32_t y = qd_atlas_skyline_fit(skyline, i, item->width, width);
+            if (y != UINT32_MAX && (uint64_t)y + item->height < best_bottom) {
+                best = i;
+                best_bottom = (uint64_t)y + item->height;
+            }
+        }
+        if (best == SIZE_MAX || best_bottom > UINT32_MAX) {
+            free(skyline);
+            return 1;
+        }
+
+        item->x = skyline[best].x;
+        item->y = (uint32_t)(best_bottom - item->height);
+        qd_atlas_skyline_raise(skyline, &segments, best, item->width, (uint32_t)best_bottom);
+        *height = (uint32_t)best_bottom > *height ? (uint32_t)best_bottom : *height;
+    }
+
+    free(skyline);
+    return 0;
+}
+
+// MARK: - Decoding
+
+struct qd_atlas_job
+{
+    struct qd_atlas *atlas;
+    struct qd_buffer *const *buffers;
+    struct qd_error *errors;
+    unsigned int scale;
+    atomic_size_t next;
+};
+
+static void *qd_atlas_decode_worker(void *context)
+{
+    struct qd_atlas_job *job = context;
+    struct qd_atlas *atlas = job->atlas;
+
+    // Each picture is drawn straight into its slot of the atlas, on a single
+    // thread, as the pictures themselves are what is decoded in parallel. The
+    // picture is read through a copy of its buffer, so that the same buffer may be
+    // given more than once.
+    size_t n;
+    while ((n = atomic_fetch_add(&job->next, 1)) < atlas->count) {
+        struct qd_atlas_entry *entry = &atlas->entries[n];
+        if (entry->failed) {
+            continue;
+        }
+
+        struct qd_surface slot = {
+            (uint8_t *)atlas->surface + entry->y * atlas->row_bytes + entry->x * sizeof(uint32_t),
+            entry->width,
+            entry->height,
+            atlas->row_bytes,
+        };
+        struct qd_pict_options options = { .scale = job->scale, .threads = 1, .target = &slot, .error = &job->errors[n] };
+        struct qd_buffer buffer = *job->buffers[n];
+        struct qd_pict *pict = NULL;
+        entry->failed = qd_pict_parse_with_options(&pict, &buffer, &options);
+        qd_pict_free(pict);
+    }
+
+    return NULL;
+}
+
+// MARK: - Atlas
+
+int qd_atlas_build(
+    struct qd_atlas **out_atlas,
+    struct qd_buffer *const *buffers,
+    size_t count,
+    const struct qd_atlas_options *options
+) {
+    struct qd_error *error = options ? options->error : NULL;
+    unsigned int scale = (options && options->scale > 1) ? options->scale : 1;
+    uint32_t padding = options ? options->padding : 0;
+    if (!out_atlas || (count && !buffers)) {
+        return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "No pictures given for the atlas.");
+    }
+    *out_atlas = NULL;
+
+    struct qd_atlas *atlas = calloc(1, sizeof(*atlas));
+    struct qd_atlas_entry *entries = calloc(count ? count : 1, sizeof(*entries));
+    struct qd_atlas_item *items = calloc(count ? count : 1, sizeof(*items));
+    struct qd_error *errors = calloc(count ? count : 1, sizeof(*errors));
+    if (!atlas || !entries || !items || !errors) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate the atlas.");
+        goto ERROR;
+    }
+    atlas->entries = entries;
+    atlas->count = count;
+
+    // Only the frames of the pictures are needed to pack them. Pictures whose frame
+    // cannot be read are given no slot.
+    for (size_t n = 0; n < count; ++n) {
+        struct qd_atlas_entry *entry = &entries[n];
+        items[n].index = n;
+        if (qd_pict_read_frame(buffers[n], &entry->frame)) {
+            qd_error_raise(&errors[n], qd_err_invalid, 2, QD_ERROR_NO_OPCODE, "Failed to read the frame of picture %zu of the atlas.", n);
+            entry->failed = 1;
+            continue;
+        }
+
+        entry->width = (uint32_t)(((uint32_t)qd_rect_get_width(entry->frame) + scale - 1) / scale);
+        entry->height = (uint32_t)(((uint32_t)qd_rect_get_height(entry->frame) + scale - 1) / scale);
+        items[n].width = entry->width + 2 * padding;
+        items[n].height = entry->height + 2 * padding;
+    }
+
+    qsort(items, count, sizeof(*items), qd_atlas_item_compare);
+    atlas->width = (options && options->width) ? options->width : qd_atlas_choose_width(items, count);
+    if (qd_atlas_pack(items, count, atlas->width, &atlas->height)) {
+        qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Pictures do not fit in an atlas %u pixels wide.", atlas->width);
+        goto ERROR;
+    }
+
+    atlas->height = atlas->height ? atlas->height : 1;
+    atlas->row_bytes = (size_t)atlas->width * sizeof(uint32_t);
+    uint64_t size = (uint64_t)atlas->row_bytes * atlas->height;
+    if (size > SIZE_MAX || !(atlas->surface = calloc(1, (size_t)size))) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate an atlas of %ux%u pixels.", atlas->width, atlas->height);
+        goto ERROR;
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        struct qd_atlas_entry *entry = &entries[items[n].index];
+        entry->x = items[n].x + padding;
+        entry->y = items[n].y + padding;
+        entry->u0 = (float)entry->x / (float)atlas->width;
+        entry->v0 = (float)entry->y / (float)atlas->height;
+        entry->u1 = (float)(entry->x + entry->width) / (float)atlas->width;
+        entry->v1 = (float)(entry->y + entry->height) / (float)atlas->height;
+    }
+
+    // Decode the pictures into their slots, with the calling thread decoding
+    // alongside the workers.
+    struct qd_atlas_job job = { atlas, buffers, errors, scale };
+    atomic_init(&job.next, 0);
+
+    pthread_t workers[QD_MAX_THREADS];
+    unsigned int worker_count = 0;
+    unsigned int threads = qd_thread_count(options ? options->threads : 0, count);
+    while (worker_count + 1 < threads) {
+        if (pthread_create(&workers[worker_count], NULL, qd_atlas_decode_worker, &job)) {
+            break;
+        }
+        ++worker_count;
+    }
+
+    qd_atlas_decode_worker(&job);
+    for (unsigned int n = 0; n < worker_count; ++n) {
+        pthread_join(workers[n], NULL);
+    }
+
+    // The first picture to have failed is reported on the calling thread.
+    int err = 0;
+    for (size_t n = 0; n < count && !err; ++n) {
+        if (entries[n].failed) {
+            const struct qd_error *e = &errors[n];
+            err = qd_error_raise(error, e->code, e->offset, e->opcode, "Picture %zu of the atlas: %s", n, e->message);
+        }
+    }
+
+    free(items);
+    free(errors);
+    *out_atlas = atlas;
+    return err;
+
+ERROR:
+    free(items);
+    free(errors);
+    if (atlas && atlas->entries == entries) {
+        // The entries are freed along with the atlas.
+        entries = NULL;
+    }
+    free(entries);
+    qd_atlas_free(atlas);
+    return 1;
+}
+
+void qd_atlas_free(struct qd_atlas *atlas)
+{
+    if (atlas) {
+        free(atlas->surface);
+        free(atlas->entries);
+        free(atlas);
+    }
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/error.h"
+#include "internal/buffer.h"
+
+#if !defined(libQuickDraw_Atlas)
+#define libQuickDraw_Atlas
+
+/* An atlas is a single surface that many pictures are decoded into, each in a
+ * slot of its own, so that a renderer can upload them all at once. The slots are
+ * packed with a skyline packer, and every picture is drawn straight into its slot
+ * rather than being decoded on its own and copied in afterwards.
+ *
+ * Each entry gives the slot of the picture in pixels, and the same rect as
+ * texture coordinates between 0 and 1. Entries are in the order of the buffers
+ * that the atlas was built from. */
+struct qd_atlas_entry
+{
+    struct qd_rect frame;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+    int failed;
+};
+
+/* The surface holds 32-bit RGBA pixels, in rows of row_bytes. Space that is not
+ * covered by a slot is transparent. */
+struct qd_atlas
+{
+    uint32_t width;
+    uint32_t height;
+    size_t row_bytes;
+    void *surface;
+    size_t count;
+    struct qd_atlas_entry *entries;
+};
+
+/* Options for building an atlas. The width of the atlas is chosen from the area
+ * of the pictures when it is 0, and the atlas grows downwards as far as it needs
+ * to. Padding is left around every slot, so that filtering at the edge of a slot
+ * does not pick up its neighbours. Pictures are decoded at the given scale, on up
+ * to the given number of threads, where 0 uses one thread per processor. */
+struct qd_atlas_options
+{
+    uint32_t width;
+    uint32_t padding;
+    unsigned int scale;
+    unsigned int threads;
+    struct qd_error *error;
+};
+
+/* Builds an atlas from the pictures in the buffers. A picture that fails to decode
+ * keeps its slot, and is marked as failed, while one whose frame cannot be read is
+ * marked as failed and given an empty slot. Returns 1 if any picture failed, with
+ * the first failure raised into the error of the options, in which case the atlas
+ * is still returned unless it could not be packed or allocated. */
+int qd_atlas_build(
+    struct qd_atlas **out_atlas,
+    struct qd_buffer *const *buffers,
+    size_t count,
+    const struct qd_atlas_options *options
+);
+
+void qd_atlas_free(struct qd_atlas *atlas);
+
+#endif
@@ -0,0 +1,446 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cache/baked_file.h"
+#include "internal/hash.h"
+
+// MARK: - File Format
+
+#define QD_BAKED_MAGIC              "QDBAKED"
+#define QD_BAKED_BYTE_ORDER         0x01020304
+
+struct qd_baked_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t entry_count;
+    uint32_t slot_count;
+    uint64_t entries_offset;
+    uint64_t slots_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t file_size;
+};
+
+struct qd_baked_entry
+{
+    uint64_t name_hash;
+    uint64_t name_offset;
+    uint32_t name_length;
+    uint32_t scale;
+    uint32_t width;
+    uint32_t height;
+    struct qd_rect frame;
+    double x_ratio;
+    double y_ratio;
+    uint64_t surface_offset;
+    uint64_t surface_size;
+};
+
+_Static_assert(sizeof(struct qd_baked_header) == 64, "Baked file header must be 64 bytes");
+_Static_assert(sizeof(struct qd_baked_entry) == 72, "Baked file entry must be 72 bytes");
+
+static inline uint64_t qd_baked_align(uint64_t offset)
+{
+    return (offset + QD_BAKED_ALIGNMENT - 1) & ~(uint64_t)(QD_BAKED_ALIGNMENT - 1);
+}
+
+// MARK: - Baking
+
+struct qd_baked_writer
+{
+    FILE *file;
+    int owns_file;
+    int failed;
+    uint64_t offset;
+    struct qd_baked_entry *entries;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    struct qd_error *error;
+};
+
+static int qd_baked_writer_write(struct qd_baked_writer *writer, const void *data, uint64_t size)
+{
+    if (size && fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = 1;
+        return qd_error_raise(writer->error, qd_err_io, (long)writer->offset, QD_ERROR_NO_OPCODE, "Failed to write to baked file.");
+    }
+
+    writer->offset += size;
+    return 0;
+}
+
+static int qd_baked_writer_pad(struct qd_baked_writer *writer)
+{
+    static const uint8_t zeros[QD_BAKED_ALIGNMENT] = { 0 };
+    return qd_baked_writer_write(writer, zeros, qd_baked_align(writer->offset) - writer->offset);
+}
+
+struct qd_baked_writer *qd_baked_writer_create(FILE *file, struct qd_error *error)
+{
+    if (!file) {
+        qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "No file given for baked file.");
+        return NULL;
+    }
+
+    struct qd_baked_writer *writer = calloc(1, sizeof(*writer));
+    if (!writer) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate baked file writer.");
+        return NULL;
+    }
+    writer->file = file;
+    writer->error = error;
+
+    // Leave room for the header, which is written once the tables are known.
+    struct qd_baked_header header = { { 0 } };
+    if (qd_baked_writer_write(writer, &header, sizeof(header)) || qd_baked_writer_pad(writer)) {
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+struct qd_baked_writer *qd_baked_writer_open(const char *restrict path, struct qd_error *error)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        qd_error_raise(error, qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to create baked file '%s'.", path);
+        return NULL;
+    }
+
+    struct qd_baked_writer *writer = qd_baked_writer_create(file, error);
+    if (!writer) {
+        fclose(file);
+        return NULL;
+    }
+
+    writer->owns_file = 1;
+    return writer;
+}
+
+static int qd_baked_writer_write_rows(struct qd_baked_writer *writer, const struct qd_pict *pict)
+{
+    size_t row_bytes = (size_t)pict->width * sizeof(uint32_t);
+    uint32_t *row = malloc(row_bytes);
+    if (!row) {
+        return qd_error_raise(writer->error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for baking a surface.");
+    }
+
+    int err = 0;
+    for (uint32_t y = 0; y < pict->height && !err; ++y) {
+        err = qd_pict_read_pixels(pict, 0, y, pict->width, 1, row, row_bytes) || qd_baked_writer_write(writer, row, row_bytes);
+    }
+
+    free(row);
+    return err;
+}
+
+int qd_baked_writer_add(struct qd_baked_writer *writer, const char *name, const struct qd_pict *pict)
+{
+    if (!writer || !name || !pict) {
+        return 1;
+    }
+
+    size_t name_length = strlen(name);
+    if (writer->count == writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 16;
+        struct qd_baked_entry *entries = realloc(writer->entries, capacity * sizeof(*entries));
+        if (!entries) {
+            return qd_error_raise(writer->error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for baked file entries.");
+        }
+        writer->entries = entries;
+        writer->capacity = capacity;
+    }
+
+    if (writer->names_size + name_length + 1 > writer->names_capacity) {
+        size_t capacity = writer->names_capacity ? writer->names_capacity : 1024;
+        while (capacity < writer->names_size + name_length + 1) {
+            capacity *= 2;
+        }
+        char *names = realloc(writer->names, capacity);
+        if (!names) {
+            return qd_error_raise(writer->error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for baked file names.");
+        }
+        writer->names = names;
+        writer->names_capacity = capacity;
+    }
+
+    int has_surface = pict->surface || pict->tiles;
+    struct qd_baked_entry entry = {
+        .name_hash = qd_hash64(name, name_length, 0),
+        .name_offset = writer->names_size,
+        .name_length = (uint32_t)name_length,
+        .scale = pict->scale,
+        .width = has_surface ? pict->width : 0,
+        .height = has_surface ? pict->height : 0,
+        .frame = pict->frame,
+        .x_ratio = pict->x_ratio,
+        .y_ratio = pict->y_ratio,
+        .surface_offset = has_surface ? writer->offset : 0,
+        .surface_size = has_surface ? pict->size : 0,
+    };
+
+    // Surfaces are written out as they are added, each one starting on an aligned
+    // offset so that it can be used in place once mapped. Tiled surfaces, and
+    // those with padded rows, are written out a row at a time so that they are
+    // baked in plain rows like any other.
+    if (pict->tiles || (pict->surface && pict->row_bytes != (size_t)pict->width * sizeof(uint32_t))) {
+        if (qd_baked_writer_write_rows(writer, pict)) {
+            return 1;
+        }
+    }
+    else if (qd_baked_writer_write(writer, pict->surface, entry.surface_size)) {
+        return 1;
+    }
+    if (qd_baked_writer_pad(writer)) {
+        return 1;
+    }
+
+    memcpy(writer->names + writer->names_size, name, name_length + 1);
+    writer->names_size += name_length + 1;
+    writer->entries[writer->count++] = entry;
+    return 0;
+}
+
+int qd_baked_writer_close(struct qd_baked_writer *writer)
+{
+    if (!writer) {
+        return 1;
+    }
+
+    // The hash table is kept at most half full, with each slot holding the index
+    // of an entry plus one so that zero marks an empty slot.
+    size_t slot_count = 16;
+    while (slot_count < writer->count * 2) {
+        slot_count <<= 1;
+    }
+
+    uint32_t *slots = calloc(slot_count, sizeof(*slots));
+    if (!slots) {
+        qd_error_raise(writer->error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for baked file index.");
+        writer->failed = 1;
+    }
+    else {
+        for (size_t n = 0; n < writer->count; ++n) {
+            size_t slot = writer->entries[n].name_hash & (slot_count - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = (uint32_t)(n + 1);
+        }
+    }
+
+    struct qd_baked_header header = { QD_BAKED_MAGIC };
+    header.version = QD_BAKED_VERSION;
+    header.byte_order = QD_BAKED_BYTE_ORDER;
+    header.entry_count = (uint32_t)writer->count;
+    header.slot_count = (uint32_t)slot_count;
+
+    if (!writer->failed) {
+        header.entries_offset = writer->offset;
+        qd_baked_writer_write(writer, writer->entries, writer->count * sizeof(*writer->entries));
+        qd_baked_writer_pad(writer);
+        header.slots_offset = writer->offset;
+        qd_baked_writer_write(writer, slots, slot_count * sizeof(*slots));
+        header.names_offset = writer->offset;
+        header.names_size = writer->names_size;
+        qd_baked_writer_write(writer, writer->names, writer->names_size);
+        header.file_size = writer->offset;
+    }
+
+    if (!writer->failed && (fseek(writer->file, 0L, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1 || fflush(writer->file) != 0)) {
+        qd_error_raise(writer->error, qd_err_io, 0, QD_ERROR_NO_OPCODE, "Failed to write the header of baked file.");
+        writer->failed = 1;
+    }
+
+    if (writer->owns_file && fclose(writer->file) != 0) {
+        qd_error_raise(writer->error, qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to close baked file.");
+        writer->failed = 1;
+    }
+
+    int err = writer->failed;
+    free(slots);
+    free(writer->entries);
+    free(writer->names);
+    free(writer);
+    return err;
+}
+
+// MARK: - Loading
+
+struct qd_baked_file
+{
+    struct qd_buffer *buffer;
+    int owns_buffer;
+    const struct qd_baked_header *header;
+    const struct qd_baked_entry *entries;
+    const uint32_t *slots;
+    const char *names;
+};
+
+struct qd_baked_file *qd_baked_file_create(struct qd_buffer *buffer, struct qd_error *error)
+{
+    if (!buffer || ((uintptr_t)buffer->data & (sizeof(uint64_t) - 1)) || buffer->size < sizeof(struct qd_baked_header)) {
+        qd_error_raise(error, qd_err_invalid, 0, QD_ERROR_NO_OPCODE, "Buffer does not hold a baked file.");
+        return NULL;
+    }
+
+    const struct qd_baked_header *header = buffer->data;
+    if (memcmp(header->magic, QD_BAKED_MAGIC, sizeof(header->magic)) != 0 || header->byte_order != QD_BAKED_BYTE_ORDER) {
+        qd_error_raise(error, qd_err_invalid, 0, QD_ERROR_NO_OPCODE, "Buffer does not hold a baked file, or it was baked with a different byte order.");
+        return NULL;
+    }
+
+    if (header->version != QD_BAKED_VERSION) {
+        qd_error_raise(error, qd_err_unsupported, 0, QD_ERROR_NO_OPCODE, "Unsupported baked file version (%u) encountered.", header->version);
+        return NULL;
+    }
+
+    // Make sure that each of the tables lies within the file, so that lookups only
+    // need to check the surface of the entry that they find.
+    uint64_t size = buffer->size;
+    if (header->file_size != size
+        || (header->slot_count & (header->slot_count - 1)) || header->slot_count <= header->entry_count
+        || (header->entries_offset & (sizeof(uint64_t) - 1))
+        || header->entries_offset > size || (uint64_t)header->entry_count * sizeof(struct qd_baked_entry) > size - header->entries_offset
+        || (header->slots_offset & (sizeof(uint32_t) - 1))
+        || header->slots_offset > size || (uint64_t)header->slot_count * sizeof(uint32_t) > size - header->slots_offset
+        || header->names_offset > size || header->names_size > size - header->names_offset) {
+        qd_error_raise(error, qd_err_truncated, 0, QD_ERROR_NO_OPCODE, "Baked file is truncated or damaged.");
+        return NULL;
+    }
+
+    struct qd_baked_file *file = calloc(1, sizeof(*file));
+    if (!file) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate baked file.");
+        return NULL;
+    }
+
+    const uint8_t *data = buffer->data;
+    file->buffer = buffer;
+    file->header = header;
+    file->entries = (const struct qd_baked_entry *)(data + header->entries_offset);
+    file->slots = (const uint32_t *)(data + header->slots_offset);
+    file->names = (const char *)(data + header->names_offset);
+    return file;
+}
+
+struct qd_baked_file *qd_baked_file_open(const char *restrict path, struct qd_error *error)
+{
+    struct qd_buffer *buffer = qd_buffer_map(path);
+    if (!buffer) {
+        qd_error_raise(error, qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to open baked file '%s'.", path);
+        return NULL;
+    }
+
+    struct qd_baked_file *file = qd_baked_file_create(buffer, error);
+    if (!file) {
+        qd_buffer_free(buffer);
+        return NULL;
+    }
+
+    file->owns_buffer = 1;
+    return file;
+}
+
+void qd_baked_file_free(struct qd_baked_file *file)
+{
+    if (file) {
+        if (file->owns_buffer) {
+            qd_buffer_free(file->buffer);
+        }
+        free(file);
+    }
+}
+
+size_t qd_baked_file_count(const struct qd_baked_file *file)
+{
+    return file ? file->header->entry_count : 0;
+}
+
+static int qd_baked_file_load(const struct qd_baked_file *file, const struct qd_baked_entry *entry, struct qd_baked_picture *picture)
+{
+    uint64_t size = file->buffer->size;
+    if (entry->name_offset > file->header->names_size || entry->name_length >= file->header->names_size - entry->name_offset
+        || entry->surface_offset > size || entry->surface_size > size - entry->surface_offset
+        || (entry->surface_offset & (QD_BAKED_ALIGNMENT - 1))
+        || (uint64_t)entry->width * entry->height * sizeof(uint32_t) != entry->surface_size) {
+        return 1;
+    }
+
+    picture->name = file->names + entry->name_offset;
+    picture->name_length = entry->name_length;
+    picture->frame = entry->frame;
+    picture->x_ratio = entry->x_ratio;
+    picture->y_ratio = entry->y_ratio;
+    picture->scale = entry->scale;
+    picture->width = entry->width;
+    picture->height = entry->height;
+    picture->size = (size_t)entry->surface_size;
+    picture->surface = entry->surface_size ? (const uint8_t *)file->buffer->data + entry->surface_offset : NULL;
+    return 0;
+}
+
+int qd_baked_file_find(const struct qd_baked_file *file, const char *name, struct qd_baked_picture *picture)
+{
+    if (!file || !name || !picture) {
+        return 1;
+    }
+
+    size_t name_length = strlen(name);
+    uint64_t hash = qd_hash64(name, name_length, 0);
+    uint32_t mask = file->header->slot_count - 1;
+
+    // The table written by qdbake always has empty slots, but a damaged file may
+    // not, so probing never visits more slots than the table has.
+    uint32_t slot = hash & mask;
+    for (uint32_t probes = 0; probes <= mask && file->slots[slot]; ++probes, slot = (slot + 1) & mask) {
+        uint32_t index = file->slots[slot] - 1;
+        if (index >= file->header->entry_count) {
+            break;
+        }
+
+        const struct qd_baked_entry *entry = &file->entries[index];
+        if (entry->name_hash == hash && entry->name_length == name_length
+            && name_length < file->header->names_size && entry->name_offset < file->header->names_size - name_length
+            && memcmp(file->names + entry->name_offset, name, name_length) == 0) {
+            return qd_baked_file_load(file, entry, picture);
+        }
+    }
+
+    return 1;
+}
+
+int qd_baked_file_get_index(const struct qd_baked_file *file, size_t index, struct qd_baked_picture *picture)
+{
+    if (!file || !picture || index >= file->header->entry_count) {
+        return 1;
+    }
+
+    return qd_baked_file_load(file, &file->entries[index], picture);
+}
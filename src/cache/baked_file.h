@@ -0,0 +1,106 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include "common/types.h"
+#include "common/error.h"
+#include "internal/buffer.h"
+#include "pict/pict.h"
+
+#if !defined(libQuickDraw_BakedFile)
+#define libQuickDraw_BakedFile
+
+/* A baked file holds pictures that have already been decoded, so that they can be
+ * used straight away rather than being parsed again each time a process starts.
+ * The file is laid out so that it can be mapped into memory and used in place:
+ *
+ *  - A header, identifying the file and giving the location of each table.
+ *  - The surface of each picture, aligned to QD_BAKED_ALIGNMENT bytes.
+ *  - The entries, describing each picture and where its surface is.
+ *  - A hash table of the entries, keyed by the names of the pictures.
+ *  - The names of the pictures.
+ *
+ * Values are stored in the byte order of the host that baked the file, and files
+ * baked on a host with a different byte order, or by a different version of the
+ * library, are rejected. */
+#define QD_BAKED_VERSION            1
+#define QD_BAKED_ALIGNMENT          64
+
+/* A picture in a baked file. The name and the surface refer directly to the baked
+ * file, and are only valid for as long as it is open. The surface is laid out as
+ * the surface of a qd_pict is. */
+struct qd_baked_picture
+{
+    const char *name;
+    size_t name_length;
+    struct qd_rect frame;
+    double x_ratio;
+    double y_ratio;
+    unsigned int scale;
+    uint32_t width;
+    uint32_t height;
+    size_t size;
+    const void *surface;
+};
+
+// MARK: - Baking
+
+struct qd_baked_writer;
+
+/* Starts baking pictures into a file. The file must be seekable, as the header is
+ * written last. Writing to a FILE does not take ownership of it. Errors from every
+ * call on the writer are raised into error, which must outlive the writer. */
+struct qd_baked_writer *qd_baked_writer_open(const char *restrict path, struct qd_error *error);
+struct qd_baked_writer *qd_baked_writer_create(FILE *file, struct qd_error *error);
+
+/* Adds a decoded picture to the file under the given name. The surface is written
+ * out immediately, so only the entries are held in memory while baking. */
+int qd_baked_writer_add(struct qd_baked_writer *writer, const char *name, const struct qd_pict *pict);
+
+/* Writes out the tables and the header, and frees the writer. Returns 1 if any of
+ * the pictures or tables could not be written. */
+int qd_baked_writer_close(struct qd_baked_writer *writer);
+
+// MARK: - Loading
+
+struct qd_baked_file;
+
+/* Opens a baked file by mapping it into memory. Only the header is checked when
+ * opening, so the cost of opening does not depend on the number of pictures. The
+ * reason that it could not be opened is raised into error, which may be NULL. */
+struct qd_baked_file *qd_baked_file_open(const char *restrict path, struct qd_error *error);
+
+/* Uses a baked file that is already in a buffer. The buffer is not copied, and
+ * must outlive the baked file. */
+struct qd_baked_file *qd_baked_file_create(struct qd_buffer *buffer, struct qd_error *error);
+
+void qd_baked_file_free(struct qd_baked_file *file);
+
+size_t qd_baked_file_count(const struct qd_baked_file *file);
+
+/* Looks up a picture by name. Returns 1 if there is no such picture, or if its
+ * entry does not lie within the file. */
+int qd_baked_file_find(const struct qd_baked_file *file, const char *name, struct qd_baked_picture *picture);
+
+/* Gets the picture at an index, in the order that the pictures were baked. */
+int qd_baked_file_get_index(const struct qd_baked_file *file, size_t index, struct qd_baked_picture *picture);
+
+#endif
@@ -0,0 +1,367 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache/pict_cache.h"
+#include "common/pixmap.h"
+#include "internal/hash.h"
+
+// MARK: - Picture Cache Constants
+
+#define QD_PICT_CACHE_BUCKETS       1024
+
+/* Each picture is moved into an entry that carries its reference count, so that
+ * a picture handed out can be turned back into its entry when it is released.
+ * The cache owns one reference to each of the entries in it, and the entries are
+ * kept in least recently used order for eviction. */
+struct qd_pict_cache_entry
+{
+    struct qd_pict pict;
+    atomic_uint references;
+    uint64_t hash;
+    uint64_t length;
+    unsigned int scale;
+    int tiled;
+    size_t bytes;
+    uint8_t *raw;
+    uint8_t *compressed_data;
+    struct qd_pict_cache_entry *next_in_bucket;
+    struct qd_pict_cache_entry *lru_prev;
+    struct qd_pict_cache_entry *lru_next;
+};
+
+struct qd_pict_cache
+{
+    pthread_mutex_t lock;
+    struct qd_pict_cache_entry *buckets[QD_PICT_CACHE_BUCKETS];
+    struct qd_pict_cache_entry *lru_head;
+    struct qd_pict_cache_entry *lru_tail;
+    struct qd_pict_cache_stats stats;
+};
+
+// MARK: - Cache Entries
+
+static void qd_pict_cache_entry_free(struct qd_pict_cache_entry *entry)
+{
+    if (entry) {
+        free(entry->raw);
+        free(entry->compressed_data);
+
+        // The picture is the first member of the entry, so freeing the picture
+        // frees the entry along with it.
+        qd_pict_free(&entry->pict);
+    }
+}
+
+static struct qd_pict_cache_entry *qd_pict_cache_entry_create(struct qd_pict *pict, struct qd_error *error)
+{
+    struct qd_pict_cache_entry *entry = calloc(1, sizeof(*entry));
+    if (!entry) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate picture cache entry.");
+        qd_pict_free(pict);
+        return NULL;
+    }
+
+    // Take over the contents of the picture, leaving its allocation behind.
+    entry->pict = *pict;
+    free(pict);
+    atomic_init(&entry->references, 1);
+
+    // Compressed images refer to the buffer that the picture was parsed from, which
+    // a cached picture outlives, so their data is copied into the entry.
+    size_t compressed_size = 0;
+    for (size_t n = 0; n < entry->pict.compressed_image_count; ++n) {
+        compressed_size += entry->pict.compressed_images[n].data_size;
+    }
+    if (compressed_size) {
+        if (!(entry->compressed_data = malloc(compressed_size))) {
+            qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate picture cache entry.");
+            qd_pict_cache_entry_free(entry);
+            return NULL;
+        }
+
+        uint8_t *data = entry->compressed_data;
+        for (size_t n = 0; n < entry->pict.compressed_image_count; ++n) {
+            struct qd_pict_compressed_image *image = &entry->pict.compressed_images[n];
+            memcpy(data, image->data, image->data_size);
+            image->data = data;
+            data += image->data_size;
+        }
+    }
+
+    uint64_t surface_size = entry->pict.tiles ? qd_tiled_surface_bytes(entry->pict.tiles) : entry->pict.size;
+    entry->bytes = sizeof(*entry) + surface_size + compressed_size
+        + entry->pict.pixmap_count * (sizeof(struct qd_pixmap) + sizeof(struct qd_pixmap *))
+        + entry->pict.compressed_image_count * sizeof(struct qd_pict_compressed_image);
+    return entry;
+}
+
+// Drops a reference to an entry, freeing it if it was the last one.
+static void qd_pict_cache_entry_release(struct qd_pict_cache_entry *entry)
+{
+    if (entry && atomic_fetch_sub(&entry->references, 1) == 1) {
+        qd_pict_cache_entry_free(entry);
+    }
+}
+
+void qd_pict_cache_release(const struct qd_pict *pict)
+{
+    qd_pict_cache_entry_release((struct qd_pict_cache_entry *)pict);
+}
+
+// MARK: - Picture Cache
+
+struct qd_pict_cache *qd_pict_cache_create(size_t budget)
+{
+    struct qd_pict_cache *cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->stats.budget = budget;
+    return cache;
+}
+
+void qd_pict_cache_free(struct qd_pict_cache *cache)
+{
+    if (cache) {
+        qd_pict_cache_purge(cache);
+        pthread_mutex_destroy(&cache->lock);
+        free(cache);
+    }
+}
+
+static inline uint32_t qd_pict_cache_bucket(uint64_t hash, unsigned int scale)
+{
+    return (uint32_t)((hash ^ scale) & (QD_PICT_CACHE_BUCKETS - 1));
+}
+
+static void qd_pict_cache_lru_unlink(struct qd_pict_cache *cache, struct qd_pict_cache_entry *entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else {
+        cache->lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else {
+        cache->lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void qd_pict_cache_lru_push(struct qd_pict_cache *cache, struct qd_pict_cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = entry;
+    }
+    cache->lru_head = entry;
+    if (!cache->lru_tail) {
+        cache->lru_tail = entry;
+    }
+}
+
+// Removes an entry from the cache, returning it so that the reference held by the
+// cache can be dropped once the cache is unlocked. Must be called with the cache
+// locked.
+static struct qd_pict_cache_entry *qd_pict_cache_remove(struct qd_pict_cache *cache, struct qd_pict_cache_entry *entry)
+{
+    struct qd_pict_cache_entry **link = &cache->buckets[qd_pict_cache_bucket(entry->hash, entry->scale)];
+    while (*link && *link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    if (*link) {
+        *link = entry->next_in_bucket;
+    }
+
+    qd_pict_cache_lru_unlink(cache, entry);
+    entry->next_in_bucket = NULL;
+    cache->stats.count--;
+    cache->stats.bytes -= entry->bytes;
+    return entry;
+}
+
+// Finds an entry and takes a reference to it. Must be called with the cache locked.
+// The hash only narrows down the entries, as different pictures can share a hash,
+// so the picture data itself is compared before an entry is used.
+static struct qd_pict_cache_entry *qd_pict_cache_find(
+    struct qd_pict_cache *cache,
+    uint64_t hash,
+    const void *data,
+    uint64_t length,
+    unsigned int scale,
+    int tiled
+) {
+    struct qd_pict_cache_entry *entry = cache->buckets[qd_pict_cache_bucket(hash, scale)];
+    for (; entry; entry = entry->next_in_bucket) {
+        if (entry->hash == hash && entry->length == length && entry->scale == scale && entry->tiled == tiled
+            && memcmp(entry->raw, data, (size_t)length) == 0) {
+            atomic_fetch_add(&entry->references, 1);
+            qd_pict_cache_lru_unlink(cache, entry);
+            qd_pict_cache_lru_push(cache, entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+const struct qd_pict *qd_pict_cache_parse(
+    struct qd_pict_cache *cache,
+    struct qd_buffer *restrict buffer,
+    const struct qd_pict_options *options
+) {
+    if (!cache || !buffer) {
+        return NULL;
+    }
+    if (options && options->target) {
+        qd_error_raise(options->error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Cached pictures cannot be drawn into a target surface.");
+        return NULL;
+    }
+
+    unsigned int scale = (options && options->scale > 1) ? options->scale : 1;
+    int tiled = (options && options->tiled) ? 1 : 0;
+    uint64_t length = buffer->size;
+    uint64_t hash = qd_hash64(buffer->data, (size_t)length, 0);
+
+    pthread_mutex_lock(&cache->lock);
+    struct qd_pict_cache_entry *entry = qd_pict_cache_find(cache, hash, buffer->data, length, scale, tiled);
+    if (entry) {
+        cache->stats.hits++;
+    }
+    else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (entry) {
+        return &entry->pict;
+    }
+
+    // Not seen before. Parse the picture outside of the lock.
+    struct qd_pict *pict = NULL;
+    if (qd_pict_parse_with_options(&pict, buffer, options)) {
+        qd_pict_free(pict);
+        return NULL;
+    }
+    if (!(entry = qd_pict_cache_entry_create(pict, options ? options->error : NULL))) {
+        return NULL;
+    }
+
+    // The data of the picture is kept to tell it apart from others with the same
+    // hash, and counts towards the size of the entry.
+    if (!(entry->raw = malloc(length ? (size_t)length : 1))) {
+        qd_error_raise(options ? options->error : NULL, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate picture cache entry.");
+        qd_pict_cache_entry_free(entry);
+        return NULL;
+    }
+    memcpy(entry->raw, buffer->data, (size_t)length);
+    entry->bytes += (size_t)length;
+    entry->hash = hash;
+    entry->length = length;
+    entry->scale = scale;
+    entry->tiled = tiled;
+
+    // Another thread may have inserted the same picture in the meantime, in which
+    // case that one is used instead. Pictures larger than the whole budget are
+    // returned without being cached.
+    struct qd_pict_cache_entry *evicted = NULL;
+    pthread_mutex_lock(&cache->lock);
+    struct qd_pict_cache_entry *existing = qd_pict_cache_find(cache, hash, buffer->data, length, scale, tiled);
+    if (!existing && entry->bytes <= cache->stats.budget) {
+        uint32_t bucket = qd_pict_cache_bucket(hash, scale);
+        entry->next_in_bucket = cache->buckets[bucket];
+        cache->buckets[bucket] = entry;
+        qd_pict_cache_lru_push(cache, entry);
+        atomic_fetch_add(&entry->references, 1);
+        cache->stats.count++;
+        cache->stats.bytes += entry->bytes;
+
+        // Evicted entries are chained through their bucket links, which are no
+        // longer in use, and released once the cache is unlocked.
+        while (cache->stats.bytes > cache->stats.budget) {
+            struct qd_pict_cache_entry *victim = qd_pict_cache_remove(cache, cache->lru_tail);
+            victim->next_in_bucket = evicted;
+            evicted = victim;
+            cache->stats.evictions++;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    while (evicted) {
+        struct qd_pict_cache_entry *next = evicted->next_in_bucket;
+        qd_pict_cache_entry_release(evicted);
+        evicted = next;
+    }
+
+    if (existing) {
+        qd_pict_cache_entry_release(entry);
+        return &existing->pict;
+    }
+    return &entry->pict;
+}
+
+void qd_pict_cache_purge(struct qd_pict_cache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    struct qd_pict_cache_entry *evicted = NULL;
+    while (cache->lru_head) {
+        struct qd_pict_cache_entry *entry = qd_pict_cache_remove(cache, cache->lru_head);
+        entry->next_in_bucket = evicted;
+        evicted = entry;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    while (evicted) {
+        struct qd_pict_cache_entry *next = evicted->next_in_bucket;
+        qd_pict_cache_entry_release(evicted);
+        evicted = next;
+    }
+}
+
+void qd_pict_cache_get_stats(struct qd_pict_cache *cache, struct qd_pict_cache_stats *stats)
+{
+    if (!cache || !stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "internal/buffer.h"
+#include "pict/pict.h"
+
+#if !defined(libQuickDraw_PictCache)
+#define libQuickDraw_PictCache
+
+/* A cache of decoded pictures, keyed by the content of the buffer a picture was
+ * parsed from and by the decode options that change the result (the scale, and
+ * whether the surface is tiled). The same picture bytes seen again, from any
+ * buffer, return the picture that was decoded the first time without parsing it
+ * again. Each entry keeps a copy of the picture bytes, which is compared on a
+ * hash match and counts towards the budget, so that pictures whose hashes
+ * collide are never mistaken for one another.
+ *
+ * Cached pictures are shared, and are handed out as const references that must
+ * be released with qd_pict_cache_release() rather than qd_pict_free(). The cache
+ * holds pictures up to a budget of bytes, evicting the least recently used ones
+ * beyond it. A picture that has been evicted stays valid until its last reference
+ * is released. */
+struct qd_pict_cache;
+
+struct qd_pict_cache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t count;
+    size_t bytes;
+    size_t budget;
+};
+
+struct qd_pict_cache *qd_pict_cache_create(size_t budget);
+
+/* Frees the cache. Pictures that are still referenced remain valid until they are
+ * released. */
+void qd_pict_cache_free(struct qd_pict_cache *cache);
+
+/* Parses the picture in the buffer, or returns the cached picture for the same
+ * bytes and options. The position of the buffer is not used, as a picture always
+ * covers all of its buffer. Compressed image data of a cached picture is copied,
+ * so that the picture does not refer to the buffer, and cached pictures cannot
+ * be drawn into a target surface. The reason that a picture could not be returned
+ * is raised into the error of the options. */
+const struct qd_pict *qd_pict_cache_parse(
+    struct qd_pict_cache *cache,
+    struct qd_buffer *restrict buffer,
+    const struct qd_pict_options *options
+);
+
+void qd_pict_cache_release(const struct qd_pict *pict);
+
+/* Evicts every picture from the cache. */
+void qd_pict_cache_purge(struct qd_pict_cache *cache);
+
+void qd_pict_cache_get_stats(struct qd_pict_cache *cache, struct qd_pict_cache_stats *stats);
+
+#endif
@@ -0,0 +1,383 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include "common/bits.h"
+#include "common/convert.h"
+#include "common/geometry.h"
+#include "internal/pixel.h"
+
+// MARK: - Word Access
+
+/* Bits are worked on as 64 bit words holding 64 consecutive pixels, with the
+ * leftmost pixel in the most significant bit. Words of a row are aligned to its
+ * start, and the last word of a row may extend past its row bytes, in which case
+ * only the bytes within the row are read or written. */
+
+static inline uint64_t qd_bits_load_be64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#elif !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+    v = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+      | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | p[7];
+#endif
+    return v;
+}
+
+static inline void qd_bits_store_be64(uint8_t *p, uint64_t v)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, sizeof(v));
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(p, &v, sizeof(v));
+#else
+    for (int i = 0; i < 8; ++i) {
+        p[i] = (uint8_t)(v >> (56 - 8 * i));
+    }
+#endif
+}
+
+static inline uint8_t qd_bits_byte(const uint8_t *row, long index, size_t row_bytes)
+{
+    return (index >= 0 && (size_t)index < row_bytes) ? row[index] : 0;
+}
+
+static inline uint64_t qd_bits_load_word(const uint8_t *row, long word, size_t row_bytes)
+{
+    size_t start = (size_t)word << 3;
+    if (start + 8 <= row_bytes) {
+        return qd_bits_load_be64(row + start);
+    }
+
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        v = (v << 8) | qd_bits_byte(row, (long)(start + i), row_bytes);
+    }
+    return v;
+}
+
+static inline void qd_bits_store_word(uint8_t *row, long word, size_t row_bytes, uint64_t v)
+{
+    size_t start = (size_t)word << 3;
+    if (start + 8 <= row_bytes) {
+        qd_bits_store_be64(row + start, v);
+        return;
+    }
+
+    for (size_t i = 0; start + i < row_bytes; ++i) {
+        row[start + i] = (uint8_t)(v >> (56 - 8 * i));
+    }
+}
+
+/* Fetches the 64 pixels starting at any pixel of a row, which need not be word
+ * or byte aligned. Pixels outside of the row are read as clear. */
+static inline uint64_t qd_bits_fetch(const uint8_t *row, long bit, size_t row_bytes)
+{
+    long byte = (bit >= 0) ? (bit >> 3) : -((7 - bit) >> 3);
+    unsigned int shift = (unsigned int)(bit - byte * 8);
+
+    uint64_t v;
+    uint8_t next;
+    if (byte >= 0 && (size_t)byte + 9 <= row_bytes) {
+        v = qd_bits_load_be64(row + byte);
+        next = row[byte + 8];
+    }
+    else {
+        v = 0;
+        for (long i = 0; i < 8; ++i) {
+            v = (v << 8) | qd_bits_byte(row, byte + i, row_bytes);
+        }
+        next = qd_bits_byte(row, byte + 8, row_bytes);
+    }
+
+    return shift ? (v << shift) | (next >> (8 - shift)) : v;
+}
+
+// MARK: - Transfer Modes
+
+static int qd_bits_boolean_mode(short mode)
+{
+    // Patterns use the same operations as the source modes.
+    mode &= ~qd_dither_copy;
+    if (mode >= qd_src_copy && mode <= qd_not_pat_bic) {
+        return mode & 7;
+    }
+
+    switch (mode) {
+        case qd_blend:          return qd_src_copy;
+        case qd_add_pin:        return qd_src_bic;
+        case qd_add_over:       return qd_src_xor;
+        case qd_sub_pin:        return qd_src_or;
+        case qd_transparent:    return qd_src_or;
+        case qd_ad_max:         return qd_src_bic;
+        case qd_sub_over:       return qd_src_xor;
+        case qd_ad_min:         return qd_src_or;
+        default:                return -1;
+    }
+}
+
+static inline uint64_t qd_bits_apply(int mode, uint64_t d, uint64_t s)
+{
+    switch (mode) {
+        case qd_src_copy:       return s;
+        case qd_src_or:         return d | s;
+        case qd_src_xor:        return d ^ s;
+        case qd_src_bic:        return d & ~s;
+        case qd_not_src_copy:   return ~s;
+        case qd_not_src_or:     return d | ~s;
+        case qd_not_src_xor:    return d ^ ~s;
+        default:                return d & s;
+    }
+}
+
+// MARK: - Row Operations
+
+/* Each row operation is generated once for every mode, so that the operation is
+ * resolved at compile time inside of the word loop. Edge words and the clip mask
+ * are merged with the existing destination. */
+
+struct qd_bits_row
+{
+    uint8_t *dst;
+    size_t dst_row_bytes;
+    long left;
+    long right;
+    const uint8_t *src;
+    size_t src_row_bytes;
+    long src_left;
+    uint64_t pattern;
+    const uint8_t *clip;
+    size_t clip_row_bytes;
+    int reverse;
+};
+
+typedef void qd_bits_row_operation(const struct qd_bits_row *row);
+
+static inline uint64_t qd_bits_edge_mask(long word, long first, long last, long left, long right)
+{
+    uint64_t mask = ~UINT64_C(0);
+    if (word == first) {
+        mask &= ~UINT64_C(0) >> (left & 63);
+    }
+    if (word == last) {
+        mask &= ~UINT64_C(0) << (63 - ((right - 1) & 63));
+    }
+    return mask;
+}
+
+#define QD_BITS_ROW_OPERATIONS(mode, name) \
+    static void qd_bits_blit_row_##name(const struct qd_bits_row *row) \
+    { \
+        long first = row->left >> 6; \
+        long last = (row->right - 1) >> 6; \
+        long offset = row->src_left - row->left; \
+        long step = row->reverse ? -1 : 1; \
+        long w = row->reverse ? last : first; \
+        for (long n = first; n <= last; ++n, w += step) { \
+            uint64_t mask = qd_bits_edge_mask(w, first, last, row->left, row->right); \
+            if (row->clip) { \
+                mask &= qd_bits_load_word(row->clip, w, row->clip_row_bytes); \
+            } \
+            uint64_t s = qd_bits_fetch(row->src, (w << 6) + offset, row->src_row_bytes); \
+            uint64_t d = qd_bits_load_word(row->dst, w, row->dst_row_bytes); \
+            uint64_t r = qd_bits_apply(mode, d, s); \
+            qd_bits_store_word(row->dst, w, row->dst_row_bytes, (d & ~mask) | (r & mask)); \
+        } \
+    } \
+    static void qd_bits_fill_row_##name(const struct qd_bits_row *row) \
+    { \
+        long first = row->left >> 6; \
+        long last = (row->right - 1) >> 6; \
+        for (long w = first; w <= last; ++w) { \
+            uint64_t mask = qd_bits_edge_mask(w, first, last, row->left, row->right); \
+            if (row->clip) { \
+                mask &= qd_bits_load_word(row->clip, w, row->clip_row_bytes); \
+            } \
+            uint64_t d = qd_bits_load_word(row->dst, w, row->dst_row_bytes); \
+            uint64_t r = qd_bits_apply(mode, d, row->pattern); \
+            qd_bits_store_word(row->dst, w, row->dst_row_bytes, (d & ~mask) | (r & mask)); \
+        } \
+    }
+
+QD_BITS_ROW_OPERATIONS(qd_src_copy, src_copy)
+QD_BITS_ROW_OPERATIONS(qd_src_or, src_or)
+QD_BITS_ROW_OPERATIONS(qd_src_xor, src_xor)
+QD_BITS_ROW_OPERATIONS(qd_src_bic, src_bic)
+QD_BITS_ROW_OPERATIONS(qd_not_src_copy, not_src_copy)
+QD_BITS_ROW_OPERATIONS(qd_not_src_or, not_src_or)
+QD_BITS_ROW_OPERATIONS(qd_not_src_xor, not_src_xor)
+QD_BITS_ROW_OPERATIONS(qd_not_src_bic, not_src_bic)
+
+static qd_bits_row_operation *const qd_bits_blit_rows[8] = {
+    qd_bits_blit_row_src_copy, qd_bits_blit_row_src_or, qd_bits_blit_row_src_xor, qd_bits_blit_row_src_bic,
+    qd_bits_blit_row_not_src_copy, qd_bits_blit_row_not_src_or, qd_bits_blit_row_not_src_xor, qd_bits_blit_row_not_src_bic,
+};
+
+static qd_bits_row_operation *const qd_bits_fill_rows[8] = {
+    qd_bits_fill_row_src_copy, qd_bits_fill_row_src_or, qd_bits_fill_row_src_xor, qd_bits_fill_row_src_bic,
+    qd_bits_fill_row_not_src_copy, qd_bits_fill_row_not_src_or, qd_bits_fill_row_not_src_xor, qd_bits_fill_row_not_src_bic,
+};
+
+// MARK: - Drawing
+
+static inline const uint8_t *qd_bits_clip_row(const struct qd_bit_surface *clip, long y)
+{
+    return (clip && y < (long)clip->height) ? clip->data + y * clip->row_bytes : NULL;
+}
+
+int qd_bits_blit(
+    const struct qd_bit_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_bit_surface *src,
+    struct qd_rect src_rect,
+    short mode,
+    const struct qd_bit_surface *clip
+) {
+    long sx = src_rect.left;
+    long sy = src_rect.top;
+    long dx = dst_rect.left;
+    long dy = dst_rect.top;
+    long width = qd_rect_get_width(src_rect);
+    long height = qd_rect_get_height(src_rect);
+
+    if (qd_rect_get_width(dst_rect) != width || qd_rect_get_height(dst_rect) != height) {
+        return 1;
+    }
+
+    int op = qd_bits_boolean_mode(mode);
+    if (op < 0) {
+        return 1;
+    }
+
+    // Clip the area being transferred to both of the surfaces, as qd_blit does.
+    if (sx < 0) { dx -= sx; width += sx; sx = 0; }
+    if (sy < 0) { dy -= sy; height += sy; sy = 0; }
+    if (dx < 0) { sx -= dx; width += dx; dx = 0; }
+    if (dy < 0) { sy -= dy; height += dy; dy = 0; }
+    if (sx + width > (long)src->width) { width = (long)src->width - sx; }
+    if (sy + height > (long)src->height) { height = (long)src->height - sy; }
+    if (dx + width > (long)dst->width) { width = (long)dst->width - dx; }
+    if (dy + height > (long)dst->height) { height = (long)dst->height - dy; }
+
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    // Within a single surface the source may overlap the destination, so, as with
+    // CopyBits, rows are transferred from the bottom up when moving down, and the
+    // words of a row from right to left when moving right within the same row.
+    // Each row and word is then read before anything is written over it.
+    int same = (src->data == dst->data);
+    int bottom_up = same && dy > sy;
+
+    struct qd_bits_row row = { 0 };
+    row.dst_row_bytes = dst->row_bytes;
+    row.src_row_bytes = src->row_bytes;
+    row.clip_row_bytes = clip ? clip->row_bytes : 0;
+    row.left = dx;
+    row.right = dx + width;
+    row.src_left = sx;
+    row.reverse = same && dy == sy && dx > sx;
+
+    qd_bits_row_operation *operation = qd_bits_blit_rows[op];
+    for (long n = 0; n < height; ++n) {
+        long y = bottom_up ? height - 1 - n : n;
+        row.dst = dst->data + (dy + y) * dst->row_bytes;
+        row.src = src->data + (sy + y) * src->row_bytes;
+        row.clip = qd_bits_clip_row(clip, dy + y);
+        if (!clip || row.clip) {
+            operation(&row);
+        }
+    }
+
+    return 0;
+}
+
+int qd_bits_fill(
+    const struct qd_bit_surface *dst,
+    struct qd_rect rect,
+    const struct qd_pattern *pattern,
+    short mode,
+    const struct qd_bit_surface *clip
+) {
+    int op = qd_bits_boolean_mode(mode);
+    if (op < 0) {
+        return 1;
+    }
+
+    long top = rect.top < 0 ? 0 : rect.top;
+    long left = rect.left < 0 ? 0 : rect.left;
+    long bottom = rect.bottom > (long)dst->height ? (long)dst->height : rect.bottom;
+    long right = rect.right > (long)dst->width ? (long)dst->width : rect.right;
+    if (left >= right || top >= bottom) {
+        return 0;
+    }
+
+    struct qd_bits_row row = { 0 };
+    row.dst_row_bytes = dst->row_bytes;
+    row.clip_row_bytes = clip ? clip->row_bytes : 0;
+    row.left = left;
+    row.right = right;
+
+    // Words start on a multiple of 8 pixels, so a row of the pattern replicated
+    // across a word is already aligned to the destination.
+    qd_bits_row_operation *operation = qd_bits_fill_rows[op];
+    for (long y = top; y < bottom; ++y) {
+        row.dst = dst->data + y * dst->row_bytes;
+        row.pattern = UINT64_C(0x0101010101010101) * pattern->pat[y & 7];
+        row.clip = qd_bits_clip_row(clip, y);
+        if (clip && !row.clip) {
+            break;
+        }
+        operation(&row);
+    }
+
+    return 0;
+}
+
+// MARK: - Expansion
+
+int qd_bits_expand(
+    const struct qd_surface *out,
+    const struct qd_bit_surface *bits,
+    struct qd_rgb_color fg_color,
+    struct qd_rgb_color bk_color
+) {
+    uint32_t palette[256] = { 0 };
+    palette[0] = qd_pixel_pack_rgb_color(bk_color);
+    palette[1] = qd_pixel_pack_rgb_color(fg_color);
+
+    struct qd_converter conv;
+    if (qd_converter_init(&conv, qd_1_monochrome_pixel_format, qd_32_rgba_pixel_format, palette, NULL)) {
+        return 1;
+    }
+
+    uint32_t width = bits->width < out->width ? bits->width : out->width;
+    uint32_t height = bits->height < out->height ? bits->height : out->height;
+    qd_convert(&conv, out->data, out->row_bytes, bits->data, bits->row_bytes, width, height);
+
+    qd_converter_destroy(&conv);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+
+#if !defined(libQuickDraw_Bits)
+#define libQuickDraw_Bits
+
+/* Drawing operations on 1 bit surfaces, which work on 64 pixels at a time and
+ * never expand the bits to color. Only the boolean transfer modes have meaning
+ * for 1 bit pixels. The arithmetic modes are reduced to them in the same way as
+ * Color QuickDraw does for a 1 bit destination.
+ *
+ * The optional clip surface is a mask in the coordinates of the destination, and
+ * only the pixels under its set bits are drawn. It would usually be a region that
+ * has been rasterized to bits. */
+
+/* Transfers the source rect into the destination rect, which must be of the same
+ * size. Both rects are clipped to their surfaces. The source and destination may
+ * be the same surface, such as when scrolling, in which case the rects may
+ * overlap. */
+int qd_bits_blit(
+    const struct qd_bit_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_bit_surface *src,
+    struct qd_rect src_rect,
+    short mode,
+    const struct qd_bit_surface *clip
+);
+
+/* Fills the rect with the pattern, aligned to the origin of the destination. */
+int qd_bits_fill(
+    const struct qd_bit_surface *dst,
+    struct qd_rect rect,
+    const struct qd_pattern *pattern,
+    short mode,
+    const struct qd_bit_surface *clip
+);
+
+/* Expands the bits to color in an RGBA surface, with set bits drawn in the
+ * foreground color and clear bits in the background color. */
+int qd_bits_expand(
+    const struct qd_surface *out,
+    const struct qd_bit_surface *bits,
+    struct qd_rgb_color fg_color,
+    struct qd_rgb_color bk_color
+);
+
+#endif
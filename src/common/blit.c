@@ -0,0 +1,825 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common/blit.h"
+#include "common/geometry.h"
+#include "internal/pixel.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// MARK: - Pixel Helpers
+
+static inline uint32_t qd_blit_alpha_max(uint32_t s, uint32_t d, uint32_t alpha_mask)
+{
+    uint32_t sa = s & alpha_mask;
+    uint32_t da = d & alpha_mask;
+    return sa > da ? sa : da;
+}
+
+static inline uint8_t qd_blit_u8_max(int a, int b)
+{
+    return (uint8_t)(a > b ? a : b);
+}
+
+static inline uint8_t qd_blit_u8_min(int a, int b)
+{
+    return (uint8_t)(a < b ? a : b);
+}
+
+// MARK: - Row Kernels
+
+/* Each transfer mode has its own row kernel, which is selected once when the
+ * blit state is prepared. With SSE2 available the kernels process 4 pixels per
+ * iteration and finish the remainder of the row with scalar code.
+ *
+ * The boolean modes follow the QuickDraw convention that black is the "ink"
+ * color. As black is all zero bits in an RGB pixel, the boolean operations
+ * are performed on the complement of the pixel values, so that srcOr paints
+ * the black pixels of the source onto the destination and so on.
+ *
+ * With the exception of srcCopy and transparent, the alpha component of the
+ * result is the larger of the source and destination alpha. */
+
+static void qd_blit_kernel_src_copy(
+    uint32_t *restrict dst,
+    const uint32_t *restrict src,
+    size_t count,
+    const struct qd_blit_state *state
+) {
+    memcpy(dst, src, count * sizeof(*dst));
+}
+
+#if defined(__SSE2__)
+#define QD_V_NOT(x)     _mm_xor_si128((x), _mm_set1_epi32(-1))
+
+#define QD_BOOLEAN_KERNEL(name, vector_expr, scalar_expr)                                   \
+static void name(                                                                           \
+    uint32_t *restrict dst,                                                                 \
+    const uint32_t *restrict src,                                                           \
+    size_t count,                                                                           \
+    const struct qd_blit_state *state                                                       \
+) {                                                                                         \
+    size_t i = 0;                                                                           \
+    const __m128i am = _mm_set1_epi32((int)state->alpha_mask);                             \
+    for (; i + 4 <= count; i += 4) {                                                        \
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));                            \
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));                            \
+        __m128i r = (vector_expr);                                                          \
+        r = _mm_or_si128(_mm_andnot_si128(am, r), _mm_and_si128(am, _mm_max_epu8(s, d)));  \
+        _mm_storeu_si128((__m128i *)(dst + i), r);                                          \
+    }                                                                                       \
+    for (; i < count; ++i) {                                                                \
+        uint32_t s = src[i];                                                                \
+        uint32_t d = dst[i];                                                                \
+        dst[i] = ((scalar_expr) & ~state->alpha_mask)                                       \
+               | qd_blit_alpha_max(s, d, state->alpha_mask);                                \
+    }                                                                                       \
+}
+
+#define QD_ARITHMETIC_KERNEL(name, vector_expr, scalar_expr)                                \
+static void name(                                                                           \
+    uint32_t *restrict dst,                                                                 \
+    const uint32_t *restrict src,                                                           \
+    size_t count,                                                                           \
+    const struct qd_blit_state *state                                                       \
+) {                                                                                         \
+    size_t i = 0;                                                                           \
+    const __m128i am = _mm_set1_epi32((int)state->alpha_mask);                             \
+    const __m128i op = _mm_set1_epi32((int)state->op_color);                               \
+    for (; i + 4 <= count; i += 4) {                                                        \
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));                            \
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));                            \
+        __m128i r = (vector_expr);                                                          \
+        r = _mm_or_si128(_mm_andnot_si128(am, r), _mm_and_si128(am, _mm_max_epu8(s, d)));  \
+        _mm_storeu_si128((__m128i *)(dst + i), r);                                          \
+    }                                                                                       \
+    const uint8_t *pb = (const uint8_t *)&state->op_color;                                  \
+    for (; i < count; ++i) {                                                                \
+        const uint8_t *sb = (const uint8_t *)(src + i);                                     \
+        uint8_t *db = (uint8_t *)(dst + i);                                                 \
+        for (int c = 0; c < 3; ++c) {                                                       \
+            int s = sb[c];                                                                  \
+            int d = db[c];                                                                  \
+            int p = pb[c];                                                                  \
+            db[c] = (uint8_t)(scalar_expr);                                                 \
+            (void)p;                                                                        \
+        }                                                                                   \
+        db[3] = qd_blit_u8_max(sb[3], db[3]);                                               \
+    }                                                                                       \
+    (void)op;                                                                               \
+}
+#else
+#define QD_BOOLEAN_KERNEL(name, vector_expr, scalar_expr)                                   \
+static void name(                                                                           \
+    uint32_t *restrict dst,                                                                 \
+    const uint32_t *restrict src,                                                           \
+    size_t count,                                                                           \
+    const struct qd_blit_state *state                                                       \
+) {                                                                                         \
+    const uint32_t am = state->alpha_mask;                                                  \
+    for (size_t i = 0; i < count; ++i) {                                                    \
+        uint32_t s = src[i];                                                                \
+        uint32_t d = dst[i];                                                                \
+        dst[i] = ((scalar_expr) & ~am) | qd_blit_alpha_max(s, d, am);                       \
+    }                                                                                       \
+}
+
+#define QD_ARITHMETIC_KERNEL(name, vector_expr, scalar_expr)                                \
+static void name(                                                                           \
+    uint32_t *restrict dst,                                                                 \
+    const uint32_t *restrict src,                                                           \
+    size_t count,                                                                           \
+    const struct qd_blit_state *state                                                       \
+) {                                                                                         \
+    const uint8_t *restrict sb = (const uint8_t *)src;                                      \
+    uint8_t *restrict db = (uint8_t *)dst;                                                  \
+    const uint8_t *pb = (const uint8_t *)&state->op_color;                                  \
+    for (size_t i = 0; i < (count << 2); i += 4) {                                          \
+        for (int c = 0; c < 3; ++c) {                                                       \
+            int s = sb[i + c];                                                              \
+            int d = db[i + c];                                                              \
+            int p = pb[c];                                                                  \
+            db[i + c] = (uint8_t)(scalar_expr);                                             \
+            (void)p;                                                                        \
+        }                                                                                   \
+        db[i + 3] = qd_blit_u8_max(sb[i + 3], db[i + 3]);                                   \
+    }                                                                                       \
+}
+#endif
+
+QD_BOOLEAN_KERNEL(qd_blit_kernel_src_or,       _mm_and_si128(d, s),            d & s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_src_xor,      _mm_xor_si128(d, QD_V_NOT(s)),  d ^ ~s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_src_bic,      _mm_or_si128(d, QD_V_NOT(s)),   d | ~s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_not_src_copy, QD_V_NOT(s),                    ~s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_not_src_or,   _mm_andnot_si128(s, d),         d & ~s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_not_src_xor,  _mm_xor_si128(d, s),            d ^ s)
+QD_BOOLEAN_KERNEL(qd_blit_kernel_not_src_bic,  _mm_or_si128(d, s),             d | s)
+
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_add_pin,   _mm_min_epu8(_mm_adds_epu8(s, d), op),  qd_blit_u8_min(s + d, p))
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_add_over,  _mm_add_epi8(s, d),                     (s + d) & 0xFF)
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_sub_pin,   _mm_max_epu8(_mm_subs_epu8(d, s), op),  qd_blit_u8_max(d - s, p))
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_sub_over,  _mm_sub_epi8(d, s),                     (d - s) & 0xFF)
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_ad_max,    _mm_max_epu8(s, d),                     qd_blit_u8_max(s, d))
+QD_ARITHMETIC_KERNEL(qd_blit_kernel_ad_min,    _mm_min_epu8(s, d),                     qd_blit_u8_min(s, d))
+
+#if defined(__SSE2__)
+static inline __m128i qd_blit_blend_half(__m128i s, __m128i d, __m128i w, __m128i iw)
+{
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s, w), _mm_mullo_epi16(d, iw)), 8);
+}
+#endif
+
+static void qd_blit_kernel_blend(
+    uint32_t *restrict dst,
+    const uint32_t *restrict src,
+    size_t count,
+    const struct qd_blit_state *state
+) {
+    // The weight of each component is taken from the op color, and expanded
+    // from 0...255 to 0...256 so that a full weight reproduces the source.
+    const uint8_t *pb = (const uint8_t *)&state->op_color;
+    uint16_t weight[4];
+    for (int c = 0; c < 4; ++c) {
+        weight[c] = pb[c] + (pb[c] >> 7);
+    }
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i am = _mm_set1_epi32((int)state->alpha_mask);
+    const __m128i w = _mm_set_epi16(
+        weight[3], weight[2], weight[1], weight[0], weight[3], weight[2], weight[1], weight[0]
+    );
+    const __m128i iw = _mm_sub_epi16(_mm_set1_epi16(256), w);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = qd_blit_blend_half(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), w, iw);
+        __m128i hi = qd_blit_blend_half(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), w, iw);
+        __m128i r = _mm_packus_epi16(lo, hi);
+        r = _mm_or_si128(_mm_andnot_si128(am, r), _mm_and_si128(am, _mm_max_epu8(s, d)));
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint8_t *sb = (const uint8_t *)(src + i);
+        uint8_t *db = (uint8_t *)(dst + i);
+        for (int c = 0; c < 3; ++c) {
+            db[c] = (uint8_t)((sb[c] * weight[c] + db[c] * (256 - weight[c])) >> 8);
+        }
+        db[3] = qd_blit_u8_max(sb[3], db[3]);
+    }
+}
+
+static void qd_blit_kernel_transparent(
+    uint32_t *restrict dst,
+    const uint32_t *restrict src,
+    size_t count,
+    const struct qd_blit_state *state
+) {
+    // Source pixels that match the background color are left out, and all
+    // other pixels are copied as is.
+    const uint32_t am = state->alpha_mask;
+    const uint32_t bk = state->bk_color & ~am;
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i vam = _mm_set1_epi32((int)am);
+    const __m128i vbk = _mm_set1_epi32((int)bk);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i eq = _mm_cmpeq_epi32(_mm_andnot_si128(vam, s), vbk);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(eq, d), _mm_andnot_si128(eq, s)));
+    }
+#endif
+    for (; i < count; ++i) {
+        if ((src[i] & ~am) != bk) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+// MARK: - Blit State
+
+static qd_blit_row_kernel qd_blit_kernel_for_mode(short mode)
+{
+    // Dithering has no meaning when drawing to a direct surface, so the modifier
+    // is ignored.
+    switch (mode & ~qd_dither_copy) {
+        case qd_src_copy:       return qd_blit_kernel_src_copy;
+        case qd_src_or:         return qd_blit_kernel_src_or;
+        case qd_src_xor:        return qd_blit_kernel_src_xor;
+        case qd_src_bic:        return qd_blit_kernel_src_bic;
+        case qd_not_src_copy:   return qd_blit_kernel_not_src_copy;
+        case qd_not_src_or:     return qd_blit_kernel_not_src_or;
+        case qd_not_src_xor:    return qd_blit_kernel_not_src_xor;
+        case qd_not_src_bic:    return qd_blit_kernel_not_src_bic;
+        case qd_blend:          return qd_blit_kernel_blend;
+        case qd_add_pin:        return qd_blit_kernel_add_pin;
+        case qd_add_over:       return qd_blit_kernel_add_over;
+        case qd_sub_pin:        return qd_blit_kernel_sub_pin;
+        case qd_transparent:    return qd_blit_kernel_transparent;
+        case qd_ad_max:         return qd_blit_kernel_ad_max;
+        case qd_sub_over:       return qd_blit_kernel_sub_over;
+        case qd_ad_min:         return qd_blit_kernel_ad_min;
+        default:                return NULL;
+    }
+}
+
+int qd_blit_state_init(struct qd_blit_state *state, const struct qd_transfer *transfer)
+{
+    struct qd_transfer copy = { .mode = qd_src_copy, .bk_color = { 0xFFFF, 0xFFFF, 0xFFFF } };
+    if (!transfer) {
+        transfer = &copy;
+    }
+
+    state->kernel = qd_blit_kernel_for_mode(transfer->mode);
+    if (!state->kernel) {
+        return 1;
+    }
+
+    state->alpha_mask = qd_pixel_pack(0, 0, 0, UINT8_MAX);
+    state->op_color = qd_pixel_pack_rgb_color(transfer->op_color);
+    state->bk_color = qd_pixel_pack_rgb_color(transfer->bk_color);
+
+    return 0;
+}
+
+// MARK: - Blitting
+
+int qd_blit(
+    struct qd_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_surface *src,
+    struct qd_rect src_rect,
+    const struct qd_transfer *transfer
+) {
+    long sx = src_rect.left;
+    long sy = src_rect.top;
+    long dx = dst_rect.left;
+    long dy = dst_rect.top;
+    long width = qd_rect_get_width(src_rect);
+    long height = qd_rect_get_height(src_rect);
+
+    // Like CopyBits, the source is stretched to fill the destination when the
+    // two rects differ in size.
+    if (qd_rect_get_width(dst_rect) != width || qd_rect_get_height(dst_rect) != height) {
+        return qd_blit_scaled(dst, dst_rect, src, src_rect, transfer, qd_blit_filter_nearest);
+    }
+
+    struct qd_blit_state state;
+    if (qd_blit_state_init(&state, transfer)) {
+        return 1;
+    }
+
+    // Clip the area being transferred to both of the surfaces. Any adjustment
+    // made to one of the origins must be carried over to the other.
+    if (sx < 0) { dx -= sx; width += sx; sx = 0; }
+    if (sy < 0) { dy -= sy; height += sy; sy = 0; }
+    if (dx < 0) { sx -= dx; width += dx; dx = 0; }
+    if (dy < 0) { sy -= dy; height += dy; dy = 0; }
+    if (sx + width > (long)src->width) { width = (long)src->width - sx; }
+    if (sy + height > (long)src->height) { height = (long)src->height - sy; }
+    if (dx + width > (long)dst->width) { width = (long)dst->width - dx; }
+    if (dy + height > (long)dst->height) { height = (long)dst->height - dy; }
+
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    const uint8_t *src_row = (const uint8_t *)src->data + sy * src->row_bytes + sx * sizeof(uint32_t);
+    uint8_t *dst_row = (uint8_t *)dst->data + dy * dst->row_bytes + dx * sizeof(uint32_t);
+    for (long y = 0; y < height; ++y) {
+        qd_blit_row(&state, dst_row, src_row, (size_t)width);
+        src_row += src->row_bytes;
+        dst_row += dst->row_bytes;
+    }
+
+    return 0;
+}
+
+// MARK: - Scaled Blitting
+
+/* Scaled blits resample one destination row at a time into a row buffer, which
+ * is then passed through the transfer mode kernel. Source coordinates are
+ * stepped in 16.16 fixed point, and are precomputed per column so that the
+ * inner loops are free of divisions. Only the part of the destination rect that
+ * lies within the destination surface is ever resampled. */
+
+#define QD_FIXED_SHIFT      16
+#define QD_FIXED_ONE        (1L << QD_FIXED_SHIFT)
+
+struct qd_blit_scale
+{
+    const struct qd_surface *src;
+    struct qd_rect src_rect;
+    struct qd_rect dst_rect;
+    long x0, x1;
+    long y0, y1;
+    long count;
+};
+
+static inline long qd_blit_clamp(long v, long lo, long hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static inline const uint32_t *qd_blit_src_row(const struct qd_surface *src, long y)
+{
+    return (const uint32_t *)((const uint8_t *)src->data + y * src->row_bytes);
+}
+
+// Maps the destination coordinate (relative to the destination rect) to the
+// source axis, returning the 16.16 position of the start of its footprint.
+static inline int64_t qd_blit_map(long d, long src_size, long dst_size)
+{
+    return ((int64_t)d * src_size << QD_FIXED_SHIFT) / dst_size;
+}
+
+// MARK: Nearest
+
+static int qd_blit_scaled_nearest(
+    struct qd_surface *dst,
+    const struct qd_blit_scale *scale,
+    const struct qd_blit_state *state,
+    uint32_t *row
+) {
+    const struct qd_surface *src = scale->src;
+    long sw = qd_rect_get_width(scale->src_rect);
+    long sh = qd_rect_get_height(scale->src_rect);
+    long dw = qd_rect_get_width(scale->dst_rect);
+    long dh = qd_rect_get_height(scale->dst_rect);
+
+    uint32_t *columns = malloc(scale->count * sizeof(*columns));
+    if (!columns) {
+        return 1;
+    }
+
+    // Sample each destination pixel at the center of its footprint.
+    int64_t half = qd_blit_map(1, sw, dw) >> 1;
+    for (long i = 0; i < scale->count; ++i) {
+        long d = scale->x0 + i - scale->dst_rect.left;
+        long x = scale->src_rect.left + (long)((qd_blit_map(d, sw, dw) + half) >> QD_FIXED_SHIFT);
+        columns[i] = (uint32_t)qd_blit_clamp(x, 0, (long)src->width - 1);
+    }
+
+    // When enlarging by 2x or 4x, runs of identical columns are written with
+    // vector stores rather than gathered one at a time.
+    long factor = (sw * 2 == dw) ? 2 : ((sw * 4 == dw) ? 4 : 1);
+    long first = columns[0];
+    long offset = scale->x0 - scale->dst_rect.left;
+    int replicate = factor > 1 && (offset % factor) == 0
+                 && first == scale->src_rect.left + offset / factor
+                 && first + (scale->count + factor - 1) / factor <= (long)src->width;
+
+    int64_t half_y = qd_blit_map(1, sh, dh) >> 1;
+    long previous = -1;
+    for (long y = scale->y0; y < scale->y1; ++y) {
+        long d = y - scale->dst_rect.top;
+        long sy = scale->src_rect.top + (long)((qd_blit_map(d, sh, dh) + half_y) >> QD_FIXED_SHIFT);
+        sy = qd_blit_clamp(sy, 0, (long)src->height - 1);
+
+        // Consecutive destination rows that sample the same source row reuse
+        // the previously resampled row.
+        if (sy != previous) {
+            const uint32_t *src_row = qd_blit_src_row(src, sy);
+            long i = 0;
+            if (replicate) {
+                const uint32_t *p = src_row + first;
+#if defined(__SSE2__)
+                if (factor == 2) {
+                    for (; i + 4 <= scale->count; i += 4, p += 2) {
+                        __m128i v = _mm_loadl_epi64((const __m128i *)p);
+                        _mm_storeu_si128((__m128i *)(row + i), _mm_unpacklo_epi32(v, v));
+                    }
+                }
+                else {
+                    for (; i + 4 <= scale->count; i += 4, ++p) {
+                        _mm_storeu_si128((__m128i *)(row + i), _mm_set1_epi32((int)*p));
+                    }
+                }
+#else
+                for (; i + factor <= scale->count; i += factor, ++p) {
+                    for (long k = 0; k < factor; ++k) {
+                        row[i + k] = *p;
+                    }
+                }
+#endif
+            }
+            for (; i < scale->count; ++i) {
+                row[i] = src_row[columns[i]];
+            }
+            previous = sy;
+        }
+
+        uint8_t *dst_row = (uint8_t *)dst->data + y * dst->row_bytes + scale->x0 * sizeof(uint32_t);
+        qd_blit_row(state, dst_row, row, (size_t)scale->count);
+    }
+
+    free(columns);
+    return 0;
+}
+
+// MARK: Bilinear
+
+static void qd_blit_lerp_rows(uint32_t *restrict out, const uint32_t *a, const uint32_t *b, long count, uint16_t f)
+{
+    // Vertical interpolation between two source rows, with f in the range 0...256.
+    long i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16((short)f);
+    const __m128i iw = _mm_set1_epi16((short)(256 - f));
+    for (; i + 4 <= count; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = qd_blit_blend_half(_mm_unpacklo_epi8(vb, zero), _mm_unpacklo_epi8(va, zero), w, iw);
+        __m128i hi = qd_blit_blend_half(_mm_unpackhi_epi8(vb, zero), _mm_unpackhi_epi8(va, zero), w, iw);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    const uint8_t *ab = (const uint8_t *)a;
+    const uint8_t *bb = (const uint8_t *)b;
+    uint8_t *ob = (uint8_t *)out;
+    for (i <<= 2; i < (count << 2); ++i) {
+        ob[i] = (uint8_t)((ab[i] * (256 - f) + bb[i] * f) >> 8);
+    }
+}
+
+static int qd_blit_scaled_bilinear(
+    struct qd_surface *dst,
+    const struct qd_blit_scale *scale,
+    const struct qd_blit_state *state,
+    uint32_t *row
+) {
+    const struct qd_surface *src = scale->src;
+    long sw = qd_rect_get_width(scale->src_rect);
+    long sh = qd_rect_get_height(scale->src_rect);
+    long dw = qd_rect_get_width(scale->dst_rect);
+    long dh = qd_rect_get_height(scale->dst_rect);
+    long max_x = (long)src->width - 1;
+    long max_y = (long)src->height - 1;
+
+    uint32_t *columns = malloc(scale->count * sizeof(*columns));
+    uint8_t *fractions = malloc(scale->count);
+
+    // Work out the span of source columns touched by the destination, so that
+    // the vertical interpolation only covers that span.
+    int64_t half = qd_blit_map(1, sw, dw) >> 1;
+    long span_left = max_x;
+    long span_right = 0;
+    for (long i = 0; columns && fractions && i < scale->count; ++i) {
+        long d = scale->x0 + i - scale->dst_rect.left;
+        int64_t pos = ((int64_t)scale->src_rect.left << QD_FIXED_SHIFT) + qd_blit_map(d, sw, dw) + half - (QD_FIXED_ONE >> 1);
+        long x = (long)(pos >> QD_FIXED_SHIFT);
+        fractions[i] = (uint8_t)((pos >> (QD_FIXED_SHIFT - 8)) & 0xFF);
+        if (x < 0) {
+            x = 0;
+            fractions[i] = 0;
+        }
+        else if (x >= max_x) {
+            x = max_x;
+            fractions[i] = 0;
+        }
+        columns[i] = (uint32_t)x;
+        span_left = x < span_left ? x : span_left;
+        span_right = x + 1 > span_right ? x + 1 : span_right;
+    }
+    span_right = span_right > max_x ? max_x : span_right;
+
+    long span = span_right - span_left + 1;
+    uint32_t *vertical = malloc(span * sizeof(*vertical));
+    if (!columns || !fractions || !vertical) {
+        free(columns);
+        free(fractions);
+        free(vertical);
+        return 1;
+    }
+
+    int64_t half_y = qd_blit_map(1, sh, dh) >> 1;
+    int64_t previous = -1;
+    for (long y = scale->y0; y < scale->y1; ++y) {
+        long d = y - scale->dst_rect.top;
+        int64_t pos = ((int64_t)scale->src_rect.top << QD_FIXED_SHIFT) + qd_blit_map(d, sh, dh) + half_y - (QD_FIXED_ONE >> 1);
+        if (pos < 0) {
+            pos = 0;
+        }
+        else if (pos > ((int64_t)max_y << QD_FIXED_SHIFT)) {
+            pos = (int64_t)max_y << QD_FIXED_SHIFT;
+        }
+
+        if (pos != previous) {
+            long sy = (long)(pos >> QD_FIXED_SHIFT);
+            uint16_t fy = (uint16_t)((pos >> (QD_FIXED_SHIFT - 8)) & 0xFF);
+            const uint32_t *a = qd_blit_src_row(src, sy) + span_left;
+            const uint32_t *b = qd_blit_src_row(src, sy < max_y ? sy + 1 : sy) + span_left;
+            qd_blit_lerp_rows(vertical, a, b, span, fy);
+
+            // Horizontal interpolation between neighbouring pixels of the vertically
+            // interpolated row.
+            const uint8_t *vb = (const uint8_t *)vertical;
+            uint8_t *rb = (uint8_t *)row;
+            for (long i = 0; i < scale->count; ++i) {
+                long x = (long)columns[i] - span_left;
+                long x1 = columns[i] < max_x ? x + 1 : x;
+                int fx = fractions[i];
+                for (int c = 0; c < 4; ++c) {
+                    rb[(i << 2) + c] = (uint8_t)((vb[(x << 2) + c] * (256 - fx) + vb[(x1 << 2) + c] * fx) >> 8);
+                }
+            }
+            previous = pos;
+        }
+
+        uint8_t *dst_row = (uint8_t *)dst->data + y * dst->row_bytes + scale->x0 * sizeof(uint32_t);
+        qd_blit_row(state, dst_row, row, (size_t)scale->count);
+    }
+
+    free(columns);
+    free(fractions);
+    free(vertical);
+    return 0;
+}
+
+// MARK: Box
+
+static void qd_blit_box_integer_row(
+    uint32_t *restrict row,
+    uint16_t *restrict sums,
+    const struct qd_surface *src,
+    long sx,
+    long sy,
+    long count,
+    long factor
+) {
+    // Fast path for reductions by exactly 2x or 4x. The rows of each block are
+    // summed with 16-bit lanes, and the blocks are then reduced horizontally.
+    long span = count * factor;
+    long lanes = span << 2;
+    memset(sums, 0, lanes * sizeof(*sums));
+
+    for (long k = 0; k < factor; ++k) {
+        const uint8_t *p = (const uint8_t *)(qd_blit_src_row(src, sy + k) + sx);
+        long i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= lanes; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i lo = _mm_loadu_si128((const __m128i *)(sums + i));
+            __m128i hi = _mm_loadu_si128((const __m128i *)(sums + i + 8));
+            _mm_storeu_si128((__m128i *)(sums + i), _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+            _mm_storeu_si128((__m128i *)(sums + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+        }
+#endif
+        for (; i < lanes; ++i) {
+            sums[i] += p[i];
+        }
+    }
+
+    int shift = factor == 2 ? 2 : 4;
+    uint16_t round = (uint16_t)(1 << (shift - 1));
+    uint8_t *out = (uint8_t *)row;
+    for (long i = 0; i < count; ++i) {
+        const uint16_t *block = sums + i * factor * 4;
+        for (int c = 0; c < 4; ++c) {
+            uint16_t total = round;
+            for (long k = 0; k < factor; ++k) {
+                total += block[k * 4 + c];
+            }
+            out[(i << 2) + c] = (uint8_t)(total >> shift);
+        }
+    }
+}
+
+static int qd_blit_scaled_box(
+    struct qd_surface *dst,
+    const struct qd_blit_scale *scale,
+    const struct qd_blit_state *state,
+    uint32_t *row
+) {
+    const struct qd_surface *src = scale->src;
+    long sw = qd_rect_get_width(scale->src_rect);
+    long sh = qd_rect_get_height(scale->src_rect);
+    long dw = qd_rect_get_width(scale->dst_rect);
+    long dh = qd_rect_get_height(scale->dst_rect);
+
+    // Reductions by exactly 2x or 4x that lie entirely within the source use the
+    // integer fast path.
+    long factor = 0;
+    if (sw == dw * 2 && sh == dh * 2) {
+        factor = 2;
+    }
+    else if (sw == dw * 4 && sh == dh * 4) {
+        factor = 4;
+    }
+    if (factor) {
+        long sx = scale->src_rect.left + (scale->x0 - scale->dst_rect.left) * factor;
+        long sy = scale->src_rect.top + (scale->y0 - scale->dst_rect.top) * factor;
+        if (sx >= 0 && sy >= 0 && sx + scale->count * factor <= (long)src->width
+            && sy + (scale->y1 - scale->y0) * factor <= (long)src->height) {
+            uint16_t *sums = malloc(scale->count * factor * 4 * sizeof(*sums));
+            if (!sums) {
+                return 1;
+            }
+            for (long y = scale->y0; y < scale->y1; ++y, sy += factor) {
+                qd_blit_box_integer_row(row, sums, src, sx, sy, scale->count, factor);
+                uint8_t *dst_row = (uint8_t *)dst->data + y * dst->row_bytes + scale->x0 * sizeof(uint32_t);
+                qd_blit_row(state, dst_row, row, (size_t)scale->count);
+            }
+            free(sums);
+            return 0;
+        }
+    }
+
+    // The footprint of each destination column, as a range of source columns.
+    // When enlarging, a footprint covers less than a pixel and is widened to one,
+    // in which case the box filter behaves like nearest neighbour.
+    uint32_t *starts = malloc((scale->count + 1) * sizeof(*starts));
+    uint32_t *ends = malloc((scale->count + 1) * sizeof(*ends));
+    long span_left = 0;
+    long span_right = 0;
+    for (long i = 0; starts && ends && i < scale->count; ++i) {
+        long d = scale->x0 + i - scale->dst_rect.left;
+        long a = scale->src_rect.left + (long)(qd_blit_map(d, sw, dw) >> QD_FIXED_SHIFT);
+        long b = scale->src_rect.left + (long)(qd_blit_map(d + 1, sw, dw) >> QD_FIXED_SHIFT);
+        a = qd_blit_clamp(a, 0, (long)src->width - 1);
+        b = qd_blit_clamp(b, a + 1, (long)src->width);
+        if (i == 0) {
+            span_left = a;
+        }
+        span_right = b;
+        starts[i] = (uint32_t)a;
+        ends[i] = (uint32_t)b;
+    }
+
+    long span = span_right - span_left;
+    uint32_t *sums = span > 0 ? malloc(span * 4 * sizeof(*sums)) : NULL;
+    if (!starts || !ends || !sums) {
+        free(starts);
+        free(ends);
+        free(sums);
+        return span > 0 ? 1 : 0;
+    }
+
+    for (long y = scale->y0; y < scale->y1; ++y) {
+        long d = y - scale->dst_rect.top;
+        long a = scale->src_rect.top + (long)(qd_blit_map(d, sh, dh) >> QD_FIXED_SHIFT);
+        long b = scale->src_rect.top + (long)(qd_blit_map(d + 1, sh, dh) >> QD_FIXED_SHIFT);
+        a = qd_blit_clamp(a, 0, (long)src->height - 1);
+        b = qd_blit_clamp(b, a + 1, (long)src->height);
+
+        // Accumulate the source rows of the footprint, and then average each
+        // column footprint of the accumulated row.
+        memset(sums, 0, span * 4 * sizeof(*sums));
+        for (long sy = a; sy < b; ++sy) {
+            const uint8_t *p = (const uint8_t *)(qd_blit_src_row(src, sy) + span_left);
+            for (long i = 0; i < (span << 2); ++i) {
+                sums[i] += p[i];
+            }
+        }
+
+        uint8_t *out = (uint8_t *)row;
+        for (long i = 0; i < scale->count; ++i) {
+            uint32_t area = (uint32_t)((ends[i] - starts[i]) * (b - a));
+            uint32_t total[4] = { area >> 1, area >> 1, area >> 1, area >> 1 };
+            for (long x = starts[i] - span_left; x < (long)ends[i] - span_left; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    total[c] += sums[(x << 2) + c];
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                out[(i << 2) + c] = (uint8_t)(total[c] / area);
+            }
+        }
+
+        uint8_t *dst_row = (uint8_t *)dst->data + y * dst->row_bytes + scale->x0 * sizeof(uint32_t);
+        qd_blit_row(state, dst_row, row, (size_t)scale->count);
+    }
+
+    free(starts);
+    free(ends);
+    free(sums);
+    return 0;
+}
+
+int qd_blit_scaled(
+    struct qd_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_surface *src,
+    struct qd_rect src_rect,
+    const struct qd_transfer *transfer,
+    int filter
+) {
+    long sw = qd_rect_get_width(src_rect);
+    long sh = qd_rect_get_height(src_rect);
+    long dw = qd_rect_get_width(dst_rect);
+    long dh = qd_rect_get_height(dst_rect);
+
+    if (sw == dw && sh == dh) {
+        return qd_blit(dst, dst_rect, src, src_rect, transfer);
+    }
+
+    struct qd_blit_state state;
+    if (qd_blit_state_init(&state, transfer)) {
+        return 1;
+    }
+
+    if (sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0 || src->width == 0 || src->height == 0) {
+        return 0;
+    }
+
+    struct qd_blit_scale scale = { src, src_rect, dst_rect };
+    scale.x0 = qd_blit_clamp(dst_rect.left, 0, dst->width);
+    scale.x1 = qd_blit_clamp(dst_rect.right, 0, dst->width);
+    scale.y0 = qd_blit_clamp(dst_rect.top, 0, dst->height);
+    scale.y1 = qd_blit_clamp(dst_rect.bottom, 0, dst->height);
+    scale.count = scale.x1 - scale.x0;
+
+    if (scale.count <= 0 || scale.y1 <= scale.y0) {
+        return 0;
+    }
+
+    uint32_t *row = malloc(scale.count * sizeof(*row));
+    if (!row) {
+        return 1;
+    }
+
+    int err = 0;
+    switch (filter) {
+        case qd_blit_filter_bilinear:
+            err = qd_blit_scaled_bilinear(dst, &scale, &state, row);
+            break;
+        case qd_blit_filter_box:
+            err = qd_blit_scaled_box(dst, &scale, &state, row);
+            break;
+        case qd_blit_filter_nearest:
+        default:
+            err = qd_blit_scaled_nearest(dst, &scale, &state, row);
+            break;
+    }
+
+    free(row);
+    return err;
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+
+#if !defined(libQuickDraw_Blit)
+#define libQuickDraw_Blit
+
+/* The transfer describes how source pixels are combined with the destination
+ * pixels that they are drawn over, along with the colors that some of the
+ * arithmetic modes depend upon. */
+struct qd_transfer
+{
+    short mode;
+    struct qd_rgb_color op_color;
+    struct qd_rgb_color bk_color;
+};
+
+struct qd_blit_state;
+
+typedef void (*qd_blit_row_kernel)(
+    uint32_t *restrict dst,
+    const uint32_t *restrict src,
+    size_t count,
+    const struct qd_blit_state *state
+);
+
+/* A blit state is prepared once per blit. It holds the row kernel for the
+ * transfer mode and the transfer colors packed into pixel words, so that
+ * no per-pixel mode switching takes place. */
+struct qd_blit_state
+{
+    qd_blit_row_kernel kernel;
+    uint32_t alpha_mask;
+    uint32_t op_color;
+    uint32_t bk_color;
+};
+
+int qd_blit_state_init(struct qd_blit_state *state, const struct qd_transfer *transfer);
+
+static inline void qd_blit_row(const struct qd_blit_state *state, void *dst, const void *src, size_t count)
+{
+    state->kernel(dst, src, count, state);
+}
+
+/* The filter used to resample the source when the source and destination rects
+ * differ in size. The box filter averages every source pixel covered by a
+ * destination pixel, and is the one to use when reducing high resolution
+ * pictures to their frame size. */
+enum
+{
+    qd_blit_filter_nearest          = 0,
+    qd_blit_filter_bilinear         = 1,
+    qd_blit_filter_box              = 2,
+};
+
+int qd_blit(
+    struct qd_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_surface *src,
+    struct qd_rect src_rect,
+    const struct qd_transfer *transfer
+);
+
+int qd_blit_scaled(
+    struct qd_surface *dst,
+    struct qd_rect dst_rect,
+    const struct qd_surface *src,
+    struct qd_rect src_rect,
+    const struct qd_transfer *transfer,
+    int filter
+);
+
+#endif
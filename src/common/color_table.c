@@ -27,17 +27,14 @@ struct qd_color_table *qd_color_table_parse(struct qd_buffer *restrict buffer)
     struct qd_color_table *color_table = calloc(1, sizeof(*color_table));
 
     if (qd_buffer_read(&color_table->ct_seed, sizeof(uint32_t), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read color table seed.\n");
         goto ERROR;
     }
 
     if (qd_buffer_read(&color_table->ct_flags, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read color table flags.\n");
         goto ERROR;
     }
 
     if (qd_buffer_read(&color_table->ct_size, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read color table size.\n");
         goto ERROR;
     }
 
@@ -46,25 +43,21 @@ struct qd_color_table *qd_color_table_parse(struct qd_buffer *restrict buffer)
     for (int i = 0; i <= color_table->ct_size; ++i) {
         // Read the pixel value
         if (qd_buffer_read(&color_table->ct_table[i].value, sizeof(unsigned short), 1, buffer) != 1) {
-            fprintf(stderr, "Failed to read color table entry (pixel value).\n");
             goto ERROR;
         }
 
         // Read the pixel red value
         if (qd_buffer_read(&color_table->ct_table[i].rgb.red, sizeof(unsigned short), 1, buffer) != 1) {
-            fprintf(stderr, "Failed to read color table entry (red value).\n");
             goto ERROR;
         }
 
         // Read the pixel green value
         if (qd_buffer_read(&color_table->ct_table[i].rgb.green, sizeof(unsigned short), 1, buffer) != 1) {
-            fprintf(stderr, "Failed to read color table entry (green value).\n");
             goto ERROR;
         }
 
         // Read the pixel blue value
         if (qd_buffer_read(&color_table->ct_table[i].rgb.blue, sizeof(unsigned short), 1, buffer) != 1) {
-            fprintf(stderr, "Failed to read color table entry (blue value).\n");
             goto ERROR;
         }
     }
@@ -83,3 +76,24 @@ void qd_color_table_free(struct qd_color_table *color_table)
         free(color_table);
     }
 }
+
+uint32_t qd_color_table_get_colors(const struct qd_color_table *color_table, struct qd_inverse_table_color colors[256])
+{
+    uint32_t count = 0;
+    if (!color_table || !color_table->ct_table) {
+        return 0;
+    }
+
+    // In a device color table the entries are in index order, and the value of
+    // each entry is not meaningful. Otherwise the value is the pixel index.
+    int device = (color_table->ct_flags & qd_color_table_device_flag) != 0;
+    for (int i = 0; i <= color_table->ct_size && count < 256; ++i) {
+        unsigned short index = device ? (unsigned short)i : color_table->ct_table[i].value;
+        if (index < 256) {
+            struct qd_rgb_color rgb = color_table->ct_table[i].rgb;
+            colors[count++] = (struct qd_inverse_table_color){ rgb.red >> 8, rgb.green >> 8, rgb.blue >> 8, (uint8_t)index };
+        }
+    }
+
+    return count;
+}
@@ -20,12 +20,24 @@
  */
 
 #include "common/types.h"
+#include "common/inverse_table.h"
 #include "internal/buffer.h"
 
 #if !defined(libQuickDraw_ColorType)
 #define libQuickDraw_ColorType
 
+enum
+{
+    qd_color_table_device_flag      = 0x8000,
+};
+
 struct qd_color_table *qd_color_table_parse(struct qd_buffer *restrict buffer);
 void qd_color_table_free(struct qd_color_table *color_table);
 
+/* Lists the colors of a color table along with the pixel index of each, in the
+ * order of the table, as 8 bit channels. Entries whose index does not fit in 8
+ * bits are left out, and no more than 256 colors are listed. Returns the number
+ * of colors listed. */
+uint32_t qd_color_table_get_colors(const struct qd_color_table *color_table, struct qd_inverse_table_color colors[256]);
+
 #endif
@@ -0,0 +1,583 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common/convert.h"
+#include "internal/pixel.h"
+
+#if defined(__SSE2__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   include <emmintrin.h>
+#   define QD_CONVERT_SSE2 1
+#endif
+
+// MARK: - Pixel Formats
+
+uint32_t qd_pixel_format_depth(uint32_t format)
+{
+    switch (format) {
+        case qd_1_monochrome_pixel_format:
+        case qd_2_indexed_pixel_format:
+        case qd_4_indexed_pixel_format:
+        case qd_8_indexed_pixel_format:
+            return format;
+        default:
+            return qd_pixel_format_bytes(format) << 3;
+    }
+}
+
+static inline int qd_pixel_format_is_indexed(uint32_t format)
+{
+    return qd_pixel_format_bytes(format) == 0;
+}
+
+// MARK: - Pixel Loads and Stores
+
+/* Each direct pixel format has a load, which unpacks a pixel into R, G, B, A
+ * bytes, and a store which packs them again. Formats without alpha load as
+ * opaque. Narrow channels are widened by replicating their high bits, so that
+ * full intensity is preserved. */
+
+static inline uint8_t qd_widen5(uint32_t v)
+{
+    return (uint8_t)((v << 3) | (v >> 2));
+}
+
+static inline uint8_t qd_widen6(uint32_t v)
+{
+    return (uint8_t)((v << 2) | (v >> 4));
+}
+
+static inline void qd_load_555(uint32_t v, uint8_t c[4])
+{
+    c[0] = qd_widen5((v >> 10) & 0x1F);
+    c[1] = qd_widen5((v >> 5) & 0x1F);
+    c[2] = qd_widen5(v & 0x1F);
+    c[3] = UINT8_MAX;
+}
+
+static inline void qd_load_565(uint32_t v, uint8_t c[4])
+{
+    c[0] = qd_widen5((v >> 11) & 0x1F);
+    c[1] = qd_widen6((v >> 5) & 0x3F);
+    c[2] = qd_widen5(v & 0x1F);
+    c[3] = UINT8_MAX;
+}
+
+static inline uint16_t qd_store_555(const uint8_t c[4])
+{
+    return (uint16_t)(((c[0] >> 3) << 10) | ((c[1] >> 3) << 5) | (c[2] >> 3));
+}
+
+static inline uint16_t qd_store_565(const uint8_t c[4])
+{
+    return (uint16_t)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+static inline void qd_load_555be(const uint8_t *s, uint8_t c[4]) { qd_load_555((uint32_t)(s[0] << 8) | s[1], c); }
+static inline void qd_load_555le(const uint8_t *s, uint8_t c[4]) { qd_load_555((uint32_t)(s[1] << 8) | s[0], c); }
+static inline void qd_load_565be(const uint8_t *s, uint8_t c[4]) { qd_load_565((uint32_t)(s[0] << 8) | s[1], c); }
+static inline void qd_load_565le(const uint8_t *s, uint8_t c[4]) { qd_load_565((uint32_t)(s[1] << 8) | s[0], c); }
+static inline void qd_load_rgb(const uint8_t *s, uint8_t c[4]) { c[0] = s[0]; c[1] = s[1]; c[2] = s[2]; c[3] = UINT8_MAX; }
+static inline void qd_load_bgr(const uint8_t *s, uint8_t c[4]) { c[0] = s[2]; c[1] = s[1]; c[2] = s[0]; c[3] = UINT8_MAX; }
+static inline void qd_load_argb(const uint8_t *s, uint8_t c[4]) { c[0] = s[1]; c[1] = s[2]; c[2] = s[3]; c[3] = s[0]; }
+static inline void qd_load_bgra(const uint8_t *s, uint8_t c[4]) { c[0] = s[2]; c[1] = s[1]; c[2] = s[0]; c[3] = s[3]; }
+static inline void qd_load_abgr(const uint8_t *s, uint8_t c[4]) { c[0] = s[3]; c[1] = s[2]; c[2] = s[1]; c[3] = s[0]; }
+static inline void qd_load_rgba(const uint8_t *s, uint8_t c[4]) { c[0] = s[0]; c[1] = s[1]; c[2] = s[2]; c[3] = s[3]; }
+
+static inline void qd_store_555be(uint8_t *d, const uint8_t c[4]) { uint16_t v = qd_store_555(c); d[0] = (uint8_t)(v >> 8); d[1] = (uint8_t)v; }
+static inline void qd_store_555le(uint8_t *d, const uint8_t c[4]) { uint16_t v = qd_store_555(c); d[0] = (uint8_t)v; d[1] = (uint8_t)(v >> 8); }
+static inline void qd_store_565be(uint8_t *d, const uint8_t c[4]) { uint16_t v = qd_store_565(c); d[0] = (uint8_t)(v >> 8); d[1] = (uint8_t)v; }
+static inline void qd_store_565le(uint8_t *d, const uint8_t c[4]) { uint16_t v = qd_store_565(c); d[0] = (uint8_t)v; d[1] = (uint8_t)(v >> 8); }
+static inline void qd_store_rgb(uint8_t *d, const uint8_t c[4]) { d[0] = c[0]; d[1] = c[1]; d[2] = c[2]; }
+static inline void qd_store_bgr(uint8_t *d, const uint8_t c[4]) { d[0] = c[2]; d[1] = c[1]; d[2] = c[0]; }
+static inline void qd_store_argb(uint8_t *d, const uint8_t c[4]) { d[0] = c[3]; d[1] = c[0]; d[2] = c[1]; d[3] = c[2]; }
+static inline void qd_store_bgra(uint8_t *d, const uint8_t c[4]) { d[0] = c[2]; d[1] = c[1]; d[2] = c[0]; d[3] = c[3]; }
+static inline void qd_store_abgr(uint8_t *d, const uint8_t c[4]) { d[0] = c[3]; d[1] = c[2]; d[2] = c[1]; d[3] = c[0]; }
+static inline void qd_store_rgba(uint8_t *d, const uint8_t c[4]) { d[0] = c[0]; d[1] = c[1]; d[2] = c[2]; d[3] = c[3]; }
+
+// MARK: - Direct to Direct Kernels
+
+/* A kernel is generated for every pair of direct formats. The load and store are
+ * inlined into each of them, so every pair gets its own straight line loop. */
+
+#define QD_DIRECT_KERNEL(from, from_bytes, to, to_bytes) \
+    static void qd_convert_##from##_to_##to(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv) \
+    { \
+        (void)conv; \
+        const uint8_t *s = src; \
+        uint8_t *d = dst; \
+        for (uint32_t x = 0; x < width; ++x, s += from_bytes, d += to_bytes) { \
+            uint8_t c[4]; \
+            qd_load_##from(s, c); \
+            qd_store_##to(d, c); \
+        } \
+    }
+
+#define QD_DIRECT_KERNELS_FROM(from, from_bytes) \
+    QD_DIRECT_KERNEL(from, from_bytes, 555be, 2) \
+    QD_DIRECT_KERNEL(from, from_bytes, 555le, 2) \
+    QD_DIRECT_KERNEL(from, from_bytes, 565be, 2) \
+    QD_DIRECT_KERNEL(from, from_bytes, 565le, 2) \
+    QD_DIRECT_KERNEL(from, from_bytes, rgb, 3) \
+    QD_DIRECT_KERNEL(from, from_bytes, bgr, 3) \
+    QD_DIRECT_KERNEL(from, from_bytes, argb, 4) \
+    QD_DIRECT_KERNEL(from, from_bytes, bgra, 4) \
+    QD_DIRECT_KERNEL(from, from_bytes, abgr, 4) \
+    QD_DIRECT_KERNEL(from, from_bytes, rgba, 4)
+
+QD_DIRECT_KERNELS_FROM(555be, 2)
+QD_DIRECT_KERNELS_FROM(555le, 2)
+QD_DIRECT_KERNELS_FROM(565be, 2)
+QD_DIRECT_KERNELS_FROM(565le, 2)
+QD_DIRECT_KERNELS_FROM(rgb, 3)
+QD_DIRECT_KERNELS_FROM(bgr, 3)
+QD_DIRECT_KERNELS_FROM(argb, 4)
+QD_DIRECT_KERNELS_FROM(bgra, 4)
+QD_DIRECT_KERNELS_FROM(abgr, 4)
+QD_DIRECT_KERNELS_FROM(rgba, 4)
+
+#define QD_DIRECT_KERNEL_ROW(from) { \
+    qd_convert_##from##_to_555be, qd_convert_##from##_to_555le, qd_convert_##from##_to_565be, qd_convert_##from##_to_565le, \
+    qd_convert_##from##_to_rgb, qd_convert_##from##_to_bgr, \
+    qd_convert_##from##_to_argb, qd_convert_##from##_to_bgra, qd_convert_##from##_to_abgr, qd_convert_##from##_to_rgba, \
+}
+
+static const uint32_t qd_direct_formats[] = {
+    qd_16_555_pixel_format, qd_16_le_555_pixel_format, qd_16_be_565_pixel_format, qd_16_le_565_pixel_format,
+    qd_24_rgb_pixel_format, qd_24_bgr_pixel_format,
+    qd_32_argb_pixel_format, qd_32_bgra_pixel_format, qd_32_abgr_pixel_format, qd_32_rgba_pixel_format,
+};
+
+#define QD_DIRECT_FORMAT_COUNT (sizeof(qd_direct_formats) / sizeof(*qd_direct_formats))
+
+static qd_convert_row_kernel *const qd_direct_kernels[QD_DIRECT_FORMAT_COUNT][QD_DIRECT_FORMAT_COUNT] = {
+    QD_DIRECT_KERNEL_ROW(555be),
+    QD_DIRECT_KERNEL_ROW(555le),
+    QD_DIRECT_KERNEL_ROW(565be),
+    QD_DIRECT_KERNEL_ROW(565le),
+    QD_DIRECT_KERNEL_ROW(rgb),
+    QD_DIRECT_KERNEL_ROW(bgr),
+    QD_DIRECT_KERNEL_ROW(argb),
+    QD_DIRECT_KERNEL_ROW(bgra),
+    QD_DIRECT_KERNEL_ROW(abgr),
+    QD_DIRECT_KERNEL_ROW(rgba),
+};
+
+static int qd_direct_format_slot(uint32_t format)
+{
+    for (int i = 0; i < (int)QD_DIRECT_FORMAT_COUNT; ++i) {
+        if (qd_direct_formats[i] == format) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void qd_convert_copy(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv)
+{
+    memcpy(dst, src, ((size_t)width * conv->src_depth + 7) >> 3);
+}
+
+// MARK: - Specialized Kernels
+
+/* The 32 bit formats are all byte permutations of each other, so on little endian
+ * hosts each pair reduces to a rotation or byte swap of the pixel word. These and
+ * the conversion of Mac 555 pixels, the most common direct format in pictures,
+ * have vector kernels. */
+
+#if defined(QD_CONVERT_SSE2)
+
+static inline uint32_t qd_rotr8(uint32_t x) { return (x >> 8) | (x << 24); }
+static inline uint32_t qd_rotl8(uint32_t x) { return (x << 8) | (x >> 24); }
+static inline uint32_t qd_swap02(uint32_t x) { return (x & 0xFF00FF00) | ((x >> 16) & 0xFF) | ((x & 0xFF) << 16); }
+static inline uint32_t qd_swap13(uint32_t x) { return (x & 0x00FF00FF) | ((x >> 16) & 0xFF00) | ((x & 0xFF00) << 16); }
+static inline uint32_t qd_bswap(uint32_t x) { return qd_rotr8(qd_swap13(x)); }
+
+static inline __m128i qd_rotr8_sse2(__m128i v) { return _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24)); }
+static inline __m128i qd_rotl8_sse2(__m128i v) { return _mm_or_si128(_mm_slli_epi32(v, 8), _mm_srli_epi32(v, 24)); }
+
+static inline __m128i qd_swap02_sse2(__m128i v)
+{
+    const __m128i keep = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i low = _mm_set1_epi32(0xFF);
+    __m128i b0 = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+    __m128i b2 = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    return _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(b0, b2));
+}
+
+static inline __m128i qd_swap13_sse2(__m128i v)
+{
+    const __m128i keep = _mm_set1_epi32(0x00FF00FF);
+    const __m128i mid = _mm_set1_epi32(0xFF00);
+    __m128i b1 = _mm_slli_epi32(_mm_and_si128(v, mid), 16);
+    __m128i b3 = _mm_and_si128(_mm_srli_epi32(v, 16), mid);
+    return _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(b1, b3));
+}
+
+static inline __m128i qd_bswap_sse2(__m128i v)
+{
+    return qd_rotr8_sse2(qd_swap13_sse2(v));
+}
+
+#define QD_PERMUTE_KERNEL(op) \
+    static void qd_convert_##op(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv) \
+    { \
+        (void)conv; \
+        const uint8_t *s = src; \
+        uint8_t *d = dst; \
+        uint32_t x = 0; \
+        for (; x + 4 <= width; x += 4, s += 16, d += 16) { \
+            __m128i v = _mm_loadu_si128((const __m128i *)s); \
+            _mm_storeu_si128((__m128i *)d, qd_##op##_sse2(v)); \
+        } \
+        for (; x < width; ++x, s += 4, d += 4) { \
+            uint32_t v; \
+            memcpy(&v, s, 4); \
+            v = qd_##op(v); \
+            memcpy(d, &v, 4); \
+        } \
+    }
+
+QD_PERMUTE_KERNEL(rotr8)
+QD_PERMUTE_KERNEL(rotl8)
+QD_PERMUTE_KERNEL(swap02)
+QD_PERMUTE_KERNEL(swap13)
+QD_PERMUTE_KERNEL(bswap)
+
+static inline __m128i qd_widen5_sse2(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 3), _mm_srli_epi16(v, 2));
+}
+
+static void qd_convert_555be_to_rgba_sse2(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    uint32_t x = 0;
+
+    const __m128i mask = _mm_set1_epi16(0x1F);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    for (; x + 8 <= width; x += 8, s += 16, d += 32) {
+        __m128i v = _mm_loadu_si128((const __m128i *)s);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+        __m128i r = qd_widen5_sse2(_mm_and_si128(_mm_srli_epi16(v, 10), mask));
+        __m128i g = qd_widen5_sse2(_mm_and_si128(_mm_srli_epi16(v, 5), mask));
+        __m128i b = qd_widen5_sse2(_mm_and_si128(v, mask));
+
+        // Interleave the channels as 16 bit (R, G) and (B, A) pairs, which are then
+        // interleaved into whole pixels.
+        __m128i rg = _mm_or_si128(_mm_and_si128(r, _mm_set1_epi16(0xFF)), _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(_mm_and_si128(b, _mm_set1_epi16(0xFF)), alpha);
+        _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(d + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    qd_convert_555be_to_rgba(d, s, width - x, conv);
+}
+
+#endif
+
+struct qd_specialized_kernel
+{
+    uint32_t src_format;
+    uint32_t dst_format;
+    qd_convert_row_kernel *kernel;
+};
+
+static const struct qd_specialized_kernel qd_specialized_kernels[] = {
+#if defined(QD_CONVERT_SSE2)
+    { qd_16_555_pixel_format, qd_32_rgba_pixel_format, qd_convert_555be_to_rgba_sse2 },
+    { qd_32_argb_pixel_format, qd_32_rgba_pixel_format, qd_convert_rotr8 },
+    { qd_32_argb_pixel_format, qd_32_bgra_pixel_format, qd_convert_bswap },
+    { qd_32_argb_pixel_format, qd_32_abgr_pixel_format, qd_convert_swap13 },
+    { qd_32_bgra_pixel_format, qd_32_rgba_pixel_format, qd_convert_swap02 },
+    { qd_32_bgra_pixel_format, qd_32_argb_pixel_format, qd_convert_bswap },
+    { qd_32_bgra_pixel_format, qd_32_abgr_pixel_format, qd_convert_rotl8 },
+    { qd_32_abgr_pixel_format, qd_32_rgba_pixel_format, qd_convert_bswap },
+    { qd_32_abgr_pixel_format, qd_32_argb_pixel_format, qd_convert_swap13 },
+    { qd_32_abgr_pixel_format, qd_32_bgra_pixel_format, qd_convert_rotr8 },
+    { qd_32_rgba_pixel_format, qd_32_argb_pixel_format, qd_convert_rotl8 },
+    { qd_32_rgba_pixel_format, qd_32_bgra_pixel_format, qd_convert_swap02 },
+    { qd_32_rgba_pixel_format, qd_32_abgr_pixel_format, qd_convert_bswap },
+#endif
+    { 0, 0, NULL },
+};
+
+// MARK: - Indexed Kernels
+
+/* Indexed pixels are packed most significant bits first. Rows are worked on in
+ * chunks of 8 bit indices, which keeps each chunk a whole number of bytes at
+ * every depth. */
+
+#define QD_INDEX_CHUNK 256
+
+static inline void qd_unpack_indices(uint8_t *restrict out, const uint8_t *restrict in, uint32_t count, uint32_t depth)
+{
+    if (depth == 8) {
+        memcpy(out, in, count);
+        return;
+    }
+
+    uint32_t mask = (1U << depth) - 1;
+    for (uint32_t x = 0; x < count; ++x) {
+        uint32_t bit = x * depth;
+        out[x] = (uint8_t)((in[bit >> 3] >> (8 - depth - (bit & 7))) & mask);
+    }
+}
+
+static inline void qd_pack_indices(uint8_t *restrict out, const uint8_t *restrict in, uint32_t count, uint32_t depth)
+{
+    if (depth == 8) {
+        memcpy(out, in, count);
+        return;
+    }
+
+    uint32_t mask = (1U << depth) - 1;
+    uint32_t per_byte = 8 / depth;
+    for (uint32_t x = 0; x < count; x += per_byte) {
+        uint8_t byte = 0;
+        for (uint32_t i = 0; i < per_byte; ++i) {
+            uint8_t v = (x + i < count) ? (in[x + i] & mask) : 0;
+            byte |= (uint8_t)(v << (8 - depth * (i + 1)));
+        }
+        *out++ = byte;
+    }
+}
+
+#define QD_INDEXED_TO_DIRECT_KERNEL(depth, bytes) \
+    static void qd_convert_i##depth##_to_##bytes(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv) \
+    { \
+        const uint8_t *s = src; \
+        uint8_t *d = dst; \
+        uint8_t indices[QD_INDEX_CHUNK]; \
+        for (uint32_t x = 0; x < width; x += QD_INDEX_CHUNK) { \
+            uint32_t count = (width - x < QD_INDEX_CHUNK) ? width - x : QD_INDEX_CHUNK; \
+            qd_unpack_indices(indices, s + ((x * depth) >> 3), count, depth); \
+            for (uint32_t i = 0; i < count; ++i, d += bytes) { \
+                memcpy(d, &conv->palette[indices[i]], bytes); \
+            } \
+        } \
+    }
+
+QD_INDEXED_TO_DIRECT_KERNEL(1, 2)
+QD_INDEXED_TO_DIRECT_KERNEL(2, 2)
+QD_INDEXED_TO_DIRECT_KERNEL(4, 2)
+QD_INDEXED_TO_DIRECT_KERNEL(8, 2)
+QD_INDEXED_TO_DIRECT_KERNEL(1, 3)
+QD_INDEXED_TO_DIRECT_KERNEL(2, 3)
+QD_INDEXED_TO_DIRECT_KERNEL(4, 3)
+QD_INDEXED_TO_DIRECT_KERNEL(8, 3)
+
+static void qd_convert_indexed_to_4(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv)
+{
+    // The expansion table produces whole pixel words, one source byte at a time.
+    if (((uintptr_t)dst & (sizeof(uint32_t) - 1)) == 0) {
+        qd_expand_row(conv->expand, dst, src, width);
+        return;
+    }
+
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    uint8_t indices[QD_INDEX_CHUNK];
+    for (uint32_t x = 0; x < width; x += QD_INDEX_CHUNK) {
+        uint32_t count = (width - x < QD_INDEX_CHUNK) ? width - x : QD_INDEX_CHUNK;
+        qd_unpack_indices(indices, s + ((x * conv->src_depth) >> 3), count, conv->src_depth);
+        for (uint32_t i = 0; i < count; ++i, d += 4) {
+            memcpy(d, &conv->palette[indices[i]], 4);
+        }
+    }
+}
+
+static qd_convert_row_kernel *const qd_indexed_to_direct_kernels[4][3] = {
+    { qd_convert_i1_to_2, qd_convert_i1_to_3, qd_convert_indexed_to_4 },
+    { qd_convert_i2_to_2, qd_convert_i2_to_3, qd_convert_indexed_to_4 },
+    { qd_convert_i4_to_2, qd_convert_i4_to_3, qd_convert_indexed_to_4 },
+    { qd_convert_i8_to_2, qd_convert_i8_to_3, qd_convert_indexed_to_4 },
+};
+
+#define QD_DIRECT_TO_INDEXED_KERNEL(from, from_bytes) \
+    static void qd_convert_##from##_to_indexed(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv) \
+    { \
+        const uint8_t *s = src; \
+        uint8_t *d = dst; \
+        uint8_t indices[QD_INDEX_CHUNK]; \
+        for (uint32_t x = 0; x < width; x += QD_INDEX_CHUNK) { \
+            uint32_t count = (width - x < QD_INDEX_CHUNK) ? width - x : QD_INDEX_CHUNK; \
+            for (uint32_t i = 0; i < count; ++i, s += from_bytes) { \
+                uint8_t c[4]; \
+                qd_load_##from(s, c); \
+                indices[i] = qd_inverse_table_lookup(conv->inverse, c[0], c[1], c[2]); \
+            } \
+            qd_pack_indices(d + ((x * conv->dst_depth) >> 3), indices, count, conv->dst_depth); \
+        } \
+    }
+
+QD_DIRECT_TO_INDEXED_KERNEL(555be, 2)
+QD_DIRECT_TO_INDEXED_KERNEL(555le, 2)
+QD_DIRECT_TO_INDEXED_KERNEL(565be, 2)
+QD_DIRECT_TO_INDEXED_KERNEL(565le, 2)
+QD_DIRECT_TO_INDEXED_KERNEL(rgb, 3)
+QD_DIRECT_TO_INDEXED_KERNEL(bgr, 3)
+QD_DIRECT_TO_INDEXED_KERNEL(argb, 4)
+QD_DIRECT_TO_INDEXED_KERNEL(bgra, 4)
+QD_DIRECT_TO_INDEXED_KERNEL(abgr, 4)
+QD_DIRECT_TO_INDEXED_KERNEL(rgba, 4)
+
+static qd_convert_row_kernel *const qd_direct_to_indexed_kernels[QD_DIRECT_FORMAT_COUNT] = {
+    qd_convert_555be_to_indexed, qd_convert_555le_to_indexed, qd_convert_565be_to_indexed, qd_convert_565le_to_indexed,
+    qd_convert_rgb_to_indexed, qd_convert_bgr_to_indexed,
+    qd_convert_argb_to_indexed, qd_convert_bgra_to_indexed, qd_convert_abgr_to_indexed, qd_convert_rgba_to_indexed,
+};
+
+static void qd_convert_indexed_to_indexed(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    uint8_t indices[QD_INDEX_CHUNK];
+    for (uint32_t x = 0; x < width; x += QD_INDEX_CHUNK) {
+        uint32_t count = (width - x < QD_INDEX_CHUNK) ? width - x : QD_INDEX_CHUNK;
+        qd_unpack_indices(indices, s + ((x * conv->src_depth) >> 3), count, conv->src_depth);
+        for (uint32_t i = 0; i < count; ++i) {
+            indices[i] = conv->index_map[indices[i]];
+        }
+        qd_pack_indices(d + ((x * conv->dst_depth) >> 3), indices, count, conv->dst_depth);
+    }
+}
+
+static inline int qd_depth_slot(uint32_t depth)
+{
+    switch (depth) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        default: return 3;
+    }
+}
+
+// MARK: - Converters
+
+int qd_converter_init(
+    struct qd_converter *conv,
+    uint32_t src_format,
+    uint32_t dst_format,
+    const uint32_t src_palette[256],
+    const struct qd_inverse_table *dst_inverse
+) {
+    memset(conv, 0, sizeof(*conv));
+    conv->src_format = src_format;
+    conv->dst_format = dst_format;
+    conv->src_depth = qd_pixel_format_depth(src_format);
+    conv->dst_depth = qd_pixel_format_depth(dst_format);
+    conv->inverse = dst_inverse;
+
+    if (conv->src_depth == 0 || conv->dst_depth == 0) {
+        goto ERROR;
+    }
+
+    int src_indexed = qd_pixel_format_is_indexed(src_format);
+    int dst_indexed = qd_pixel_format_is_indexed(dst_format);
+
+    if (src_indexed && !src_palette) {
+        goto ERROR;
+    }
+
+    if (dst_indexed && !dst_inverse && !src_indexed) {
+        goto ERROR;
+    }
+
+    if (src_format == dst_format && !(src_indexed && dst_inverse)) {
+        conv->kernel = qd_convert_copy;
+        return 0;
+    }
+
+    if (src_indexed && dst_indexed) {
+        for (int i = 0; i < 256; ++i) {
+            const uint8_t *c = (const uint8_t *)&src_palette[i];
+            conv->index_map[i] = dst_inverse ? qd_inverse_table_lookup(dst_inverse, c[0], c[1], c[2]) : (uint8_t)i;
+        }
+        conv->kernel = qd_convert_indexed_to_indexed;
+        return 0;
+    }
+
+    if (src_indexed) {
+        // Pack the source colors in the destination format up front, so that
+        // each pixel is a single copy.
+        for (int i = 0; i < 256; ++i) {
+            const uint8_t *c = (const uint8_t *)&src_palette[i];
+            conv->palette[i] = qd_pixel_pack_format(dst_format, c[0], c[1], c[2], c[3]);
+        }
+
+        uint32_t bytes = qd_pixel_format_bytes(dst_format);
+        if (bytes == 4) {
+            if (!(conv->expand = malloc(sizeof(*conv->expand)))) {
+                goto ERROR;
+            }
+            qd_expand_table_init(conv->expand, conv->palette, conv->src_depth);
+        }
+        conv->kernel = qd_indexed_to_direct_kernels[qd_depth_slot(conv->src_depth)][bytes - 2];
+        return 0;
+    }
+
+    int src_slot = qd_direct_format_slot(src_format);
+    if (dst_indexed) {
+        conv->kernel = qd_direct_to_indexed_kernels[src_slot];
+        return 0;
+    }
+
+    for (const struct qd_specialized_kernel *k = qd_specialized_kernels; k->kernel; ++k) {
+        if (k->src_format == src_format && k->dst_format == dst_format) {
+            conv->kernel = k->kernel;
+            return 0;
+        }
+    }
+
+    conv->kernel = qd_direct_kernels[src_slot][qd_direct_format_slot(dst_format)];
+    return 0;
+
+ERROR:
+    qd_converter_destroy(conv);
+    return 1;
+}
+
+void qd_converter_destroy(struct qd_converter *conv)
+{
+    if (conv) {
+        free(conv->expand);
+        conv->expand = NULL;
+        conv->kernel = NULL;
+    }
+}
+
+void qd_convert(
+    const struct qd_converter *conv,
+    void *dst,
+    size_t dst_row_bytes,
+    const void *src,
+    size_t src_row_bytes,
+    uint32_t width,
+    uint32_t height
+) {
+    for (uint32_t y = 0; y < height; ++y) {
+        conv->kernel((uint8_t *)dst + y * dst_row_bytes, (const uint8_t *)src + y * src_row_bytes, width, conv);
+    }
+}
@@ -0,0 +1,83 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+#include "common/inverse_table.h"
+#include "internal/expand.h"
+
+#if !defined(libQuickDraw_Convert)
+#define libQuickDraw_Convert
+
+struct qd_converter;
+
+typedef void qd_convert_row_kernel(void *restrict dst, const void *restrict src, uint32_t width, const struct qd_converter *conv);
+
+/* A converter translates rows of pixels between any two of the QuickDraw pixel
+ * formats (1, 2, 4 and 8 bit indexed, 16 bit 555, 24 bit RGB, 32 bit ARGB) and
+ * the host pixel formats. The row kernel for the pair of formats is picked when
+ * the converter is set up, so converting a row does no format dispatch.
+ *
+ * Indexed sources need the colors of the source color table, as packed RGBA
+ * pixels (see qd_palette_create). Indexed destinations need an inverse
+ * table for the destination color table. Converting between indexed formats
+ * without an inverse table keeps the pixel values as they are. */
+struct qd_converter
+{
+    uint32_t src_format;
+    uint32_t dst_format;
+    uint32_t src_depth;
+    uint32_t dst_depth;
+    qd_convert_row_kernel *kernel;
+    const struct qd_inverse_table *inverse;
+    struct qd_expand_table *expand;
+    uint32_t palette[256];
+    uint8_t index_map[256];
+};
+
+int qd_converter_init(
+    struct qd_converter *conv,
+    uint32_t src_format,
+    uint32_t dst_format,
+    const uint32_t src_palette[256],
+    const struct qd_inverse_table *dst_inverse
+);
+void qd_converter_destroy(struct qd_converter *conv);
+
+static inline void qd_convert_row(const struct qd_converter *conv, void *restrict dst, const void *restrict src, uint32_t width)
+{
+    conv->kernel(dst, src, width, conv);
+}
+
+void qd_convert(
+    const struct qd_converter *conv,
+    void *dst,
+    size_t dst_row_bytes,
+    const void *src,
+    size_t src_row_bytes,
+    uint32_t width,
+    uint32_t height
+);
+
+/* The number of bits occupied by a pixel of the given format, or 0 if the format
+ * is not known. */
+uint32_t qd_pixel_format_depth(uint32_t format);
+
+#endif
@@ -0,0 +1,79 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "common/error.h"
+
+const char *qd_err_string(enum qd_err code)
+{
+    switch (code) {
+        case qd_err_none:           return "no error";
+        case qd_err_no_memory:      return "out of memory";
+        case qd_err_io:             return "i/o error";
+        case qd_err_truncated:      return "truncated data";
+        case qd_err_invalid:        return "invalid data";
+        case qd_err_unsupported:    return "unsupported data";
+        case qd_err_argument:       return "invalid argument";
+        default:                    return "unknown error";
+    }
+}
+
+int qd_error_vraise(struct qd_error *error, enum qd_err code, long offset, int32_t opcode, const char *format, va_list args)
+{
+    if (!error) {
+        return 1;
+    }
+
+    // Only the first error is kept, but every error is logged.
+    struct qd_error raised = { code, offset, opcode };
+    vsnprintf(raised.message, sizeof(raised.message), format, args);
+    if (error->log) {
+        error->log(error->log_context, &raised);
+    }
+
+    if (error->code == qd_err_none) {
+        raised.log = error->log;
+        raised.log_context = error->log_context;
+        *error = raised;
+    }
+
+    return 1;
+}
+
+int qd_error_raise(struct qd_error *error, enum qd_err code, long offset, int32_t opcode, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    qd_error_vraise(error, code, offset, opcode, format, args);
+    va_end(args);
+    return 1;
+}
+
+void qd_error_clear(struct qd_error *error)
+{
+    if (error) {
+        error->code = qd_err_none;
+        error->offset = QD_ERROR_NO_OFFSET;
+        error->opcode = QD_ERROR_NO_OPCODE;
+        error->message[0] = '\0';
+    }
+}
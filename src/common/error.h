@@ -0,0 +1,74 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#if !defined(libQuickDraw_Error)
+#define libQuickDraw_Error
+
+/* The kinds of failure that the library reports. */
+enum qd_err
+{
+    qd_err_none         = 0,
+    qd_err_no_memory    = 1,    /* An allocation failed. */
+    qd_err_io           = 2,    /* A file could not be opened, mapped or written. */
+    qd_err_truncated    = 3,    /* The data ends before something that it describes. */
+    qd_err_invalid      = 4,    /* The data is malformed. */
+    qd_err_unsupported  = 5,    /* The data is valid, but uses something that is not supported. */
+    qd_err_argument     = 6,    /* A function was given an invalid argument or option. */
+};
+
+#define QD_ERROR_NO_OFFSET      (-1L)
+#define QD_ERROR_NO_OPCODE      (-1)
+#define QD_ERROR_MESSAGE_SIZE   128
+
+/* Describes why a call failed. Functions that can fail take an optional error
+ * object, which keeps the first error raised into it until it is cleared, so that
+ * the cause of a failure is not replaced by the failures of the functions that
+ * called it. The offset is the position in the data being read, and the opcode is
+ * the PICT opcode being read, when they are known.
+ *
+ * The library never writes to stderr itself. Every error raised is also passed to
+ * log, when it is set, on the thread that called into the library. */
+struct qd_error
+{
+    enum qd_err code;
+    long offset;
+    int32_t opcode;
+    char message[QD_ERROR_MESSAGE_SIZE];
+    void (*log)(void *context, const struct qd_error *error);
+    void *log_context;
+};
+
+/* Returns a short description of an error code, such as "truncated data". */
+const char *qd_err_string(enum qd_err code);
+
+/* Raises an error into the error object, which may be NULL. The message is
+ * formatted with printf conventions. Always returns 1, so that it can be returned
+ * from a failing function directly. */
+int qd_error_raise(struct qd_error *error, enum qd_err code, long offset, int32_t opcode, const char *format, ...);
+int qd_error_vraise(struct qd_error *error, enum qd_err code, long offset, int32_t opcode, const char *format, va_list args);
+
+/* Forgets the error that has been raised, keeping the log callback. */
+void qd_error_clear(struct qd_error *error);
+
+#endif
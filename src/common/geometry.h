@@ -44,4 +44,10 @@ static inline short qd_rect_get_height(struct qd_rect r)
 	return r.bottom - r.top;
 }
 
+static inline struct qd_rect qd_rect_offset(struct qd_rect r, short dh, short dv)
+{
+	struct qd_rect result = { r.top + dv, r.left + dh, r.bottom + dv, r.right + dh };
+	return result;
+}
+
 #endif
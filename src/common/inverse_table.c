@@ -0,0 +1,158 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include "common/inverse_table.h"
+#include "common/color_table.h"
+
+// MARK: - Construction
+
+struct qd_inverse_table *qd_inverse_table_create_with_colors(const struct qd_inverse_table_color *colors, uint32_t count, unsigned int resolution)
+{
+    struct qd_inverse_table *table = NULL;
+
+    if (resolution < qd_inverse_table_min_resolution || resolution > qd_inverse_table_max_resolution) {
+        goto ERROR;
+    }
+
+    if (count == 0 || count > 256) {
+        goto ERROR;
+    }
+
+    uint32_t cells = 1u << resolution;
+    if (!(table = calloc(1, sizeof(*table))) || !(table->indices = malloc((size_t)cells * cells * cells))) {
+        goto ERROR;
+    }
+    table->resolution = resolution;
+
+    // The dither spread approximates the distance between neighbouring colors,
+    // assuming that the colors are spread evenly over the color cube.
+    uint32_t side = 1;
+    while (side * side * side < count) {
+        side++;
+    }
+    table->spread = 256 / side;
+
+    // Find the nearest color to the center of each cell. The distance is split
+    // by channel so that the red and green terms are only computed once for each
+    // row of cells.
+    uint32_t dist_rg[256];
+    uint8_t *out = table->indices;
+    unsigned int shift = 8 - resolution;
+    for (uint32_t r = 0; r < cells; ++r) {
+        int cr = (int)((r << shift) | (1u << (shift - 1)));
+        for (uint32_t g = 0; g < cells; ++g) {
+            int cg = (int)((g << shift) | (1u << (shift - 1)));
+            for (uint32_t i = 0; i < count; ++i) {
+                int dr = cr - colors[i].red;
+                int dg = cg - colors[i].green;
+                dist_rg[i] = (uint32_t)(dr * dr + dg * dg);
+            }
+
+            for (uint32_t b = 0; b < cells; ++b) {
+                int cb = (int)((b << shift) | (1u << (shift - 1)));
+                uint32_t best = UINT32_MAX;
+                uint8_t index = colors[0].index;
+                for (uint32_t i = 0; i < count; ++i) {
+                    int db = cb - colors[i].blue;
+                    uint32_t d = dist_rg[i] + (uint32_t)(db * db);
+                    if (d < best) {
+                        best = d;
+                        index = colors[i].index;
+                    }
+                }
+                *out++ = index;
+            }
+        }
+    }
+
+    return table;
+
+ERROR:
+    qd_inverse_table_free(table);
+    return NULL;
+}
+
+struct qd_inverse_table *qd_inverse_table_create(const struct qd_color_table *color_table, unsigned int resolution)
+{
+    struct qd_inverse_table_color colors[256];
+    uint32_t count = qd_color_table_get_colors(color_table, colors);
+    return qd_inverse_table_create_with_colors(colors, count, resolution);
+}
+
+void qd_inverse_table_free(struct qd_inverse_table *table)
+{
+    if (table) {
+        free(table->indices);
+        free(table);
+    }
+}
+
+// MARK: - Conversion
+
+static const uint8_t qd_bayer_4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+static inline uint8_t qd_dither_channel(uint8_t value, int offset)
+{
+    int v = value + offset;
+    return (uint8_t)(v < 0 ? 0 : (v > UINT8_MAX ? UINT8_MAX : v));
+}
+
+int qd_inverse_table_convert(
+    const struct qd_inverse_table *table,
+    uint8_t *out,
+    size_t out_row_bytes,
+    const struct qd_surface *surface,
+    int mode
+) {
+    if (out_row_bytes < surface->width) {
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < surface->height; ++y) {
+        const uint8_t *p = (const uint8_t *)surface->data + y * surface->row_bytes;
+        uint8_t *o = out + y * out_row_bytes;
+
+        if (mode == qd_inverse_table_ordered_dither) {
+            // Scale the pattern so that it spans one color step, centered on zero.
+            int offsets[4];
+            for (int x = 0; x < 4; ++x) {
+                offsets[x] = ((2 * qd_bayer_4x4[y & 3][x] - 15) * (int)table->spread) / 32;
+            }
+            for (uint32_t x = 0; x < surface->width; ++x, p += 4) {
+                int d = offsets[x & 3];
+                o[x] = qd_inverse_table_lookup(table, qd_dither_channel(p[0], d), qd_dither_channel(p[1], d), qd_dither_channel(p[2], d));
+            }
+        }
+        else {
+            for (uint32_t x = 0; x < surface->width; ++x, p += 4) {
+                o[x] = qd_inverse_table_lookup(table, p[0], p[1], p[2]);
+            }
+        }
+    }
+
+    return 0;
+}
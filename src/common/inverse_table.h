@@ -0,0 +1,84 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+
+#if !defined(libQuickDraw_InverseTable)
+#define libQuickDraw_InverseTable
+
+/* An inverse table maps quantized RGB colors back to the index of the nearest
+ * color of a color table, in the manner of the Color Manager's ITab. Each channel
+ * is reduced to resolution bits, so the table holds 1 << (3 * resolution) indices
+ * and converting a pixel is a single lookup. */
+struct qd_inverse_table
+{
+    unsigned int resolution;
+    unsigned int spread;
+    uint8_t *indices;
+};
+
+struct qd_inverse_table_color
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t index;
+};
+
+enum
+{
+    qd_inverse_table_min_resolution = 3,
+    qd_inverse_table_max_resolution = 6,
+    qd_inverse_table_default_resolution = 5,
+};
+
+enum
+{
+    qd_inverse_table_nearest = 0,
+    qd_inverse_table_ordered_dither = 1,
+};
+
+struct qd_inverse_table *qd_inverse_table_create(const struct qd_color_table *color_table, unsigned int resolution);
+
+/* Builds an inverse table from a list of colors and the indices that they map
+ * back to. As indices are 8 bits, there can be between 1 and 256 colors, and any
+ * other count is rejected by returning NULL. */
+struct qd_inverse_table *qd_inverse_table_create_with_colors(const struct qd_inverse_table_color *colors, uint32_t count, unsigned int resolution);
+void qd_inverse_table_free(struct qd_inverse_table *table);
+
+static inline uint8_t qd_inverse_table_lookup(const struct qd_inverse_table *table, uint8_t r, uint8_t g, uint8_t b)
+{
+    unsigned int res = table->resolution;
+    unsigned int shift = 8 - res;
+    return table->indices[((uint32_t)(r >> shift) << (2 * res)) | ((uint32_t)(g >> shift) << res) | (b >> shift)];
+}
+
+/* Converts a surface to 8 bit indices, one byte per pixel. When dithering, an
+ * ordered 4x4 Bayer pattern is added to each pixel before the lookup. */
+int qd_inverse_table_convert(
+    const struct qd_inverse_table *table,
+    uint8_t *out,
+    size_t out_row_bytes,
+    const struct qd_surface *surface,
+    int mode
+);
+
+#endif
@@ -0,0 +1,316 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/palette.h"
+#include "common/color_table.h"
+#include "common/inverse_table.h"
+#include "internal/hash.h"
+#include "internal/pixel.h"
+
+// MARK: - Palette Cache Constants
+
+#define QD_PALETTE_CACHE_BUCKETS    64
+#define QD_PALETTE_CACHE_CAPACITY   128
+
+/* Each palette is wrapped in an entry that carries its reference count. The
+ * cache owns one reference to each of the palettes in it, and the entries are
+ * kept in least recently used order for eviction. */
+struct qd_palette_entry
+{
+    struct qd_palette palette;
+    uint32_t references;
+    int cached;
+    uint8_t *raw;
+    size_t raw_length;
+    struct qd_inverse_table_color defined[256];
+    uint32_t defined_count;
+    struct qd_inverse_table *inverse;
+    struct qd_palette_entry *next_in_bucket;
+    struct qd_palette_entry *lru_prev;
+    struct qd_palette_entry *lru_next;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    struct qd_palette_entry *buckets[QD_PALETTE_CACHE_BUCKETS];
+    struct qd_palette_entry *lru_head;
+    struct qd_palette_entry *lru_tail;
+    uint32_t count;
+} qd_palette_cache = { PTHREAD_MUTEX_INITIALIZER };
+
+// MARK: - Palette Construction
+
+static struct qd_palette_entry *qd_palette_entry_create(const struct qd_color_table *color_table, uint32_t format)
+{
+    if (qd_pixel_format_bytes(format) == 0) {
+        return NULL;
+    }
+
+    struct qd_palette_entry *entry = calloc(1, sizeof(*entry));
+    if (!entry) {
+        return NULL;
+    }
+    entry->references = 1;
+
+    struct qd_palette *palette = &entry->palette;
+    palette->ct_seed = color_table->ct_seed;
+    palette->ct_flags = color_table->ct_flags;
+    palette->ct_size = color_table->ct_size;
+    palette->format = format;
+
+    // Entries that the color table does not define are left as opaque black.
+    uint32_t black = qd_pixel_pack_format(format, 0, 0, 0, UINT8_MAX);
+    for (int i = 0; i < 256; ++i) {
+        palette->colors[i] = black;
+    }
+
+    entry->defined_count = qd_color_table_get_colors(color_table, entry->defined);
+    for (uint32_t n = 0; n < entry->defined_count; ++n) {
+        const struct qd_inverse_table_color *c = &entry->defined[n];
+        palette->colors[c->index] = qd_pixel_pack_format(format, c->red, c->green, c->blue, UINT8_MAX);
+    }
+
+    return entry;
+}
+
+static void qd_palette_entry_free(struct qd_palette_entry *entry)
+{
+    if (entry) {
+        qd_inverse_table_free(entry->inverse);
+        free(entry->raw);
+        free(entry);
+    }
+}
+
+struct qd_palette *qd_palette_create(const struct qd_color_table *color_table, uint32_t format)
+{
+    struct qd_palette_entry *entry = qd_palette_entry_create(color_table, format);
+    return entry ? &entry->palette : NULL;
+}
+
+void qd_palette_release(const struct qd_palette *palette)
+{
+    if (!palette) {
+        return;
+    }
+
+    struct qd_palette_entry *entry = (struct qd_palette_entry *)palette;
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    uint32_t references = --entry->references;
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+
+    if (references == 0) {
+        qd_palette_entry_free(entry);
+    }
+}
+
+const struct qd_inverse_table *qd_palette_inverse_table(const struct qd_palette *palette)
+{
+    struct qd_palette_entry *entry = (struct qd_palette_entry *)palette;
+
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    struct qd_inverse_table *inverse = entry->inverse;
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+    if (inverse) {
+        return inverse;
+    }
+
+    // Build the table outside of the lock, keeping the first one to be published
+    // if several threads build it at once.
+    inverse = qd_inverse_table_create_with_colors(entry->defined, entry->defined_count, qd_inverse_table_default_resolution);
+    if (!inverse) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    struct qd_inverse_table *existing = entry->inverse;
+    if (!existing) {
+        entry->inverse = inverse;
+    }
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+
+    if (existing) {
+        qd_inverse_table_free(inverse);
+        return existing;
+    }
+    return inverse;
+}
+
+// MARK: - Palette Cache
+
+static inline uint32_t qd_palette_bucket(uint64_t hash, uint32_t format)
+{
+    return (uint32_t)((hash ^ format) % QD_PALETTE_CACHE_BUCKETS);
+}
+
+static void qd_palette_lru_unlink(struct qd_palette_entry *entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else {
+        qd_palette_cache.lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else {
+        qd_palette_cache.lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void qd_palette_lru_push(struct qd_palette_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = qd_palette_cache.lru_head;
+    if (qd_palette_cache.lru_head) {
+        qd_palette_cache.lru_head->lru_prev = entry;
+    }
+    qd_palette_cache.lru_head = entry;
+    if (!qd_palette_cache.lru_tail) {
+        qd_palette_cache.lru_tail = entry;
+    }
+}
+
+// Removes an entry from the cache, returning it if the reference held by the
+// cache was the last one. Must be called with the cache locked.
+static struct qd_palette_entry *qd_palette_cache_remove(struct qd_palette_entry *entry)
+{
+    uint32_t bucket = qd_palette_bucket(entry->palette.hash, entry->palette.format);
+    struct qd_palette_entry **link = &qd_palette_cache.buckets[bucket];
+    while (*link && *link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    if (*link) {
+        *link = entry->next_in_bucket;
+    }
+
+    qd_palette_lru_unlink(entry);
+    entry->cached = 0;
+    entry->next_in_bucket = NULL;
+    qd_palette_cache.count--;
+
+    return --entry->references == 0 ? entry : NULL;
+}
+
+// Finds an entry and takes a reference to it. Must be called with the cache locked.
+static struct qd_palette_entry *qd_palette_cache_find(int32_t seed, uint64_t hash, uint32_t format, const uint8_t *raw, size_t length)
+{
+    struct qd_palette_entry *entry = qd_palette_cache.buckets[qd_palette_bucket(hash, format)];
+    for (; entry; entry = entry->next_in_bucket) {
+        if (entry->palette.hash == hash && entry->palette.ct_seed == seed && entry->palette.format == format
+            && entry->raw_length == length && memcmp(entry->raw, raw, length) == 0) {
+            entry->references++;
+            qd_palette_lru_unlink(entry);
+            qd_palette_lru_push(entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+const struct qd_palette *qd_palette_read(struct qd_buffer *restrict buffer, uint32_t format)
+{
+    // Work out the extent of the color table from its header, so that it can be
+    // identified without being parsed.
+    const uint8_t *header = qd_buffer_peek(buffer, 8);
+    if (!header) {
+        return NULL;
+    }
+
+    int32_t seed = (int32_t)(((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3]);
+    int16_t size = (int16_t)((header[6] << 8) | header[7]);
+    size_t length = 8 + (size_t)(size + 1) * 8;
+    const uint8_t *raw = qd_buffer_peek(buffer, length);
+    if (!raw || size < -1) {
+        return NULL;
+    }
+
+    uint64_t hash = qd_hash64(raw, length, 0);
+
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    struct qd_palette_entry *entry = qd_palette_cache_find(seed, hash, format, raw, length);
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+
+    if (entry) {
+        qd_buffer_seek(buffer, (long)length, SEEK_CUR);
+        return &entry->palette;
+    }
+
+    // Not seen before. Parse and prepare the palette outside of the lock.
+    struct qd_color_table *color_table = qd_color_table_parse(buffer);
+    if (!color_table) {
+        return NULL;
+    }
+    entry = qd_palette_entry_create(color_table, format);
+    qd_color_table_free(color_table);
+    if (!entry || !(entry->raw = malloc(length))) {
+        qd_palette_entry_free(entry);
+        return NULL;
+    }
+    memcpy(entry->raw, raw, length);
+    entry->raw_length = length;
+    entry->palette.hash = hash;
+
+    // Another thread may have inserted the same palette in the meantime, in which
+    // case that one is used instead.
+    struct qd_palette_entry *evicted = NULL;
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    struct qd_palette_entry *existing = qd_palette_cache_find(seed, hash, format, raw, length);
+    if (!existing) {
+        uint32_t bucket = qd_palette_bucket(hash, format);
+        entry->next_in_bucket = qd_palette_cache.buckets[bucket];
+        qd_palette_cache.buckets[bucket] = entry;
+        qd_palette_lru_push(entry);
+        entry->cached = 1;
+        entry->references++;
+        qd_palette_cache.count++;
+
+        if (qd_palette_cache.count > QD_PALETTE_CACHE_CAPACITY) {
+            evicted = qd_palette_cache_remove(qd_palette_cache.lru_tail);
+        }
+    }
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+
+    qd_palette_entry_free(evicted);
+    if (existing) {
+        qd_palette_entry_free(entry);
+        return &existing->palette;
+    }
+    return &entry->palette;
+}
+
+void qd_palette_cache_purge(void)
+{
+    pthread_mutex_lock(&qd_palette_cache.lock);
+    while (qd_palette_cache.lru_head) {
+        struct qd_palette_entry *entry = qd_palette_cache_remove(qd_palette_cache.lru_head);
+        qd_palette_entry_free(entry);
+    }
+    pthread_mutex_unlock(&qd_palette_cache.lock);
+}
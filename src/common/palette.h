@@ -0,0 +1,63 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+#include "common/inverse_table.h"
+#include "internal/buffer.h"
+
+#if !defined(libQuickDraw_Palette)
+#define libQuickDraw_Palette
+
+/* A palette is a color table that has been prepared for drawing: each of the
+ * 256 possible pixel values maps directly to a pixel in the target format. The
+ * pixel bytes occupy the start of each color word in memory. */
+struct qd_palette
+{
+    int32_t ct_seed;
+    short ct_flags;
+    short ct_size;
+    uint32_t format;
+    uint64_t hash;
+    uint32_t colors[256];
+};
+
+/* Builds a palette for a parsed color table. The palette is not shared, but is
+ * still released with qd_palette_release(). */
+struct qd_palette *qd_palette_create(const struct qd_color_table *color_table, uint32_t format);
+
+/* Reads a color table from the buffer, returning the prepared palette for it.
+ * Palettes are held in a process wide cache keyed by the seed and the content of
+ * the color table, so color tables that have been seen before are neither parsed
+ * nor converted again. The buffer is left after the color table. */
+const struct qd_palette *qd_palette_read(struct qd_buffer *restrict buffer, uint32_t format);
+
+void qd_palette_release(const struct qd_palette *palette);
+
+/* Returns the inverse table of the palette's color table, for converting RGB
+ * colors back to pixel values. It is built on first use and lives as long as the
+ * palette, so cached palettes share a single inverse table. */
+const struct qd_inverse_table *qd_palette_inverse_table(const struct qd_palette *palette);
+
+/* Drops every palette from the cache. Palettes that are still in use remain valid
+ * until they are released. */
+void qd_palette_cache_purge(void);
+
+#endif
@@ -0,0 +1,196 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common/pattern.h"
+#include "common/geometry.h"
+
+// MARK: - Tiles
+
+static int qd_tile_alloc(struct qd_tile *tile, uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0) {
+        return 1;
+    }
+
+    uint32_t repeats = (QD_TILE_SPAN + width - 1) / width;
+    uint32_t span = (repeats + 1) * width;
+    uint32_t *pixels = malloc((size_t)span * height * sizeof(*pixels));
+    if (!pixels) {
+        return 1;
+    }
+
+    free(tile->pixels);
+    tile->width = width;
+    tile->height = height;
+    tile->span = span;
+    tile->pixels = pixels;
+    return 0;
+}
+
+static void qd_tile_replicate_rows(struct qd_tile *tile)
+{
+    for (uint32_t y = 0; y < tile->height; ++y) {
+        uint32_t *row = tile->pixels + (size_t)y * tile->span;
+        for (uint32_t x = tile->width; x < tile->span; x += tile->width) {
+            memcpy(row + x, row, tile->width * sizeof(*row));
+        }
+    }
+}
+
+int qd_tile_init_pattern(struct qd_tile *tile, const struct qd_pattern *pattern, uint32_t fg, uint32_t bk)
+{
+    if (qd_tile_alloc(tile, 8, 8)) {
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < 8; ++y) {
+        uint32_t *row = tile->pixels + (size_t)y * tile->span;
+        for (uint32_t x = 0; x < 8; ++x) {
+            row[x] = (pattern->pat[y] & (0x80 >> x)) ? fg : bk;
+        }
+    }
+
+    qd_tile_replicate_rows(tile);
+    return 0;
+}
+
+int qd_tile_init_pixels(struct qd_tile *tile, const uint32_t *pixels, uint32_t width, uint32_t height, size_t row_bytes)
+{
+    if (qd_tile_alloc(tile, width, height)) {
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < height; ++y) {
+        memcpy(tile->pixels + (size_t)y * tile->span, (const uint8_t *)pixels + y * row_bytes, width * sizeof(*pixels));
+    }
+
+    qd_tile_replicate_rows(tile);
+    return 0;
+}
+
+void qd_tile_destroy(struct qd_tile *tile)
+{
+    if (tile) {
+        free(tile->pixels);
+        memset(tile, 0, sizeof(*tile));
+    }
+}
+
+// MARK: - Filling
+
+static inline uint32_t qd_tile_phase(long v, uint32_t size)
+{
+    long m = v % (long)size;
+    return (uint32_t)(m < 0 ? m + (long)size : m);
+}
+
+int qd_tile_fill(
+    const struct qd_tile *tile,
+    struct qd_surface *dst,
+    struct qd_rect rect,
+    long origin_h,
+    long origin_v,
+    const struct qd_transfer *transfer
+) {
+    long top = rect.top < 0 ? 0 : rect.top;
+    long left = rect.left < 0 ? 0 : rect.left;
+    long bottom = rect.bottom > (long)dst->height ? (long)dst->height : rect.bottom;
+    long right = rect.right > (long)dst->width ? (long)dst->width : rect.right;
+    if (left >= right || top >= bottom) {
+        return 0;
+    }
+
+    // Patterns are combined using the same operations as the source modes.
+    struct qd_transfer copy = { .mode = qd_pat_copy, .bk_color = { 0xFFFF, 0xFFFF, 0xFFFF } };
+    if (!transfer) {
+        transfer = &copy;
+    }
+
+    struct qd_transfer source_transfer = *transfer;
+    short mode = transfer->mode & ~qd_dither_copy;
+    if (mode >= qd_pat_copy && mode <= qd_not_pat_bic) {
+        source_transfer.mode = (short)(mode - qd_pat_copy);
+    }
+
+    struct qd_blit_state state;
+    int direct = (source_transfer.mode & ~qd_dither_copy) == qd_src_copy;
+    if (!direct && qd_blit_state_init(&state, &source_transfer)) {
+        return 1;
+    }
+
+    // Each stored row of the tile can supply this many pixels from any phase, and
+    // as it is a whole number of repeats the phase is the same for every run.
+    uint32_t run = tile->span - tile->width;
+    size_t width = (size_t)(right - left);
+    uint32_t phase = qd_tile_phase(left - origin_h, tile->width);
+
+    for (long y = top; y < bottom; ++y) {
+        const uint32_t *src = tile->pixels + (size_t)qd_tile_phase(y - origin_v, tile->height) * tile->span + phase;
+        uint32_t *out = (uint32_t *)((uint8_t *)dst->data + y * dst->row_bytes) + left;
+        for (size_t x = 0; x < width; x += run) {
+            size_t count = (width - x < run) ? width - x : run;
+            if (direct) {
+                memcpy(out + x, src, count * sizeof(*out));
+            }
+            else {
+                qd_blit_row(&state, out + x, src, count);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// MARK: - Port Patterns
+
+int qd_port_pattern_set(struct qd_port_pattern *pattern, const struct qd_pattern *pat, uint32_t fg, uint32_t bk)
+{
+    pattern->pat = *pat;
+    pattern->is_color = 0;
+    pattern->fg = fg;
+    pattern->bk = bk;
+    return qd_tile_init_pattern(&pattern->tile, pat, fg, bk);
+}
+
+int qd_port_pattern_set_pixels(struct qd_port_pattern *pattern, const uint32_t *pixels, uint32_t width, uint32_t height, size_t row_bytes)
+{
+    pattern->is_color = 1;
+    return qd_tile_init_pixels(&pattern->tile, pixels, width, height, row_bytes);
+}
+
+const struct qd_tile *qd_port_pattern_tile(struct qd_port_pattern *pattern, uint32_t fg, uint32_t bk)
+{
+    if (!pattern->is_color && (!pattern->tile.pixels || pattern->fg != fg || pattern->bk != bk)) {
+        if (qd_port_pattern_set(pattern, &pattern->pat, fg, bk)) {
+            return NULL;
+        }
+    }
+    return &pattern->tile;
+}
+
+void qd_port_pattern_destroy(struct qd_port_pattern *pattern)
+{
+    if (pattern) {
+        qd_tile_destroy(&pattern->tile);
+    }
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+#include "common/blit.h"
+
+#if !defined(libQuickDraw_Pattern)
+#define libQuickDraw_Pattern
+
+enum
+{
+    qd_pixpat_old_pattern           = 0,
+    qd_pixpat_color_pattern         = 1,
+    qd_pixpat_dither_pattern        = 2,
+};
+
+/* A tile is a pattern that has been expanded to surface pixels. Each stored row
+ * holds the pattern repeated out to at least QD_TILE_SPAN pixels, plus one more
+ * repeat, so that a run of span - width pixels can be copied from any phase of
+ * the pattern. Filling a row is then a series of straight copies. */
+#define QD_TILE_SPAN    64
+
+struct qd_tile
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t span;
+    uint32_t *pixels;
+};
+
+int qd_tile_init_pattern(struct qd_tile *tile, const struct qd_pattern *pattern, uint32_t fg, uint32_t bk);
+int qd_tile_init_pixels(struct qd_tile *tile, const uint32_t *pixels, uint32_t width, uint32_t height, size_t row_bytes);
+void qd_tile_destroy(struct qd_tile *tile);
+
+/* Fills the rect of the surface with the tile. The pattern is aligned so that its
+ * origin falls on the given surface coordinates. The transfer may use either the
+ * pattern or the source modes, and defaults to patCopy. */
+int qd_tile_fill(
+    const struct qd_tile *tile,
+    struct qd_surface *dst,
+    struct qd_rect rect,
+    long origin_h,
+    long origin_v,
+    const struct qd_transfer *transfer
+);
+
+/* The pattern of a graphics port. A 1 bit pattern is drawn in the foreground and
+ * background colors of the port, and is expanded when it is set and again only
+ * when those colors change. A color pattern is expanded once. */
+struct qd_port_pattern
+{
+    struct qd_pattern pat;
+    int is_color;
+    uint32_t fg;
+    uint32_t bk;
+    struct qd_tile tile;
+};
+
+int qd_port_pattern_set(struct qd_port_pattern *pattern, const struct qd_pattern *pat, uint32_t fg, uint32_t bk);
+int qd_port_pattern_set_pixels(struct qd_port_pattern *pattern, const uint32_t *pixels, uint32_t width, uint32_t height, size_t row_bytes);
+const struct qd_tile *qd_port_pattern_tile(struct qd_port_pattern *pattern, uint32_t fg, uint32_t bk);
+void qd_port_pattern_destroy(struct qd_port_pattern *pattern);
+
+#endif
@@ -20,8 +20,12 @@
  */
 
 #include <stdlib.h>
+#include "common/geometry.h"
 #include "common/pixmap.h"
 
+static int qd_pixmap_parse_fields(struct qd_pixmap *pm, struct qd_buffer *restrict buffer);
+static int qd_pixmap_validate_row_bytes(const struct qd_pixmap *pm);
+
 int qd_pixmap_parse(struct qd_pixmap **out_pm, struct qd_buffer *restrict buffer)
 {
     struct qd_pixmap *pm = calloc(1, sizeof(*pm));
@@ -30,86 +34,136 @@ int qd_pixmap_parse(struct qd_pixmap **out_pm, struct qd_buffer *restrict buffer
     }
 
     if (qd_buffer_read(&pm->base_addr, sizeof(uint32_t), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read base address of pixmap.\n");
         goto ERROR;
     }
 
     if (qd_buffer_read(&pm->row_bytes, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the row_bytes of pixmap.\n");
         goto ERROR;
     }
     pm->row_bytes &= 0x7FFF;
 
     if (qd_buffer_read(&pm->bounds, sizeof(short), 4, buffer) != 4) {
-        fprintf(stderr, "Failed to read the bounds of the pixmap.\n");
         goto ERROR;
     }
 
-    if (qd_buffer_read(&pm->pm_version, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the pixmap version.\n");
+    if (qd_pixmap_parse_fields(pm, buffer)) {
         goto ERROR;
     }
 
-    if (qd_buffer_read(&pm->pack_type, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the pixmap pack type.\n");
+    return 0;
+
+ERROR:
+	qd_pixmap_free(pm);
+	return 1;
+}
+
+int qd_pixmap_parse_bits(struct qd_pixmap **out_pm, int *is_pixmap, struct qd_buffer *restrict buffer)
+{
+    struct qd_pixmap *pm = calloc(1, sizeof(*pm));
+    if (out_pm) {
+        *out_pm = pm;
+    }
+
+    // The bitmap opcodes of a PICT omit the base address. The top bit of the
+    // row_bytes indicates whether a full PixMap follows, or a plain BitMap.
+    if (qd_buffer_read(&pm->row_bytes, sizeof(short), 1, buffer) != 1) {
         goto ERROR;
     }
+    *is_pixmap = (pm->row_bytes & 0x8000) != 0;
+    pm->row_bytes &= 0x7FFF;
 
-    if (qd_buffer_read(&pm->pack_size, sizeof(int32_t), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the pixmap pack size.\n");
+    if (qd_buffer_read(&pm->bounds, sizeof(short), 4, buffer) != 4) {
         goto ERROR;
     }
 
-    if (qd_buffer_read_fixed(&pm->h_res, 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the horizontal resolution from the pixmap.\n");
+    if (!*is_pixmap) {
+        // A BitMap is always 1-bit monochrome.
+        pm->h_res = 72;
+        pm->v_res = 72;
+        pm->pixel_size = 1;
+        pm->cmp_count = 1;
+        pm->cmp_size = 1;
+        pm->pixel_format = qd_1_monochrome_pixel_format;
+    }
+    else if (qd_pixmap_parse_fields(pm, buffer)) {
         goto ERROR;
     }
 
-    if (qd_buffer_read_fixed(&pm->v_res, 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the vertical resolution from the pixmap.\n");
+    // The pixel data of these opcodes is sized by the row bytes alone, so each
+    // row needs to hold every pixel of the bounds.
+    if (qd_pixmap_validate_row_bytes(pm)) {
         goto ERROR;
     }
 
+    return 0;
+
+ERROR:
+	qd_pixmap_free(pm);
+	return 1;
+}
+
+static int qd_pixmap_parse_fields(struct qd_pixmap *pm, struct qd_buffer *restrict buffer)
+{
+    if (qd_buffer_read(&pm->pm_version, sizeof(short), 1, buffer) != 1) {
+        return 1;
+    }
+
+    if (qd_buffer_read(&pm->pack_type, sizeof(short), 1, buffer) != 1) {
+        return 1;
+    }
+
+    if (qd_buffer_read(&pm->pack_size, sizeof(int32_t), 1, buffer) != 1) {
+        return 1;
+    }
+
+    if (qd_buffer_read_fixed(&pm->h_res, 1, buffer) != 1) {
+        return 1;
+    }
+
+    if (qd_buffer_read_fixed(&pm->v_res, 1, buffer) != 1) {
+        return 1;
+    }
+
     if (qd_buffer_read(&pm->pixel_type, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the pixel type for the pixmap.\n");
-        goto ERROR;
+        return 1;
     }
 
     if (qd_buffer_read(&pm->pixel_size, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the pixel size for the pixmap.\n");
-        goto ERROR;
+        return 1;
     }
 
     if (qd_buffer_read(&pm->cmp_count, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the component count for the pixmap.\n");
-        goto ERROR;
+        return 1;
     }
 
     if (qd_buffer_read(&pm->cmp_size, sizeof(short), 1, buffer) != 1) {
-        fprintf(stderr, "Failed to read the component size for the pixmap.\n");
-        goto ERROR;
+        return 1;
     }
 
     if (qd_buffer_read(&pm->pixel_format, sizeof(uint32_t), 1, buffer) != 1) {
-    	fprintf(stderr, "Failed to read the pixel format from the pixmap.\n");
-    	goto ERROR;
+    	return 1;
     }
 
     if (qd_buffer_read(&pm->pm_table, sizeof(uint32_t), 1, buffer) != 1) {
-    	fprintf(stderr, "Failed to read the pixmap color table handle.\n");
-    	goto ERROR;
+    	return 1;
     }
 
     if (qd_buffer_read(&pm->pm_extension, sizeof(uint32_t), 1, buffer) != 1) {
-    	fprintf(stderr, "Failed to read the extension for the pixmap.\n");
-    	goto ERROR;
+    	return 1;
     }
 
     return 0;
+}
 
-ERROR:
-	qd_pixmap_free(pm);
-	return 1;
+static int qd_pixmap_validate_row_bytes(const struct qd_pixmap *pm)
+{
+    short width = qd_rect_get_width(pm->bounds);
+    short height = qd_rect_get_height(pm->bounds);
+    if (width < 0 || height < 0 || pm->pixel_size < 0) {
+        return 1;
+    }
+
+    return pm->row_bytes < ((uint32_t)width * (uint32_t)pm->pixel_size + 7) / 8;
 }
 
 void qd_pixmap_free(struct qd_pixmap *pm)
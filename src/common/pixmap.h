@@ -26,6 +26,7 @@
 #define libQuickDraw_PixMap
 
 int qd_pixmap_parse(struct qd_pixmap **pm, struct qd_buffer *restrict buffer);
+int qd_pixmap_parse_bits(struct qd_pixmap **pm, int *is_pixmap, struct qd_buffer *restrict buffer);
 void qd_pixmap_free(struct qd_pixmap *pm);
 
 #endif
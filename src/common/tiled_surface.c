@@ -0,0 +1,173 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common/tiled_surface.h"
+
+#define QD_SURFACE_TILE_PIXELS  ((size_t)QD_SURFACE_TILE_SIZE * QD_SURFACE_TILE_SIZE)
+
+int qd_tiled_surface_init(struct qd_tiled_surface *surface, uint32_t width, uint32_t height, uint32_t background)
+{
+    if (!surface || width == 0 || height == 0) {
+        return 1;
+    }
+
+    uint32_t columns = (uint32_t)(((uint64_t)width + QD_SURFACE_TILE_SIZE - 1) >> QD_SURFACE_TILE_SHIFT);
+    uint32_t rows = (uint32_t)(((uint64_t)height + QD_SURFACE_TILE_SIZE - 1) >> QD_SURFACE_TILE_SHIFT);
+    uint64_t count = (uint64_t)columns * rows;
+    if (count > SIZE_MAX / sizeof(uint32_t *)) {
+        return 1;
+    }
+
+    uint32_t **tiles = calloc((size_t)count, sizeof(*tiles));
+    if (!tiles) {
+        return 1;
+    }
+
+    surface->width = width;
+    surface->height = height;
+    surface->columns = columns;
+    surface->rows = rows;
+    surface->background = background;
+    surface->tile_count = 0;
+    surface->tiles = tiles;
+    return 0;
+}
+
+void qd_tiled_surface_destroy(struct qd_tiled_surface *surface)
+{
+    if (surface && surface->tiles) {
+        size_t count = (size_t)surface->columns * surface->rows;
+        for (size_t n = 0; n < count; ++n) {
+            free(surface->tiles[n]);
+        }
+        free(surface->tiles);
+        surface->tiles = NULL;
+        surface->tile_count = 0;
+    }
+}
+
+uint64_t qd_tiled_surface_bytes(const struct qd_tiled_surface *surface)
+{
+    return (uint64_t)surface->columns * surface->rows * sizeof(uint32_t *)
+        + (uint64_t)surface->tile_count * QD_SURFACE_TILE_PIXELS * sizeof(uint32_t);
+}
+
+int qd_tiled_surface_get_tile(struct qd_tiled_surface *surface, uint32_t column, uint32_t row, struct qd_surface *tile)
+{
+    if (column >= surface->columns || row >= surface->rows) {
+        return 1;
+    }
+
+    uint32_t **pixels = &surface->tiles[(size_t)row * surface->columns + column];
+    if (!*pixels) {
+        if (!(*pixels = malloc(QD_SURFACE_TILE_PIXELS * sizeof(uint32_t)))) {
+            return 1;
+        }
+        for (size_t n = 0; n < QD_SURFACE_TILE_PIXELS; ++n) {
+            (*pixels)[n] = surface->background;
+        }
+        surface->tile_count++;
+    }
+
+    uint32_t left = column << QD_SURFACE_TILE_SHIFT;
+    uint32_t top = row << QD_SURFACE_TILE_SHIFT;
+    tile->data = *pixels;
+    tile->width = (surface->width - left < QD_SURFACE_TILE_SIZE) ? surface->width - left : QD_SURFACE_TILE_SIZE;
+    tile->height = (surface->height - top < QD_SURFACE_TILE_SIZE) ? surface->height - top : QD_SURFACE_TILE_SIZE;
+    tile->row_bytes = QD_SURFACE_TILE_SIZE * sizeof(uint32_t);
+    return 0;
+}
+
+int qd_tiled_surface_draw(
+    struct qd_tiled_surface *surface,
+    struct qd_rect rect,
+    qd_tiled_surface_draw_function draw,
+    void *context
+) {
+    long top = rect.top < 0 ? 0 : rect.top;
+    long left = rect.left < 0 ? 0 : rect.left;
+    long bottom = rect.bottom > (long)surface->height ? (long)surface->height : rect.bottom;
+    long right = rect.right > (long)surface->width ? (long)surface->width : rect.right;
+    if (left >= right || top >= bottom) {
+        return 0;
+    }
+
+    // Tiles are visited a row at a time, so that those which are next to each
+    // other in memory are drawn one after the other.
+    for (uint32_t row = (uint32_t)top >> QD_SURFACE_TILE_SHIFT; row <= (uint32_t)(bottom - 1) >> QD_SURFACE_TILE_SHIFT; ++row) {
+        for (uint32_t column = (uint32_t)left >> QD_SURFACE_TILE_SHIFT; column <= (uint32_t)(right - 1) >> QD_SURFACE_TILE_SHIFT; ++column) {
+            struct qd_surface tile;
+            if (qd_tiled_surface_get_tile(surface, column, row, &tile)
+                || draw(context, &tile, (long)column << QD_SURFACE_TILE_SHIFT, (long)row << QD_SURFACE_TILE_SHIFT)) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int qd_tiled_surface_read(
+    const struct qd_tiled_surface *surface,
+    uint32_t left,
+    uint32_t top,
+    uint32_t width,
+    uint32_t height,
+    void *out,
+    size_t row_bytes
+) {
+    if (left > surface->width || width > surface->width - left || top > surface->height || height > surface->height - top) {
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t sy = top + y;
+        uint32_t *const *tiles = surface->tiles + (size_t)(sy >> QD_SURFACE_TILE_SHIFT) * surface->columns;
+        size_t tile_offset = (size_t)(sy & (QD_SURFACE_TILE_SIZE - 1)) << QD_SURFACE_TILE_SHIFT;
+        uint32_t *row = (uint32_t *)((uint8_t *)out + y * row_bytes);
+
+        // Copy the row a tile at a time, filling in the background where no tile
+        // has been allocated.
+        for (uint32_t x = 0; x < width;) {
+            uint32_t sx = left + x;
+            uint32_t phase = sx & (QD_SURFACE_TILE_SIZE - 1);
+            uint32_t count = QD_SURFACE_TILE_SIZE - phase;
+            if (count > width - x) {
+                count = width - x;
+            }
+
+            const uint32_t *tile = tiles[sx >> QD_SURFACE_TILE_SHIFT];
+            if (tile) {
+                memcpy(row + x, tile + tile_offset + phase, count * sizeof(uint32_t));
+            }
+            else {
+                for (uint32_t n = 0; n < count; ++n) {
+                    row[x + n] = surface->background;
+                }
+            }
+            x += count;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+
+#if !defined(libQuickDraw_TiledSurface)
+#define libQuickDraw_TiledSurface
+
+/* A tiled surface stores its pixels in square tiles rather than in one run of
+ * rows, so that drawing into or reading back a small part of a very large surface
+ * only touches the memory of the tiles involved. Tiles are only allocated once
+ * something is drawn into them, and until then read as the background pixel.
+ * Sizes are worked out in 64 bits, so that surfaces too large to be allocated in
+ * one piece can still be described. */
+#define QD_SURFACE_TILE_SHIFT   6
+#define QD_SURFACE_TILE_SIZE    (1U << QD_SURFACE_TILE_SHIFT)
+
+struct qd_tiled_surface
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t background;
+    size_t tile_count;
+    uint32_t **tiles;
+};
+
+int qd_tiled_surface_init(struct qd_tiled_surface *surface, uint32_t width, uint32_t height, uint32_t background);
+void qd_tiled_surface_destroy(struct qd_tiled_surface *surface);
+
+/* Returns the memory held by the surface, which grows as tiles are allocated. */
+uint64_t qd_tiled_surface_bytes(const struct qd_tiled_surface *surface);
+
+/* Sets up a plain surface over the tile at the given column and row, allocating
+ * the tile if it has not been drawn into yet. Tiles on the right and bottom edges
+ * are cut down to the size of the surface. */
+int qd_tiled_surface_get_tile(struct qd_tiled_surface *surface, uint32_t column, uint32_t row, struct qd_surface *tile);
+
+/* Draws into the rect of the surface one tile at a time. The draw function is
+ * called for each tile that the rect overlaps, with a surface over the tile and
+ * the position of the tile within the tiled surface, which it subtracts from the
+ * coordinates it draws at. Drawing stops at the first tile it fails on. */
+typedef int (*qd_tiled_surface_draw_function)(void *context, struct qd_surface *tile, long left, long top);
+
+int qd_tiled_surface_draw(
+    struct qd_tiled_surface *surface,
+    struct qd_rect rect,
+    qd_tiled_surface_draw_function draw,
+    void *context
+);
+
+/* Copies an area of the surface into plain rows of pixels. The area must lie
+ * within the surface. */
+int qd_tiled_surface_read(
+    const struct qd_tiled_surface *surface,
+    uint32_t left,
+    uint32_t top,
+    uint32_t width,
+    uint32_t height,
+    void *out,
+    size_t row_bytes
+);
+
+#endif
@@ -19,6 +19,7 @@
  * SOFTWARE.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if !defined(libQuickDraw_Types)
@@ -37,6 +38,9 @@
 typedef uint32_t                    qd_four_char_code;
 typedef qd_four_char_code           qd_os_type;
 
+#define QD_FOUR_CHAR_CODE(a, b, c, d) \
+    (((qd_four_char_code)(a) << 24) | ((qd_four_char_code)(b) << 16) | ((qd_four_char_code)(c) << 8) | (qd_four_char_code)(d))
+
 /** 
     QuickDraw Types
  **/
@@ -83,11 +87,40 @@ enum
 typedef unsigned char               qd_style;
 typedef short                       qd_style_parameter;
 
-typedef short                       qd_err;
-
 enum
 {
-    qd_src_copy                     = 0
+    /* Boolean Transfer Modes */
+    qd_src_copy                     = 0,
+    qd_src_or                       = 1,
+    qd_src_xor                      = 2,
+    qd_src_bic                      = 3,
+    qd_not_src_copy                 = 4,
+    qd_not_src_or                   = 5,
+    qd_not_src_xor                  = 6,
+    qd_not_src_bic                  = 7,
+
+    /* Pattern Transfer Modes */
+    qd_pat_copy                     = 8,
+    qd_pat_or                       = 9,
+    qd_pat_xor                      = 10,
+    qd_pat_bic                      = 11,
+    qd_not_pat_copy                 = 12,
+    qd_not_pat_or                   = 13,
+    qd_not_pat_xor                  = 14,
+    qd_not_pat_bic                  = 15,
+
+    /* Arithmetic Transfer Modes */
+    qd_blend                        = 32,
+    qd_add_pin                      = 33,
+    qd_add_over                     = 34,
+    qd_sub_pin                      = 35,
+    qd_transparent                  = 36,
+    qd_ad_max                       = 37,
+    qd_sub_over                     = 38,
+    qd_ad_min                       = 39,
+
+    /* Transfer Mode Modifiers */
+    qd_dither_copy                  = 64,
 };
 
 struct qd_bitmap
@@ -147,6 +180,36 @@ enum
     qd_16_555_pixel_format          = 0x10, /* 16 bit Big Endian RGB 555 (Mac) */
     qd_24_rgb_pixel_format          = 0x18, /* 24 bit RGB */
     qd_32_argb_pixel_format         = 0x20, /* 32 bit ARGB (Mac) */
+
+    /* Host Pixel Formats */
+    qd_16_le_555_pixel_format       = 0x4C353535, /* 'L555' 16 bit Little Endian RGB 555 */
+    qd_16_le_565_pixel_format       = 0x4C353635, /* 'L565' 16 bit Little Endian RGB 565 */
+    qd_16_be_565_pixel_format       = 0x42353635, /* 'B565' 16 bit Big Endian RGB 565 */
+    qd_24_bgr_pixel_format          = 0x32344247, /* '24BG' 24 bit BGR */
+    qd_32_bgra_pixel_format         = 0x42475241, /* 'BGRA' 32 bit BGRA */
+    qd_32_abgr_pixel_format         = 0x41424752, /* 'ABGR' 32 bit ABGR */
+    qd_32_rgba_pixel_format         = 0x52474241, /* 'RGBA' 32 bit RGBA (Surfaces) */
+};
+
+/* A surface is a plain view over 32-bit pixels stored as R, G, B, A bytes in
+ * memory order. It does not own the pixel data it refers to. */
+struct qd_surface
+{
+    void *data;
+    uint32_t width;
+    uint32_t height;
+    size_t row_bytes;
+};
+
+/* A bit surface is a plain view over 1 bit pixels, packed most significant bit
+ * first as in a QuickDraw BitMap. Set bits are black. It does not own the data
+ * it refers to. */
+struct qd_bit_surface
+{
+    uint8_t *data;
+    uint32_t width;
+    uint32_t height;
+    size_t row_bytes;
 };
 
 struct qd_pattern
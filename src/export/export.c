@@ -0,0 +1,422 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export/export.h"
+
+// MARK: - Export Constants
+
+#define QD_QOI_OP_INDEX         0x00
+#define QD_QOI_OP_DIFF          0x40
+#define QD_QOI_OP_LUMA          0x80
+#define QD_QOI_OP_RUN           0xC0
+#define QD_QOI_OP_RGB           0xFE
+#define QD_QOI_OP_RGBA          0xFF
+#define QD_QOI_MAX_RUN          62
+#define QD_QOI_MAX_PIXELS       400000000ULL
+
+#define QD_BMP_HEADER_SIZE      14
+#define QD_BMP_INFO_SIZE        108
+
+/* QOI keeps its state from one row to the next, as runs and the index of recent
+ * colors carry on across rows. */
+struct qd_exporter
+{
+    enum qd_export_format format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rows_written;
+    qd_export_write_function write;
+    void *context;
+    struct qd_error *error;
+    int failed;
+    uint8_t *row;
+    uint32_t qoi_index[64];
+    uint32_t qoi_previous;
+    uint32_t qoi_run;
+};
+
+// MARK: - Output
+
+static int qd_exporter_output(struct qd_exporter *exporter, const void *data, size_t size)
+{
+    if (exporter->failed) {
+        return 1;
+    }
+    if (size && exporter->write(exporter->context, data, size)) {
+        exporter->failed = 1;
+        return qd_error_raise(exporter->error, qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to write the exported picture.");
+    }
+    return 0;
+}
+
+static inline uint8_t *qd_export_put16le(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    return p + 2;
+}
+
+static inline uint8_t *qd_export_put32le(uint8_t *p, uint32_t value)
+{
+    return qd_export_put16le(qd_export_put16le(p, (uint16_t)value), (uint16_t)(value >> 16));
+}
+
+static inline uint8_t *qd_export_put32be(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+    return p + 4;
+}
+
+// MARK: - QOI
+
+/* Pixels are handled as words holding R, G, B, A bytes in memory, like the
+ * surface, and are only taken apart when they need to be encoded. */
+static inline uint32_t qd_qoi_hash(const uint8_t *px)
+{
+    return (px[0] * 3u + px[1] * 5u + px[2] * 7u + px[3] * 11u) % 64;
+}
+
+static int qd_qoi_write_header(struct qd_exporter *exporter)
+{
+    uint8_t header[14] = { 'q', 'o', 'i', 'f' };
+    qd_export_put32be(header + 4, exporter->width);
+    qd_export_put32be(header + 8, exporter->height);
+    header[12] = 4;
+    header[13] = 0;
+
+    const uint8_t opaque_black[4] = { 0, 0, 0, UINT8_MAX };
+    memcpy(&exporter->qoi_previous, opaque_black, sizeof(uint32_t));
+    return qd_exporter_output(exporter, header, sizeof(header));
+}
+
+static inline uint8_t *qd_qoi_flush_run(struct qd_exporter *exporter, uint8_t *p)
+{
+    if (exporter->qoi_run) {
+        *p++ = (uint8_t)(QD_QOI_OP_RUN | (exporter->qoi_run - 1));
+        exporter->qoi_run = 0;
+    }
+    return p;
+}
+
+static size_t qd_qoi_encode_row(struct qd_exporter *exporter, const uint8_t *rgba)
+{
+    uint8_t *p = exporter->row;
+    uint32_t previous = exporter->qoi_previous;
+
+    for (uint32_t x = 0; x < exporter->width; ++x, rgba += 4) {
+        uint32_t pixel;
+        memcpy(&pixel, rgba, sizeof(pixel));
+        if (pixel == previous) {
+            if (++exporter->qoi_run == QD_QOI_MAX_RUN) {
+                p = qd_qoi_flush_run(exporter, p);
+            }
+            continue;
+        }
+        p = qd_qoi_flush_run(exporter, p);
+
+        uint32_t hash = qd_qoi_hash(rgba);
+        if (exporter->qoi_index[hash] == pixel) {
+            *p++ = (uint8_t)(QD_QOI_OP_INDEX | hash);
+            previous = pixel;
+            continue;
+        }
+        exporter->qoi_index[hash] = pixel;
+
+        uint8_t last[4];
+        memcpy(last, &previous, sizeof(last));
+        previous = pixel;
+        if (rgba[3] != last[3]) {
+            *p++ = QD_QOI_OP_RGBA;
+            memcpy(p, rgba, 4);
+            p += 4;
+            continue;
+        }
+
+        // Differences wrap around, as in the decoder.
+        int8_t dr = (int8_t)(rgba[0] - last[0]);
+        int8_t dg = (int8_t)(rgba[1] - last[1]);
+        int8_t db = (int8_t)(rgba[2] - last[2]);
+        int8_t dr_dg = (int8_t)(dr - dg);
+        int8_t db_dg = (int8_t)(db - dg);
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+            *p++ = (uint8_t)(QD_QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+        }
+        else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 && db_dg >= -8 && db_dg <= 7) {
+            *p++ = (uint8_t)(QD_QOI_OP_LUMA | (dg + 32));
+            *p++ = (uint8_t)((dr_dg + 8) << 4 | (db_dg + 8));
+        }
+        else {
+            *p++ = QD_QOI_OP_RGB;
+            memcpy(p, rgba, 3);
+            p += 3;
+        }
+    }
+
+    exporter->qoi_previous = previous;
+    return (size_t)(p - exporter->row);
+}
+
+static int qd_qoi_finish(struct qd_exporter *exporter)
+{
+    static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    uint8_t *p = qd_qoi_flush_run(exporter, exporter->row);
+    return qd_exporter_output(exporter, exporter->row, (size_t)(p - exporter->row))
+        || qd_exporter_output(exporter, end, sizeof(end));
+}
+
+// MARK: - BMP
+
+/* A file header and a version 4 info header, describing 32-bit pixels with masks
+ * for each component, alpha included. The height is negative, which stores the
+ * rows from the top down, in the order that they are written. */
+static int qd_bmp_write_header(struct qd_exporter *exporter)
+{
+    uint8_t header[QD_BMP_HEADER_SIZE + QD_BMP_INFO_SIZE] = { 'B', 'M' };
+    uint32_t image_size = exporter->width * 4 * exporter->height;
+
+    uint8_t *p = header + 2;
+    p = qd_export_put32le(p, QD_BMP_HEADER_SIZE + QD_BMP_INFO_SIZE + image_size);
+    p = qd_export_put32le(p, 0);
+    p = qd_export_put32le(p, QD_BMP_HEADER_SIZE + QD_BMP_INFO_SIZE);
+
+    p = qd_export_put32le(p, QD_BMP_INFO_SIZE);
+    p = qd_export_put32le(p, exporter->width);
+    p = qd_export_put32le(p, (uint32_t)-(int32_t)exporter->height);
+    p = qd_export_put16le(p, 1);
+    p = qd_export_put16le(p, 32);
+    p = qd_export_put32le(p, 3);                // BI_BITFIELDS
+    p = qd_export_put32le(p, image_size);
+    p = qd_export_put32le(p, 2835);             // 72 dpi
+    p = qd_export_put32le(p, 2835);
+    p = qd_export_put32le(p, 0);
+    p = qd_export_put32le(p, 0);
+    p = qd_export_put32le(p, 0x00FF0000);
+    p = qd_export_put32le(p, 0x0000FF00);
+    p = qd_export_put32le(p, 0x000000FF);
+    p = qd_export_put32le(p, 0xFF000000);
+    qd_export_put32le(p, 0x73524742);           // LCS_sRGB, with no endpoints or gamma
+
+    return qd_exporter_output(exporter, header, sizeof(header));
+}
+
+static size_t qd_bmp_encode_row(struct qd_exporter *exporter, const uint8_t *rgba)
+{
+    uint8_t *p = exporter->row;
+    for (uint32_t x = 0; x < exporter->width; ++x, rgba += 4, p += 4) {
+        p[0] = rgba[2];
+        p[1] = rgba[1];
+        p[2] = rgba[0];
+        p[3] = rgba[3];
+    }
+    return (size_t)exporter->width * 4;
+}
+
+// MARK: - PAM
+
+static int qd_pam_write_header(struct qd_exporter *exporter)
+{
+    char header[128];
+    int length = snprintf(header, sizeof(header), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+        exporter->width, exporter->height);
+    return qd_exporter_output(exporter, header, (size_t)length);
+}
+
+// MARK: - Exporter
+
+struct qd_exporter *qd_exporter_create(
+    enum qd_export_format format,
+    uint32_t width,
+    uint32_t height,
+    qd_export_write_function write,
+    void *context,
+    struct qd_error *error
+) {
+    if (!write || width == 0 || height == 0) {
+        qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "An empty picture, or one without a write function, can not be exported.");
+        return NULL;
+    }
+
+    uint64_t pixels = (uint64_t)width * height;
+    if ((format == qd_export_qoi && pixels >= QD_QOI_MAX_PIXELS)
+        || (format == qd_export_bmp && (height > INT32_MAX || pixels * 4 > UINT32_MAX - QD_BMP_HEADER_SIZE - QD_BMP_INFO_SIZE))) {
+        qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "A picture of %ux%u pixels is too large to export.", width, height);
+        return NULL;
+    }
+
+    // A QOI row is at its largest when every pixel needs all of its components, as
+    // well as a run that carries over from the last row.
+    size_t row_size = 0;
+    switch (format) {
+        case qd_export_qoi:
+            row_size = (size_t)width * 5 + 1;
+            break;
+        case qd_export_bmp:
+            row_size = (size_t)width * 4;
+            break;
+        case qd_export_pam:
+            break;
+        default:
+            qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Unknown export format (%d).", (int)format);
+            return NULL;
+    }
+
+    struct qd_exporter *exporter = calloc(1, sizeof(*exporter));
+    if (!exporter || (row_size && !(exporter->row = malloc(row_size)))) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate the exporter.");
+        free(exporter);
+        return NULL;
+    }
+    exporter->format = format;
+    exporter->width = width;
+    exporter->height = height;
+    exporter->write = write;
+    exporter->context = context;
+    exporter->error = error;
+
+    int err = 0;
+    switch (format) {
+        case qd_export_qoi:
+            err = qd_qoi_write_header(exporter);
+            break;
+        case qd_export_bmp:
+            err = qd_bmp_write_header(exporter);
+            break;
+        case qd_export_pam:
+            err = qd_pam_write_header(exporter);
+            break;
+    }
+    if (err) {
+        qd_exporter_free(exporter);
+        return NULL;
+    }
+    return exporter;
+}
+
+int qd_exporter_write_rows(struct qd_exporter *exporter, const void *rows, size_t row_bytes, uint32_t count)
+{
+    if (exporter->failed) {
+        return 1;
+    }
+    if (count > exporter->height - exporter->rows_written) {
+        exporter->failed = 1;
+        return qd_error_raise(exporter->error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "More rows were exported than the picture has (%u).", exporter->height);
+    }
+
+    const uint8_t *row = rows;
+    size_t length = (size_t)exporter->width * 4;
+
+    // PAM rows are the same as surface rows, so rows without padding between them
+    // are written as they are, all at once.
+    if (exporter->format == qd_export_pam && row_bytes == length) {
+        exporter->rows_written += count;
+        return qd_exporter_output(exporter, row, length * count);
+    }
+
+    for (uint32_t n = 0; n < count; ++n, row += row_bytes) {
+        int err = 0;
+        switch (exporter->format) {
+            case qd_export_qoi:
+                err = qd_exporter_output(exporter, exporter->row, qd_qoi_encode_row(exporter, row));
+                break;
+            case qd_export_bmp:
+                err = qd_exporter_output(exporter, exporter->row, qd_bmp_encode_row(exporter, row));
+                break;
+            case qd_export_pam:
+                err = qd_exporter_output(exporter, row, length);
+                break;
+        }
+        if (err) {
+            return 1;
+        }
+        ++exporter->rows_written;
+    }
+    return 0;
+}
+
+int qd_exporter_finish(struct qd_exporter *exporter)
+{
+    if (exporter->failed) {
+        return 1;
+    }
+    if (exporter->rows_written != exporter->height) {
+        exporter->failed = 1;
+        return qd_error_raise(exporter->error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Only %u of the %u rows of the picture were exported.", exporter->rows_written, exporter->height);
+    }
+    return exporter->format == qd_export_qoi ? qd_qoi_finish(exporter) : 0;
+}
+
+void qd_exporter_free(struct qd_exporter *exporter)
+{
+    if (exporter) {
+        free(exporter->row);
+        free(exporter);
+    }
+}
+
+int qd_export_pict(
+    const struct qd_pict *pict,
+    enum qd_export_format format,
+    qd_export_write_function write,
+    void *context,
+    struct qd_error *error
+) {
+    if (!pict || (!pict->surface && !pict->tiles)) {
+        return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "The picture has no surface to export.");
+    }
+
+    struct qd_exporter *exporter = qd_exporter_create(format, pict->width, pict->height, write, context, error);
+    if (!exporter) {
+        return 1;
+    }
+
+    // A tiled surface is gathered a row at a time, so that the pixels of the
+    // picture are never held in one piece.
+    int err = 0;
+    if (pict->surface) {
+        err = qd_exporter_write_rows(exporter, pict->surface, pict->row_bytes, pict->height);
+    }
+    else {
+        size_t row_bytes = (size_t)pict->width * 4;
+        uint8_t *row = malloc(row_bytes);
+        if (!row) {
+            err = qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate a row to export.");
+        }
+        for (uint32_t y = 0; row && y < pict->height && !err; ++y) {
+            if (qd_pict_read_pixels(pict, 0, y, pict->width, 1, row, row_bytes)) {
+                err = qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to read row %u of the picture.", y);
+            }
+            else {
+                err = qd_exporter_write_rows(exporter, row, row_bytes, 1);
+            }
+        }
+        free(row);
+    }
+
+    err = err || qd_exporter_finish(exporter);
+    qd_exporter_free(exporter);
+    return err;
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/error.h"
+#include "pict/pict.h"
+
+#if !defined(libQuickDraw_Export)
+#define libQuickDraw_Export
+
+/* The formats that pixels can be exported to. QOI is losslessly compressed, while
+ * BMP and PAM are uncompressed. All three keep alpha: BMP as 32-bit pixels with an
+ * alpha mask, stored top down. */
+enum qd_export_format
+{
+    qd_export_qoi = 0,
+    qd_export_bmp = 1,
+    qd_export_pam = 2,
+};
+
+/* Called with each piece of the output in order. Returns 0 once the data has been
+ * written, or 1 to stop the export. */
+typedef int (*qd_export_write_function)(void *context, const void *data, size_t size);
+
+/* An exporter encodes 32-bit RGBA rows, from top to bottom, as they are given to
+ * it, and passes the output straight on to the write function. Only a row of
+ * output is held at a time, so a picture can be exported without another copy of
+ * all of its pixels. */
+struct qd_exporter;
+
+/* Creates an exporter for a picture of the given size, and writes the header of
+ * the format. The reason that it could not be created is raised into the error,
+ * which is also where later failures of the exporter are raised. */
+struct qd_exporter *qd_exporter_create(
+    enum qd_export_format format,
+    uint32_t width,
+    uint32_t height,
+    qd_export_write_function write,
+    void *context,
+    struct qd_error *error
+);
+
+/* Encodes count rows of pixels, each row_bytes apart. Returns 1 if more rows are
+ * given than the picture has, or if the output could not be written. */
+int qd_exporter_write_rows(struct qd_exporter *exporter, const void *rows, size_t row_bytes, uint32_t count);
+
+/* Ends the output once every row has been written. Returns 1 if rows are missing,
+ * or if the output could not be written. */
+int qd_exporter_finish(struct qd_exporter *exporter);
+
+void qd_exporter_free(struct qd_exporter *exporter);
+
+/* Exports the surface of a decoded picture a row at a time, whether it is held
+ * in one piece or in tiles. */
+int qd_export_pict(
+    const struct qd_pict *pict,
+    enum qd_export_format format,
+    qd_export_write_function write,
+    void *context,
+    struct qd_error *error
+);
+
+#endif
@@ -19,13 +19,16 @@
  * SOFTWARE.
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "internal/buffer.h"
 
 struct qd_buffer *qd_buffer_open(const char *restrict path)
 {
     FILE *f = fopen(path, "r");
     if (!f) {
-        fprintf(stderr, "Failed to open a file buffer for '%s'\n", path);
         return NULL;
     }
 
@@ -35,7 +38,6 @@ struct qd_buffer *qd_buffer_open(const char *restrict path)
 
     void *data = malloc(size);
     if (fread(data, 1, size, f) != size) {
-        fprintf(stderr, "Failed to read file buffer for '%s'\n", path);
         free(data);
         fclose(f);
         return NULL;
@@ -45,6 +47,56 @@ struct qd_buffer *qd_buffer_open(const char *restrict path)
     return qd_buffer_create(data, size);
 }
 
+struct qd_buffer *qd_buffer_map(const char *restrict path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Empty files can not be mapped, but are still valid, empty buffers.
+    if (info.st_size == 0) {
+        close(fd);
+        return qd_buffer_create_empty(0);
+    }
+
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct qd_buffer *buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) {
+        munmap(data, (size_t)info.st_size);
+        return NULL;
+    }
+
+    buffer->data = data;
+    buffer->size = (uint64_t)info.st_size;
+    buffer->storage = qd_buffer_mapped;
+    return buffer;
+}
+
+int qd_buffer_view(struct qd_buffer *view, const struct qd_buffer *buffer, uint64_t offset, uint64_t size)
+{
+    if (!view || !buffer || offset > buffer->size || size > buffer->size - offset) {
+        return 1;
+    }
+
+    view->data = (uint8_t *)buffer->data + offset;
+    view->pos = 0;
+    view->size = size;
+    view->storage = qd_buffer_borrowed;
+    return 0;
+}
+
 struct qd_buffer *qd_buffer_create(void *data, uint64_t size)
 {
     struct qd_buffer *buffer = calloc(1, sizeof(*buffer));
@@ -65,7 +117,16 @@ struct qd_buffer *qd_buffer_create_empty(uint64_t size)
 void qd_buffer_free(struct qd_buffer *buffer)
 {
     if (buffer) {
-        free(buffer->data);
+        switch (buffer->storage) {
+            case qd_buffer_owned:
+                free(buffer->data);
+                break;
+            case qd_buffer_mapped:
+                munmap(buffer->data, (size_t)buffer->size);
+                break;
+            default:
+                break;
+        }
         free(buffer);
     }
 }
@@ -104,6 +165,14 @@ long qd_buffer_tell(struct qd_buffer *restrict stream)
     return stream ? stream->pos : 0;
 }
 
+const void *qd_buffer_peek(struct qd_buffer *restrict stream, uint64_t size)
+{
+    if (!stream || stream->pos > stream->size || size > stream->size - stream->pos) {
+        return NULL;
+    }
+    return (const uint8_t *)stream->data + stream->pos;
+}
+
 size_t qd_buffer_read_flags(
     void *restrict ptr, 
     size_t size, 
@@ -159,11 +228,16 @@ size_t qd_buffer_read_fixed(
     size_t nitems,
     struct qd_buffer *restrict stream
 ) {
-    int32_t *buffer = calloc(nitems, sizeof(*buffer));
+    // Each value is converted as it is read, rather than reading them all into a
+    // temporary array first.
     double *fixed = ptr;
-    size_t r = qd_buffer_read(buffer, sizeof(*buffer), nitems, stream);
-    for (int i = 0; i < nitems; ++i) {
-    	fixed[i] = buffer[i] / ((double)(1 << 16));
+    size_t count = 0;
+    for (; count < nitems; ++count) {
+        int32_t value = 0;
+        if (qd_buffer_read(&value, sizeof(value), 1, stream) != 1) {
+            break;
+        }
+        fixed[count] = value / ((double)(1 << 16));
     }
-    return r;
+    return count;
 }
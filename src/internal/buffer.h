@@ -34,11 +34,22 @@ enum
     qd_f_endian = 0x01,
 };
 
+/* How the data of a buffer is held, which determines what freeing the buffer
+ * does with it. Borrowed data belongs to something else, such as the buffer a
+ * view was made from, and is left alone. */
+enum
+{
+    qd_buffer_owned = 0,
+    qd_buffer_mapped = 1,
+    qd_buffer_borrowed = 2,
+};
+
 struct qd_buffer
 {
     void *data;
     uint64_t pos;
     uint64_t size;
+    int storage;
 };
 
 struct qd_buffer *qd_buffer_open(const char *restrict path);
@@ -46,10 +57,24 @@ struct qd_buffer *qd_buffer_create(void *data, uint64_t size);
 struct qd_buffer *qd_buffer_create_empty(uint64_t size);
 void qd_buffer_free(struct qd_buffer *buffer);
 
+/* Maps a file into memory read only, rather than reading it in. Pages of the file
+ * are only loaded as they are touched, so opening a large file costs the same as
+ * opening a small one. */
+struct qd_buffer *qd_buffer_map(const char *restrict path);
+
+/* Sets up a buffer over size bytes of another buffer, starting at offset, without
+ * copying them. The view must not outlive the buffer it was made from, and does
+ * not need to be freed. Returns 1 if the range is outside of the buffer. */
+int qd_buffer_view(struct qd_buffer *view, const struct qd_buffer *buffer, uint64_t offset, uint64_t size);
+
 int qd_buffer_eof(struct qd_buffer *restrict stream);
 void qd_buffer_seek(struct qd_buffer *stream, long offset, int whence);
 long qd_buffer_tell(struct qd_buffer *restrict stream);
 
+/* Returns a pointer to the next size bytes of the buffer without consuming them,
+ * or NULL if the buffer does not hold that many more bytes. */
+const void *qd_buffer_peek(struct qd_buffer *restrict stream, uint64_t size);
+
 size_t qd_buffer_read_flags(
     void *restrict ptr, 
     size_t size, 
@@ -0,0 +1,81 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include "internal/expand.h"
+
+int qd_expand_table_init(struct qd_expand_table *table, const uint32_t palette[256], uint32_t depth)
+{
+    if (depth != 1 && depth != 2 && depth != 4 && depth != 8) {
+        return 1;
+    }
+
+    table->depth = depth;
+    table->pixels_per_byte = 8 / depth;
+
+    // Pixels are packed most significant bits first.
+    uint32_t mask = (1U << depth) - 1;
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t *out = &table->pixels[byte * table->pixels_per_byte];
+        for (uint32_t i = 0; i < table->pixels_per_byte; ++i) {
+            out[i] = palette[(byte >> (8 - depth * (i + 1))) & mask];
+        }
+    }
+
+    return 0;
+}
+
+void qd_expand_row(const struct qd_expand_table *table, uint32_t *restrict out, const uint8_t *restrict in, uint32_t width)
+{
+    const uint32_t *pixels = table->pixels;
+    uint32_t x = 0;
+
+    switch (table->depth) {
+        case 8:
+            for (; x < width; ++x) {
+                out[x] = pixels[in[x]];
+            }
+            return;
+
+        case 4:
+            for (; x + 2 <= width; x += 2) {
+                memcpy(out + x, &pixels[*in++ << 1], 2 * sizeof(*out));
+            }
+            break;
+
+        case 2:
+            for (; x + 4 <= width; x += 4) {
+                memcpy(out + x, &pixels[*in++ << 2], 4 * sizeof(*out));
+            }
+            break;
+
+        case 1:
+            for (; x + 8 <= width; x += 8) {
+                memcpy(out + x, &pixels[*in++ << 3], 8 * sizeof(*out));
+            }
+            break;
+    }
+
+    // The last byte of the row may only be partially used.
+    if (x < width) {
+        memcpy(out + x, &pixels[*in * table->pixels_per_byte], (width - x) * sizeof(*out));
+    }
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+
+#if !defined(libQuickDraw_Expand)
+#define libQuickDraw_Expand
+
+/* An expansion table maps every possible byte of indexed pixel data to the
+ * packed RGBA pixels that it holds, so that each byte of a row is expanded
+ * with a single lookup regardless of the pixel depth. */
+struct qd_expand_table
+{
+    uint32_t depth;
+    uint32_t pixels_per_byte;
+    uint32_t pixels[256 * 8];
+};
+
+int qd_expand_table_init(struct qd_expand_table *table, const uint32_t palette[256], uint32_t depth);
+void qd_expand_row(const struct qd_expand_table *table, uint32_t *restrict out, const uint8_t *restrict in, uint32_t width);
+
+#endif
@@ -0,0 +1,119 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal/hash.h"
+
+#define QD_HASH_PRIME_1     0x9E3779B185EBCA87ULL
+#define QD_HASH_PRIME_2     0xC2B2AE3D27D4EB4FULL
+#define QD_HASH_PRIME_3     0x165667B19E3779F9ULL
+#define QD_HASH_PRIME_4     0x85EBCA77C2B2AE63ULL
+#define QD_HASH_PRIME_5     0x27D4EB2F165667C5ULL
+
+static inline uint64_t qd_hash_rotl(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t qd_hash_read64(const uint8_t *p)
+{
+    // Always read little endian so that hashes are the same on every host.
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline uint32_t qd_hash_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t qd_hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * QD_HASH_PRIME_2;
+    acc = qd_hash_rotl(acc, 31);
+    return acc * QD_HASH_PRIME_1;
+}
+
+static inline uint64_t qd_hash_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= qd_hash_round(0, v);
+    return acc * QD_HASH_PRIME_1 + QD_HASH_PRIME_4;
+}
+
+uint64_t qd_hash64(const void *data, size_t length, uint64_t seed)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = p + length;
+    uint64_t h = 0;
+
+    if (length >= 32) {
+        // Four independent lanes over 32 byte stripes.
+        uint64_t v1 = seed + QD_HASH_PRIME_1 + QD_HASH_PRIME_2;
+        uint64_t v2 = seed + QD_HASH_PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - QD_HASH_PRIME_1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = qd_hash_round(v1, qd_hash_read64(p));
+            v2 = qd_hash_round(v2, qd_hash_read64(p + 8));
+            v3 = qd_hash_round(v3, qd_hash_read64(p + 16));
+            v4 = qd_hash_round(v4, qd_hash_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = qd_hash_rotl(v1, 1) + qd_hash_rotl(v2, 7) + qd_hash_rotl(v3, 12) + qd_hash_rotl(v4, 18);
+        h = qd_hash_merge(h, v1);
+        h = qd_hash_merge(h, v2);
+        h = qd_hash_merge(h, v3);
+        h = qd_hash_merge(h, v4);
+    }
+    else {
+        h = seed + QD_HASH_PRIME_5;
+    }
+
+    h += (uint64_t)length;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= qd_hash_round(0, qd_hash_read64(p));
+        h = qd_hash_rotl(h, 27) * QD_HASH_PRIME_1 + QD_HASH_PRIME_4;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t)qd_hash_read32(p) * QD_HASH_PRIME_1;
+        h = qd_hash_rotl(h, 23) * QD_HASH_PRIME_2 + QD_HASH_PRIME_3;
+        p += 4;
+    }
+
+    for (; p < end; ++p) {
+        h ^= (*p) * QD_HASH_PRIME_5;
+        h = qd_hash_rotl(h, 11) * QD_HASH_PRIME_1;
+    }
+
+    // Final avalanche.
+    h ^= h >> 33;
+    h *= QD_HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= QD_HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
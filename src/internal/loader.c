@@ -0,0 +1,529 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if defined(QD_ENABLE_IO_URING)
+#define _DEFAULT_SOURCE
+#else
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "internal/loader.h"
+
+#if defined(QD_ENABLE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+// MARK: - Loader Structures
+
+/* The state of one file of the batch. The file is open while it is being read,
+ * and done counts the bytes that have been read into its buffer so far. */
+struct qd_loader_file
+{
+    struct qd_buffer *buffer;
+    int fd;
+    int err;
+    uint64_t done;
+    struct iovec iov;
+};
+
+#if defined(QD_ENABLE_IO_URING)
+/* The rings shared with the kernel. Submission queue entries are used in the
+ * order of the ring, so the index array maps each slot to itself. */
+struct qd_loader_ring
+{
+    int fd;
+    unsigned int entries;
+    unsigned int pending;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    _Atomic unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    _Atomic unsigned int *cq_head;
+    _Atomic unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+#endif
+
+/* Files are handed back through the completed list, in the order that they were
+ * finished, by whichever thread finished them. */
+struct qd_loader
+{
+    const char *const *paths;
+    size_t count;
+    struct qd_loader_file *files;
+    atomic_size_t next;
+    atomic_int cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    size_t *completed;
+    size_t completed_count;
+    size_t handed_count;
+    pthread_t *threads;
+    unsigned int thread_count;
+    int uses_io_uring;
+#if defined(QD_ENABLE_IO_URING)
+    struct qd_loader_ring ring;
+#endif
+};
+
+// MARK: - Reading Files
+
+/* Opens the file and allocates a buffer for all of it. */
+static int qd_loader_open_file(struct qd_loader_file *file, const char *path)
+{
+    file->fd = open(path, O_RDONLY);
+    if (file->fd < 0) {
+        file->err = errno;
+        return 1;
+    }
+
+    struct stat info;
+    if (fstat(file->fd, &info) != 0) {
+        file->err = errno;
+        return 1;
+    }
+
+    uint64_t size = (uint64_t)info.st_size;
+    if (size == 0) {
+        file->buffer = qd_buffer_create_empty(0);
+    }
+    else if (size <= SIZE_MAX) {
+        void *data = malloc((size_t)size);
+        file->buffer = data ? qd_buffer_create(data, size) : NULL;
+    }
+
+    if (!file->buffer) {
+        file->err = ENOMEM;
+        return 1;
+    }
+    return 0;
+}
+
+/* Reads whatever of the file has not been read yet. */
+static int qd_loader_read_rest(struct qd_loader_file *file)
+{
+    while (file->done < file->buffer->size) {
+        ssize_t result = pread(file->fd, (uint8_t *)file->buffer->data + file->done, (size_t)(file->buffer->size - file->done), (off_t)file->done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            // A file that ends early has been cut short since it was opened.
+            file->err = result < 0 ? errno : EIO;
+            return 1;
+        }
+        file->done += (uint64_t)result;
+    }
+    return 0;
+}
+
+/* Closes the file, and passes it on to be handed back. */
+static void qd_loader_finish(struct qd_loader *loader, size_t index)
+{
+    struct qd_loader_file *file = &loader->files[index];
+    if (file->fd >= 0) {
+        close(file->fd);
+        file->fd = -1;
+    }
+    if (file->err) {
+        qd_buffer_free(file->buffer);
+        file->buffer = NULL;
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    loader->completed[loader->completed_count++] = index;
+    pthread_cond_signal(&loader->finished);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// MARK: - Thread Pool
+
+static void *qd_loader_thread_worker(void *context)
+{
+    struct qd_loader *loader = context;
+
+    size_t n;
+    while (!atomic_load(&loader->cancelled) && (n = atomic_fetch_add(&loader->next, 1)) < loader->count) {
+        struct qd_loader_file *file = &loader->files[n];
+        if (!qd_loader_open_file(file, loader->paths[n])) {
+            qd_loader_read_rest(file);
+        }
+        qd_loader_finish(loader, n);
+    }
+
+    return NULL;
+}
+
+// MARK: - io_uring
+
+#if defined(QD_ENABLE_IO_URING)
+
+static void qd_loader_ring_destroy(struct qd_loader_ring *ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int qd_loader_ring_init(struct qd_loader_ring *ring, unsigned int entries)
+{
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return 1;
+    }
+
+    // Recent kernels map both rings at once.
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_map_size = ring->cq_map_size > ring->sq_map_size ? ring->cq_map_size : ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        qd_loader_ring_destroy(ring);
+        return 1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    }
+    else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            qd_loader_ring_destroy(ring);
+            return 1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        qd_loader_ring_destroy(ring);
+        return 1;
+    }
+
+    uint8_t *sq = ring->sq_map;
+    uint8_t *cq = ring->cq_map;
+    ring->entries = params.sq_entries;
+    ring->sq_tail = (_Atomic unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->cq_head = (_Atomic unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (_Atomic unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    unsigned int *array = (unsigned int *)(sq + params.sq_off.array);
+    for (unsigned int n = 0; n < params.sq_entries; ++n) {
+        array[n] = n;
+    }
+    return 0;
+}
+
+/* Queues a read of the rest of the file. It is submitted on the next call to
+ * io_uring_enter. */
+static void qd_loader_ring_queue(struct qd_loader_ring *ring, struct qd_loader_file *file, size_t index)
+{
+    unsigned int tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    struct io_uring_sqe *sqe = &ring->sqes[tail & *ring->sq_mask];
+
+    file->iov.iov_base = (uint8_t *)file->buffer->data + file->done;
+    file->iov.iov_len = (size_t)(file->buffer->size - file->done);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&file->iov;
+    sqe->len = 1;
+    sqe->off = file->done;
+    sqe->user_data = index;
+
+    atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+    ++ring->pending;
+}
+
+/* Handles the reads that have completed, returning how many there were. A short
+ * read is queued again for the rest of the file when requeue is set, and is
+ * otherwise left to be finished by qd_loader_read_rest. */
+static unsigned int qd_loader_ring_reap(struct qd_loader *loader, size_t *in_flight, int requeue)
+{
+    struct qd_loader_ring *ring = &loader->ring;
+    unsigned int head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+    unsigned int reaped = tail - head;
+
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        size_t n = (size_t)cqe->user_data;
+        struct qd_loader_file *file = &loader->files[n];
+        if (cqe->res <= 0) {
+            file->err = cqe->res < 0 ? -cqe->res : EIO;
+        }
+        else {
+            file->done += (uint64_t)cqe->res;
+        }
+
+        if (file->err || file->done == file->buffer->size) {
+            qd_loader_finish(loader, n);
+            --*in_flight;
+        }
+        else if (requeue) {
+            qd_loader_ring_queue(ring, file, n);
+        }
+    }
+    atomic_store_explicit(ring->cq_head, head, memory_order_release);
+    return reaped;
+}
+
+/* Keeps up to a ring of reads in flight, one per file, from a single thread. A
+ * short read is queued again for the rest of the file. */
+static void *qd_loader_ring_worker(void *context)
+{
+    struct qd_loader *loader = context;
+    struct qd_loader_ring *ring = &loader->ring;
+    size_t next = 0;
+    size_t in_flight = 0;
+
+    while ((next < loader->count && !atomic_load(&loader->cancelled)) || in_flight) {
+        while (next < loader->count && in_flight < ring->entries && !atomic_load(&loader->cancelled)) {
+            struct qd_loader_file *file = &loader->files[next];
+            if (qd_loader_open_file(file, loader->paths[next]) || file->buffer->size == 0) {
+                qd_loader_finish(loader, next);
+            }
+            else {
+                qd_loader_ring_queue(ring, file, next);
+                ++in_flight;
+            }
+            ++next;
+        }
+        if (in_flight == 0) {
+            continue;
+        }
+
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            break;
+        }
+        ring->pending -= (unsigned int)submitted;
+
+        qd_loader_ring_reap(loader, &in_flight, 1);
+    }
+
+    // Should the ring stop accepting reads, the reads that the kernel has already
+    // accepted may still be writing into their buffers, so they are waited for
+    // before any buffer is read into here or handed back. Reads that were queued
+    // but never submitted stay in the ring, which is not entered to submit again.
+    size_t accepted = in_flight - ring->pending;
+    while (accepted) {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            // Completions are still posted to the ring when it cannot be waited on.
+            nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+        }
+        accepted -= qd_loader_ring_reap(loader, &in_flight, 0);
+    }
+
+    // The files that were in flight, and the ones that had not been started, are
+    // then read here instead.
+    for (size_t n = 0; n < next && in_flight; ++n) {
+        if (loader->files[n].fd >= 0) {
+            qd_loader_read_rest(&loader->files[n]);
+            qd_loader_finish(loader, n);
+            --in_flight;
+        }
+    }
+    atomic_store(&loader->next, next);
+    return qd_loader_thread_worker(loader);
+}
+
+#endif
+
+// MARK: - Loader
+
+int qd_loader_open(
+    struct qd_loader **out_loader,
+    const char *const *paths,
+    size_t count,
+    const struct qd_loader_options *options
+) {
+    struct qd_error *error = options ? options->error : NULL;
+    if (!out_loader || (count && !paths)) {
+        return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "No files given to load.");
+    }
+    *out_loader = NULL;
+
+    unsigned int threads = (options && options->threads) ? options->threads : QD_LOADER_DEFAULT_THREADS;
+    struct qd_loader *loader = calloc(1, sizeof(*loader));
+    if (!loader) {
+        return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate loader.");
+    }
+
+    loader->paths = paths;
+    loader->count = count;
+    loader->files = calloc(count ? count : 1, sizeof(*loader->files));
+    loader->completed = calloc(count ? count : 1, sizeof(*loader->completed));
+    loader->threads = calloc(threads, sizeof(*loader->threads));
+    atomic_init(&loader->next, 0);
+    atomic_init(&loader->cancelled, 0);
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->finished, NULL);
+#if defined(QD_ENABLE_IO_URING)
+    loader->ring.fd = -1;
+#endif
+    if (!loader->files || !loader->completed || !loader->threads) {
+        qd_loader_close(loader);
+        return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate loader.");
+    }
+    for (size_t n = 0; n < count; ++n) {
+        loader->files[n].fd = -1;
+    }
+    if (count == 0) {
+        *out_loader = loader;
+        return 0;
+    }
+
+#if defined(QD_ENABLE_IO_URING)
+    unsigned int queue_depth = (options && options->queue_depth) ? options->queue_depth : QD_LOADER_DEFAULT_QUEUE_DEPTH;
+    if (!(options && options->use_threads) && qd_loader_ring_init(&loader->ring, queue_depth) == 0) {
+        if (pthread_create(&loader->threads[0], NULL, qd_loader_ring_worker, loader) == 0) {
+            loader->thread_count = 1;
+            loader->uses_io_uring = 1;
+            *out_loader = loader;
+            return 0;
+        }
+        qd_loader_ring_destroy(&loader->ring);
+    }
+#endif
+
+    if ((size_t)threads > count) {
+        threads = (unsigned int)count;
+    }
+    while (loader->thread_count < threads) {
+        if (pthread_create(&loader->threads[loader->thread_count], NULL, qd_loader_thread_worker, loader)) {
+            break;
+        }
+        ++loader->thread_count;
+    }
+    if (loader->thread_count == 0) {
+        qd_loader_close(loader);
+        return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to start loader threads.");
+    }
+
+    *out_loader = loader;
+    return 0;
+}
+
+int qd_loader_next(struct qd_loader *loader, size_t *index, struct qd_buffer **buffer, struct qd_error *error)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (loader->handed_count == loader->completed_count && loader->handed_count < loader->count) {
+        pthread_cond_wait(&loader->finished, &loader->lock);
+    }
+    if (loader->handed_count == loader->count) {
+        pthread_mutex_unlock(&loader->lock);
+        return 1;
+    }
+
+    size_t n = loader->completed[loader->handed_count++];
+    struct qd_loader_file *file = &loader->files[n];
+    *index = n;
+    *buffer = file->buffer;
+    file->buffer = NULL;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (file->err) {
+        qd_error_raise(error, file->err == ENOMEM ? qd_err_no_memory : qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to load %s: %s", loader->paths[n], strerror(file->err));
+    }
+    return 0;
+}
+
+int qd_loader_uses_io_uring(const struct qd_loader *loader)
+{
+    return loader ? loader->uses_io_uring : 0;
+}
+
+void qd_loader_close(struct qd_loader *loader)
+{
+    if (!loader) {
+        return;
+    }
+
+    atomic_store(&loader->cancelled, 1);
+    for (unsigned int n = 0; n < loader->thread_count; ++n) {
+        pthread_join(loader->threads[n], NULL);
+    }
+#if defined(QD_ENABLE_IO_URING)
+    if (loader->uses_io_uring) {
+        qd_loader_ring_destroy(&loader->ring);
+    }
+#endif
+
+    for (size_t n = 0; loader->files && n < loader->count; ++n) {
+        if (loader->files[n].fd >= 0) {
+            close(loader->files[n].fd);
+        }
+        qd_buffer_free(loader->files[n].buffer);
+    }
+
+    pthread_cond_destroy(&loader->finished);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader->threads);
+    free(loader->completed);
+    free(loader->files);
+    free(loader);
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include "common/error.h"
+#include "internal/buffer.h"
+
+#if !defined(libQuickDraw_Loader)
+#define libQuickDraw_Loader
+
+/* A loader reads a batch of files into buffers, with many reads in flight at
+ * once, and hands each buffer back as soon as its file has been read so that
+ * parsing one file overlaps reading the rest.
+ *
+ * When the library is built with QD_ENABLE_IO_URING, on Linux, the reads are
+ * submitted through an io_uring from a single thread. Otherwise, or when the
+ * kernel does not allow io_uring, the files are read by a pool of threads that
+ * each read one file at a time. */
+struct qd_loader;
+
+/* Options for loading. Up to queue_depth files are read at once through io_uring,
+ * where 0 uses QD_LOADER_DEFAULT_QUEUE_DEPTH. The thread pool uses the given
+ * number of threads, where 0 uses QD_LOADER_DEFAULT_THREADS, and is used even
+ * when io_uring is available if use_threads is set. */
+struct qd_loader_options
+{
+    unsigned int queue_depth;
+    unsigned int threads;
+    int use_threads;
+    struct qd_error *error;
+};
+
+#define QD_LOADER_DEFAULT_QUEUE_DEPTH   64
+#define QD_LOADER_DEFAULT_THREADS       16
+
+/* Starts loading the files at the given paths, which must stay valid until the
+ * loader is closed. The reason that loading could not be started is raised into
+ * the error of the options. */
+int qd_loader_open(
+    struct qd_loader **out_loader,
+    const char *const *paths,
+    size_t count,
+    const struct qd_loader_options *options
+);
+
+/* Hands back the next file to have been read, waiting for one if none has,
+ * in the order that the reads finish. The index is the position of its path in
+ * the batch, and the buffer belongs to the caller. The buffer is NULL if the file
+ * could not be read, and the reason is raised into the error. Returns 1, without
+ * handing back a file, once every file has been handed back. It may be called
+ * from several threads at once. */
+int qd_loader_next(struct qd_loader *loader, size_t *index, struct qd_buffer **buffer, struct qd_error *error);
+
+/* Returns 1 if the files are being read through io_uring. */
+int qd_loader_uses_io_uring(const struct qd_loader *loader);
+
+/* Stops loading, waiting for the reads that are in flight, and frees the buffers
+ * of the files that have not been handed back. */
+void qd_loader_close(struct qd_loader *loader);
+
+#endif
@@ -19,39 +19,148 @@
  * SOFTWARE.
  */
 
-#include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 #include "internal/packbits.h"
 
-int qd_packbits_decode(uint8_t **out_data, uint8_t *packed_data, int length, int value_size)
+/* A count byte below 128 is followed by count + 1 literal values, and any other
+ * count byte by a single value that is repeated 257 - count times. */
+
+int qd_packbits_validate(const uint8_t *packed_data, size_t length, size_t capacity, int value_size)
 {
-	// We now know how many bytes the unpacked data requires.
-	uint8_t *data = *out_data;
-	uint32_t pos = 0;
-	uint32_t out_pos = 0;
+	size_t pos = 0;
+	size_t out_pos = 0;
 	while (pos < length) {
 		uint8_t count = packed_data[pos++];
-		if (count >= 0 && count < 128) {
-			uint16_t run = (1 + count) * value_size;
-			memmove(data + out_pos, packed_data + pos, run);
-			pos += run;
-			out_pos += run;
-		}
-		else if (count >= 128) {
-			uint8_t run = 256 - count + 1;
-			uint8_t value[value_size];
-			memmove(value, packed_data + pos, value_size);
-			pos += value_size;
-			for (uint8_t i = 0; i < run; ++i) {
-				memmove(data + out_pos, value, value_size);
-				out_pos += value_size;
-			}
+		size_t in, out;
+		if (count < 128) {
+			in = out = (size_t)(1 + count) * value_size;
 		}
 		else {
-			// No-op
+			in = value_size;
+			out = (size_t)(257 - count) * value_size;
+		}
+
+		if (in > length - pos || out > capacity - out_pos) {
+			return 1;
+		}
+		pos += in;
+		out_pos += out;
+	}
+
+	return 0;
+}
+
+size_t qd_packbits_decode(uint8_t *restrict out, const uint8_t *restrict packed_data, size_t length, int value_size)
+{
+	const uint8_t *end = packed_data + length;
+	uint8_t *start = out;
+	while (packed_data < end) {
+		uint8_t count = *packed_data++;
+		if (count < 128) {
+			size_t run = (size_t)(1 + count) * value_size;
+			memcpy(out, packed_data, run);
+			packed_data += run;
+			out += run;
+		}
+		else if (value_size == 1) {
+			size_t run = 257 - count;
+			memset(out, *packed_data++, run);
+			out += run;
 		}
+		else {
+			for (int i = 257 - count; i > 0; --i) {
+				memcpy(out, packed_data, value_size);
+				out += value_size;
+			}
+			packed_data += value_size;
+		}
+	}
+
+	return (size_t)(out - start);
+}
+
+// MARK: - Encoding
+
+/* Runs are found eight bytes at a time, by comparing each word of the data with
+ * the word one item further on. Item n is equal to item n + 1 exactly when byte
+ * j is equal to byte j + value_size for each byte j of the item, so the bytes
+ * that are equal to the ones an item later show where the runs are. */
+
+static inline uint64_t qd_packbits_load(const uint8_t *data)
+{
+	uint64_t word;
+	memcpy(&word, data, sizeof(word));
+	return word;
+}
+
+/* Returns whether any byte of the word is zero. */
+static inline int qd_packbits_has_zero_byte(uint64_t word)
+{
+	return ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) != 0;
+}
+
+/* Counts the items of the data, up to limit, that are equal to the first. */
+static inline size_t qd_packbits_run_length(const uint8_t *data, size_t limit, int value_size)
+{
+	size_t bytes = (limit - 1) * value_size;
+	size_t n = 0;
+	while (n + sizeof(uint64_t) <= bytes && qd_packbits_load(data + n) == qd_packbits_load(data + n + value_size)) {
+		n += sizeof(uint64_t);
+	}
+	while (n < bytes && data[n] == data[n + value_size]) {
+		++n;
+	}
+	return 1 + n / value_size;
+}
+
+/* Counts the items of the data, up to limit, that come before the next run of
+ * three equal items. There are count items left in the data. A word with no byte
+ * equal to the byte an item later holds no item equal to the next, so the whole
+ * word is skipped, and only the other words are checked item by item. */
+static inline size_t qd_packbits_literal_length(const uint8_t *data, size_t limit, size_t count, int value_size)
+{
+	size_t n = 0;
+	while (n < limit) {
+		if ((n + 1) * value_size + sizeof(uint64_t) <= count * value_size
+			&& !qd_packbits_has_zero_byte(qd_packbits_load(data + n * value_size) ^ qd_packbits_load(data + (n + 1) * value_size))) {
+			n += sizeof(uint64_t) / value_size;
+			continue;
+		}
+
+		const uint8_t *item = data + n * value_size;
+		if (n + 2 < count && memcmp(item, item + value_size, value_size) == 0 && memcmp(item, item + 2 * value_size, value_size) == 0) {
+			break;
+		}
+		++n;
+	}
+	return n < limit ? n : limit;
+}
+
+size_t qd_packbits_encode(uint8_t *restrict out, const uint8_t *restrict data, size_t length, int value_size)
+{
+	size_t count = length / value_size;
+	size_t pos = 0;
+	uint8_t *p = out;
+
+	while (pos < count) {
+		const uint8_t *item = data + pos * value_size;
+		size_t limit = (count - pos < 128) ? count - pos : 128;
+
+		size_t run = qd_packbits_run_length(item, limit, value_size);
+		if (run >= 3) {
+			*p++ = (uint8_t)(257 - run);
+			memcpy(p, item, value_size);
+			p += value_size;
+			pos += run;
+			continue;
+		}
+
+		size_t literal = qd_packbits_literal_length(item, limit, count - pos, value_size);
+		*p++ = (uint8_t)(literal - 1);
+		memcpy(p, item, literal * value_size);
+		p += literal * value_size;
+		pos += literal;
 	}
 
-	return out_pos;
+	return (size_t)(p - out);
 }
@@ -19,11 +19,28 @@
  * SOFTWARE.
  */
 
+#include <stddef.h>
 #include "common/types.h"
 
 #if !defined(libQuickDraw_PackBits)
 #define libQuickDraw_PackBits
 
-int qd_packbits_decode(uint8_t **out_data, uint8_t *packed_data, int length, int value_size);
+/* Checks that length bytes of packed data are made of whole runs, and that they
+ * unpack to no more than capacity bytes. Returns 1 if they do not. */
+int qd_packbits_validate(const uint8_t *packed_data, size_t length, size_t capacity, int value_size);
+
+/* Unpacks length bytes of packed data into out, returning the number of bytes
+ * written. There are no bounds checks, so the packed data must have been checked
+ * by qd_packbits_validate against the size of out beforehand. */
+size_t qd_packbits_decode(uint8_t *restrict out, const uint8_t *restrict packed_data, size_t length, int value_size);
+
+/* The most bytes that length bytes of data can pack to. */
+#define QD_PACKBITS_MAX_PACKED(length)  ((length) + (length) / 128 + 1)
+
+/* Packs length bytes of data, in items of value_size bytes, into out, returning
+ * the packed length. Runs of three or more equal items are packed, and everything
+ * between them is copied as literals. The output must have room for
+ * QD_PACKBITS_MAX_PACKED(length) bytes. */
+size_t qd_packbits_encode(uint8_t *restrict out, const uint8_t *restrict data, size_t length, int value_size);
 
 #endif
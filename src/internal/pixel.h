@@ -0,0 +1,112 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include "common/types.h"
+
+#if !defined(libQuickDraw_Pixel)
+#define libQuickDraw_Pixel
+
+/* Surface pixels are stored as R, G, B, A bytes in memory, so the word value of
+ * a pixel depends on the host byte order. Pixels are built and taken apart
+ * through memory to stay independent of that. */
+
+static inline uint32_t qd_pixel_pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    uint8_t bytes[4] = { r, g, b, a };
+    uint32_t px = 0;
+    memcpy(&px, bytes, sizeof(px));
+    return px;
+}
+
+static inline uint32_t qd_pixel_pack_rgb_color(struct qd_rgb_color color)
+{
+    return qd_pixel_pack(color.red >> 8, color.green >> 8, color.blue >> 8, UINT8_MAX);
+}
+
+/* The number of bytes occupied by a pixel of a direct pixel format, or 0 for the
+ * indexed formats. */
+static inline uint32_t qd_pixel_format_bytes(uint32_t format)
+{
+    switch (format) {
+        case qd_16_555_pixel_format:
+        case qd_16_le_555_pixel_format:
+        case qd_16_le_565_pixel_format:
+        case qd_16_be_565_pixel_format:
+            return 2;
+        case qd_24_rgb_pixel_format:
+        case qd_24_bgr_pixel_format:
+            return 3;
+        case qd_32_argb_pixel_format:
+        case qd_32_bgra_pixel_format:
+        case qd_32_abgr_pixel_format:
+        case qd_32_rgba_pixel_format:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/* Packs a color into the memory representation of a direct pixel format. The
+ * bytes of the pixel occupy the start of the returned word in memory, so that a
+ * pixel is written by copying qd_pixel_format_bytes() bytes of it. */
+static inline uint32_t qd_pixel_pack_format(uint32_t format, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    uint8_t bytes[4] = { 0 };
+    uint16_t v = 0;
+
+    switch (format) {
+        case qd_32_rgba_pixel_format:
+            return qd_pixel_pack(r, g, b, a);
+        case qd_32_argb_pixel_format:
+            return qd_pixel_pack(a, r, g, b);
+        case qd_32_bgra_pixel_format:
+            return qd_pixel_pack(b, g, r, a);
+        case qd_32_abgr_pixel_format:
+            return qd_pixel_pack(a, b, g, r);
+        case qd_24_rgb_pixel_format:
+            return qd_pixel_pack(r, g, b, 0);
+        case qd_24_bgr_pixel_format:
+            return qd_pixel_pack(b, g, r, 0);
+        case qd_16_555_pixel_format:
+        case qd_16_le_555_pixel_format:
+            v = (uint16_t)(((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3));
+            break;
+        case qd_16_be_565_pixel_format:
+        case qd_16_le_565_pixel_format:
+            v = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+            break;
+        default:
+            return 0;
+    }
+
+    if (format == qd_16_555_pixel_format || format == qd_16_be_565_pixel_format) {
+        bytes[0] = (uint8_t)(v >> 8);
+        bytes[1] = (uint8_t)v;
+    }
+    else {
+        bytes[0] = (uint8_t)v;
+        bytes[1] = (uint8_t)(v >> 8);
+    }
+    return qd_pixel_pack(bytes[0], bytes[1], bytes[2], bytes[3]);
+}
+
+#endif
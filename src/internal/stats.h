@@ -0,0 +1,55 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#if !defined(libQuickDraw_Stats)
+#define libQuickDraw_Stats
+
+/* Gathering statistics is compiled in with QD_ENABLE_STATS. Without it, each of
+ * the macros below expands to nothing, and the code that gathers statistics is
+ * not compiled at all. Code that only exists to gather statistics goes inside of
+ * QD_STATS(...). */
+#if defined(QD_ENABLE_STATS)
+
+/* A monotonic clock, in nanoseconds. */
+uint64_t qd_stats_now(void);
+
+#   define QD_STATS(...)                __VA_ARGS__
+#   define QD_STATS_ADD(stats, field, n) \
+        do { if (stats) { (stats)->field += (n); } } while (0)
+#   define QD_STATS_ALLOC(stats, size) \
+        do { if (stats) { (stats)->allocations++; (stats)->bytes_allocated += (size); } } while (0)
+#   define QD_STATS_BEGIN(name)         uint64_t name = qd_stats_now()
+#   define QD_STATS_END(stats, stage, name) \
+        do { if (stats) { (stats)->stage_ns[stage] += qd_stats_now() - (name); } } while (0)
+
+#else
+
+#   define QD_STATS(...)
+#   define QD_STATS_ADD(stats, field, n)            ((void)0)
+#   define QD_STATS_ALLOC(stats, size)              ((void)0)
+#   define QD_STATS_BEGIN(name)                     ((void)0)
+#   define QD_STATS_END(stats, stage, name)         ((void)0)
+
+#endif
+
+#endif
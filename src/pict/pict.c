@@ -19,17 +19,28 @@
  * SOFTWARE.
  */
 
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pict/pict.h"
+#include "common/blit.h"
 #include "common/color_table.h"
+#include "common/convert.h"
+#include "common/palette.h"
 #include "common/pixmap.h"
 #include "common/geometry.h"
+#include "common/tiled_surface.h"
 #include "internal/packbits.h"
+#include "internal/pixel.h"
+#include "internal/stats.h"
+#include "internal/threads.h"
 
 // MARK: - PICT Constants
 
 #define PICT_V2_MAGIC 				0x001102ff
-#define PACK_BITS_THRESHOLD         4
+#define PACK_BITS_THRESHOLD         8
 
 // MARK: - PICT Opcodes
 
@@ -37,275 +48,1538 @@ enum qd_pict_opcode
 {
 	qd_pict_opcode_nop              = 0x0000,
 	qd_pict_opcode_clip_region      = 0x0001,
+	qd_pict_opcode_bk_pat           = 0x0002,
+	qd_pict_opcode_pn_size          = 0x0007,
+	qd_pict_opcode_pn_mode          = 0x0008,
+	qd_pict_opcode_pn_pat           = 0x0009,
+	qd_pict_opcode_fill_pat         = 0x000A,
+	qd_pict_opcode_bk_pix_pat       = 0x0012,
+	qd_pict_opcode_pn_pix_pat       = 0x0013,
+	qd_pict_opcode_fill_pix_pat     = 0x0014,
+	qd_pict_opcode_rgb_fg_color     = 0x001A,
+	qd_pict_opcode_rgb_bk_color     = 0x001B,
+	qd_pict_opcode_op_color         = 0x001F,
+	qd_pict_opcode_frame_rect       = 0x0030,
+	qd_pict_opcode_paint_rect       = 0x0031,
+	qd_pict_opcode_erase_rect       = 0x0032,
+	qd_pict_opcode_invert_rect      = 0x0033,
+	qd_pict_opcode_fill_rect        = 0x0034,
+	qd_pict_opcode_frame_same_rect  = 0x0038,
+	qd_pict_opcode_paint_same_rect  = 0x0039,
+	qd_pict_opcode_erase_same_rect  = 0x003A,
+	qd_pict_opcode_invert_same_rect = 0x003B,
+	qd_pict_opcode_fill_same_rect   = 0x003C,
+	qd_pict_opcode_bits_rect        = 0x0090,
+	qd_pict_opcode_pack_bits_rect   = 0x0098,
 	qd_pict_opcode_direct_bits_rect = 0x009A,
 	qd_pict_opcode_eof              = 0x00FF,
 	qd_pict_opcode_def_hilite       = 0x001E,
 	qd_pict_opcode_long_comment     = 0x00A1,
 	qd_pict_opcode_ext_header       = 0x0C00,
+	qd_pict_opcode_compressed_qt    = 0x8200,
 };
 
+// MARK: - Errors
+
+/* Raises an error against the opcode that is being read, at the current position
+ * of the buffer, or with no offset if there is no buffer. */
+static int qd_pict_error(const struct qd_pict *pict, struct qd_buffer *buffer, enum qd_err code, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	long offset = buffer ? qd_buffer_tell(buffer) : QD_ERROR_NO_OFFSET;
+	qd_error_vraise(pict->error, code, offset, pict->opcode, format, args);
+	va_end(args);
+	return 1;
+}
+
 // MARK: - Picture Parser
 
-static inline int qd_pict_read_pict_rect(struct qd_rect *rect, struct qd_buffer *restrict buffer)
+static inline int qd_pict_read_pict_rect(const struct qd_pict *pict, struct qd_rect *rect, struct qd_buffer *restrict buffer)
+{
+	// Rects in the PICT opcodes are encoded as a standard QuickDraw Rect (top, left, bottom, right).
+	// The source and destination rects of the bitmap opcodes must be read this way in order for the
+	// bitmaps to be positioned correctly within the frame.
+	if (qd_buffer_read(rect, sizeof(int16_t), 4, buffer) != 4) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PICT rect from PICT.");
+	}
+
+	return 0;
+}
+
+static inline int qd_pict_read_rgb_color(const struct qd_pict *pict, struct qd_rgb_color *color, struct qd_buffer *restrict buffer)
+{
+	if (qd_buffer_read(color, sizeof(unsigned short), 3, buffer) != 3) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read RGB color from PICT.");
+	}
+
+	return 0;
+}
+
+static inline int qd_read_opcode(uint16_t *opcode, struct qd_buffer *restrict buffer)
+{
+	long pos = qd_buffer_tell(buffer);
+	pos += pos % sizeof(uint16_t);
+	qd_buffer_seek(buffer, pos, SEEK_SET);
+
+	return qd_buffer_read(opcode, sizeof(uint16_t), 1, buffer) != 1;
+}
+
+static inline int qd_pict_read_region(struct qd_pict *pict, struct qd_rect *rect, struct qd_buffer *restrict buffer)
+{
+	uint16_t size = 0;
+	if (qd_buffer_read(&size, sizeof(uint16_t), 1, buffer) != 1) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the size of a clip region in PICT.");
+	}
+
+	if (qd_buffer_read(rect, sizeof(short), 4, buffer) != 4) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the clip region rect in PICT.");
+	}
+
+	rect->left /= pict->x_ratio;
+	rect->right /= pict->x_ratio;
+	rect->top /= pict->y_ratio;
+	rect->bottom /= pict->y_ratio;
+
+	uint32_t points = (size - 10) >> 2;
+	qd_buffer_seek(buffer, sizeof(uint16_t) * 2 * points, SEEK_CUR);
+
+	return 0;
+}
+
+static inline int qd_pict_read_long_comment(const struct qd_pict *pict, struct qd_buffer *restrict buffer)
+{
+	qd_buffer_seek(buffer, 2, SEEK_CUR);
+
+	int16_t length = 0;
+	if (qd_buffer_read(&length, sizeof(int16_t), 1, buffer) != 1) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read long comment length from PICT.");
+	}
+
+	qd_buffer_seek(buffer, (long)length, SEEK_CUR);
+
+	return 0;
+}
+
+static inline uint32_t qd_pict_scale_shift(const struct qd_pict *pict)
+{
+	switch (pict->scale) {
+		case 2:		return 1;
+		case 4:		return 2;
+		case 8:		return 3;
+		default:	return 0;
+	}
+}
+
+static inline struct qd_rect qd_pict_reduce_rect(struct qd_rect r, uint32_t shift)
+{
+	// Round outwards so that partially covered pixels of a thumbnail are kept.
+	short round = (short)((1 << shift) - 1);
+	struct qd_rect result = {
+		r.top >> shift, r.left >> shift, (r.bottom + round) >> shift, (r.right + round) >> shift
+	};
+	return result;
+}
+
+static int qd_pict_prepare_surface(struct qd_pict *pict)
+{
+	if (pict->surface || pict->tiles) {
+		return 0;
+	}
+
+	if (qd_rect_get_width(pict->frame) <= 0 || qd_rect_get_height(pict->frame) <= 0) {
+		return qd_pict_error(pict, NULL, qd_err_invalid, "Unable to create a surface for an empty PICT frame.");
+	}
+
+	uint32_t shift = qd_pict_scale_shift(pict);
+	uint32_t round = (1U << shift) - 1;
+	pict->width = (qd_rect_get_width(pict->frame) + round) >> shift;
+	pict->height = (qd_rect_get_height(pict->frame) + round) >> shift;
+	pict->size = (uint64_t)pict->width * pict->height * sizeof(uint32_t);
+	pict->row_bytes = (size_t)pict->width * sizeof(uint32_t);
+
+	// Pictures are drawn into a port that has been erased to white. The tiles of a
+	// tiled surface start out white as they are allocated.
+	if (pict->target) {
+		const struct qd_surface *target = pict->target;
+		if (!target->data || target->width < pict->width || target->height < pict->height) {
+			return qd_pict_error(pict, NULL, qd_err_argument, "The target surface is smaller than the PICT surface (%ux%u).", pict->width, pict->height);
+		}
+		pict->surface = target->data;
+		pict->surface_borrowed = 1;
+		pict->row_bytes = target->row_bytes;
+		for (uint32_t y = 0; y < pict->height; ++y) {
+			memset((uint8_t *)pict->surface + y * pict->row_bytes, UINT8_MAX, (size_t)pict->width * sizeof(uint32_t));
+		}
+		return 0;
+	}
+
+	if (pict->tiled) {
+		if (!(pict->tiles = malloc(sizeof(*pict->tiles)))
+			|| qd_tiled_surface_init(pict->tiles, pict->width, pict->height, UINT32_MAX)) {
+			free(pict->tiles);
+			pict->tiles = NULL;
+			return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate the tiles of the PICT surface.");
+		}
+		return 0;
+	}
+
+	if (pict->size > SIZE_MAX || !(pict->surface = malloc((size_t)pict->size))) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate the PICT surface.");
+	}
+	QD_STATS_ALLOC(pict->stats, pict->size);
+	memset(pict->surface, UINT8_MAX, (size_t)pict->size);
+	return 0;
+}
+
+/* Draws into the rect of the prepared PICT surface, given in the coordinates of the
+ * surface. A surface in one piece is drawn into in one go. A tiled surface is drawn
+ * into a tile at a time, and draw subtracts the position of each tile from the
+ * coordinates that it draws at. */
+static int qd_pict_draw(struct qd_pict *pict, struct qd_rect rect, qd_tiled_surface_draw_function draw, void *context)
+{
+	if (pict->tiles) {
+		return qd_tiled_surface_draw(pict->tiles, rect, draw, context);
+	}
+
+	struct qd_surface surface = { pict->surface, pict->width, pict->height, pict->row_bytes };
+	return draw(context, &surface, 0, 0);
+}
+
+// MARK: - Statistics
+
+#if defined(QD_ENABLE_STATS)
+
+/* The statistics of decoding a single bitmap, which is done on its own thread and
+ * added to the statistics of the picture afterwards. */
+struct qd_pict_decode_stats
+{
+	uint64_t compressed_bytes;
+	uint64_t decompressed_bytes;
+	uint64_t rows_decoded;
+	uint64_t allocations;
+	uint64_t bytes_allocated;
+	uint64_t stage_ns[qd_pict_stage_count];
+};
+
+static inline void qd_pict_trace_begin(const struct qd_pict *pict, enum qd_pict_stage stage)
+{
+	if (pict->trace && pict->trace->begin) {
+		pict->trace->begin(pict->trace->context, stage, pict);
+	}
+}
+
+static inline void qd_pict_trace_end(const struct qd_pict *pict, enum qd_pict_stage stage)
+{
+	if (pict->trace && pict->trace->end) {
+		pict->trace->end(pict->trace->context, stage, pict);
+	}
+}
+
+static void qd_pict_stats_count_opcode(struct qd_pict_stats *stats, uint16_t opcode, uint64_t bytes)
+{
+	if (!stats) {
+		return;
+	}
+
+	size_t n = 0;
+	while (n < stats->opcode_count && stats->opcodes[n].opcode != opcode) {
+		++n;
+	}
+	if (n == QD_PICT_STATS_MAX_OPCODES) {
+		return;
+	}
+	if (n == stats->opcode_count) {
+		stats->opcodes[stats->opcode_count++].opcode = opcode;
+	}
+
+	stats->opcodes[n].count++;
+	stats->opcodes[n].bytes += bytes;
+}
+
+static void qd_pict_stats_merge(struct qd_pict_stats *stats, const struct qd_pict_decode_stats *decode)
+{
+	if (!stats) {
+		return;
+	}
+
+	stats->compressed_bytes += decode->compressed_bytes;
+	stats->decompressed_bytes += decode->decompressed_bytes;
+	stats->rows_decoded += decode->rows_decoded;
+	stats->allocations += decode->allocations;
+	stats->bytes_allocated += decode->bytes_allocated;
+	for (int stage = 0; stage < qd_pict_stage_count; ++stage) {
+		stats->stage_ns[stage] += decode->stage_ns[stage];
+	}
+}
+
+#endif
+
+// MARK: - Bitmap Opcodes
+
+/* All of the bitmap opcodes end with pixel data that is decoded row by row,
+ * converted to RGBA and transferred into the PICT surface. This describes an
+ * individual bitmap opcode, once its header has been read, along with where its
+ * pixel data starts in the buffer and the surface it is decoded into. */
+struct qd_pict_bitmap
+{
+	struct qd_pixmap *pm;
+	struct qd_rect source_rect;
+	struct qd_rect destination_rect;
+	struct qd_transfer transfer;
+	struct qd_converter convert;
+	short pack_type;
+	size_t row_length;
+	int packed;
+	int opaque;
+	long data_offset;
+	int32_t opcode;
+	struct qd_surface bits;
+	struct qd_error error;
+	QD_STATS(struct qd_pict_decode_stats stats;)
+};
+
+/* Bitmap opcodes are only scanned as they are encountered, and are queued until
+ * an opcode that draws into the surface, or the end of the picture, needs them
+ * to have been drawn. The queued bitmaps are then decoded concurrently, and
+ * transferred into the surface in the order of their opcodes. Pictures that are
+ * made up of many strips of pixels, such as scanned documents, decode all of
+ * their strips at once. Decoding on the calling thread alone gains nothing from
+ * queuing, so each bitmap is then drawn by its own opcode. */
+#define QD_PICT_MAX_QUEUED_BITMAPS  64
+
+struct qd_pict_bitmap_queue
+{
+	struct qd_pict_bitmap *bitmaps;
+	size_t count;
+	size_t capacity;
+};
+
+static void qd_pict_convert_planar_row(struct qd_pixmap *pm, const uint8_t *raw, uint8_t *rgb, uint32_t width)
+{
+	if (pm->cmp_count == 3) {
+		// RGB Formatted Data
+		for (uint32_t x = 0; x < width; ++x) {
+			*rgb++ = raw[x];
+			*rgb++ = raw[width + x];
+			*rgb++ = raw[2 * width + x];
+			*rgb++ = UINT8_MAX;
+		}
+	}
+	else {
+		// ARGB Formatted Data
+		for (uint32_t x = 0; x < width; ++x) {
+			*rgb++ = raw[width + x];
+			*rgb++ = raw[2 * width + x];
+			*rgb++ = raw[3 * width + x];
+			*rgb++ = raw[x];
+		}
+	}
+}
+
+static inline void qd_pict_convert_row(struct qd_pict_bitmap *bitmap, const uint8_t *raw, uint8_t *rgb, uint32_t width)
+{
+	if (!bitmap->convert.kernel) {
+		qd_pict_convert_planar_row(bitmap->pm, raw, rgb, width);
+		return;
+	}
+
+	qd_convert_row(&bitmap->convert, rgb, raw, width);
+
+	// Chunky 32-bit pixels with three components carry a pad byte, not alpha.
+	if (bitmap->opaque) {
+		for (uint32_t x = 0; x < width; ++x) {
+			rgb[4 * x + 3] = UINT8_MAX;
+		}
+	}
+}
+
+static int qd_pict_read_bitmap_rects(struct qd_pict *pict, struct qd_pict_bitmap *bitmap, struct qd_buffer *restrict buffer)
+{
+	if (qd_pict_read_pict_rect(pict, &bitmap->source_rect, buffer) || qd_pict_read_pict_rect(pict, &bitmap->destination_rect, buffer)) {
+		// Abort if failed to read either rect!
+		return 1;
+	}
+
+	bitmap->transfer.op_color = pict->op_color;
+	bitmap->transfer.bk_color = pict->bk_color;
+	if (qd_buffer_read(&bitmap->transfer.mode, sizeof(short), 1, buffer) != 1) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the transfer mode of the PixMap in PICT.");
+	}
+
+	return 0;
+}
+
+/* Checks that each row of a bitmap holds every pixel that is converted from it.
+ * The row bytes and the bounds of a PixMap are independent fields of the picture,
+ * and rows are converted without any further checks, so rows that are too short
+ * for the width of the bounds are rejected before any pixel data is read. */
+static int qd_pict_validate_row_length(
+	const struct qd_pict *pict,
+	const struct qd_pixmap *pm,
+	size_t row_length,
+	uint32_t bits_per_pixel,
+	struct qd_buffer *restrict buffer
+) {
+	uint64_t width = (uint32_t)qd_rect_get_width(pm->bounds);
+	uint64_t length = (width * bits_per_pixel + 7) / 8;
+	if (row_length < length) {
+		return qd_pict_error(pict, buffer, qd_err_invalid, "PixMap rows of %zu bytes are too short for its width of %u pixels in PICT.", row_length, (uint32_t)width);
+	}
+
+	return 0;
+}
+
+/* Checks the pixel data of a single row, and moves past it without unpacking it.
+ * Returns 1 if the row extends beyond the end of the buffer, or if a packed row
+ * unpacks to more than capacity bytes. */
+static int qd_pict_validate_bitmap_row(
+	const struct qd_pixmap *pm,
+	size_t row_length,
+	int packed,
+	int value_size,
+	size_t capacity,
+	struct qd_buffer *restrict buffer
+) {
+	uint8_t tmp8 = 0;
+	uint16_t packed_bytes_count = 0;
+
+	if (!packed) {
+		// No pack bits compression.
+		if (!qd_buffer_peek(buffer, row_length)) {
+			return 1;
+		}
+		qd_buffer_seek(buffer, (long)row_length, SEEK_CUR);
+		return 0;
+	}
+
+	if (pm->row_bytes > 250) {
+		// Pack bits compression is in place, with the length encoded as a short.
+		if (qd_buffer_read(&packed_bytes_count, sizeof(uint16_t), 1, buffer) != 1) {
+			return 1;
+		}
+	}
+	else {
+		// Pack bits compression is in place, with the length encoded as a byte.
+		if (qd_buffer_read(&tmp8, sizeof(uint8_t), 1, buffer) != 1) {
+			return 1;
+		}
+		packed_bytes_count = (uint16_t)tmp8;
+	}
+
+	const uint8_t *packed_data = qd_buffer_peek(buffer, packed_bytes_count);
+	if (!packed_data || qd_packbits_validate(packed_data, packed_bytes_count, capacity, value_size)) {
+		return 1;
+	}
+	qd_buffer_seek(buffer, packed_bytes_count, SEEK_CUR);
+	return 0;
+}
+
+/* Reads the pixel data of a single row that has already been checked by
+ * qd_pict_validate_bitmap_row, returning the unpacked row and moving the cursor
+ * past it. Nothing is bounds checked here. Rows that are not packed are used in
+ * place rather than being copied, and packed rows are unpacked into the raw row. */
+static inline const uint8_t *qd_pict_unpack_bitmap_row(
+	const struct qd_pixmap *pm,
+	size_t row_length,
+	int packed,
+	int value_size,
+	uint8_t *raw,
+	const uint8_t **cursor
+) {
+	const uint8_t *data = *cursor;
+	if (!packed) {
+		*cursor = data + row_length;
+		return data;
+	}
+
+	size_t packed_bytes_count = *data++;
+	if (pm->row_bytes > 250) {
+		packed_bytes_count = (packed_bytes_count << 8) | *data++;
+	}
+
+	qd_packbits_decode(raw, data, packed_bytes_count, value_size);
+	*cursor = data + packed_bytes_count;
+	return raw;
+}
+
+/* Checks the pixel data of a bitmap, and moves past it. This is the only pass over
+ * the pixel data that is bounds checked: once it succeeds the bitmap is queued and
+ * decoded by qd_pict_decode_bitmap without any further checks. The row length has
+ * already been checked against the bounds by qd_pict_validate_row_length. Unpacked
+ * rows are all the same length, so the whole of their pixel data is checked at once.
+ * Packed rows are checked run by run, against the raw row they are unpacked into. */
+static int qd_pict_validate_bitmap_data(const struct qd_pict *pict, struct qd_pict_bitmap *bitmap, struct qd_buffer *restrict buffer)
+{
+	struct qd_pixmap *pm = bitmap->pm;
+	uint32_t height = qd_rect_get_height(pm->bounds);
+
+	if (!bitmap->packed) {
+		uint64_t length = (uint64_t)bitmap->row_length * height;
+		if (!qd_buffer_peek(buffer, length)) {
+			return qd_pict_error(pict, buffer, qd_err_truncated, "PixMap pixel data extends beyond the end of the PICT buffer.");
+		}
+		qd_buffer_seek(buffer, (long)length, SEEK_CUR);
+		return 0;
+	}
+
+	int value_size = (bitmap->pack_type == 3) ? sizeof(uint16_t) : sizeof(uint8_t);
+	for (uint32_t scanline = 0; scanline < height; ++scanline) {
+		if (qd_pict_validate_bitmap_row(pm, bitmap->row_length, 1, value_size, pm->row_bytes, buffer)) {
+			return qd_pict_error(pict, buffer, qd_err_truncated, "Row %u of PixMap extends beyond the end of its row or of the PICT buffer.", scanline);
+		}
+	}
+
+	return 0;
+}
+
+/* Decodes the pixel data of a queued bitmap into its own surface. This only reads
+ * from the picture and the buffer, so that several bitmaps can be decoded at the
+ * same time, and raises errors into the bitmap rather than the picture. The pixel
+ * data was validated when the bitmap was queued, so it is read without checks. */
+static int qd_pict_decode_bitmap(const struct qd_pict *pict, struct qd_pict_bitmap *bitmap, const struct qd_buffer *buffer)
+{
+	struct qd_pixmap *pm = bitmap->pm;
+	int value_size = (bitmap->pack_type == 3) ? sizeof(uint16_t) : sizeof(uint8_t);
+	QD_STATS(struct qd_pict_decode_stats *stats = pict->stats ? &bitmap->stats : NULL;)
+	QD_STATS(qd_pict_trace_begin(pict, qd_pict_stage_decode);)
+	QD_STATS_BEGIN(decode_start);
+
+	// The pixel data covers the entire bounds of the PixMap, and is decoded into
+	// its own surface before being transferred into the PICT surface. When decoding
+	// a thumbnail, rows are box filtered as they are converted so that only the
+	// reduced pixels are ever stored.
+	uint32_t height = qd_rect_get_height(pm->bounds);
+	uint32_t width = qd_rect_get_width(pm->bounds);
+	uint32_t shift = qd_pict_scale_shift(pict);
+	uint32_t scale = 1U << shift;
+
+	struct qd_surface *bits = &bitmap->bits;
+	bits->width = (width + scale - 1) >> shift;
+	bits->height = (height + scale - 1) >> shift;
+	bits->row_bytes = (size_t)bits->width * sizeof(uint32_t);
+	bits->data = malloc(bits->row_bytes * bits->height);
+
+	// We're going to allocate memory privately, and not as part of the main PICT structure.
+	uint8_t *raw = calloc(pm->row_bytes, 1);
+	uint8_t *row = shift ? malloc((size_t)width * sizeof(uint32_t)) : NULL;
+	uint32_t *sums = shift ? calloc((size_t)bits->width * 4, sizeof(*sums)) : NULL;
+
+	if (!bits->data || !raw || (shift && (!row || !sums))) {
+		qd_error_raise(&bitmap->error, qd_err_no_memory, bitmap->data_offset, bitmap->opcode, "Failed to allocate memory for PixMap in PICT.");
+		goto ERROR;
+	}
+	QD_STATS_ALLOC(stats, bits->row_bytes * bits->height);
+	QD_STATS_ALLOC(stats, (size_t)pm->row_bytes);
+	QD_STATS(if (shift) { QD_STATS_ALLOC(stats, (size_t)width * sizeof(uint32_t) + (size_t)bits->width * 4 * sizeof(*sums)); })
+
+	const uint8_t *cursor = (const uint8_t *)buffer->data + bitmap->data_offset;
+	for (uint32_t scanline = 0; scanline < height; ++scanline) {
+		QD_STATS(const uint8_t *row_start = cursor;)
+		QD_STATS_BEGIN(packbits_start);
+		const uint8_t *data = qd_pict_unpack_bitmap_row(pm, bitmap->row_length, bitmap->packed, value_size, raw, &cursor);
+		QD_STATS_END(stats, qd_pict_stage_packbits, packbits_start);
+		QD_STATS_ADD(stats, compressed_bytes, cursor - row_start);
+		QD_STATS_ADD(stats, decompressed_bytes, bitmap->row_length);
+		QD_STATS_ADD(stats, rows_decoded, 1);
+
+		QD_STATS_BEGIN(convert_start);
+		if (!shift) {
+			qd_pict_convert_row(bitmap, data, (uint8_t *)bits->data + scanline * bits->row_bytes, width);
+			QD_STATS_END(stats, qd_pict_stage_convert, convert_start);
+			continue;
+		}
+
+		// Accumulate the converted row into the current band of the thumbnail, and
+		// emit the band once all of its rows have been seen.
+		qd_pict_convert_row(bitmap, data, row, width);
+		for (uint32_t x = 0; x < width; ++x) {
+			uint32_t *sum = sums + ((x >> shift) << 2);
+			sum[0] += row[(x << 2) + 0];
+			sum[1] += row[(x << 2) + 1];
+			sum[2] += row[(x << 2) + 2];
+			sum[3] += row[(x << 2) + 3];
+		}
+
+		if (((scanline + 1) & (scale - 1)) == 0 || scanline + 1 == height) {
+			uint32_t rows = (scanline & (scale - 1)) + 1;
+			uint8_t *out = (uint8_t *)bits->data + (scanline >> shift) * bits->row_bytes;
+			for (uint32_t x = 0; x < bits->width; ++x) {
+				uint32_t columns = width - (x << shift);
+				uint32_t area = (columns < scale ? columns : scale) * rows;
+				for (int c = 0; c < 4; ++c) {
+					*out++ = (uint8_t)((sums[(x << 2) + c] + (area >> 1)) / area);
+				}
+			}
+			memset(sums, 0, (size_t)bits->width * 4 * sizeof(*sums));
+		}
+		QD_STATS_END(stats, qd_pict_stage_convert, convert_start);
+	}
+
+	free(raw);
+	free(row);
+	free(sums);
+	QD_STATS_END(stats, qd_pict_stage_decode, decode_start);
+	QD_STATS(qd_pict_trace_end(pict, qd_pict_stage_decode);)
+	return 0;
+
+ERROR:
+	free(raw);
+	free(row);
+	free(sums);
+	free(bits->data);
+	bits->data = NULL;
+	QD_STATS(qd_pict_trace_end(pict, qd_pict_stage_decode);)
+	return 1;
+}
+
+struct qd_pict_composite
+{
+	const struct qd_pict_bitmap *bitmap;
+	struct qd_rect source_rect;
+	struct qd_rect destination_rect;
+	int failed;
+};
+
+static int qd_pict_composite_tile(void *context, struct qd_surface *surface, long left, long top)
+{
+	// Each tile only resamples the part of the destination rect that lies within
+	// it, so drawing a tile at a time gives the same pixels as drawing in one go.
+	struct qd_pict_composite *composite = context;
+	struct qd_rect destination_rect = qd_rect_offset(composite->destination_rect, (short)-left, (short)-top);
+	const struct qd_pict_bitmap *bitmap = composite->bitmap;
+	composite->failed = qd_blit_scaled(surface, destination_rect, &bitmap->bits, composite->source_rect, &bitmap->transfer, qd_blit_filter_box);
+	return composite->failed;
+}
+
+static int qd_pict_composite_bitmap(struct qd_pict *pict, struct qd_pict_bitmap *bitmap)
+{
+	// Transfer the decoded pixels into the PICT surface, at the location of the
+	// destination rect within the frame of the picture.
+	if (qd_pict_prepare_surface(pict)) {
+		return 1;
+	}
+
+	uint32_t shift = qd_pict_scale_shift(pict);
+	struct qd_pict_composite composite = { bitmap };
+	composite.source_rect = qd_rect_offset(bitmap->source_rect, -bitmap->pm->bounds.left, -bitmap->pm->bounds.top);
+	composite.destination_rect = qd_rect_offset(bitmap->destination_rect, -pict->frame.left, -pict->frame.top);
+	composite.source_rect = qd_pict_reduce_rect(composite.source_rect, shift);
+	composite.destination_rect = qd_pict_reduce_rect(composite.destination_rect, shift);
+
+	// High resolution pictures store more pixels than their destination rect covers,
+	// and are reduced to the frame size while being transferred.
+	if (qd_pict_draw(pict, composite.destination_rect, qd_pict_composite_tile, &composite)) {
+		if (!composite.failed) {
+			return qd_error_raise(pict->error, qd_err_no_memory, bitmap->data_offset, bitmap->opcode,
+				"Failed to allocate a tile of the PICT surface.");
+		}
+		return qd_error_raise(pict->error, qd_err_unsupported, bitmap->data_offset, bitmap->opcode,
+			"Failed to transfer PixMap into the PICT surface with mode (%d).", bitmap->transfer.mode);
+	}
+
+	return 0;
+}
+
+// MARK: - Bitmap Decoding
+
+struct qd_pict_decode_job
+{
+	const struct qd_pict *pict;
+	struct qd_pict_bitmap_queue *queue;
+	const struct qd_buffer *buffer;
+	atomic_size_t next;
+};
+
+static void *qd_pict_decode_worker(void *context)
+{
+	struct qd_pict_decode_job *job = context;
+
+	// Bitmaps are decoded straight from the data of the buffer, without moving its
+	// position, so the buffer is shared between threads. A bitmap that fails to
+	// decode is left without a surface, and is reported once compositing reaches it.
+	size_t n;
+	while ((n = atomic_fetch_add(&job->next, 1)) < job->queue->count) {
+		qd_pict_decode_bitmap(job->pict, &job->queue->bitmaps[n], job->buffer);
+	}
+
+	return NULL;
+}
+
+static void qd_pict_bitmap_queue_clear(struct qd_pict_bitmap_queue *queue)
+{
+	for (size_t n = 0; n < queue->count; ++n) {
+		qd_converter_destroy(&queue->bitmaps[n].convert);
+		free(queue->bitmaps[n].bits.data);
+	}
+	queue->count = 0;
+}
+
+static void qd_pict_bitmap_queue_destroy(struct qd_pict_bitmap_queue *queue)
+{
+	qd_pict_bitmap_queue_clear(queue);
+	free(queue->bitmaps);
+	queue->bitmaps = NULL;
+	queue->capacity = 0;
+}
+
+/* Decodes all of the queued bitmaps, and transfers them into the surface in the
+ * order that their opcodes appeared in. The calling thread decodes alongside the
+ * workers. */
+static int qd_pict_flush_bitmaps(struct qd_pict *pict, struct qd_pict_bitmap_queue *queue, struct qd_buffer *restrict buffer)
+{
+	if (queue->count == 0) {
+		return 0;
+	}
+
+	struct qd_pict_decode_job job = { pict, queue, buffer };
+	atomic_init(&job.next, 0);
+
+	pthread_t workers[QD_MAX_THREADS];
+	unsigned int worker_count = 0;
+	unsigned int threads = qd_thread_count(pict->threads, queue->count);
+	while (worker_count + 1 < threads) {
+		if (pthread_create(&workers[worker_count], NULL, qd_pict_decode_worker, &job)) {
+			// Carry on with however many workers could be started.
+			break;
+		}
+		++worker_count;
+	}
+
+	qd_pict_decode_worker(&job);
+	for (unsigned int n = 0; n < worker_count; ++n) {
+		pthread_join(workers[n], NULL);
+	}
+
+	QD_STATS(
+		for (size_t n = 0; n < queue->count; ++n) {
+			qd_pict_stats_merge(pict->stats, &queue->bitmaps[n].stats);
+		}
+		qd_pict_trace_begin(pict, qd_pict_stage_composite);
+	)
+	QD_STATS_BEGIN(composite_start);
+
+	// Errors that were raised while decoding are raised into the picture here, on
+	// the calling thread, in the order of the opcodes.
+	int err = 0;
+	for (size_t n = 0; n < queue->count && !err; ++n) {
+		struct qd_pict_bitmap *bitmap = &queue->bitmaps[n];
+		if (!bitmap->bits.data) {
+			const struct qd_error *e = &bitmap->error;
+			err = qd_error_raise(pict->error, e->code, e->offset, e->opcode, "%s", e->message);
+		}
+		else {
+			err = qd_pict_composite_bitmap(pict, bitmap);
+		}
+	}
+
+	QD_STATS_END(pict->stats, qd_pict_stage_composite, composite_start);
+	QD_STATS(qd_pict_trace_end(pict, qd_pict_stage_composite);)
+	qd_pict_bitmap_queue_clear(queue);
+	return err;
+}
+
+static int qd_pict_add_pixmap(struct qd_pict *pict, struct qd_pixmap *pm)
+{
+	struct qd_pixmap **pixmaps = realloc(pict->pixmaps, (pict->pixmap_count + 1) * sizeof(*pixmaps));
+	if (!pixmaps) {
+		qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate memory for PixMap in PICT.");
+		qd_pixmap_free(pm);
+		return 1;
+	}
+
+	pixmaps[pict->pixmap_count++] = pm;
+	pict->pixmaps = pixmaps;
+	pict->pm = pm;
+	QD_STATS_ALLOC(pict->stats, pict->pixmap_count * sizeof(*pixmaps));
+	return 0;
+}
+
+/* Queues a bitmap whose header has been read, skipping over its pixel data. The
+ * queue takes ownership of the converter of the bitmap, even on failure. */
+static int qd_pict_queue_bitmap(
+	struct qd_pict *pict,
+	struct qd_pict_bitmap_queue *queue,
+	struct qd_pict_bitmap *bitmap,
+	struct qd_buffer *restrict buffer
+) {
+	// Rows that are narrower than the threshold are never packed, and neither are
+	// pack types 1 and 2.
+	bitmap->packed = bitmap->packed && bitmap->pm->row_bytes >= PACK_BITS_THRESHOLD && bitmap->pack_type != 1 && bitmap->pack_type != 2;
+	bitmap->data_offset = qd_buffer_tell(buffer);
+	bitmap->opcode = pict->opcode;
+
+	if (queue->count == queue->capacity) {
+		size_t capacity = queue->capacity ? queue->capacity * 2 : 4;
+		struct qd_pict_bitmap *bitmaps = realloc(queue->bitmaps, capacity * sizeof(*bitmaps));
+		if (!bitmaps) {
+			qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate memory for PixMap in PICT.");
+			qd_converter_destroy(&bitmap->convert);
+			return 1;
+		}
+		queue->bitmaps = bitmaps;
+		queue->capacity = capacity;
+		QD_STATS_ALLOC(pict->stats, capacity * sizeof(*bitmaps));
+	}
+
+	if (qd_pict_validate_bitmap_data(pict, bitmap, buffer)) {
+		qd_converter_destroy(&bitmap->convert);
+		return 1;
+	}
+
+	QD_STATS(memset(&bitmap->stats, 0, sizeof(bitmap->stats));)
+	queue->bitmaps[queue->count++] = *bitmap;
+	if (queue->count == QD_PICT_MAX_QUEUED_BITMAPS || pict->threads == 1) {
+		return qd_pict_flush_bitmaps(pict, queue, buffer);
+	}
+
+	return 0;
+}
+
+static inline int qd_pict_read_direct_bits_rect(
+	struct qd_pict *pict,
+	struct qd_pict_bitmap_queue *queue,
+	struct qd_buffer *restrict buffer
+) {
+	struct qd_pict_bitmap bitmap = { 0 };
+
+	// Read the PixMap for the opcode. This defines information about the pixel
+	// data represented.
+	if (qd_pixmap_parse(&bitmap.pm, buffer)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PixMap structure from PICT.");
+	}
+
+	if (qd_pict_add_pixmap(pict, bitmap.pm) || qd_pict_read_bitmap_rects(pict, &bitmap, buffer)) {
+		return 1;
+	}
+
+	// Work out the layout of the pixel data. Pack type 0 is the default packing for
+	// the pixel size, and rows narrower than the threshold are never packed. Pack
+	// type 1 rows are unpacked pixels, and pack type 2 rows are unpacked 32-bit
+	// pixels with the pad byte dropped.
+	struct qd_pixmap *pm = bitmap.pm;
+	uint32_t width = qd_rect_get_width(pm->bounds);
+	bitmap.pack_type = pm->pack_type;
+	if (bitmap.pack_type == 0) {
+		bitmap.pack_type = (pm->pixel_size == 16) ? 3 : 4;
+	}
+	if (pm->row_bytes < PACK_BITS_THRESHOLD) {
+		bitmap.pack_type = 1;
+	}
+	bitmap.row_length = (bitmap.pack_type == 2) ? (size_t)width * 3 : (size_t)pm->row_bytes;
+
+	// Chunky pixels are converted to the surface format row by row. Planar pixels
+	// of pack type 4 are interleaved by the decoder instead.
+	uint32_t format = 0;
+	switch (bitmap.pack_type) {
+		case 1:
+			format = (pm->pixel_size == 16) ? qd_16_555_pixel_format : qd_32_argb_pixel_format;
+			bitmap.opaque = (pm->pixel_size == 32 && pm->cmp_count < 4);
+			break;
+		case 2:
+			format = qd_24_rgb_pixel_format;
+			break;
+		case 3:
+			format = qd_16_555_pixel_format;
+			break;
+		case 4:
+			break;
+		default:
+			return qd_pict_error(pict, buffer, qd_err_unsupported, "Unsupported PixMap pack type (%d) encountered in PICT.", pm->pack_type);
+	}
+
+	if ((pm->pixel_size != 16 && pm->pixel_size != 32)
+		|| (pm->pixel_size == 16 && bitmap.pack_type != 1 && bitmap.pack_type != 3)
+		|| (pm->pixel_size == 32 && bitmap.pack_type == 3)) {
+		return qd_pict_error(pict, buffer, qd_err_unsupported, "Unsupported PixMap pixel size (%d) for pack type (%d) encountered in PICT.", pm->pixel_size, pm->pack_type);
+	}
+
+	// Unpacked rows are converted in place, straight out of the buffer, and packed
+	// rows out of a raw row of the row bytes. Planar rows of pack type 4 hold each
+	// of their components, and pack type 2 rows hold 3 bytes per pixel.
+	uint32_t bits_per_pixel = (uint32_t)pm->pixel_size;
+	if (bitmap.pack_type == 4) {
+		bits_per_pixel = (pm->cmp_count == 3) ? 24 : 32;
+	}
+	else if (bitmap.pack_type == 2) {
+		bits_per_pixel = 24;
+	}
+	if (qd_pict_validate_row_length(pict, pm, bitmap.row_length, bits_per_pixel, buffer)) {
+		return 1;
+	}
+
+	if (format && qd_converter_init(&bitmap.convert, format, qd_32_rgba_pixel_format, NULL, NULL)) {
+		return qd_pict_error(pict, buffer, qd_err_no_memory, "Failed to prepare the pixel conversion of PixMap in PICT.");
+	}
+
+	bitmap.packed = 1;
+	return qd_pict_queue_bitmap(pict, queue, &bitmap, buffer);
+}
+
+static inline int qd_pict_read_bits_rect(
+	struct qd_pict *pict,
+	struct qd_pict_bitmap_queue *queue,
+	struct qd_buffer *restrict buffer,
+	int packed
+) {
+	struct qd_pict_bitmap bitmap = { 0 };
+	const struct qd_palette *clut = NULL;
+	uint32_t palette[256] = { 0 };
+	int is_pixmap = 0;
+	int err = 1;
+
+	// Read the PixMap or BitMap for the opcode, followed by the color table of a
+	// PixMap. A BitMap is monochrome, with white as 0 and black as 1. Color tables
+	// tend to repeat between bitmaps and pictures, so they come from the palette
+	// cache rather than being parsed and converted each time.
+	if (qd_pixmap_parse_bits(&bitmap.pm, &is_pixmap, buffer)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PixMap structure from PICT.");
+	}
+
+	if (qd_pict_add_pixmap(pict, bitmap.pm)) {
+		return 1;
+	}
+
+	if (is_pixmap) {
+		if (!(clut = qd_palette_read(buffer, qd_32_rgba_pixel_format))) {
+			return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the color table of PixMap in PICT.");
+		}
+	}
+
+	if (qd_pict_read_bitmap_rects(pict, &bitmap, buffer)) {
+		goto CLEANUP;
+	}
+
+	// Indexed pixel data is converted through the colors of the palette. Older
+	// PixMaps leave the pixel format empty, in which case the pixel size
+	// determines it.
+	uint32_t depth = bitmap.pm->pixel_format ? bitmap.pm->pixel_format : (uint32_t)bitmap.pm->pixel_size;
+	if (clut) {
+		memcpy(palette, clut->colors, sizeof(palette));
+	}
+	else {
+		palette[0] = qd_pixel_pack(UINT8_MAX, UINT8_MAX, UINT8_MAX, UINT8_MAX);
+		palette[1] = qd_pixel_pack(0, 0, 0, UINT8_MAX);
+	}
+
+	if (depth > 8 || qd_converter_init(&bitmap.convert, depth, qd_32_rgba_pixel_format, palette, NULL)) {
+		qd_pict_error(pict, buffer, qd_err_unsupported, "Unsupported PixMap pixel format (%u) encountered in PICT.", depth);
+		goto CLEANUP;
+	}
+
+	bitmap.pack_type = bitmap.pm->pack_type;
+	bitmap.row_length = (size_t)bitmap.pm->row_bytes;
+	if (qd_pict_validate_row_length(pict, bitmap.pm, bitmap.row_length, depth, buffer)) {
+		qd_converter_destroy(&bitmap.convert);
+		goto CLEANUP;
+	}
+
+	bitmap.packed = packed;
+	qd_palette_release(clut);
+	return qd_pict_queue_bitmap(pict, queue, &bitmap, buffer);
+
+CLEANUP:
+	qd_palette_release(clut);
+	return err;
+}
+
+// MARK: - Pattern Opcodes
+
+/* Patterns are expanded into tiles of surface pixels as soon as they are set, so
+ * that the fill opcodes only ever copy rows of pixels out of them. */
+
+static inline uint32_t qd_pict_fg_pixel(struct qd_pict *pict)
+{
+	return qd_pixel_pack_rgb_color(pict->fg_color);
+}
+
+static inline uint32_t qd_pict_bk_pixel(struct qd_pict *pict)
+{
+	return qd_pixel_pack_rgb_color(pict->bk_color);
+}
+
+static int qd_pict_set_pattern(struct qd_pict *pict, struct qd_port_pattern *pattern, const struct qd_pattern *pat)
+{
+	if (qd_port_pattern_set(pattern, pat, qd_pict_fg_pixel(pict), qd_pict_bk_pixel(pict))) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate pattern tile in PICT.");
+	}
+
+	return 0;
+}
+
+static int qd_pict_set_pattern_pixels(struct qd_pict *pict, struct qd_port_pattern *pattern, const uint32_t *pixels, uint32_t width, uint32_t height)
+{
+	if (qd_port_pattern_set_pixels(pattern, pixels, width, height, (size_t)width * sizeof(*pixels))) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate pattern tile in PICT.");
+	}
+
+	return 0;
+}
+
+static int qd_pict_read_pattern(struct qd_pict *pict, struct qd_port_pattern *pattern, struct qd_buffer *restrict buffer)
+{
+	struct qd_pattern pat;
+	if (qd_buffer_read(pat.pat, 1, sizeof(pat.pat), buffer) != sizeof(pat.pat)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read pattern from PICT.");
+	}
+
+	return qd_pict_set_pattern(pict, pattern, &pat);
+}
+
+static int qd_pict_read_color_pattern(struct qd_pict *pict, struct qd_port_pattern *pattern, struct qd_buffer *restrict buffer)
+{
+	struct qd_pixmap *pm = NULL;
+	const struct qd_palette *clut = NULL;
+	struct qd_converter convert = { 0 };
+	uint8_t *raw = NULL;
+	uint32_t *pixels = NULL;
+	int is_pixmap = 0;
+	int err = 1;
+
+	// A color pattern is an indexed PixMap, with its color table and pixel data.
+	if (qd_pixmap_parse_bits(&pm, &is_pixmap, buffer)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PixMap of color pattern from PICT.");
+	}
+
+	if (!is_pixmap) {
+		qd_pict_error(pict, buffer, qd_err_invalid, "Color pattern in PICT is not a PixMap.");
+		goto CLEANUP;
+	}
+
+	if (!(clut = qd_palette_read(buffer, qd_32_rgba_pixel_format))) {
+		qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the color table of color pattern in PICT.");
+		goto CLEANUP;
+	}
+
+	uint32_t depth = pm->pixel_format ? pm->pixel_format : (uint32_t)pm->pixel_size;
+	if (depth > 8 || qd_converter_init(&convert, depth, qd_32_rgba_pixel_format, clut->colors, NULL)) {
+		qd_pict_error(pict, buffer, qd_err_unsupported, "Unsupported color pattern pixel format (%u) encountered in PICT.", depth);
+		goto CLEANUP;
+	}
+
+	if (qd_pict_validate_row_length(pict, pm, (size_t)pm->row_bytes, depth, buffer)) {
+		goto CLEANUP;
+	}
+
+	uint32_t width = qd_rect_get_width(pm->bounds);
+	uint32_t height = qd_rect_get_height(pm->bounds);
+	raw = calloc(pm->row_bytes, 1);
+	pixels = malloc((size_t)width * height * sizeof(*pixels));
+	if (!raw || !pixels) {
+		qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate memory for color pattern in PICT.");
+		goto CLEANUP;
+	}
+
+	int packed = pm->row_bytes >= PACK_BITS_THRESHOLD;
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t *cursor = qd_buffer_peek(buffer, 0);
+		if (qd_pict_validate_bitmap_row(pm, pm->row_bytes, packed, sizeof(uint8_t), pm->row_bytes, buffer)) {
+			qd_pict_error(pict, buffer, qd_err_truncated, "Row %u of color pattern extends beyond the end of its row or of the PICT buffer.", y);
+			goto CLEANUP;
+		}
+		const uint8_t *data = qd_pict_unpack_bitmap_row(pm, pm->row_bytes, packed, sizeof(uint8_t), raw, &cursor);
+		qd_convert_row(&convert, pixels + (size_t)y * width, data, width);
+	}
+
+	err = qd_pict_set_pattern_pixels(pict, pattern, pixels, width, height);
+
+CLEANUP:
+	free(raw);
+	free(pixels);
+	qd_converter_destroy(&convert);
+	qd_palette_release(clut);
+	qd_pixmap_free(pm);
+	return err;
+}
+
+static int qd_pict_read_pixpat(struct qd_pict *pict, struct qd_port_pattern *pattern, struct qd_buffer *restrict buffer)
 {
-	// a "PICT rect" is encoded differently. It is (x, y, width, height). Read these values and
-	// encode to a standard qd_rect (top, left, bottom, right).
-	int16_t values[4];
-	if (qd_buffer_read(values, sizeof(int16_t), 4, buffer) != 4) {
-		fprintf(stderr, "Failed to read PICT rect from PICT.\n");
-		return 1;
+	short pat_type = 0;
+	struct qd_pattern pat;
+	if (qd_buffer_read(&pat_type, sizeof(short), 1, buffer) != 1
+		|| qd_buffer_read(pat.pat, 1, sizeof(pat.pat), buffer) != sizeof(pat.pat)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PixPat from PICT.");
 	}
 
-	rect->top = values[0];
-	rect->bottom = values[0] + values[2];
-	rect->left = values[1];
-	rect->right = values[1] + values[3];
+	switch (pat_type) {
+		case qd_pixpat_color_pattern:
+			return qd_pict_read_color_pattern(pict, pattern, buffer);
 
-	return 0;
+		case qd_pixpat_dither_pattern: {
+			// The requested color, which is drawn as a solid color on a direct surface.
+			struct qd_rgb_color rgb;
+			if (qd_pict_read_rgb_color(pict, &rgb, buffer)) {
+				return 1;
+			}
+			uint32_t px = qd_pixel_pack_rgb_color(rgb);
+			return qd_pict_set_pattern_pixels(pict, pattern, &px, 1, 1);
+		}
+
+		default:
+			return qd_pict_set_pattern(pict, pattern, &pat);
+	}
 }
 
-static inline int qd_read_opcode(uint16_t *opcode, struct qd_buffer *restrict buffer)
+struct qd_pict_fill
 {
-	long pos = qd_buffer_tell(buffer);
-	pos += pos % sizeof(uint16_t);
-	qd_buffer_seek(buffer, pos, SEEK_SET);
+	const struct qd_tile *tile;
+	struct qd_rect rect;
+	long origin_h;
+	long origin_v;
+	struct qd_transfer transfer;
+	int failed;
+};
+
+static int qd_pict_fill_tile(void *context, struct qd_surface *surface, long left, long top)
+{
+	struct qd_pict_fill *fill = context;
+	struct qd_rect rect = qd_rect_offset(fill->rect, (short)-left, (short)-top);
+	fill->failed = qd_tile_fill(fill->tile, surface, rect, fill->origin_h - left, fill->origin_v - top, &fill->transfer);
+	return fill->failed;
+}
 
-	if (qd_buffer_read(opcode, sizeof(uint16_t), 1, buffer) != 1) {
-		fprintf(stderr, "Failed to read PICT opcode, returning EOF..\n");
+static int qd_pict_fill_rect(struct qd_pict *pict, struct qd_rect rect, struct qd_port_pattern *pattern, short mode)
+{
+	if (qd_pict_prepare_surface(pict)) {
 		return 1;
 	}
 
+	const struct qd_tile *tile = qd_port_pattern_tile(pattern, qd_pict_fg_pixel(pict), qd_pict_bk_pixel(pict));
+	if (!tile) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate pattern tile in PICT.");
+	}
+
+	// Patterns are aligned to the origin of the picture's coordinate system.
+	uint32_t shift = qd_pict_scale_shift(pict);
+	struct qd_pict_fill fill = {
+		.tile = tile,
+		.rect = qd_pict_reduce_rect(qd_rect_offset(rect, -pict->frame.left, -pict->frame.top), shift),
+		.origin_h = -(long)pict->frame.left >> shift,
+		.origin_v = -(long)pict->frame.top >> shift,
+		.transfer = { .mode = mode, .op_color = pict->op_color, .bk_color = pict->bk_color },
+	};
+	QD_STATS_BEGIN(composite_start);
+	int err = qd_pict_draw(pict, fill.rect, qd_pict_fill_tile, &fill);
+	QD_STATS_END(pict->stats, qd_pict_stage_composite, composite_start);
+	if (err && !fill.failed) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate a tile of the PICT surface.");
+	}
+	if (err) {
+		return qd_pict_error(pict, NULL, qd_err_unsupported, "Unsupported transfer mode (%d) for filling a rect in PICT.", mode);
+	}
+
 	return 0;
 }
 
-static inline int qd_pict_read_region(struct qd_pict *pict, struct qd_rect *rect, struct qd_buffer *restrict buffer)
+static int qd_pict_read_rect_opcode(struct qd_pict *pict, uint16_t opcode, struct qd_buffer *restrict buffer)
 {
-	uint16_t size = 0;
-	if (qd_buffer_read(&size, sizeof(uint16_t), 1, buffer) != 1) {
-		fprintf(stderr, "Failed to read the size of a clip region in PICT.\n");
+	// The same rect opcodes reuse the rect of the previous rect opcode.
+	if (opcode < qd_pict_opcode_frame_same_rect && qd_pict_read_pict_rect(pict, &pict->last_rect, buffer)) {
 		return 1;
 	}
 
-	if (qd_buffer_read(rect, sizeof(short), 4, buffer) != 4) {
-		fprintf(stderr, "Failed to read the clip region rect in PICT.\n");
-		return 1;
-	}
+	struct qd_rect r = pict->last_rect;
+	switch (opcode & ~0x0008) {
+		case qd_pict_opcode_paint_rect:
+			return qd_pict_fill_rect(pict, r, &pict->pen_pat, pict->pen_mode);
 
-	rect->left /= pict->x_ratio;
-	rect->right /= pict->x_ratio;
-	rect->top /= pict->y_ratio;
-	rect->bottom /= pict->y_ratio;
+		case qd_pict_opcode_erase_rect:
+			return qd_pict_fill_rect(pict, r, &pict->bk_pat, qd_pat_copy);
 
-	uint32_t points = (size - 10) >> 2;
-	qd_buffer_seek(buffer, sizeof(uint16_t) * 2 * points, SEEK_CUR);
+		case qd_pict_opcode_fill_rect:
+			return qd_pict_fill_rect(pict, r, &pict->fill_pat, qd_pat_copy);
 
-	return 0;
+		case qd_pict_opcode_invert_rect: {
+			struct qd_port_pattern black = { 0 };
+			struct qd_pattern pat = { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } };
+			int err = qd_pict_set_pattern(pict, &black, &pat) || qd_pict_fill_rect(pict, r, &black, qd_pat_xor);
+			qd_port_pattern_destroy(&black);
+			return err;
+		}
+
+		default: {
+			// Frame the rect with the pen, drawing the pen's width inside of the rect.
+			short ph = pict->pen_size.h;
+			short pv = pict->pen_size.v;
+			if (ph <= 0 || pv <= 0) {
+				return 0;
+			}
+			if (2 * ph >= qd_rect_get_width(r) || 2 * pv >= qd_rect_get_height(r)) {
+				return qd_pict_fill_rect(pict, r, &pict->pen_pat, pict->pen_mode);
+			}
+
+			struct qd_rect edges[4] = {
+				{ r.top, r.left, r.top + pv, r.right },
+				{ r.bottom - pv, r.left, r.bottom, r.right },
+				{ r.top + pv, r.left, r.bottom - pv, r.left + ph },
+				{ r.top + pv, r.right - ph, r.bottom - pv, r.right },
+			};
+			for (int i = 0; i < 4; ++i) {
+				if (qd_pict_fill_rect(pict, edges[i], &pict->pen_pat, pict->pen_mode)) {
+					return 1;
+				}
+			}
+			return 0;
+		}
+	}
 }
 
-static inline int qd_pict_read_long_comment(struct qd_buffer *restrict buffer)
+// MARK: - QuickTime Opcodes
+
+#define QD_IMAGE_DESCRIPTION_SIZE   86
+
+static int qd_pict_read_image_description(const struct qd_pict *pict, struct qd_image_description *desc, struct qd_buffer *restrict buffer)
 {
-	qd_buffer_seek(buffer, 2, SEEK_CUR);
+	int32_t size = 0;
+	long start = qd_buffer_tell(buffer);
+	if (qd_buffer_read(&size, sizeof(int32_t), 1, buffer) != 1 || size < QD_IMAGE_DESCRIPTION_SIZE) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read QuickTime image description size from PICT.");
+	}
 
-	int16_t length = 0;
-	if (qd_buffer_read(&length, sizeof(int16_t), 1, buffer) != 1) {
-		fprintf(stderr, "Failed to read long comment length from PICT.\n");
-		return 1;
+	uint8_t name[32] = { 0 };
+	int ok = qd_buffer_read(&desc->codec_type, sizeof(uint32_t), 1, buffer) == 1;
+	qd_buffer_seek(buffer, 8, SEEK_CUR);
+	ok = ok && qd_buffer_read(&desc->version, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->revision_level, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->vendor, sizeof(uint32_t), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->temporal_quality, sizeof(uint32_t), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->spatial_quality, sizeof(uint32_t), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->width, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->height, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read_fixed(&desc->h_res, 1, buffer) == 1;
+	ok = ok && qd_buffer_read_fixed(&desc->v_res, 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->data_size, sizeof(uint32_t), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->frame_count, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(name, 1, sizeof(name), buffer) == sizeof(name);
+	ok = ok && qd_buffer_read(&desc->depth, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&desc->clut_id, sizeof(short), 1, buffer) == 1;
+	if (!ok) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read QuickTime image description from PICT.");
 	}
 
-	qd_buffer_seek(buffer, (long)length, SEEK_CUR);
+	// The name is a Pascal string.
+	uint8_t length = name[0] < sizeof(desc->name) ? name[0] : sizeof(desc->name) - 1;
+	memcpy(desc->name, name + 1, length);
+	desc->name[length] = '\0';
 
+	// Skip any extensions that follow the description.
+	qd_buffer_seek(buffer, start + size, SEEK_SET);
 	return 0;
 }
 
-static inline int qd_pict_read_direct_bits_rect(struct qd_pict *pict, struct qd_buffer *restrict buffer)
+static int qd_pict_read_compressed_quicktime(struct qd_pict *pict, struct qd_buffer *restrict buffer)
 {
-	uint8_t tmp8 = 0;
+	struct qd_pict_compressed_image image = { 0 };
+	uint32_t length = 0;
+	uint32_t matte_size = 0;
+	uint32_t mask_size = 0;
+	short version = 0;
+	struct qd_rect matte_rect;
 
-	// Read the PixMap for the opcode. This defines information about the pixel
-	// data represented.
-	struct qd_pixmap *pm = NULL;
-	if (qd_pixmap_parse(&pm, buffer)) {
-		fprintf(stderr, "Failed to read PixMap structure from PICT.\n");
-		return 1;
+	if (qd_buffer_read(&length, sizeof(uint32_t), 1, buffer) != 1) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read the length of QuickTime data in PICT.");
 	}
-	pict->pm = pm;
-
-	struct qd_rect source_rect = { 0 };
-	struct qd_rect destination_rect = { 0 };
 
-	if (qd_pict_read_pict_rect(&source_rect, buffer) || qd_pict_read_pict_rect(&destination_rect, buffer)) {
-		// Abort if failed to read either rect!
-		return 1;
+	long start = qd_buffer_tell(buffer);
+	if (!qd_buffer_peek(buffer, length)) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "QuickTime data extends beyond the end of the PICT.");
 	}
 
-	qd_buffer_seek(buffer, 2L, SEEK_CUR);
+	int ok = qd_buffer_read(&version, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(image.matrix, sizeof(int32_t), 9, buffer) == 9;
+	ok = ok && qd_buffer_read(&matte_size, sizeof(uint32_t), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&matte_rect, sizeof(int16_t), 4, buffer) == 4;
+	ok = ok && qd_buffer_read(&image.mode, sizeof(short), 1, buffer) == 1;
+	ok = ok && qd_buffer_read(&image.source_rect, sizeof(int16_t), 4, buffer) == 4;
+	qd_buffer_seek(buffer, sizeof(uint32_t), SEEK_CUR);
+	ok = ok && qd_buffer_read(&mask_size, sizeof(uint32_t), 1, buffer) == 1;
+	if (!ok) {
+		return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read QuickTime image header from PICT.");
+	}
 
-	// Verify the type of PixMap. We can only accept certain types for the time being
-	// until support for decoding/rendering other types is added.
-	if (pm->pack_type != 3 && pm->pack_type != 4) {
-		fprintf(stderr, "Unsupported PixMap pack type (%d) encountered in PICT.\n", pm->pack_type);
+	// The matte and mask are not used, and are skipped over to reach the image.
+	qd_buffer_seek(buffer, (long)matte_size + (long)mask_size, SEEK_CUR);
+	if (qd_pict_read_image_description(pict, &image.description, buffer)) {
 		return 1;
 	}
 
-	// We're going to allocate memory privately, and not as part of the main PICT structure.
-	uint8_t *raw = NULL;
-	uint32_t raw_size = 0;
-	void *px_buffer = NULL;
+	image.data_size = image.description.data_size;
+	if ((uint64_t)(qd_buffer_tell(buffer) - start) + image.data_size > length || !(image.data = qd_buffer_peek(buffer, image.data_size))) {
+		return qd_pict_error(pict, buffer, qd_err_invalid, "QuickTime image data extends beyond the end of its opcode in PICT.");
+	}
 
-	if (pm->pack_type == 3) {
-		raw_size = pm->row_bytes * sizeof(*raw);
-		px_buffer = calloc((qd_rect_get_height(source_rect) * (pm->row_bytes + 1)) >> 1, sizeof(uint16_t));
+	// The matrix is in 16.16 fixed point. Only its scale and translation are used
+	// to place the image.
+	double sx = image.matrix[0] / 65536.0;
+	double sy = image.matrix[4] / 65536.0;
+	double tx = image.matrix[6] / 65536.0;
+	double ty = image.matrix[7] / 65536.0;
+	image.destination_rect.top = (short)(image.source_rect.top * sy + ty);
+	image.destination_rect.left = (short)(image.source_rect.left * sx + tx);
+	image.destination_rect.bottom = (short)(image.source_rect.bottom * sy + ty);
+	image.destination_rect.right = (short)(image.source_rect.right * sx + tx);
+
+	struct qd_pict_compressed_image *images = realloc(pict->compressed_images, (pict->compressed_image_count + 1) * sizeof(*images));
+	if (!images) {
+		return qd_pict_error(pict, NULL, qd_err_no_memory, "Failed to allocate memory for QuickTime image in PICT.");
 	}
-	else if (pm->pack_type == 4) {
-		raw_size = ((pm->cmp_count * pm->row_bytes) >> 2) * sizeof(*raw);
-		px_buffer = calloc((qd_rect_get_height(source_rect) * (pm->row_bytes + 3)) >> 1, sizeof(uint32_t));
+	images[pict->compressed_image_count++] = image;
+	pict->compressed_images = images;
+
+	qd_buffer_seek(buffer, start + (long)length, SEEK_SET);
+	return 0;
+}
+
+// MARK: - Opcode Parser
+
+/* Reports an opcode that has been handled to the listener and the statistics.
+ * Opcodes begin on word boundaries, so the padding before the next one is counted
+ * as part of this one. */
+static inline void qd_pict_opcode_done(struct qd_pict *pict, uint16_t opcode, long offset, struct qd_buffer *restrict buffer)
+{
+	long end = qd_buffer_tell(buffer);
+	offset += offset % sizeof(uint16_t);
+	end += end % sizeof(uint16_t);
+
+	QD_STATS(qd_pict_stats_count_opcode(pict->stats, opcode, (uint64_t)(end - offset));)
+	if (pict->listener && pict->listener->opcode) {
+		pict->listener->opcode(pict->listener->context, opcode, offset, end - offset, pict);
 	}
-	raw = calloc(raw_size, 1);
+}
 
-	uint32_t px_buffer_offset = 0;
-	uint16_t packed_bytes_count = 0;
-	uint32_t height = qd_rect_get_height(source_rect);
-	uint32_t width = qd_rect_get_width(source_rect);
-	uint32_t bounds_width = qd_rect_get_width(pm->bounds);
+static int qd_pict_read_opcodes(struct qd_pict *pict, struct qd_pict_bitmap_queue *queue, struct qd_buffer *restrict buffer)
+{
+	struct qd_rect clip_rect = { 0 };
 
-	for (uint32_t scanline = 0; scanline < height; ++scanline) {
-		if (pm->row_bytes <= PACK_BITS_THRESHOLD) {
-			// No pack bits compression.
-			if (qd_buffer_read(raw, 1, pm->row_bytes, buffer) != pm->row_bytes) {
-				fprintf(stderr, "Failed to read pixel pattern data from PICT buffer (1).\n");
-				goto ERROR;
-			}
+	while ( qd_buffer_eof(buffer) == 0) {
+		long opcode_offset = qd_buffer_tell(buffer);
+		uint16_t opcode = 0;
+		pict->opcode = QD_ERROR_NO_OPCODE;
+		if (qd_read_opcode(&opcode, buffer)) {
+			return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read opcode from PICT.");
+		}
+		pict->opcode = opcode;
+
+		if (opcode == qd_pict_opcode_eof) {
+			qd_pict_opcode_done(pict, opcode, opcode_offset, buffer);
+			break;
 		}
-		else  {
-			if (pm->row_bytes > 250) {
-				// Pack bits compression is in place, with the length encoded as a short.
-				if (qd_buffer_read(&packed_bytes_count, sizeof(uint16_t), 1, buffer) != 1) {
-					fprintf(stderr, "Failed to read the number of packed bytes in PICT buffer.\n");
-					goto ERROR;
+
+		switch (opcode) {
+			case qd_pict_opcode_clip_region:
+				if (qd_pict_read_region(pict, &clip_rect, buffer)) {
+					return 1;
 				}
-			}
-			else {
-				// Pack bits compression is in place, with the length encoded as a byte.
-				if (qd_buffer_read(&tmp8, sizeof(uint8_t), 1, buffer) != 1) {
-					fprintf(stderr, "Failed to read the number of packed bytes in PICT buffer.\n");
-					goto ERROR;
+				break;
+
+			case qd_pict_opcode_bk_pat:
+				if (qd_pict_read_pattern(pict, &pict->bk_pat, buffer)) {
+					return 1;
 				}
-				packed_bytes_count = (uint16_t)tmp8;
-			}
-			
-			// Create a temporary buffer to read the packed data into on the stack. Avoid allocation
-			// in a loop!
-			uint8_t packed_data[packed_bytes_count];
-			if (qd_buffer_read(packed_data, 1, packed_bytes_count, buffer) != packed_bytes_count) {
-				fprintf(stderr, "Failed to read pixel pattern data from PICT buffer (2).\n");
-				goto ERROR;
-			}
+				break;
 
-			if (pm->pack_type == 3) {
-				qd_packbits_decode(&raw, packed_data, packed_bytes_count, sizeof(uint16_t));
-			}
-			else if (pm->pack_type == 4) {
-				qd_packbits_decode(&raw, packed_data, packed_bytes_count, sizeof(uint8_t));	
-			}
-			
-		}
+			case qd_pict_opcode_pn_pat:
+				if (qd_pict_read_pattern(pict, &pict->pen_pat, buffer)) {
+					return 1;
+				}
+				break;
 
-		if (pm->pack_type == 3) {
-			for (uint32_t x = 0; x < width; ++x) {
-                ((uint16_t *)px_buffer)[px_buffer_offset + x] = (uint16_t)(((0xFF & raw[2*x]) << 8) | (0xFF & raw[2*x+1]));
-            }
-		}
-		else {
-			if (pm->cmp_count == 3) {
-				// RGB Formatted Data
-				for (uint32_t x = 0; x < width; ++x) {
-					((uint16_t *)px_buffer)[px_buffer_offset + x] = 0xFF000000
-						| ((raw[x] & 0xFF) << 16)
-						| ((raw[bounds_width + x] & 0xFF) << 8)
-						| (raw[2 * bounds_width + x] & 0xFF);
+			case qd_pict_opcode_fill_pat:
+				if (qd_pict_read_pattern(pict, &pict->fill_pat, buffer)) {
+					return 1;
 				}
-			}
-			else {
-				// ARGB Formatted Data
-				for (uint32_t x = 0; x < width; ++x) {
-					((uint16_t *)px_buffer)[px_buffer_offset + x] =
-					  ((raw[x] & 0xFF) << 24)
-					| ((raw[bounds_width] & 0xFF) << 16)
-					| ((raw[2 * bounds_width + x] & 0xFF) << 8)
-					| (raw[3 * bounds_width + x] & 0xFF);
+				break;
+
+			case qd_pict_opcode_bk_pix_pat:
+				if (qd_pict_read_pixpat(pict, &pict->bk_pat, buffer)) {
+					return 1;
 				}
-			}
-		}
-		
-		px_buffer_offset += width;
-	}
+				break;
 
-	uint32_t source_length = width * height;
-	uint32_t rgb_length = source_length * 4;
-	uint8_t *rgb = calloc(rgb_length, sizeof(*rgb));
+			case qd_pict_opcode_pn_pix_pat:
+				if (qd_pict_read_pixpat(pict, &pict->pen_pat, buffer)) {
+					return 1;
+				}
+				break;
 
-	if (pm->pack_type == 3) {
-		for (uint32_t p = 0, i = 0; i < source_length; ++i) {
-            rgb[p++] = ((((uint16_t *)px_buffer)[i] & 0x001f) << 3);
-            rgb[p++] = ((((uint16_t *)px_buffer)[i] & 0x03e0) >> 5) << 3;
-            rgb[p++] = ((((uint16_t *)px_buffer)[i] & 0x7c00) >> 10) << 3;
-            rgb[p++] = UINT8_MAX;
-        }
-	}
-	else if (pm->pack_type == 4) {
-		for (uint32_t p = 0, i = 0; i < source_length; ++i) {
-            rgb[p++] = (((uint32_t *)px_buffer)[i] & 0xFF0000) >> 16;
-            rgb[p++] = (((uint32_t *)px_buffer)[i] & 0xFF00) >> 8;
-            rgb[p++] = (((uint32_t *)px_buffer)[i] & 0xFF);
-            rgb[p++] = (((uint32_t *)px_buffer)[i] & 0xFF000000) >> 24;
-        }
-	}
+			case qd_pict_opcode_fill_pix_pat:
+				if (qd_pict_read_pixpat(pict, &pict->fill_pat, buffer)) {
+					return 1;
+				}
+				break;
 
-	// Copy the data into the PICT surface and make sure everything is assigned 
-	// correctly so that the image data can be used.
-	// TODO: This should be improved so that we actually draw into the pict surface,
-	// not just set the surface to this.
-	pict->size = rgb_length;
-	pict->surface = rgb;
+			case qd_pict_opcode_pn_size:
+				if (qd_buffer_read(&pict->pen_size, sizeof(short), 2, buffer) != 2) {
+					return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read pen size from PICT.");
+				}
+				break;
 
-	free(raw);
-	free(px_buffer);
-	return 0;
+			case qd_pict_opcode_pn_mode:
+				if (qd_buffer_read(&pict->pen_mode, sizeof(short), 1, buffer) != 1) {
+					return qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read pen mode from PICT.");
+				}
+				break;
 
-ERROR:
-	free(raw);
-	free(px_buffer);
-	return 1;
+			case qd_pict_opcode_frame_rect:
+			case qd_pict_opcode_paint_rect:
+			case qd_pict_opcode_erase_rect:
+			case qd_pict_opcode_invert_rect:
+			case qd_pict_opcode_fill_rect:
+			case qd_pict_opcode_frame_same_rect:
+			case qd_pict_opcode_paint_same_rect:
+			case qd_pict_opcode_erase_same_rect:
+			case qd_pict_opcode_invert_same_rect:
+			case qd_pict_opcode_fill_same_rect:
+				if (qd_pict_flush_bitmaps(pict, queue, buffer) || qd_pict_read_rect_opcode(pict, opcode, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_rgb_fg_color:
+				if (qd_pict_read_rgb_color(pict, &pict->fg_color, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_rgb_bk_color:
+				if (qd_pict_read_rgb_color(pict, &pict->bk_color, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_op_color:
+				if (qd_pict_read_rgb_color(pict, &pict->op_color, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_bits_rect:
+				if (qd_pict_read_bits_rect(pict, queue, buffer, 0)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_pack_bits_rect:
+				if (qd_pict_read_bits_rect(pict, queue, buffer, 1)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_direct_bits_rect:
+				if (qd_pict_read_direct_bits_rect(pict, queue, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_compressed_qt:
+				if (qd_pict_read_compressed_quicktime(pict, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_long_comment:
+				if (qd_pict_read_long_comment(pict, buffer)) {
+					return 1;
+				}
+				break;
+
+			case qd_pict_opcode_nop:
+			case qd_pict_opcode_eof:
+			case qd_pict_opcode_ext_header:
+			case qd_pict_opcode_def_hilite:
+				break;
+
+			default:
+				return qd_pict_error(pict, buffer, qd_err_unsupported, "Unrecognised PICT opcode '%04x' encountered.", opcode);
+		}
+
+		qd_pict_opcode_done(pict, opcode, opcode_offset, buffer);
+	}
+
+	return 0;
 }
 
 int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer)
 {
+	return qd_pict_parse_with_options(out_pict, buffer, NULL);
+}
+
+int qd_pict_parse_with_options(
+	struct qd_pict **out_pict,
+	struct qd_buffer *restrict buffer,
+	const struct qd_pict_options *options
+) {
 	uint16_t tmp16 = 0;
 	uint32_t tmp32 = 0;
-	struct qd_rect clip_rect = { 0 };
 
 	struct qd_pict *pict = calloc(1, sizeof(*pict));
 	if (out_pict) {
 		*out_pict = pict;
 	}
+	if (!pict) {
+		return qd_error_raise(options ? options->error : NULL, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate PICT.");
+	}
+
+	pict->error = options ? options->error : NULL;
+	pict->opcode = QD_ERROR_NO_OPCODE;
+
+	QD_STATS(
+		if (options && options->stats) {
+			memset(options->stats, 0, sizeof(*options->stats));
+			pict->stats = options->stats;
+			QD_STATS_ALLOC(pict->stats, sizeof(*pict));
+		}
+		pict->trace = options ? options->trace : NULL;
+		qd_pict_trace_begin(pict, qd_pict_stage_header);
+	)
+	QD_STATS_BEGIN(header_start);
+
+	pict->scale = 1;
+	if (options && options->scale > 1) {
+		if (options->scale != 2 && options->scale != 4 && options->scale != 8) {
+			qd_pict_error(pict, NULL, qd_err_argument, "Unsupported PICT decode scale (1/%u) requested.", options->scale);
+			goto ERROR;
+		}
+		pict->scale = options->scale;
+	}
+	pict->threads = options ? options->threads : 0;
+	pict->tiled = options ? options->tiled : 0;
+	pict->target = options ? options->target : NULL;
+	pict->listener = options ? options->listener : NULL;
+
+	// The initial colors of the graphics port that the picture is drawn into.
+	pict->fg_color = (struct qd_rgb_color){ 0x0000, 0x0000, 0x0000 };
+	pict->bk_color = (struct qd_rgb_color){ 0xFFFF, 0xFFFF, 0xFFFF };
+	pict->op_color = (struct qd_rgb_color){ 0x0000, 0x0000, 0x0000 };
+
+	// The initial pen draws black in patCopy mode, over a white background.
+	struct qd_pattern black = { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } };
+	struct qd_pattern white = { { 0 } };
+	pict->pen_mode = qd_pat_copy;
+	pict->pen_size = (struct qd_point){ 1, 1 };
+	if (qd_pict_set_pattern(pict, &pict->pen_pat, &black)
+		|| qd_pict_set_pattern(pict, &pict->bk_pat, &white)
+		|| qd_pict_set_pattern(pict, &pict->fill_pat, &black)) {
+		goto ERROR;
+	}
 
 	qd_buffer_seek(buffer, 2L, SEEK_SET);
 
 	if (qd_buffer_read(&pict->frame, sizeof(int16_t), 4, buffer) != 4) {
-		fprintf(stderr, "Failed to read PICT frame.\n");
+		qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read PICT frame.");
 		goto ERROR;
 	}
 
 	// For now we're looking for Version 2 PICTs. Version 1 PICTs will come later on.
 	if (qd_buffer_read(&tmp32, sizeof(uint32_t), 1, buffer) != 1 && tmp32 != PICT_V2_MAGIC) {
-		fprintf(stderr, "Failed to read PICT Magic Number, or unexpected value encountered.\n");
+		qd_pict_error(pict, buffer, qd_err_invalid, "Failed to read PICT Magic Number, or unexpected value encountered.");
 		goto ERROR;
 	}
 
 	// The very first thing we should find is an extended header opcode. Read this
 	// outside of the main opcode loop as it should only appear once, and at the beginning.
 	if (qd_read_opcode(&tmp16, buffer) || tmp16 != qd_pict_opcode_ext_header) {
-		fprintf(stderr, "Expected to find Extended PICT Header, but did not.\n");
+		qd_pict_error(pict, buffer, qd_err_invalid, "Expected to find Extended PICT Header, but did not.");
 		goto ERROR;
 	}
 
@@ -313,7 +1587,7 @@ int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer)
 		// Standard Header Variant
 		struct qd_fixed_rect rect = { 0 };
 		if (qd_buffer_read_fixed(&rect, 4, buffer) != 4) {
-			fprintf(stderr, "Failed to read fixed point rect from PICT standard header.\n");
+			qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read fixed point rect from PICT standard header.");
 			goto ERROR;
 		}
 
@@ -326,7 +1600,7 @@ int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer)
 
 		struct qd_rect rect = { 0 };
 		if (qd_buffer_read(&rect, sizeof(int16_t), 4, buffer) != 4) {
-			fprintf(stderr, "Failed to read rect from PICT extended header.\n");
+			qd_pict_error(pict, buffer, qd_err_truncated, "Failed to read rect from PICT extended header.");
 			goto ERROR;
 		}
 
@@ -335,53 +1609,42 @@ int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer)
 	}
 
 	if (pict->x_ratio <= 0 || pict->y_ratio <= 0) {
-		fprintf(stderr, "Unrecognised PICT resource. Content ratio is not valid.\n");
+		qd_pict_error(pict, buffer, qd_err_invalid, "Unrecognised PICT resource. Content ratio is not valid.");
 		goto ERROR;
 	}
 
 	qd_buffer_seek(buffer, 4, SEEK_CUR);
+	QD_STATS_END(pict->stats, qd_pict_stage_header, header_start);
+	QD_STATS(qd_pict_trace_end(pict, qd_pict_stage_header);)
 
-	// Begin parsing the PICT opcodes
-	while ( qd_buffer_eof(buffer) == 0) {
-		uint16_t opcode = 0;
-		if (qd_read_opcode(&opcode, buffer)) {
-			fprintf(stderr, "Failed to read opcode from PICT.\n");
-			return 1;
-		}
-
-		if (opcode == qd_pict_opcode_eof) {
-			break;
+	// Begin parsing the PICT opcodes. Bitmaps that are still queued once the end of
+	// the picture is reached are drawn last.
+	QD_STATS(qd_pict_trace_begin(pict, qd_pict_stage_opcodes);)
+	QD_STATS_BEGIN(opcodes_start);
+	struct qd_pict_bitmap_queue queue = { 0 };
+	int err = qd_pict_read_opcodes(pict, &queue, buffer) || qd_pict_flush_bitmaps(pict, &queue, buffer);
+	qd_pict_bitmap_queue_destroy(&queue);
+	QD_STATS_END(pict->stats, qd_pict_stage_opcodes, opcodes_start);
+	QD_STATS(
+		qd_pict_trace_end(pict, qd_pict_stage_opcodes);
+		if (pict->tiles && pict->stats) {
+			pict->stats->allocations += pict->tiles->tile_count + 1;
+			pict->stats->bytes_allocated += qd_tiled_surface_bytes(pict->tiles);
 		}
-
-		switch (opcode) {
-			case qd_pict_opcode_clip_region:
-				if (qd_pict_read_region(pict, &clip_rect, buffer)) {
-					return 1;
-				}
-				break;
-
-			case qd_pict_opcode_direct_bits_rect:
-				if (qd_pict_read_direct_bits_rect(pict, buffer)) {
-					return 1;
-				}
-				break;
-
-			case qd_pict_opcode_long_comment:
-				if (qd_pict_read_long_comment(buffer)) {
-					return 1;
-				}
-				break;
-
-			case qd_pict_opcode_nop:
-			case qd_pict_opcode_eof:
-			case qd_pict_opcode_ext_header:
-			case qd_pict_opcode_def_hilite:
-				break;
-
-			default:
-				fprintf(stderr, "Unrecognised PICT opcode '%04x' encountered.\n", opcode);
-				return 1;
+		pict->stats = NULL;
+		pict->trace = NULL;
+	)
+	pict->listener = NULL;
+	pict->target = NULL;
+	pict->error = NULL;
+	if (err) {
+		// A picture that fails part way through is not handed back, in the same
+		// way as one whose header could not be read.
+		qd_pict_free(pict);
+		if (out_pict) {
+			*out_pict = NULL;
 		}
+		return 1;
 	}
 
 	// Reaching this point is indicative that we have successfully parsed
@@ -389,14 +1652,68 @@ int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer)
 	return 0;
 
 ERROR:
+	QD_STATS(qd_pict_trace_end(pict, qd_pict_stage_header);)
 	qd_pict_free(pict);
+	if (out_pict) {
+		*out_pict = NULL;
+	}
 	return 1;
 }
 
+int qd_pict_read_frame(const struct qd_buffer *buffer, struct qd_rect *frame)
+{
+	// The frame follows the size of the picture at the start of the buffer, and is
+	// read through a copy of the buffer so that its position is left alone.
+	struct qd_buffer view = *buffer;
+	qd_buffer_seek(&view, 2L, SEEK_SET);
+	if (qd_buffer_read(frame, sizeof(int16_t), 4, &view) != 4) {
+		return 1;
+	}
+	return (qd_rect_get_width(*frame) <= 0 || qd_rect_get_height(*frame) <= 0) ? 1 : 0;
+}
+
+int qd_pict_read_pixels(
+	const struct qd_pict *pict,
+	uint32_t left,
+	uint32_t top,
+	uint32_t width,
+	uint32_t height,
+	void *out,
+	size_t row_bytes
+) {
+	if (pict->tiles) {
+		return qd_tiled_surface_read(pict->tiles, left, top, width, height, out, row_bytes);
+	}
+
+	if (!pict->surface || left > pict->width || width > pict->width - left || top > pict->height || height > pict->height - top) {
+		return 1;
+	}
+
+	const uint8_t *in = (const uint8_t *)pict->surface + top * pict->row_bytes + left * sizeof(uint32_t);
+	for (uint32_t y = 0; y < height; ++y) {
+		memcpy((uint8_t *)out + y * row_bytes, in + y * pict->row_bytes, (size_t)width * sizeof(uint32_t));
+	}
+	return 0;
+}
+
 void qd_pict_free(struct qd_pict *p)
 {
 	if (p) {
-		free(p->surface);
+		qd_port_pattern_destroy(&p->pen_pat);
+		qd_port_pattern_destroy(&p->bk_pat);
+		qd_port_pattern_destroy(&p->fill_pat);
+		for (size_t n = 0; n < p->pixmap_count; ++n) {
+			qd_pixmap_free(p->pixmaps[n]);
+		}
+		free(p->pixmaps);
+		free(p->compressed_images);
+		if (p->tiles) {
+			qd_tiled_surface_destroy(p->tiles);
+			free(p->tiles);
+		}
+		else if (!p->surface_borrowed) {
+			free(p->surface);
+		}
 		free(p);
 	}
 }
@@ -20,24 +20,215 @@
  */
 
 #include "common/types.h"
+#include "common/error.h"
+#include "common/pattern.h"
+#include "common/tiled_surface.h"
 #include "internal/buffer.h"
 
 #if !defined(libQuickDraw_Pict)
 #define libQuickDraw_Pict
 
 struct qd_pixmap;
+struct qd_pict;
 
+/* The stages of decoding a picture. Stages nest: the opcodes stage covers all of
+ * the opcodes of the picture, including the decoding and compositing of their
+ * bitmaps, and the decode stage of a bitmap includes its PackBits and conversion
+ * time. */
+enum qd_pict_stage
+{
+	qd_pict_stage_header    = 0,
+	qd_pict_stage_opcodes   = 1,
+	qd_pict_stage_decode    = 2,
+	qd_pict_stage_packbits  = 3,
+	qd_pict_stage_convert   = 4,
+	qd_pict_stage_composite = 5,
+	qd_pict_stage_count     = 6,
+};
+
+#define QD_PICT_STATS_MAX_OPCODES   64
+
+struct qd_pict_opcode_stats
+{
+	uint16_t opcode;
+	uint32_t count;
+	uint64_t bytes;
+};
+
+/* Statistics gathered while decoding a single picture. Opcodes are listed in the
+ * order that they first appear, and their bytes include any data that follows
+ * them, along with its padding. Compressed bytes are the pixel data read from the picture, and
+ * decompressed bytes are the rows that they unpack to. Allocations are those
+ * made by the picture decoder itself. Stage times are in nanoseconds, and stages
+ * that run on several threads at once report their total time across threads.
+ *
+ * Statistics are only gathered when the library is built with QD_ENABLE_STATS,
+ * and are otherwise left as zero. */
+struct qd_pict_stats
+{
+	struct qd_pict_opcode_stats opcodes[QD_PICT_STATS_MAX_OPCODES];
+	size_t opcode_count;
+	uint64_t compressed_bytes;
+	uint64_t decompressed_bytes;
+	uint64_t rows_decoded;
+	uint64_t allocations;
+	uint64_t bytes_allocated;
+	uint64_t stage_ns[qd_pict_stage_count];
+};
+
+/* Callbacks made at the start and end of the header, opcodes, decode and composite
+ * stages. The decode stage is reported once for each bitmap, and may be reported
+ * from the threads that bitmaps are decoded on. The PackBits and conversion stages
+ * happen once per row, and are only timed. Like the statistics, tracing is only
+ * available when built with QD_ENABLE_STATS. */
+struct qd_pict_trace
+{
+	void (*begin)(void *context, enum qd_pict_stage stage, const struct qd_pict *pict);
+	void (*end)(void *context, enum qd_pict_stage stage, const struct qd_pict *pict);
+	void *context;
+};
+
+/* Called once each opcode that follows the picture header has been handled, with
+ * the offset of the opcode in the picture and its length, which includes its data
+ * and the padding after it. Bitmaps are decoded and drawn by the opcode that reads
+ * them only when decoding on a single thread. Unlike tracing, listening for
+ * opcodes is always available. */
+struct qd_pict_listener
+{
+	void (*opcode)(void *context, uint16_t opcode, long offset, long length, const struct qd_pict *pict);
+	void *context;
+};
+
+/* Options controlling how a picture is decoded. A scale of 2, 4 or 8 decodes a
+ * thumbnail of the picture at 1/2, 1/4 or 1/8 of its frame size. Pictures with
+ * several bitmaps decode them on up to the given number of threads, where 0 uses
+ * one thread per processor and 1 decodes on the calling thread only. Statistics
+ * are written to stats, and the stages of decoding are reported to trace, when
+ * they are given. Opcodes are reported to the listener as they are read, and the
+ * reason that a picture could not be decoded is raised into error. A tiled picture
+ * stores its surface in tiles that are only allocated once drawn into, which suits
+ * very large pictures.
+ *
+ * A picture with a target is drawn into the top left of the target instead of a
+ * surface of its own. The target must be at least as large as the picture at its
+ * scale, and the pixels drawn belong to it rather than to the picture. */
+struct qd_pict_options
+{
+	unsigned int scale;
+	unsigned int threads;
+	int tiled;
+	const struct qd_surface *target;
+	struct qd_pict_stats *stats;
+	const struct qd_pict_trace *trace;
+	const struct qd_pict_listener *listener;
+	struct qd_error *error;
+};
+
+/* A QuickTime image description, which describes the codec and dimensions of
+ * compressed image data. */
+struct qd_image_description
+{
+	qd_os_type codec_type;
+	short version;
+	short revision_level;
+	qd_os_type vendor;
+	uint32_t temporal_quality;
+	uint32_t spatial_quality;
+	short width;
+	short height;
+	double h_res;
+	double v_res;
+	uint32_t data_size;
+	short frame_count;
+	char name[32];
+	short depth;
+	short clut_id;
+};
+
+/* A QuickTime compressed image within a picture. It is not decoded, and its data
+ * refers directly to the buffer that the picture was parsed from, so that it can
+ * be handed to a decoder or served as is. The data is only valid for as long as
+ * that buffer is. */
+struct qd_pict_compressed_image
+{
+	int32_t matrix[9];
+	struct qd_rect source_rect;
+	struct qd_rect destination_rect;
+	short mode;
+	struct qd_image_description description;
+	const uint8_t *data;
+	uint32_t data_size;
+};
+
+/* The pixmaps of all of the bitmap opcodes in the picture are kept, in the order
+ * of their opcodes, and pm is the last of them. The surface is width by height
+ * pixels in rows of row_bytes, with size bytes of pixels, unless the picture was
+ * decoded tiled, when the surface is NULL and its pixels are held in tiles
+ * instead. Rows are only padded when the picture was drawn into a target. */
 struct qd_pict
 {
 	struct qd_rect frame;
     struct qd_pixmap *pm;
+	struct qd_pixmap **pixmaps;
+	size_t pixmap_count;
 	double x_ratio;
 	double y_ratio;
-	size_t size;
+	struct qd_rgb_color fg_color;
+	struct qd_rgb_color bk_color;
+	struct qd_rgb_color op_color;
+	short pen_mode;
+	struct qd_point pen_size;
+	struct qd_rect last_rect;
+	struct qd_port_pattern pen_pat;
+	struct qd_port_pattern bk_pat;
+	struct qd_port_pattern fill_pat;
+	struct qd_pict_compressed_image *compressed_images;
+	size_t compressed_image_count;
+	unsigned int scale;
+	unsigned int threads;
+	int tiled;
+	const struct qd_surface *target;
+	struct qd_pict_stats *stats;
+	const struct qd_pict_trace *trace;
+	const struct qd_pict_listener *listener;
+	struct qd_error *error;
+	int32_t opcode;
+	uint32_t width;
+	uint32_t height;
+	uint64_t size;
+	size_t row_bytes;
+	int surface_borrowed;
 	void *surface;
+	struct qd_tiled_surface *tiles;
 };
 
+/* Decodes a picture from the buffer, returning 0 on success. On failure 1 is
+ * returned, nothing is kept of the picture and out_pict is set to NULL, whether
+ * the header or one of the opcodes could not be read. Anything that was already
+ * drawn into a target stays there. */
 int qd_pict_parse(struct qd_pict **out_pict, struct qd_buffer *restrict buffer);
+int qd_pict_parse_with_options(
+	struct qd_pict **out_pict,
+	struct qd_buffer *restrict buffer,
+	const struct qd_pict_options *options
+);
 void qd_pict_free(struct qd_pict *pm);
 
+/* Reads the frame of the picture in the buffer without decoding the picture.
+ * Returns 1 if the buffer is too short to hold a frame, or the frame is empty. */
+int qd_pict_read_frame(const struct qd_buffer *buffer, struct qd_rect *frame);
+
+/* Copies an area of the surface of a picture into plain rows of pixels, whether
+ * the surface is in one piece or in tiles. Only the tiles that the area covers
+ * are read. Returns 1 if the area does not lie within the surface. */
+int qd_pict_read_pixels(
+	const struct qd_pict *pict,
+	uint32_t left,
+	uint32_t top,
+	uint32_t width,
+	uint32_t height,
+	void *out,
+	size_t row_bytes
+);
+
 #endif
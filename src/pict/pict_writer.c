@@ -0,0 +1,583 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/color_table.h"
+#include "common/inverse_table.h"
+#include "internal/packbits.h"
+#include "internal/threads.h"
+#include "pict/pict_writer.h"
+
+// MARK: - Writer Constants
+
+#define QD_PICT_WRITE_JOB_ROWS      16
+#define QD_PICT_WRITE_MAX_ROW_BYTES 0x3FFE
+#define QD_PICT_WRITE_MAX_SIZE      0x7FFF
+#define PACK_BITS_THRESHOLD         8
+
+// MARK: - Output
+
+struct qd_pict_writer
+{
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+	int failed;
+};
+
+static uint8_t *qd_pict_writer_reserve(struct qd_pict_writer *writer, size_t size)
+{
+	if (writer->failed) {
+		return NULL;
+	}
+
+	if (writer->size + size > writer->capacity) {
+		size_t capacity = writer->capacity ? writer->capacity : 4096;
+		while (capacity < writer->size + size) {
+			capacity *= 2;
+		}
+		uint8_t *data = realloc(writer->data, capacity);
+		if (!data) {
+			writer->failed = 1;
+			return NULL;
+		}
+		writer->data = data;
+		writer->capacity = capacity;
+	}
+
+	uint8_t *p = writer->data + writer->size;
+	writer->size += size;
+	return p;
+}
+
+static void qd_pict_writer_put16(struct qd_pict_writer *writer, uint16_t value)
+{
+	uint8_t *p = qd_pict_writer_reserve(writer, 2);
+	if (p) {
+		p[0] = (uint8_t)(value >> 8);
+		p[1] = (uint8_t)value;
+	}
+}
+
+static void qd_pict_writer_put32(struct qd_pict_writer *writer, uint32_t value)
+{
+	qd_pict_writer_put16(writer, (uint16_t)(value >> 16));
+	qd_pict_writer_put16(writer, (uint16_t)value);
+}
+
+static void qd_pict_writer_put_rect(struct qd_pict_writer *writer, struct qd_rect rect)
+{
+	qd_pict_writer_put16(writer, (uint16_t)rect.top);
+	qd_pict_writer_put16(writer, (uint16_t)rect.left);
+	qd_pict_writer_put16(writer, (uint16_t)rect.bottom);
+	qd_pict_writer_put16(writer, (uint16_t)rect.right);
+}
+
+// MARK: - Layout
+
+/* How the rows of the surface are laid out in the picture. The pack type is the
+ * one that rows are actually written with, as rows that are narrower than the
+ * threshold are never packed, and are read as pack type 1 whatever the PixMap
+ * says. Each row is row_length bytes before it is packed. */
+struct qd_pict_write_layout
+{
+	uint16_t opcode;
+	struct qd_pixmap pm;
+	short pack_type;
+	size_t row_length;
+	int packed;
+	int value_size;
+};
+
+static int qd_pict_write_layout_init(
+	struct qd_pict_write_layout *layout,
+	const struct qd_surface *surface,
+	const struct qd_pict_write_options *options
+) {
+	struct qd_error *error = options ? options->error : NULL;
+	const struct qd_pixmap *pm = options ? options->pm : NULL;
+	short pixel_size = pm ? pm->pixel_size : 32;
+	short pack_type = pm ? pm->pack_type : 4;
+	short cmp_count = (pm && pm->cmp_count == 4) ? 4 : 3;
+	uint32_t width = surface->width;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->pm.bounds = (struct qd_rect){ 0, 0, (short)surface->height, (short)width };
+	layout->pm.h_res = 72.0;
+	layout->pm.v_res = 72.0;
+	layout->value_size = 1;
+
+	size_t row_bytes = 0;
+	switch (pixel_size) {
+		case 32:
+			pack_type = pack_type ? pack_type : 4;
+			if (pack_type != 1 && pack_type != 2 && pack_type != 4) {
+				return qd_error_raise(error, qd_err_unsupported, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Pack type %d can not be written with 32-bit pixels.", pack_type);
+			}
+			row_bytes = (size_t)width * 4;
+			layout->opcode = 0x009A;
+			layout->pm.pixel_type = 16;
+			layout->pm.cmp_count = (pack_type == 2) ? 3 : cmp_count;
+			layout->pm.cmp_size = 8;
+			layout->row_length = (pack_type == 1) ? row_bytes : (size_t)width * layout->pm.cmp_count;
+			break;
+		case 16:
+			pack_type = pack_type ? pack_type : 3;
+			if (pack_type != 1 && pack_type != 3) {
+				return qd_error_raise(error, qd_err_unsupported, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Pack type %d can not be written with 16-bit pixels.", pack_type);
+			}
+			row_bytes = (size_t)width * 2;
+			layout->opcode = 0x009A;
+			layout->pm.pixel_type = 16;
+			layout->pm.cmp_count = 3;
+			layout->pm.cmp_size = 5;
+			layout->row_length = row_bytes;
+			layout->value_size = (pack_type == 3) ? 2 : 1;
+			break;
+		case 1:
+		case 2:
+		case 4:
+		case 8:
+			if (!options || !options->clut || !options->clut->ct_table) {
+				return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "A color table is needed to write %d-bit pixels.", pixel_size);
+			}
+			pack_type = 0;
+			row_bytes = (((size_t)width * pixel_size + 15) / 16) * 2;
+			layout->pm.cmp_count = 1;
+			layout->pm.cmp_size = pixel_size;
+			layout->row_length = row_bytes;
+			break;
+		default:
+			return qd_error_raise(error, qd_err_unsupported, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Pixel size %d can not be written.", pixel_size);
+	}
+
+	if (row_bytes > QD_PICT_WRITE_MAX_ROW_BYTES) {
+		return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "A surface %u pixels wide is too wide for %d-bit pixels.", width, pixel_size);
+	}
+
+	layout->pm.row_bytes = (short)row_bytes;
+	layout->pm.pack_type = pack_type;
+	layout->pm.pixel_size = pixel_size;
+	layout->pack_type = pack_type;
+	layout->packed = (pack_type != 1 && pack_type != 2);
+
+	if (row_bytes < PACK_BITS_THRESHOLD) {
+		layout->packed = 0;
+		if (layout->opcode == 0x009A) {
+			layout->pack_type = 1;
+			layout->row_length = row_bytes;
+		}
+	}
+	if (layout->opcode == 0) {
+		layout->opcode = layout->packed ? 0x0098 : 0x0090;
+	}
+	return 0;
+}
+
+// MARK: - Colors
+
+/* The colors of the color table are found exactly, through a small hash table, as
+ * the pixels written as indexed pixels are usually the colors of their table
+ * already. Only other colors need the nearest color of the table, from an inverse
+ * table that is built the first time that one is seen. */
+#define QD_PICT_WRITE_COLOR_SLOTS   512
+
+struct qd_pict_write_colors
+{
+	uint32_t keys[QD_PICT_WRITE_COLOR_SLOTS];
+	uint8_t indices[QD_PICT_WRITE_COLOR_SLOTS];
+};
+
+static inline uint32_t qd_pict_write_color_key(uint8_t r, uint8_t g, uint8_t b)
+{
+	return 0x1000000 | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+static inline uint32_t qd_pict_write_color_slot(uint32_t key)
+{
+	return (key * 2654435761u) >> 23;
+}
+
+static void qd_pict_write_colors_init(struct qd_pict_write_colors *colors, const struct qd_color_table *clut)
+{
+	memset(colors, 0, sizeof(*colors));
+
+	// The first of any repeated colors is the one that is used.
+	struct qd_inverse_table_color entries[256];
+	uint32_t count = qd_color_table_get_colors(clut, entries);
+	for (uint32_t n = 0; n < count; ++n) {
+		uint32_t key = qd_pict_write_color_key(entries[n].red, entries[n].green, entries[n].blue);
+		uint32_t slot = qd_pict_write_color_slot(key);
+		while (colors->keys[slot] && colors->keys[slot] != key) {
+			slot = (slot + 1) & (QD_PICT_WRITE_COLOR_SLOTS - 1);
+		}
+		if (!colors->keys[slot]) {
+			colors->keys[slot] = key;
+			colors->indices[slot] = entries[n].index;
+		}
+	}
+}
+
+static inline int qd_pict_write_colors_find(const struct qd_pict_write_colors *colors, uint32_t key, uint8_t *index)
+{
+	for (uint32_t slot = qd_pict_write_color_slot(key); colors->keys[slot]; slot = (slot + 1) & (QD_PICT_WRITE_COLOR_SLOTS - 1)) {
+		if (colors->keys[slot] == key) {
+			*index = colors->indices[slot];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// MARK: - Row Conversion
+
+/* Converts a row of surface pixels, which are R, G, B, A bytes, to the layout of
+ * a direct picture. */
+static void qd_pict_write_convert_row(const struct qd_pict_write_layout *layout, const uint8_t *rgba, uint8_t *raw, uint32_t width)
+{
+	int alpha = (layout->pm.cmp_count == 4);
+
+	switch (layout->pack_type) {
+		case 4: {
+			// Planar components, one plane after another, with alpha first.
+			uint8_t *plane = raw;
+			if (alpha) {
+				for (uint32_t x = 0; x < width; ++x) {
+					plane[x] = rgba[4 * x + 3];
+				}
+				plane += width;
+			}
+			for (uint32_t x = 0; x < width; ++x) {
+				plane[x] = rgba[4 * x];
+				plane[width + x] = rgba[4 * x + 1];
+				plane[2 * width + x] = rgba[4 * x + 2];
+			}
+			break;
+		}
+		case 2:
+			for (uint32_t x = 0; x < width; ++x, rgba += 4, raw += 3) {
+				raw[0] = rgba[0];
+				raw[1] = rgba[1];
+				raw[2] = rgba[2];
+			}
+			break;
+		default:
+			if (layout->pm.pixel_size == 16) {
+				for (uint32_t x = 0; x < width; ++x, rgba += 4, raw += 2) {
+					uint16_t v = (uint16_t)(((rgba[0] >> 3) << 10) | ((rgba[1] >> 3) << 5) | (rgba[2] >> 3));
+					raw[0] = (uint8_t)(v >> 8);
+					raw[1] = (uint8_t)v;
+				}
+			}
+			else {
+				for (uint32_t x = 0; x < width; ++x, rgba += 4, raw += 4) {
+					raw[0] = alpha ? rgba[3] : 0;
+					raw[1] = rgba[0];
+					raw[2] = rgba[1];
+					raw[3] = rgba[2];
+				}
+			}
+			break;
+	}
+}
+
+// MARK: - Row Encoding
+
+/* Rows are converted and packed in blocks, concurrently, each into a slot of its
+ * own that is large enough for the row at its worst. The slots are then joined
+ * up in order once every row has been encoded. */
+struct qd_pict_write_job
+{
+	const struct qd_surface *surface;
+	const struct qd_pict_write_layout *layout;
+	const struct qd_color_table *clut;
+	const struct qd_pict_write_colors *colors;
+	uint8_t *rows;
+	size_t stride;
+	size_t *lengths;
+	atomic_size_t next;
+	atomic_int failed;
+	pthread_mutex_t lock;
+	struct qd_inverse_table *table;
+};
+
+static const struct qd_inverse_table *qd_pict_write_inverse_table(struct qd_pict_write_job *job)
+{
+	pthread_mutex_lock(&job->lock);
+	if (!job->table) {
+		job->table = qd_inverse_table_create(job->clut, qd_inverse_table_default_resolution);
+	}
+	const struct qd_inverse_table *table = job->table;
+	pthread_mutex_unlock(&job->lock);
+	return table;
+}
+
+/* Converts a row of surface pixels to color indices, packed into bytes with the
+ * leftmost pixel in the high bits. Runs of the same color are only looked up
+ * once. The inverse table, once a worker has needed it, is kept in table. */
+static int qd_pict_write_index_row(
+	struct qd_pict_write_job *job,
+	const struct qd_inverse_table **table,
+	const uint8_t *rgba,
+	uint8_t *raw,
+	uint32_t width
+) {
+	uint32_t depth = (uint32_t)job->layout->pm.pixel_size;
+	uint32_t mask = (1U << depth) - 1;
+	uint32_t last_key = 0;
+	uint8_t index = 0;
+
+	memset(raw, 0, job->layout->row_length);
+	for (uint32_t x = 0; x < width; ++x, rgba += 4) {
+		uint32_t key = qd_pict_write_color_key(rgba[0], rgba[1], rgba[2]);
+		if (key != last_key) {
+			if (!qd_pict_write_colors_find(job->colors, key, &index)) {
+				if (!*table && !(*table = qd_pict_write_inverse_table(job))) {
+					return 1;
+				}
+				index = qd_inverse_table_lookup(*table, rgba[0], rgba[1], rgba[2]);
+			}
+			last_key = key;
+		}
+
+		uint32_t bit = x * depth;
+		raw[bit >> 3] |= (uint8_t)((index & mask) << (8 - depth - (bit & 7)));
+	}
+	return 0;
+}
+
+static void *qd_pict_write_worker(void *context)
+{
+	struct qd_pict_write_job *job = context;
+	const struct qd_pict_write_layout *layout = job->layout;
+	const struct qd_surface *surface = job->surface;
+	const struct qd_inverse_table *table = NULL;
+
+	uint8_t *raw = malloc(layout->row_length);
+	if (!raw) {
+		return NULL;
+	}
+
+	// The packed length is a word when the rows of the PixMap are wide.
+	size_t prefix = (layout->pm.row_bytes > 250) ? 2 : 1;
+
+	size_t block;
+	while (!atomic_load(&job->failed) && (block = atomic_fetch_add(&job->next, 1)) * QD_PICT_WRITE_JOB_ROWS < surface->height) {
+		uint32_t first = (uint32_t)(block * QD_PICT_WRITE_JOB_ROWS);
+		uint32_t last = first + QD_PICT_WRITE_JOB_ROWS < surface->height ? first + QD_PICT_WRITE_JOB_ROWS : surface->height;
+		for (uint32_t y = first; y < last; ++y) {
+			const uint8_t *rgba = (const uint8_t *)surface->data + y * surface->row_bytes;
+			uint8_t *out = job->rows + y * job->stride;
+			uint8_t *row = layout->packed ? raw : out;
+			if (job->colors) {
+				if (qd_pict_write_index_row(job, &table, rgba, row, surface->width)) {
+					atomic_store(&job->failed, 1);
+					break;
+				}
+			}
+			else {
+				qd_pict_write_convert_row(layout, rgba, row, surface->width);
+			}
+
+			if (!layout->packed) {
+				job->lengths[y] = layout->row_length;
+				continue;
+			}
+
+			size_t length = qd_packbits_encode(out + prefix, raw, layout->row_length, layout->value_size);
+			if (prefix == 2) {
+				out[0] = (uint8_t)(length >> 8);
+				out[1] = (uint8_t)length;
+			}
+			else {
+				out[0] = (uint8_t)length;
+			}
+			job->lengths[y] = prefix + length;
+		}
+	}
+
+	free(raw);
+	return NULL;
+}
+
+static int qd_pict_write_rows(struct qd_pict_write_job *job, unsigned int requested_threads)
+{
+	size_t blocks = (job->surface->height + QD_PICT_WRITE_JOB_ROWS - 1) / QD_PICT_WRITE_JOB_ROWS;
+	unsigned int threads = qd_thread_count(requested_threads, blocks);
+
+	pthread_t workers[QD_MAX_THREADS];
+	unsigned int worker_count = 0;
+	while (worker_count + 1 < threads) {
+		if (pthread_create(&workers[worker_count], NULL, qd_pict_write_worker, job)) {
+			break;
+		}
+		++worker_count;
+	}
+
+	qd_pict_write_worker(job);
+	for (unsigned int n = 0; n < worker_count; ++n) {
+		pthread_join(workers[n], NULL);
+	}
+
+	// A worker that could not start on its rows leaves them to the others, so
+	// rows are only missing if every worker failed.
+	return atomic_load(&job->failed) || atomic_load(&job->next) * QD_PICT_WRITE_JOB_ROWS < job->surface->height;
+}
+
+// MARK: - Picture
+
+static void qd_pict_writer_put_pixmap(struct qd_pict_writer *writer, const struct qd_pixmap *pm)
+{
+	qd_pict_writer_put16(writer, (uint16_t)(0x8000 | pm->row_bytes));
+	qd_pict_writer_put_rect(writer, pm->bounds);
+	qd_pict_writer_put16(writer, 0);
+	qd_pict_writer_put16(writer, (uint16_t)pm->pack_type);
+	qd_pict_writer_put32(writer, 0);
+	qd_pict_writer_put32(writer, (uint32_t)(pm->h_res * 65536.0));
+	qd_pict_writer_put32(writer, (uint32_t)(pm->v_res * 65536.0));
+	qd_pict_writer_put16(writer, (uint16_t)pm->pixel_type);
+	qd_pict_writer_put16(writer, (uint16_t)pm->pixel_size);
+	qd_pict_writer_put16(writer, (uint16_t)pm->cmp_count);
+	qd_pict_writer_put16(writer, (uint16_t)pm->cmp_size);
+	qd_pict_writer_put32(writer, 0);
+	qd_pict_writer_put32(writer, 0);
+	qd_pict_writer_put32(writer, 0);
+}
+
+static void qd_pict_writer_put_color_table(struct qd_pict_writer *writer, const struct qd_color_table *clut)
+{
+	qd_pict_writer_put32(writer, (uint32_t)clut->ct_seed);
+	qd_pict_writer_put16(writer, (uint16_t)clut->ct_flags);
+	qd_pict_writer_put16(writer, (uint16_t)clut->ct_size);
+	for (int i = 0; i <= clut->ct_size; ++i) {
+		const struct qd_color_spec *spec = &clut->ct_table[i];
+		qd_pict_writer_put16(writer, spec->value);
+		qd_pict_writer_put16(writer, spec->rgb.red);
+		qd_pict_writer_put16(writer, spec->rgb.green);
+		qd_pict_writer_put16(writer, spec->rgb.blue);
+	}
+}
+
+/* The version 2 header, with the frame given again as fixed point numbers. */
+static void qd_pict_writer_put_header(struct qd_pict_writer *writer, struct qd_rect frame)
+{
+	qd_pict_writer_put16(writer, 0);
+	qd_pict_writer_put_rect(writer, frame);
+	qd_pict_writer_put32(writer, 0x001102FF);
+	qd_pict_writer_put16(writer, 0x0C00);
+	qd_pict_writer_put32(writer, 0xFFFFFFFF);
+	qd_pict_writer_put32(writer, (uint32_t)frame.left << 16);
+	qd_pict_writer_put32(writer, (uint32_t)frame.top << 16);
+	qd_pict_writer_put32(writer, (uint32_t)frame.right << 16);
+	qd_pict_writer_put32(writer, (uint32_t)frame.bottom << 16);
+	qd_pict_writer_put32(writer, 0);
+}
+
+int qd_pict_write(
+	struct qd_buffer **out_buffer,
+	const struct qd_surface *surface,
+	const struct qd_pict_write_options *options
+) {
+	struct qd_error *error = options ? options->error : NULL;
+	if (!out_buffer || !surface || !surface->data) {
+		return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "No surface given to write.");
+	}
+	*out_buffer = NULL;
+	if (surface->width == 0 || surface->height == 0 || surface->width > QD_PICT_WRITE_MAX_SIZE || surface->height > QD_PICT_WRITE_MAX_SIZE) {
+		return qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "A surface of %ux%u pixels can not be written as a PICT.", surface->width, surface->height);
+	}
+
+	struct qd_pict_write_layout layout;
+	if (qd_pict_write_layout_init(&layout, surface, options)) {
+		return 1;
+	}
+
+	struct qd_pict_write_colors colors;
+	const struct qd_color_table *clut = (layout.pm.pixel_type == 0) ? options->clut : NULL;
+	if (clut) {
+		qd_pict_write_colors_init(&colors, clut);
+	}
+
+	struct qd_pict_write_job job = { surface, &layout, clut, clut ? &colors : NULL };
+	job.stride = layout.packed ? 2 + QD_PACKBITS_MAX_PACKED(layout.row_length) : layout.row_length;
+	job.rows = malloc(job.stride * surface->height);
+	job.lengths = malloc(surface->height * sizeof(*job.lengths));
+	atomic_init(&job.next, 0);
+	atomic_init(&job.failed, 0);
+	pthread_mutex_init(&job.lock, NULL);
+
+	struct qd_pict_writer writer = { 0 };
+	if (!job.rows || !job.lengths || qd_pict_write_rows(&job, options ? options->threads : 0)) {
+		writer.failed = 1;
+	}
+
+	// The bitmap opcode covers the frame, and is followed by its rows in order.
+	struct qd_rect frame = layout.pm.bounds;
+	qd_pict_writer_put_header(&writer, frame);
+	qd_pict_writer_put16(&writer, layout.opcode);
+	if (layout.opcode == 0x009A) {
+		qd_pict_writer_put32(&writer, 0x000000FF);
+	}
+	qd_pict_writer_put_pixmap(&writer, &layout.pm);
+	if (clut) {
+		qd_pict_writer_put_color_table(&writer, clut);
+	}
+	qd_pict_writer_put_rect(&writer, frame);
+	qd_pict_writer_put_rect(&writer, frame);
+	qd_pict_writer_put16(&writer, qd_src_copy);
+
+	for (uint32_t y = 0; y < surface->height && !writer.failed; ++y) {
+		uint8_t *p = qd_pict_writer_reserve(&writer, job.lengths[y]);
+		if (p) {
+			memcpy(p, job.rows + y * job.stride, job.lengths[y]);
+		}
+	}
+
+	// Opcodes start on even offsets.
+	if (writer.size & 1) {
+		uint8_t *p = qd_pict_writer_reserve(&writer, 1);
+		if (p) {
+			*p = 0;
+		}
+	}
+	qd_pict_writer_put16(&writer, 0x00FF);
+
+	free(job.rows);
+	free(job.lengths);
+	qd_inverse_table_free(job.table);
+	pthread_mutex_destroy(&job.lock);
+	if (writer.failed) {
+		free(writer.data);
+		return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for the PICT.");
+	}
+
+	// The size of the picture is only kept to 16 bits.
+	writer.data[0] = (uint8_t)(writer.size >> 8);
+	writer.data[1] = (uint8_t)writer.size;
+	if (!(*out_buffer = qd_buffer_create(writer.data, writer.size))) {
+		free(writer.data);
+		return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate memory for the PICT.");
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+#include "common/error.h"
+#include "internal/buffer.h"
+
+#if !defined(libQuickDraw_PictWriter)
+#define libQuickDraw_PictWriter
+
+/* Options for writing a picture. The PixMap gives the layout that the pixels are
+ * written in, of which only the pixel size, pack type and component count are
+ * used; its bounds and row bytes follow from the surface.
+ *
+ *  - A pixel size of 32 is written as a DirectBitsRect, with pack type 4 (planar
+ *    and packed, the default), 2 (without the pad byte) or 1. A component count
+ *    of 4 writes the alpha of the surface as well.
+ *  - A pixel size of 16 is written as a DirectBitsRect, with pack type 3 (packed,
+ *    the default) or 1.
+ *  - A pixel size of 1, 2, 4 or 8 is written as a PackBitsRect, with every pixel
+ *    mapped to the nearest color of the color table, which is required.
+ *
+ * Without a PixMap, pixels are written with a pixel size of 32 and pack type 4.
+ * Rows are encoded on up to the given number of threads, where 0 uses one thread
+ * per processor. */
+struct qd_pict_write_options
+{
+	const struct qd_pixmap *pm;
+	const struct qd_color_table *clut;
+	unsigned int threads;
+	struct qd_error *error;
+};
+
+/* Writes the pixels of the surface as a version 2 PICT, made up of a single
+ * bitmap opcode that covers the frame of the picture. The buffer belongs to the
+ * caller. */
+int qd_pict_write(
+	struct qd_buffer **out_buffer,
+	const struct qd_surface *surface,
+	const struct qd_pict_write_options *options
+);
+
+#endif
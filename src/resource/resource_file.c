@@ -0,0 +1,326 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "resource/resource_file.h"
+
+// MARK: - Resource Map
+
+/* The layout of a resource fork: a header giving the locations of the resource
+ * data and the resource map, the data of each resource preceded by its length,
+ * and the map. The map holds a list of types, each with a list of references to
+ * the resources of that type, followed by the names of the resources. */
+#define QD_RESOURCE_HEADER_SIZE         16
+#define QD_RESOURCE_MAP_HEADER_SIZE     28
+#define QD_RESOURCE_TYPE_SIZE           8
+#define QD_RESOURCE_REFERENCE_SIZE      12
+#define QD_RESOURCE_NO_NAME             0xFFFF
+
+struct qd_resource_entry
+{
+    qd_os_type type;
+    int16_t id;
+    uint8_t attributes;
+    uint16_t name_offset;
+    uint32_t data_offset;
+};
+
+/* Resources are found through an open addressed hash table of (type, id) pairs.
+ * Each slot holds the index of an entry plus one, so that zero marks an empty
+ * slot. The table is kept at most half full. */
+struct qd_resource_file
+{
+    struct qd_buffer *buffer;
+    int owns_buffer;
+    uint32_t data_offset;
+    uint32_t data_length;
+    uint64_t names_offset;
+    struct qd_resource_entry *entries;
+    size_t count;
+    uint32_t *index;
+    size_t index_mask;
+};
+
+static inline size_t qd_resource_hash(qd_os_type type, int16_t id)
+{
+    uint64_t key = ((uint64_t)type << 16) | (uint16_t)id;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(key >> 32);
+}
+
+static const struct qd_resource_entry *qd_resource_file_find(const struct qd_resource_file *file, qd_os_type type, int16_t id)
+{
+    if (!file->index) {
+        return NULL;
+    }
+
+    for (size_t slot = qd_resource_hash(type, id) & file->index_mask; file->index[slot]; slot = (slot + 1) & file->index_mask) {
+        const struct qd_resource_entry *entry = &file->entries[file->index[slot] - 1];
+        if (entry->type == type && entry->id == id) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static int qd_resource_file_build_index(struct qd_resource_file *file, struct qd_error *error)
+{
+    size_t slots = 16;
+    while (slots < file->count * 2) {
+        slots <<= 1;
+    }
+
+    if (!(file->index = calloc(slots, sizeof(*file->index)))) {
+        return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate the index of resource file.");
+    }
+    file->index_mask = slots - 1;
+
+    // When a type and id appear more than once, the first of them is the one that
+    // is found, as it would be by the Resource Manager.
+    for (size_t n = 0; n < file->count; ++n) {
+        const struct qd_resource_entry *entry = &file->entries[n];
+        size_t slot = qd_resource_hash(entry->type, entry->id) & file->index_mask;
+        int duplicate = 0;
+        for (; file->index[slot]; slot = (slot + 1) & file->index_mask) {
+            const struct qd_resource_entry *other = &file->entries[file->index[slot] - 1];
+            if (other->type == entry->type && other->id == entry->id) {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (!duplicate) {
+            file->index[slot] = (uint32_t)(n + 1);
+        }
+    }
+
+    return 0;
+}
+
+static int qd_resource_file_read_map(struct qd_resource_file *file, struct qd_error *error)
+{
+    uint32_t header[4] = { 0 };
+    qd_buffer_seek(file->buffer, 0, SEEK_SET);
+    if (qd_buffer_read(header, sizeof(uint32_t), 4, file->buffer) != 4) {
+        return qd_error_raise(error, qd_err_truncated, 0, QD_ERROR_NO_OPCODE, "Failed to read the header of resource file.");
+    }
+
+    file->data_offset = header[0];
+    file->data_length = header[2];
+    uint32_t map_offset = header[1];
+    uint32_t map_length = header[3];
+
+    struct qd_buffer map = { 0 };
+    if ((uint64_t)file->data_offset + file->data_length > file->buffer->size
+        || map_length < QD_RESOURCE_MAP_HEADER_SIZE
+        || qd_buffer_view(&map, file->buffer, map_offset, map_length)) {
+        return qd_error_raise(error, qd_err_invalid, 0, QD_ERROR_NO_OPCODE, "Resource file header does not describe the contents of the file.");
+    }
+
+    // Skip the copy of the header, the handle to the next map, the file reference
+    // and the attributes of the file.
+    uint16_t type_list_offset = 0;
+    uint16_t name_list_offset = 0;
+    qd_buffer_seek(&map, 24, SEEK_SET);
+    if (qd_buffer_read(&type_list_offset, sizeof(uint16_t), 1, &map) != 1
+        || qd_buffer_read(&name_list_offset, sizeof(uint16_t), 1, &map) != 1) {
+        return qd_error_raise(error, qd_err_truncated, map_offset + qd_buffer_tell(&map), QD_ERROR_NO_OPCODE, "Failed to read the resource map of resource file.");
+    }
+    file->names_offset = (uint64_t)map_offset + name_list_offset;
+
+    // The type list starts with the number of types, less one. An empty map may
+    // store -1 here.
+    uint16_t type_count = 0;
+    qd_buffer_seek(&map, type_list_offset, SEEK_SET);
+    if (qd_buffer_read(&type_count, sizeof(uint16_t), 1, &map) != 1) {
+        return qd_error_raise(error, qd_err_truncated, map_offset + qd_buffer_tell(&map), QD_ERROR_NO_OPCODE, "Failed to read the type list of resource file.");
+    }
+    type_count = (type_count == 0xFFFF) ? 0 : type_count + 1;
+
+    // Count the resources first, so that the entries are allocated only once. The
+    // reference list of each type is checked against the map before anything is
+    // allocated for it, and as the lists of a map do not overlap, together they
+    // can be no larger than the map.
+    size_t count = 0;
+    uint64_t references_total = 0;
+    for (uint16_t t = 0; t < type_count; ++t) {
+        uint16_t fields[3] = { 0 };
+        qd_buffer_seek(&map, type_list_offset + 2 + t * QD_RESOURCE_TYPE_SIZE + 4, SEEK_SET);
+        if (qd_buffer_read(fields, sizeof(uint16_t), 2, &map) != 2) {
+            return qd_error_raise(error, qd_err_truncated, map_offset + qd_buffer_tell(&map), QD_ERROR_NO_OPCODE, "Failed to read the type list of resource file.");
+        }
+
+        size_t references_size = ((size_t)fields[0] + 1) * QD_RESOURCE_REFERENCE_SIZE;
+        references_total += references_size;
+        qd_buffer_seek(&map, (long)type_list_offset + fields[1], SEEK_SET);
+        if (!qd_buffer_peek(&map, references_size) || references_total > map_length) {
+            return qd_error_raise(error, qd_err_invalid, map_offset + qd_buffer_tell(&map), QD_ERROR_NO_OPCODE, "Reference list of resource type extends beyond the resource map.");
+        }
+        count += (size_t)fields[0] + 1;
+    }
+
+    if (count && !(file->entries = calloc(count, sizeof(*file->entries)))) {
+        return qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate the resource entries of resource file.");
+    }
+
+    for (uint16_t t = 0; t < type_count; ++t) {
+        qd_os_type type = 0;
+        uint16_t resource_count = 0;
+        uint16_t reference_list_offset = 0;
+
+        qd_buffer_seek(&map, type_list_offset + 2 + t * QD_RESOURCE_TYPE_SIZE, SEEK_SET);
+        if (qd_buffer_read(&type, sizeof(type), 1, &map) != 1
+            || qd_buffer_read(&resource_count, sizeof(uint16_t), 1, &map) != 1
+            || qd_buffer_read(&reference_list_offset, sizeof(uint16_t), 1, &map) != 1) {
+            return qd_error_raise(error, qd_err_truncated, map_offset + qd_buffer_tell(&map), QD_ERROR_NO_OPCODE, "Failed to read the type list of resource file.");
+        }
+
+        // The reference list was checked against the map while counting.
+        size_t references_size = ((size_t)resource_count + 1) * QD_RESOURCE_REFERENCE_SIZE;
+        qd_buffer_seek(&map, (long)type_list_offset + reference_list_offset, SEEK_SET);
+        const uint8_t *references = qd_buffer_peek(&map, references_size);
+
+        // References are decoded straight from the map, as there can be thousands
+        // of them.
+        for (const uint8_t *ref = references; ref < references + references_size; ref += QD_RESOURCE_REFERENCE_SIZE) {
+            struct qd_resource_entry *entry = &file->entries[file->count++];
+            entry->type = type;
+            entry->id = (int16_t)((ref[0] << 8) | ref[1]);
+            entry->name_offset = (uint16_t)((ref[2] << 8) | ref[3]);
+            entry->attributes = ref[4];
+            entry->data_offset = ((uint32_t)ref[5] << 16) | ((uint32_t)ref[6] << 8) | ref[7];
+        }
+    }
+
+    return 0;
+}
+
+// MARK: - Resource File
+
+struct qd_resource_file *qd_resource_file_create(struct qd_buffer *buffer, struct qd_error *error)
+{
+    if (!buffer) {
+        qd_error_raise(error, qd_err_argument, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "No buffer given for resource file.");
+        return NULL;
+    }
+
+    struct qd_resource_file *file = calloc(1, sizeof(*file));
+    if (!file) {
+        qd_error_raise(error, qd_err_no_memory, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to allocate resource file.");
+        return NULL;
+    }
+
+    file->buffer = buffer;
+    if (qd_resource_file_read_map(file, error) || qd_resource_file_build_index(file, error)) {
+        qd_resource_file_free(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+struct qd_resource_file *qd_resource_file_open(const char *restrict path, struct qd_error *error)
+{
+    struct qd_buffer *buffer = qd_buffer_map(path);
+    if (!buffer) {
+        qd_error_raise(error, qd_err_io, QD_ERROR_NO_OFFSET, QD_ERROR_NO_OPCODE, "Failed to open resource file '%s'.", path);
+        return NULL;
+    }
+
+    struct qd_resource_file *file = qd_resource_file_create(buffer, error);
+    if (!file) {
+        qd_buffer_free(buffer);
+        return NULL;
+    }
+
+    file->owns_buffer = 1;
+    return file;
+}
+
+void qd_resource_file_free(struct qd_resource_file *file)
+{
+    if (file) {
+        if (file->owns_buffer) {
+            qd_buffer_free(file->buffer);
+        }
+        free(file->entries);
+        free(file->index);
+        free(file);
+    }
+}
+
+size_t qd_resource_file_count(const struct qd_resource_file *file)
+{
+    return file ? file->count : 0;
+}
+
+static int qd_resource_file_load(const struct qd_resource_file *file, const struct qd_resource_entry *entry, struct qd_resource *resource)
+{
+    // The data of the resource is preceded by its length.
+    struct qd_buffer data = { 0 };
+    uint32_t length = 0;
+    if (entry->data_offset > file->data_length
+        || qd_buffer_view(&data, file->buffer, (uint64_t)file->data_offset + entry->data_offset, file->data_length - entry->data_offset)
+        || qd_buffer_read(&length, sizeof(uint32_t), 1, &data) != 1
+        || qd_buffer_view(&resource->data, &data, sizeof(uint32_t), length)) {
+        return 1;
+    }
+
+    resource->type = entry->type;
+    resource->id = entry->id;
+    resource->attributes = entry->attributes;
+    resource->name = NULL;
+
+    if (entry->name_offset != QD_RESOURCE_NO_NAME) {
+        struct qd_buffer names = *file->buffer;
+        qd_buffer_seek(&names, (long)(file->names_offset + entry->name_offset), SEEK_SET);
+        const uint8_t *name = qd_buffer_peek(&names, 1);
+        if (name && qd_buffer_peek(&names, 1 + (uint64_t)name[0])) {
+            resource->name = name;
+        }
+    }
+
+    return 0;
+}
+
+int qd_resource_file_get(
+    const struct qd_resource_file *file,
+    qd_os_type type,
+    int16_t id,
+    struct qd_resource *resource
+) {
+    const struct qd_resource_entry *entry = file ? qd_resource_file_find(file, type, id) : NULL;
+    if (!entry || !resource) {
+        return 1;
+    }
+
+    return qd_resource_file_load(file, entry, resource);
+}
+
+int qd_resource_file_get_index(const struct qd_resource_file *file, size_t index, struct qd_resource *resource)
+{
+    if (!file || !resource || index >= file->count) {
+        return 1;
+    }
+
+    return qd_resource_file_load(file, &file->entries[index], resource);
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "common/types.h"
+#include "common/error.h"
+#include "internal/buffer.h"
+
+#if !defined(libQuickDraw_ResourceFile)
+#define libQuickDraw_ResourceFile
+
+/* A resource fork, or a resource file in the same format. Opening one reads only
+ * its resource map, from which an index of every (type, id) pair is built. The
+ * data of a resource is not read until it is asked for, and is then handed out
+ * as a view onto the file rather than being copied, ready to be given to the
+ * parsers (qd_pict_parse, qd_color_table_parse, etc). */
+struct qd_resource_file;
+
+/* A resource within a resource file. The name is a Pascal string, or NULL for an
+ * unnamed resource. Both the name and the data refer directly to the resource
+ * file, and are only valid for as long as it is open. */
+struct qd_resource
+{
+    qd_os_type type;
+    int16_t id;
+    uint8_t attributes;
+    const uint8_t *name;
+    struct qd_buffer data;
+};
+
+/* Opens the resource file at the path, mapping it into memory. The reason that it
+ * could not be opened is raised into error, which may be NULL. */
+struct qd_resource_file *qd_resource_file_open(const char *restrict path, struct qd_error *error);
+
+/* Reads the resource map of a resource fork that is already in a buffer. The
+ * buffer is not copied, and must outlive the resource file. */
+struct qd_resource_file *qd_resource_file_create(struct qd_buffer *buffer, struct qd_error *error);
+
+void qd_resource_file_free(struct qd_resource_file *file);
+
+/* The number of resources in the file. */
+size_t qd_resource_file_count(const struct qd_resource_file *file);
+
+/* Looks up the resource with the given type and id. Returns 1 if there is no such
+ * resource, or if its data lies outside of the file. */
+int qd_resource_file_get(
+    const struct qd_resource_file *file,
+    qd_os_type type,
+    int16_t id,
+    struct qd_resource *resource
+);
+
+/* Gets the resource at an index, in the order of the resource map, for listing
+ * all of the resources in the file. */
+int qd_resource_file_get_index(const struct qd_resource_file *file, size_t index, struct qd_resource *resource);
+
+#endif
@@ -0,0 +1,97 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "atlas/atlas.h"
+#include "pict/pict.h"
+
+#if defined(UNIT_TEST)
+
+static int slots_overlap(const struct qd_atlas_entry *a, const struct qd_atlas_entry *b)
+{
+    return a->x < b->x + b->width && b->x < a->x + a->width && a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+static int compare_slot(const struct qd_atlas *atlas, const struct qd_atlas_entry *entry, const struct qd_pict *pict)
+{
+    for (uint32_t y = 0; y < entry->height; ++y) {
+        const uint8_t *row = (const uint8_t *)atlas->surface + (entry->y + y) * atlas->row_bytes + entry->x * 4;
+        if (memcmp(row, (const uint8_t *)pict->surface + y * pict->width * 4, entry->width * 4)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE(Atlas, PacksAndDecodesIntoSlots)
+{
+    struct qd_buffer *pict_buffer = qd_buffer_open("tests/test.pict");
+    struct qd_buffer *empty_buffer = qd_buffer_create_empty(8);
+    struct qd_buffer *buffers[] = { pict_buffer, pict_buffer, empty_buffer, pict_buffer, pict_buffer };
+
+    // The picture whose frame cannot be read is marked as failed, and the rest are
+    // still decoded.
+    struct qd_error error = { 0 };
+    struct qd_atlas *atlas = NULL;
+    struct qd_atlas_options options = { .padding = 1, .scale = 2, .threads = 2, .error = &error };
+    ASSERT_NEQ(qd_atlas_build(&atlas, buffers, 5, &options), 0);
+    ASSERT_NEQ(atlas, NULL);
+    ASSERT_EQ(error.code, qd_err_invalid);
+    ASSERT_EQ(atlas->count, 5);
+    ASSERT_EQ(atlas->width, 256);
+    ASSERT_NEQ(atlas->entries[2].failed, 0);
+    ASSERT_EQ(atlas->entries[2].width, 0);
+
+    struct qd_pict *pict = NULL;
+    struct qd_pict_options pict_options = { .scale = 2 };
+    ASSERT_EQ(qd_pict_parse_with_options(&pict, pict_buffer, &pict_options), 0);
+
+    for (size_t n = 0; n < atlas->count; ++n) {
+        const struct qd_atlas_entry *entry = &atlas->entries[n];
+        if (n == 2) {
+            continue;
+        }
+        ASSERT_EQ(entry->failed, 0);
+        ASSERT_EQ(entry->width, 63);
+        ASSERT_EQ(entry->height, 75);
+        ASSERT_EQ(entry->frame.right, 126);
+        ASSERT_EQ(entry->x + entry->width + 1 <= atlas->width, 1);
+        ASSERT_EQ(entry->y + entry->height + 1 <= atlas->height, 1);
+        ASSERT_EQ(entry->u0, (float)entry->x / (float)atlas->width);
+        ASSERT_EQ(entry->v1, (float)(entry->y + entry->height) / (float)atlas->height);
+        ASSERT_EQ(compare_slot(atlas, entry, pict), 0);
+        for (size_t m = n + 1; m < atlas->count; ++m) {
+            ASSERT_EQ(slots_overlap(entry, &atlas->entries[m]), 0);
+        }
+    }
+
+    // Three of the 65x77 padded slots fit across 256 pixels, and the fourth goes
+    // beneath them.
+    ASSERT_EQ(atlas->height, 154);
+
+    qd_pict_free(pict);
+    qd_atlas_free(atlas);
+    qd_buffer_free(empty_buffer);
+    qd_buffer_free(pict_buffer);
+}
+
+#endif
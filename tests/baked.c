@@ -0,0 +1,116 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "cache/baked_file.h"
+#include "pict/pict.h"
+
+#if defined(UNIT_TEST)
+
+TEST_CASE(BakedFile, LoadsSurfacesInPlace)
+{
+    struct qd_buffer *pict_buffer = qd_buffer_open("tests/test.pict");
+    struct qd_pict *pict = NULL;
+    struct qd_pict *thumbnail = NULL;
+    struct qd_pict_options options = { .scale = 4, .tiled = 1 };
+    ASSERT_EQ(qd_pict_parse(&pict, pict_buffer), 0);
+    ASSERT_EQ(qd_pict_parse_with_options(&thumbnail, pict_buffer, &options), 0);
+
+    FILE *f = tmpfile();
+    struct qd_baked_writer *writer = qd_baked_writer_create(f, NULL);
+    ASSERT_NEQ(writer, NULL);
+    ASSERT_EQ(qd_baked_writer_add(writer, "test.pict", pict), 0);
+    ASSERT_EQ(qd_baked_writer_add(writer, "test.pict@4", thumbnail), 0);
+    ASSERT_EQ(qd_baked_writer_close(writer), 0);
+
+    fseek(f, 0L, SEEK_END);
+    long size = ftell(f);
+    uint8_t *data = malloc(size);
+    fseek(f, 0L, SEEK_SET);
+    ASSERT_EQ(fread(data, 1, size, f), size);
+    fclose(f);
+
+    struct qd_buffer *buffer = qd_buffer_create(data, size);
+    struct qd_baked_file *file = qd_baked_file_create(buffer, NULL);
+    ASSERT_NEQ(file, NULL);
+    ASSERT_EQ(qd_baked_file_count(file), 2);
+
+    // Surfaces are aligned within the file, and are used where they are.
+    struct qd_baked_picture picture = { 0 };
+    ASSERT_EQ(qd_baked_file_find(file, "test.pict", &picture), 0);
+    ASSERT_EQ(((const uint8_t *)picture.surface - data) % QD_BAKED_ALIGNMENT, 0);
+    ASSERT_EQ(picture.frame.right, 126);
+    ASSERT_EQ(picture.frame.bottom, 149);
+    ASSERT_EQ(picture.width, pict->width);
+    ASSERT_EQ(picture.height, pict->height);
+    ASSERT_EQ(picture.size, pict->size);
+    ASSERT_EQ(memcmp(picture.surface, pict->surface, pict->size), 0);
+
+    ASSERT_EQ(qd_baked_file_find(file, "test.pict@4", &picture), 0);
+    ASSERT_EQ(((const uint8_t *)picture.surface - data) % QD_BAKED_ALIGNMENT, 0);
+    ASSERT_EQ(picture.scale, 4);
+    ASSERT_EQ(picture.width, 32);
+
+    // The thumbnail was decoded into tiles, and is baked in rows like any other.
+    uint8_t *rows = malloc(thumbnail->size);
+    ASSERT_EQ(qd_pict_read_pixels(thumbnail, 0, 0, thumbnail->width, thumbnail->height, rows, thumbnail->width * 4), 0);
+    ASSERT_EQ(picture.size, thumbnail->size);
+    ASSERT_EQ(memcmp(picture.surface, rows, thumbnail->size), 0);
+    free(rows);
+
+    ASSERT_EQ(qd_baked_file_find(file, "test", &picture), 1);
+    ASSERT_EQ(qd_baked_file_get_index(file, 1, &picture), 0);
+    ASSERT_EQ(strcmp(picture.name, "test.pict@4"), 0);
+
+    // A damaged table without empty slots still ends the lookup of a missing name,
+    // and surfaces that are not aligned are not handed out.
+    qd_baked_file_free(file);
+    uint32_t slot_count = 0;
+    uint64_t slots_offset = 0;
+    uint64_t entries_offset = 0;
+    memcpy(&slot_count, data + 20, sizeof(slot_count));
+    memcpy(&entries_offset, data + 24, sizeof(entries_offset));
+    memcpy(&slots_offset, data + 32, sizeof(slots_offset));
+    for (uint32_t n = 0; n < slot_count; ++n) {
+        uint32_t index = 1;
+        memcpy(data + slots_offset + n * sizeof(index), &index, sizeof(index));
+    }
+    uint8_t *surface_offset = data + entries_offset + 56;
+    *surface_offset += 4;
+    file = qd_baked_file_create(buffer, NULL);
+    ASSERT_NEQ(file, NULL);
+    ASSERT_EQ(qd_baked_file_find(file, "missing", &picture), 1);
+    ASSERT_EQ(qd_baked_file_get_index(file, 0, &picture), 1);
+    ASSERT_EQ(qd_baked_file_get_index(file, 1, &picture), 0);
+
+    // Files from another version of the format are rejected.
+    qd_baked_file_free(file);
+    data[8] = QD_BAKED_VERSION + 1;
+    ASSERT_EQ(qd_baked_file_create(buffer, NULL), NULL);
+
+    qd_buffer_free(buffer);
+    qd_pict_free(thumbnail);
+    qd_pict_free(pict);
+    qd_buffer_free(pict_buffer);
+}
+
+#endif
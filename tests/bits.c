@@ -0,0 +1,119 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "common/bits.h"
+
+#if defined(UNIT_TEST)
+
+TEST_CASE(Bits, BlitWithShiftAndClip)
+{
+    // A 70 pixel wide source with a single run of set bits at pixels 4 to 11.
+    uint8_t src_bits[9 * 2] = { 0x0F, 0xF0 };
+    uint8_t dst_bits[12 * 2] = { 0 };
+    struct qd_bit_surface src = { src_bits, 70, 2, 9 };
+    struct qd_bit_surface dst = { dst_bits, 90, 2, 12 };
+
+    // Moving the run 61 pixels to the right straddles the first word boundary.
+    struct qd_rect src_rect = { 0, 0, 1, 70 };
+    struct qd_rect dst_rect = { 0, 61, 1, 131 };
+    ASSERT_EQ(qd_bits_blit(&dst, dst_rect, &src, src_rect, qd_src_copy, NULL), 0);
+    ASSERT_EQ(dst_bits[7], 0x00);
+    ASSERT_EQ(dst_bits[8], 0x7F);
+    ASSERT_EQ(dst_bits[9], 0x80);
+    ASSERT_EQ(dst_bits[10], 0x00);
+
+    // XOR the run back out, through a clip mask that only covers pixel 72.
+    uint8_t clip_bits[12 * 2] = { 0 };
+    clip_bits[9] = 0x80;
+    struct qd_bit_surface clip = { clip_bits, 90, 2, 12 };
+    ASSERT_EQ(qd_bits_blit(&dst, dst_rect, &src, src_rect, qd_src_xor, &clip), 0);
+    ASSERT_EQ(dst_bits[8], 0x7F);
+    ASSERT_EQ(dst_bits[9], 0x00);
+
+    clip_bits[9] = 0x00;
+    clip_bits[8] = 0x40;
+    ASSERT_EQ(qd_bits_blit(&dst, dst_rect, &src, src_rect, qd_src_xor, &clip), 0);
+    ASSERT_EQ(dst_bits[8], 0x3F);
+}
+
+TEST_CASE(Bits, BlitWithinOneSurface)
+{
+    // Scrolling a mask down and to the right within its own surface gives the same
+    // bits as copying it out of an untouched copy of the surface.
+    uint8_t bits[24 * 8];
+    uint8_t copy[24 * 8];
+    uint8_t expected[24 * 8];
+    for (size_t n = 0; n < sizeof(bits); ++n) {
+        bits[n] = (uint8_t)(n * 37 + 11);
+    }
+    memcpy(copy, bits, sizeof(bits));
+    memcpy(expected, bits, sizeof(bits));
+    struct qd_bit_surface surface = { bits, 190, 8, 24 };
+    struct qd_bit_surface original = { copy, 190, 8, 24 };
+    struct qd_bit_surface reference = { expected, 190, 8, 24 };
+
+    struct qd_rect src_rect = { 0, 3, 6, 150 };
+    struct qd_rect dst_rect = { 2, 40, 8, 187 };
+    ASSERT_EQ(qd_bits_blit(&reference, dst_rect, &original, src_rect, qd_src_copy, NULL), 0);
+    ASSERT_EQ(qd_bits_blit(&surface, dst_rect, &surface, src_rect, qd_src_copy, NULL), 0);
+    ASSERT_EQ(memcmp(bits, expected, sizeof(bits)), 0);
+
+    // Moving right within the same rows overlaps each row with itself.
+    memcpy(bits, copy, sizeof(bits));
+    memcpy(expected, copy, sizeof(bits));
+    dst_rect = (struct qd_rect){ 0, 40, 6, 187 };
+    ASSERT_EQ(qd_bits_blit(&reference, dst_rect, &original, src_rect, qd_src_xor, NULL), 0);
+    ASSERT_EQ(qd_bits_blit(&surface, dst_rect, &surface, src_rect, qd_src_xor, NULL), 0);
+    ASSERT_EQ(memcmp(bits, expected, sizeof(bits)), 0);
+}
+
+TEST_CASE(Bits, PatternFillAndExpand)
+{
+    uint8_t bits[2 * 4] = { 0 };
+    struct qd_bit_surface dst = { bits, 12, 4, 2 };
+    struct qd_pattern gray = { { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 } };
+
+    struct qd_rect rect = { 1, 2, 3, 10 };
+    ASSERT_EQ(qd_bits_fill(&dst, rect, &gray, qd_pat_copy, NULL), 0);
+    ASSERT_EQ(bits[0], 0x00);
+    ASSERT_EQ(bits[2], 0x15);
+    ASSERT_EQ(bits[3], 0x40);
+    ASSERT_EQ(bits[4], 0x2A);
+    ASSERT_EQ(bits[5], 0x80);
+
+    uint8_t px[12 * 4 * 4] = { 0 };
+    struct qd_surface out = { px, 12, 4, 12 * 4 };
+    struct qd_rgb_color fg = { 0xFFFF, 0, 0 };
+    struct qd_rgb_color bk = { 0, 0, 0xFFFF };
+    ASSERT_EQ(qd_bits_expand(&out, &dst, fg, bk), 0);
+
+    // Pixel (3, 1) is set and pixel (2, 1) is clear.
+    uint8_t *set = &px[(1 * 12 + 3) * 4];
+    uint8_t *clear = &px[(1 * 12 + 2) * 4];
+    ASSERT_EQ(set[0], 0xFF);
+    ASSERT_EQ(set[2], 0x00);
+    ASSERT_EQ(clear[0], 0x00);
+    ASSERT_EQ(clear[2], 0xFF);
+}
+
+#endif
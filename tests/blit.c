@@ -0,0 +1,147 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include "common/blit.h"
+
+#if defined(UNIT_TEST)
+
+TEST_CASE(Blit, SourceCopyClipsToDestination)
+{
+    uint8_t src_px[4 * 4 * 4];
+    uint8_t dst_px[3 * 3 * 4] = { 0 };
+    for (int i = 0; i < sizeof(src_px); ++i) {
+        src_px[i] = (uint8_t)i;
+    }
+
+    struct qd_surface src = { src_px, 4, 4, 4 * 4 };
+    struct qd_surface dst = { dst_px, 3, 3, 3 * 4 };
+    struct qd_rect src_rect = { 0, 0, 4, 4 };
+    struct qd_rect dst_rect = { 1, 1, 5, 5 };
+
+    int err = qd_blit(&dst, dst_rect, &src, src_rect, NULL);
+    ASSERT_EQ(err, 0);
+
+    // The first row and column of the destination are untouched.
+    ASSERT_EQ(dst_px[0], 0);
+    ASSERT_EQ(dst_px[4 * 3], 0);
+
+    // The remaining 2x2 pixels receive the top left of the source.
+    ASSERT_EQ(dst_px[(1 * 3 + 1) * 4], src_px[0]);
+    ASSERT_EQ(dst_px[(1 * 3 + 2) * 4 + 3], src_px[7]);
+    ASSERT_EQ(dst_px[(2 * 3 + 2) * 4 + 2], src_px[(1 * 4 + 1) * 4 + 2]);
+}
+
+TEST_CASE(Blit, ArithmeticAndBooleanModes)
+{
+    // Use enough pixels for both the vector and the scalar parts of the kernels.
+    uint8_t src_px[6 * 4];
+    uint8_t dst_px[6 * 4];
+    for (int i = 0; i < 6; ++i) {
+        uint8_t *s = &src_px[i * 4];
+        s[0] = 200; s[1] = 0; s[2] = 100; s[3] = 0xFF;
+    }
+
+    struct qd_surface src = { src_px, 6, 1, 6 * 4 };
+    struct qd_surface dst = { dst_px, 6, 1, 6 * 4 };
+    struct qd_rect rect = { 0, 0, 1, 6 };
+
+    struct qd_transfer transfer = { qd_add_pin, { 0xFFFF, 0x8000, 0x8000 } };
+    for (int i = 0; i < sizeof(dst_px); ++i) {
+        dst_px[i] = 100;
+    }
+    ASSERT_EQ(qd_blit(&dst, rect, &src, rect, &transfer), 0);
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_EQ(dst_px[i * 4 + 0], 255);
+        ASSERT_EQ(dst_px[i * 4 + 1], 100);
+        ASSERT_EQ(dst_px[i * 4 + 2], 128);
+        ASSERT_EQ(dst_px[i * 4 + 3], 255);
+    }
+
+    // Black is the ink color, so srcOr only paints the black parts of the source.
+    transfer.mode = qd_src_or;
+    for (int i = 0; i < sizeof(dst_px); ++i) {
+        dst_px[i] = 100;
+    }
+    ASSERT_EQ(qd_blit(&dst, rect, &src, rect, &transfer), 0);
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_EQ(dst_px[i * 4 + 0], 200 & 100);
+        ASSERT_EQ(dst_px[i * 4 + 1], 0);
+        ASSERT_EQ(dst_px[i * 4 + 2], 100);
+    }
+
+    // Transparent leaves the destination wherever the source matches the background.
+    transfer.mode = qd_transparent;
+    transfer.bk_color = (struct qd_rgb_color){ 200 << 8, 0, 100 << 8 };
+    src_px[4 * 4 + 1] = 50;
+    for (int i = 0; i < sizeof(dst_px); ++i) {
+        dst_px[i] = 7;
+    }
+    ASSERT_EQ(qd_blit(&dst, rect, &src, rect, &transfer), 0);
+    ASSERT_EQ(dst_px[0], 7);
+    ASSERT_EQ(dst_px[5 * 4], 7);
+    ASSERT_EQ(dst_px[4 * 4 + 0], 200);
+    ASSERT_EQ(dst_px[4 * 4 + 1], 50);
+}
+
+TEST_CASE(Blit, ScaledReductionAndEnlargement)
+{
+    // An 8x4 source where each pixel carries its column in red and its row in green.
+    uint8_t src_px[8 * 4 * 4];
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            uint8_t *p = &src_px[(y * 8 + x) * 4];
+            p[0] = (uint8_t)(x * 10); p[1] = (uint8_t)(y * 10); p[2] = 0; p[3] = 0xFF;
+        }
+    }
+    struct qd_surface src = { src_px, 8, 4, 8 * 4 };
+    struct qd_rect src_rect = { 0, 0, 4, 8 };
+
+    // Reducing by 2x averages each 2x2 block.
+    uint8_t half_px[4 * 2 * 4] = { 0 };
+    struct qd_surface half = { half_px, 4, 2, 4 * 4 };
+    struct qd_rect half_rect = { 0, 0, 2, 4 };
+    ASSERT_EQ(qd_blit_scaled(&half, half_rect, &src, src_rect, NULL, qd_blit_filter_box), 0);
+    ASSERT_EQ(half_px[0], 5);
+    ASSERT_EQ(half_px[1], 5);
+    ASSERT_EQ(half_px[(1 * 4 + 3) * 4 + 0], 65);
+    ASSERT_EQ(half_px[(1 * 4 + 3) * 4 + 1], 25);
+    ASSERT_EQ(half_px[(1 * 4 + 3) * 4 + 3], 0xFF);
+
+    // Enlarging by 2x replicates each pixel.
+    uint8_t big_px[16 * 8 * 4] = { 0 };
+    struct qd_surface big = { big_px, 16, 8, 16 * 4 };
+    struct qd_rect big_rect = { 0, 0, 8, 16 };
+    ASSERT_EQ(qd_blit_scaled(&big, big_rect, &src, src_rect, NULL, qd_blit_filter_nearest), 0);
+    for (int x = 0; x < 16; ++x) {
+        ASSERT_EQ(big_px[(5 * 16 + x) * 4 + 0], (x / 2) * 10);
+        ASSERT_EQ(big_px[(5 * 16 + x) * 4 + 1], 20);
+    }
+
+    // Bilinear filtering interpolates between neighbouring source pixels.
+    ASSERT_EQ(qd_blit_scaled(&big, big_rect, &src, src_rect, NULL, qd_blit_filter_bilinear), 0);
+    ASSERT_EQ(big_px[(0 * 16 + 0) * 4 + 0], 0);
+    ASSERT_EQ(big_px[(0 * 16 + 2) * 4 + 0], 7);
+    ASSERT_EQ(big_px[(0 * 16 + 3) * 4 + 0], 12);
+    ASSERT_EQ(big_px[(0 * 16 + 15) * 4 + 0], 70);
+}
+
+#endif
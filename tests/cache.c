@@ -0,0 +1,98 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "cache/pict_cache.h"
+
+#if defined(UNIT_TEST)
+
+TEST_CASE(PictCache, SharesPicturesByContent)
+{
+    struct qd_buffer *buffer = qd_buffer_open("tests/test.pict");
+    struct qd_buffer *copy = qd_buffer_open("tests/test.pict");
+    struct qd_pict_cache *cache = qd_pict_cache_create(1 << 20);
+    struct qd_pict_cache_stats stats = { 0 };
+
+    // The same bytes from another buffer are a hit, but another scale is not.
+    const struct qd_pict *pict = qd_pict_cache_parse(cache, buffer, NULL);
+    ASSERT_NEQ(pict, NULL);
+    const struct qd_pict *same = qd_pict_cache_parse(cache, copy, NULL);
+    ASSERT_EQ(same, pict);
+
+    struct qd_pict_options options = { .scale = 4 };
+    const struct qd_pict *thumbnail = qd_pict_cache_parse(cache, buffer, &options);
+    ASSERT_NEQ(thumbnail, pict);
+    ASSERT_EQ(thumbnail->width, 32);
+
+    qd_pict_cache_get_stats(cache, &stats);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.evictions, 0);
+    ASSERT_EQ(stats.count, 2);
+    ASSERT_EQ(stats.bytes > 2 * buffer->size, 1);
+
+    qd_pict_cache_release(same);
+    qd_pict_cache_release(thumbnail);
+    qd_pict_cache_release(pict);
+    qd_pict_cache_free(cache);
+    qd_buffer_free(copy);
+    qd_buffer_free(buffer);
+}
+
+TEST_CASE(PictCache, EvictsLeastRecentlyUsedBeyondBudget)
+{
+    struct qd_buffer *buffer = qd_buffer_open("tests/test.pict");
+    struct qd_pict_options half = { .scale = 2 };
+    struct qd_pict_options quarter = { .scale = 4 };
+    struct qd_pict_cache_stats stats = { 0 };
+
+    // Leave room for the full size picture and a little more, but not for all
+    // three of the decoded sizes. Each entry also keeps a copy of the picture data.
+    struct qd_pict_cache *cache = qd_pict_cache_create(90000 + 2 * buffer->size);
+    const struct qd_pict *quarter_pict = qd_pict_cache_parse(cache, buffer, &quarter);
+    const struct qd_pict *half_pict = qd_pict_cache_parse(cache, buffer, &half);
+    qd_pict_cache_release(qd_pict_cache_parse(cache, buffer, &quarter));
+    const struct qd_pict *full_pict = qd_pict_cache_parse(cache, buffer, NULL);
+
+    // The half size picture was used least recently, and is evicted first. It is
+    // still valid while it is referenced.
+    qd_pict_cache_get_stats(cache, &stats);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.evictions, 1);
+    ASSERT_EQ(stats.count, 2);
+    ASSERT_EQ(half_pict->width, 63);
+
+    const struct qd_pict *again = qd_pict_cache_parse(cache, buffer, &half);
+    ASSERT_NEQ(again, half_pict);
+    qd_pict_cache_get_stats(cache, &stats);
+    ASSERT_EQ(stats.misses, 4);
+    ASSERT_EQ(stats.bytes <= stats.budget, 1);
+
+    qd_pict_cache_release(again);
+    qd_pict_cache_release(half_pict);
+    qd_pict_cache_release(full_pict);
+    qd_pict_cache_release(quarter_pict);
+    qd_pict_cache_free(cache);
+    qd_buffer_free(buffer);
+}
+
+#endif
@@ -21,6 +21,7 @@
 
 #include <libUnit/unit.h>
 #include "common/color_table.h"
+#include "common/palette.h"
 
 #if defined(UNIT_TEST)
 
@@ -47,8 +48,90 @@ TEST_CASE(ColorTable, ParseResourceData)
     ASSERT_EQ(clut->ct_table[2].rgb.green, 0xFFFF);
     ASSERT_EQ(clut->ct_table[2].rgb.blue, 0x0000);
 
+    // The colors are listed in table order, with 8 bit channels and their index.
+    struct qd_inverse_table_color colors[256];
+    ASSERT_EQ(qd_color_table_get_colors(clut, colors), 3);
+    ASSERT_EQ(colors[1].red, 0xFF);
+    ASSERT_EQ(colors[1].green, 0x00);
+    ASSERT_EQ(colors[1].index, clut->ct_table[1].value);
+
     qd_color_table_free(clut);
     qd_buffer_free(clut_buffer);
 }
 
-#endif
\ No newline at end of file
+TEST_CASE(Palette, CachedByContent)
+{
+    struct qd_buffer *clut_buffer = qd_buffer_open("tests/test.clut");
+    const struct qd_palette *first = qd_palette_read(clut_buffer, qd_32_rgba_pixel_format);
+    ASSERT_NEQ(first, NULL);
+
+    // The colors are packed in the requested format, in index order.
+    const uint8_t *magenta = (const uint8_t *)&first->colors[1];
+    ASSERT_EQ(magenta[0], 0xFF);
+    ASSERT_EQ(magenta[1], 0x00);
+    ASSERT_EQ(magenta[2], 0xFF);
+    ASSERT_EQ(magenta[3], 0xFF);
+
+    // Reading the same color table again gives the cached palette, and leaves the
+    // buffer in the same place.
+    long end = qd_buffer_tell(clut_buffer);
+    qd_buffer_seek(clut_buffer, 0, SEEK_SET);
+    const struct qd_palette *second = qd_palette_read(clut_buffer, qd_32_rgba_pixel_format);
+    ASSERT_EQ(second, first);
+    ASSERT_EQ(qd_buffer_tell(clut_buffer), end);
+
+    // A different pixel format is a different palette.
+    qd_buffer_seek(clut_buffer, 0, SEEK_SET);
+    const struct qd_palette *bgra = qd_palette_read(clut_buffer, qd_32_bgra_pixel_format);
+    ASSERT_NEQ(bgra, first);
+    ASSERT_EQ(((const uint8_t *)&bgra->colors[2])[1], 0xFF);
+
+    qd_palette_release(first);
+    qd_palette_release(second);
+    qd_palette_release(bgra);
+    qd_palette_cache_purge();
+    qd_buffer_free(clut_buffer);
+}
+
+TEST_CASE(InverseTable, MapsColorsToNearestIndex)
+{
+    struct qd_buffer *clut_buffer = qd_buffer_open("tests/test.clut");
+    const struct qd_palette *palette = qd_palette_read(clut_buffer, qd_32_rgba_pixel_format);
+    const struct qd_inverse_table *table = qd_palette_inverse_table(palette);
+    ASSERT_NEQ(table, NULL);
+    ASSERT_EQ(qd_palette_inverse_table(palette), table);
+
+    ASSERT_EQ(qd_inverse_table_lookup(table, 0xF0, 0xF0, 0xF0), 0);
+    ASSERT_EQ(qd_inverse_table_lookup(table, 0xE0, 0x10, 0xF0), 1);
+    ASSERT_EQ(qd_inverse_table_lookup(table, 0x00, 0xC0, 0x20), 2);
+
+    uint8_t px[4 * 4] = {
+        0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0x00, 0xFF, 0xFF,
+        0x00, 0xFF, 0x00, 0xFF,
+        0x10, 0xE0, 0x10, 0xFF,
+    };
+    struct qd_surface surface = { px, 4, 1, sizeof(px) };
+    uint8_t out[4] = { 0 };
+    ASSERT_EQ(qd_inverse_table_convert(table, out, sizeof(out), &surface, qd_inverse_table_nearest), 0);
+    ASSERT_EQ(out[0], 0);
+    ASSERT_EQ(out[1], 1);
+    ASSERT_EQ(out[2], 2);
+    ASSERT_EQ(out[3], 2);
+
+    // Dithering never selects a color outside of the color table.
+    ASSERT_EQ(qd_inverse_table_convert(table, out, sizeof(out), &surface, qd_inverse_table_ordered_dither), 0);
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQ(out[i] <= 2, 1);
+    }
+
+    // Indices are 8 bits, so no more than 256 colors can be mapped back to.
+    struct qd_inverse_table_color colors[257] = { { 0 } };
+    ASSERT_EQ(qd_inverse_table_create_with_colors(colors, 257, 4), NULL);
+
+    qd_palette_release(palette);
+    qd_palette_cache_purge();
+    qd_buffer_free(clut_buffer);
+}
+
+#endif
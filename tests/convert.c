@@ -0,0 +1,120 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include "common/convert.h"
+
+#if defined(UNIT_TEST)
+
+TEST_CASE(Convert, DirectFormats)
+{
+    // A Mac 555 pixel of pure red, followed by white and black, with enough pixels
+    // for both the vector and scalar parts of the kernels.
+    uint8_t src[10 * 2] = { 0x7C, 0x00, 0x7F, 0xFF, 0x00, 0x00 };
+    uint8_t rgba[10 * 4] = { 0 };
+    struct qd_converter conv;
+
+    ASSERT_EQ(qd_converter_init(&conv, qd_16_555_pixel_format, qd_32_rgba_pixel_format, NULL, NULL), 0);
+    qd_convert_row(&conv, rgba, src, 10);
+    ASSERT_EQ(rgba[0], 0xFF);
+    ASSERT_EQ(rgba[1], 0x00);
+    ASSERT_EQ(rgba[3], 0xFF);
+    ASSERT_EQ(rgba[4], 0xFF);
+    ASSERT_EQ(rgba[6], 0xFF);
+    ASSERT_EQ(rgba[8], 0x00);
+    qd_converter_destroy(&conv);
+
+    // Round trip through a host format and back to the Mac formats.
+    uint8_t bgr[10 * 3] = { 0 };
+    uint8_t argb[10 * 4] = { 0 };
+    ASSERT_EQ(qd_converter_init(&conv, qd_32_rgba_pixel_format, qd_24_bgr_pixel_format, NULL, NULL), 0);
+    qd_convert_row(&conv, bgr, rgba, 10);
+    ASSERT_EQ(bgr[0], 0x00);
+    ASSERT_EQ(bgr[2], 0xFF);
+    qd_converter_destroy(&conv);
+
+    ASSERT_EQ(qd_converter_init(&conv, qd_24_bgr_pixel_format, qd_32_argb_pixel_format, NULL, NULL), 0);
+    qd_convert_row(&conv, argb, bgr, 10);
+    ASSERT_EQ(argb[0], 0xFF);
+    ASSERT_EQ(argb[1], 0xFF);
+    ASSERT_EQ(argb[2], 0x00);
+    qd_converter_destroy(&conv);
+
+    uint8_t back[10 * 2] = { 0 };
+    ASSERT_EQ(qd_converter_init(&conv, qd_32_argb_pixel_format, qd_16_555_pixel_format, NULL, NULL), 0);
+    qd_convert_row(&conv, back, argb, 10);
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_EQ(back[i], src[i]);
+    }
+    qd_converter_destroy(&conv);
+}
+
+TEST_CASE(Convert, IndexedFormats)
+{
+    struct qd_inverse_table_color colors[4] = {
+        { 0xFF, 0xFF, 0xFF, 0 }, { 0xFF, 0x00, 0x00, 1 }, { 0x00, 0x00, 0xFF, 2 }, { 0x00, 0x00, 0x00, 3 },
+    };
+    uint32_t palette[256] = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        uint8_t *c = (uint8_t *)&palette[colors[i].index];
+        c[0] = colors[i].red;
+        c[1] = colors[i].green;
+        c[2] = colors[i].blue;
+        c[3] = 0xFF;
+    }
+
+    // Five 2 bit pixels: 0, 1, 2, 3, 1
+    uint8_t src[2] = { 0x1B, 0x40 };
+    uint8_t rgb[5 * 3] = { 0 };
+    struct qd_converter conv;
+    ASSERT_EQ(qd_converter_init(&conv, qd_2_indexed_pixel_format, qd_24_rgb_pixel_format, palette, NULL), 0);
+    qd_convert_row(&conv, rgb, src, 5);
+    ASSERT_EQ(rgb[0], 0xFF);
+    ASSERT_EQ(rgb[3], 0xFF);
+    ASSERT_EQ(rgb[4], 0x00);
+    ASSERT_EQ(rgb[8], 0xFF);
+    ASSERT_EQ(rgb[9], 0x00);
+    ASSERT_EQ(rgb[12], 0xFF);
+    qd_converter_destroy(&conv);
+
+    // Back to indices through an inverse table, first at 2 bits and then at 8.
+    struct qd_inverse_table *inverse = qd_inverse_table_create_with_colors(colors, 4, 4);
+    uint8_t indexed[2] = { 0 };
+    ASSERT_EQ(qd_converter_init(&conv, qd_24_rgb_pixel_format, qd_2_indexed_pixel_format, NULL, inverse), 0);
+    qd_convert_row(&conv, indexed, rgb, 5);
+    ASSERT_EQ(indexed[0], src[0]);
+    ASSERT_EQ(indexed[1], src[1]);
+    qd_converter_destroy(&conv);
+
+    uint8_t wide[5] = { 0 };
+    ASSERT_EQ(qd_converter_init(&conv, qd_2_indexed_pixel_format, qd_8_indexed_pixel_format, palette, inverse), 0);
+    qd_convert_row(&conv, wide, src, 5);
+    ASSERT_EQ(wide[0], 0);
+    ASSERT_EQ(wide[1], 1);
+    ASSERT_EQ(wide[2], 2);
+    ASSERT_EQ(wide[3], 3);
+    ASSERT_EQ(wide[4], 1);
+    qd_converter_destroy(&conv);
+
+    qd_inverse_table_free(inverse);
+}
+
+#endif
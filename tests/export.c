@@ -0,0 +1,206 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export/export.h"
+#include "internal/pixel.h"
+
+#if defined(UNIT_TEST)
+
+struct output
+{
+    uint8_t *data;
+    size_t size;
+    size_t writes;
+};
+
+static int write_output(void *context, const void *data, size_t size)
+{
+    struct output *output = context;
+    output->data = realloc(output->data, output->size + size);
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    output->writes++;
+    return 0;
+}
+
+static int fail_output(void *context, const void *data, size_t size)
+{
+    return 1;
+}
+
+/* Decodes a QOI image into RGBA pixels, returning 1 if it is malformed. */
+static int decode_qoi(const uint8_t *data, size_t size, uint32_t width, uint32_t height, uint8_t *pixels)
+{
+    uint8_t index[64][4] = { { 0 } };
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    size_t pos = 14;
+    size_t run = 0;
+
+    if (size < 22 || memcmp(data, "qoif", 4) || data[7] != (uint8_t)width || data[11] != (uint8_t)height || data[12] != 4) {
+        return 1;
+    }
+    for (size_t n = 0; n < (size_t)width * height; ++n, pixels += 4) {
+        if (run) {
+            --run;
+        }
+        else if (pos < size - 8) {
+            uint8_t op = data[pos++];
+            if (op == 0xFE || op == 0xFF) {
+                memcpy(px, data + pos, op == 0xFE ? 3 : 4);
+                pos += op == 0xFE ? 3 : 4;
+            }
+            else if ((op & 0xC0) == 0x00) {
+                memcpy(px, index[op], 4);
+            }
+            else if ((op & 0xC0) == 0x40) {
+                px[0] += ((op >> 4) & 3) - 2;
+                px[1] += ((op >> 2) & 3) - 2;
+                px[2] += (op & 3) - 2;
+            }
+            else if ((op & 0xC0) == 0x80) {
+                int dg = (op & 0x3F) - 32;
+                uint8_t b = data[pos++];
+                px[0] += dg - 8 + (b >> 4);
+                px[1] += dg;
+                px[2] += dg - 8 + (b & 0x0F);
+            }
+            else {
+                run = op & 0x3F;
+            }
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        }
+        memcpy(pixels, px, 4);
+    }
+
+    static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    return pos != size - 8 || memcmp(data + pos, end, 8) != 0;
+}
+
+TEST_CASE(Export, EncodesEachFormat)
+{
+    // Runs, gradients and noise, with runs that carry on from one row to the next.
+    const uint32_t width = 40;
+    const uint32_t height = 30;
+    uint32_t *pixels = malloc(width * height * 4);
+    uint32_t state = 0x12345678;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            uint32_t px = (y < 10) ? qd_pixel_pack(10, 20, 30, 255)
+                : (y < 20) ? qd_pixel_pack((uint8_t)(x * 3), (uint8_t)(y * 5), (uint8_t)(x + y), (uint8_t)(255 - x))
+                : state;
+            pixels[y * width + x] = px;
+        }
+    }
+
+    struct output output = { 0 };
+    struct qd_exporter *exporter = qd_exporter_create(qd_export_qoi, width, height, write_output, &output, NULL);
+    ASSERT_NEQ(exporter, NULL);
+    ASSERT_EQ(qd_exporter_write_rows(exporter, pixels, width * 4, 12), 0);
+    ASSERT_EQ(qd_exporter_write_rows(exporter, pixels + 12 * width, width * 4, height - 12), 0);
+    ASSERT_EQ(qd_exporter_finish(exporter), 0);
+    qd_exporter_free(exporter);
+
+    uint8_t *decoded = malloc(width * height * 4);
+    ASSERT_EQ(decode_qoi(output.data, output.size, width, height, decoded), 0);
+    ASSERT_EQ(memcmp(decoded, pixels, width * height * 4), 0);
+    free(decoded);
+    free(output.data);
+
+    // BMP pixels are stored from the top down as B, G, R, A.
+    output = (struct output){ 0 };
+    exporter = qd_exporter_create(qd_export_bmp, width, height, write_output, &output, NULL);
+    ASSERT_EQ(qd_exporter_write_rows(exporter, pixels, width * 4, height), 0);
+    ASSERT_EQ(qd_exporter_finish(exporter), 0);
+    qd_exporter_free(exporter);
+    ASSERT_EQ(output.size, 122 + width * height * 4);
+    ASSERT_EQ(output.data[0], 'B');
+    ASSERT_EQ(output.data[10], 122);
+    ASSERT_EQ(output.data[25], 0xFF);
+    const uint8_t *source = (const uint8_t *)&pixels[15 * width + 7];
+    const uint8_t *stored = output.data + 122 + (15 * width + 7) * 4;
+    ASSERT_EQ(stored[0], source[2]);
+    ASSERT_EQ(stored[2], source[0]);
+    ASSERT_EQ(stored[3], source[3]);
+    free(output.data);
+
+    // PAM rows are the surface rows as they are, written at once.
+    output = (struct output){ 0 };
+    exporter = qd_exporter_create(qd_export_pam, width, height, write_output, &output, NULL);
+    ASSERT_EQ(qd_exporter_write_rows(exporter, pixels, width * 4, height), 0);
+    ASSERT_EQ(qd_exporter_finish(exporter), 0);
+    qd_exporter_free(exporter);
+    ASSERT_EQ(output.writes, 2);
+    ASSERT_EQ(memcmp(output.data, "P7\nWIDTH 40\nHEIGHT 30\n", 22), 0);
+    ASSERT_EQ(memcmp(output.data + output.size - width * height * 4, pixels, width * height * 4), 0);
+    free(output.data);
+
+    // Failing writes, and missing rows, are reported.
+    struct qd_error error = { 0 };
+    ASSERT_EQ(qd_exporter_create(qd_export_pam, width, height, fail_output, NULL, &error), NULL);
+    ASSERT_EQ(error.code, qd_err_io);
+    qd_error_clear(&error);
+    output = (struct output){ 0 };
+    exporter = qd_exporter_create(qd_export_qoi, width, height, write_output, &output, &error);
+    ASSERT_EQ(qd_exporter_write_rows(exporter, pixels, width * 4, 5), 0);
+    ASSERT_NEQ(qd_exporter_finish(exporter), 0);
+    ASSERT_EQ(error.code, qd_err_argument);
+    qd_exporter_free(exporter);
+    free(output.data);
+
+    free(pixels);
+}
+
+TEST_CASE(Export, ExportsTiledPictures)
+{
+    // A tiled picture exports the same as one decoded in one piece.
+    struct qd_buffer *buffer = qd_buffer_open("tests/test.pict");
+    struct qd_pict *linear = NULL;
+    struct qd_pict *tiled = NULL;
+    struct qd_pict_options options = { .tiled = 1 };
+    ASSERT_EQ(qd_pict_parse(&linear, buffer), 0);
+    ASSERT_EQ(qd_pict_parse_with_options(&tiled, buffer, &options), 0);
+
+    struct output a = { 0 };
+    struct output b = { 0 };
+    ASSERT_EQ(qd_export_pict(linear, qd_export_qoi, write_output, &a, NULL), 0);
+    ASSERT_EQ(qd_export_pict(tiled, qd_export_qoi, write_output, &b, NULL), 0);
+    ASSERT_EQ(a.size, b.size);
+    ASSERT_EQ(memcmp(a.data, b.data, a.size), 0);
+
+    uint8_t *decoded = malloc((size_t)linear->width * linear->height * 4);
+    ASSERT_EQ(decode_qoi(a.data, a.size, linear->width, linear->height, decoded), 0);
+    ASSERT_EQ(memcmp(decoded, linear->surface, (size_t)linear->width * linear->height * 4), 0);
+
+    free(decoded);
+    free(a.data);
+    free(b.data);
+    qd_pict_free(linear);
+    qd_pict_free(tiled);
+    qd_buffer_free(buffer);
+}
+
+#endif
@@ -0,0 +1,77 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "internal/loader.h"
+
+#if defined(UNIT_TEST)
+
+static const char *loader_paths[] = {
+    "tests/test.pict",
+    "tests/test.clut",
+    "tests/missing.pict",
+    "tests/test.pixmap",
+    "tests/test.pict",
+};
+
+TEST_CASE(Loader, LoadsEveryFileOnce)
+{
+    // Both the thread pool and, where it is built in and allowed, io_uring hand
+    // back every file exactly once, with the same bytes as reading it directly.
+    for (int use_threads = 0; use_threads < 2; ++use_threads) {
+        struct qd_loader *loader = NULL;
+        struct qd_loader_options options = { .queue_depth = 2, .threads = 2, .use_threads = use_threads };
+        ASSERT_EQ(qd_loader_open(&loader, loader_paths, 5, &options), 0);
+        if (use_threads) {
+            ASSERT_EQ(qd_loader_uses_io_uring(loader), 0);
+        }
+
+        int seen[5] = { 0 };
+        size_t index;
+        struct qd_buffer *buffer;
+        struct qd_error error = { 0 };
+        while (qd_loader_next(loader, &index, &buffer, &error) == 0) {
+            ASSERT_EQ(index < 5, 1);
+            ++seen[index];
+
+            struct qd_buffer *expected = qd_buffer_open(loader_paths[index]);
+            if (expected) {
+                ASSERT_NEQ(buffer, NULL);
+                ASSERT_EQ(buffer->size, expected->size);
+                ASSERT_EQ(memcmp(buffer->data, expected->data, (size_t)expected->size), 0);
+            }
+            else {
+                ASSERT_EQ(buffer, NULL);
+                ASSERT_EQ(error.code, qd_err_io);
+            }
+            qd_buffer_free(expected);
+            qd_buffer_free(buffer);
+        }
+
+        for (int n = 0; n < 5; ++n) {
+            ASSERT_EQ(seen[n], 1);
+        }
+        qd_loader_close(loader);
+    }
+}
+
+#endif
@@ -20,6 +20,8 @@
  */
 
 #include <libUnit/unit.h>
+#include <stdatomic.h>
+#include <string.h>
 #include "pict/pict.h"
 
 #if defined(UNIT_TEST)
@@ -50,4 +52,664 @@ TEST_CASE(PICT, ParseResourceData)
     qd_buffer_free(pm_buffer);
 }
 
-#endif
\ No newline at end of file
+TEST_CASE(PICT, ParseThumbnail)
+{
+    struct qd_buffer *pm_buffer = qd_buffer_open("tests/test.pict");
+
+    struct qd_pict *pict = NULL;
+    struct qd_pict_options options = { .scale = 4 };
+    int err = qd_pict_parse_with_options(&pict, pm_buffer, &options);
+    ASSERT_EQ(err, 0);
+
+    // The frame is reported as is, but the surface is reduced to 1/4 of it.
+    ASSERT_EQ(pict->frame.right, 126);
+    ASSERT_EQ(pict->frame.bottom, 149);
+    ASSERT_EQ(pict->width, 32);
+    ASSERT_EQ(pict->height, 38);
+    ASSERT_EQ(pict->size, 32 * 38 * 4);
+
+    qd_pict_free(pict);
+    qd_buffer_free(pm_buffer);
+}
+
+// MARK: - Synthetic Pictures
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++ = (uint8_t)(v >> 8);
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    return put16(put16(p, (uint16_t)(v >> 16)), (uint16_t)v);
+}
+
+static uint8_t *put_rect(uint8_t *p, short top, short left, short bottom, short right)
+{
+    return put16(put16(put16(put16(p, top), left), bottom), right);
+}
+
+static uint8_t *put_header(uint8_t *p, short width, short height)
+{
+    p = put16(p, 0);
+    p = put_rect(p, 0, 0, height, width);
+    p = put32(p, 0x001102FF);
+    p = put16(p, 0x0C00);
+    p = put32(p, 0xFFFFFFFF);
+    p = put32(p, 0);
+    p = put32(p, 0);
+    p = put32(p, (uint32_t)width << 16);
+    p = put32(p, (uint32_t)height << 16);
+    return put32(p, 0);
+}
+
+static uint8_t *put_indexed_pixmap(uint8_t *p, short row_bytes, short width, short height, short depth)
+{
+    p = put16(p, 0x8000 | row_bytes);
+    p = put_rect(p, 0, 0, height, width);
+    p = put16(p, 0);                    // version
+    p = put16(p, 0);                    // pack type
+    p = put32(p, 0);                    // pack size
+    p = put32(p, 0x00480000);           // h res
+    p = put32(p, 0x00480000);           // v res
+    p = put16(p, 0);                    // pixel type
+    p = put16(p, depth);                // pixel size
+    p = put16(p, 1);                    // component count
+    p = put16(p, depth);                // component size
+    p = put32(p, 0);                    // pixel format
+    p = put32(p, 0);                    // color table
+    return put32(p, 0);                 // reserved
+}
+
+static uint8_t *put_direct_pixmap(uint8_t *p, short row_bytes, short width, short top, short pack_type, short pixel_size, short cmp_count)
+{
+    p = put32(p, 0x000000FF);           // base address
+    p = put16(p, 0x8000 | row_bytes);
+    p = put_rect(p, top, 0, top + 1, width);
+    p = put16(p, 0);                    // version
+    p = put16(p, pack_type);
+    p = put32(p, 0);                    // pack size
+    p = put32(p, 0x00480000);           // h res
+    p = put32(p, 0x00480000);           // v res
+    p = put16(p, 16);                   // pixel type
+    p = put16(p, pixel_size);
+    p = put16(p, cmp_count);
+    p = put16(p, pixel_size == 16 ? 5 : 8);
+    p = put32(p, 0);                    // pixel format
+    p = put32(p, 0);                    // color table
+    p = put32(p, 0);                    // reserved
+    p = put_rect(p, top, 0, top + 1, width);
+    p = put_rect(p, top, 0, top + 1, width);
+    return put16(p, 0);
+}
+
+TEST_CASE(PICT, ParseIndexedBitmaps)
+{
+    uint8_t *data = calloc(1024, 1);
+    uint8_t *p = put_header(data, 10, 3);
+
+    // A 1-bit BitMap in the first row: alternating black and white pixels.
+    p = put16(p, 0x0090);
+    p = put16(p, 2);
+    p = put_rect(p, 0, 0, 1, 10);
+    p = put_rect(p, 0, 0, 1, 10);
+    p = put_rect(p, 0, 0, 1, 10);
+    p = put16(p, 0);
+    *p++ = 0xAA;
+    *p++ = 0x80;
+
+    // An 8-bit packed PixMap with a 3 color table in the remaining two rows.
+    p = put16(p, 0x0098);
+    p = put_indexed_pixmap(p, 10, 10, 2, 8);
+    p = put32(p, 0);
+    p = put16(p, 0);
+    p = put16(p, 2);
+    p = put16(p, 0); p = put16(p, 0xFFFF); p = put16(p, 0x0000); p = put16(p, 0x0000);
+    p = put16(p, 1); p = put16(p, 0x0000); p = put16(p, 0xFFFF); p = put16(p, 0x0000);
+    p = put16(p, 2); p = put16(p, 0x0000); p = put16(p, 0x0000); p = put16(p, 0xFFFF);
+    p = put_rect(p, 0, 0, 2, 10);
+    p = put_rect(p, 1, 0, 3, 10);
+    p = put16(p, 0);
+
+    // Row 1: ten pixels of index 1. Row 2: literal 0, 1, 2 followed by seven 2s.
+    *p++ = 2; *p++ = (uint8_t)(257 - 10); *p++ = 1;
+    *p++ = 6; *p++ = 2; *p++ = 0; *p++ = 1; *p++ = 2; *p++ = (uint8_t)(257 - 7); *p++ = 2;
+    if ((p - data) & 1) {
+        *p++ = 0;
+    }
+    p = put16(p, 0x00FF);
+
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, buffer);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(pict->width, 10);
+    ASSERT_EQ(pict->height, 3);
+
+    const uint8_t *px = pict->surface;
+    ASSERT_EQ(px[0], 0x00);
+    ASSERT_EQ(px[4], 0xFF);
+    ASSERT_EQ(px[8 * 4], 0x00);
+    ASSERT_EQ(px[9 * 4], 0xFF);
+
+    const uint8_t *row1 = px + 10 * 4;
+    ASSERT_EQ(row1[9 * 4 + 0], 0x00);
+    ASSERT_EQ(row1[9 * 4 + 1], 0xFF);
+    ASSERT_EQ(row1[9 * 4 + 2], 0x00);
+
+    const uint8_t *row2 = px + 20 * 4;
+    ASSERT_EQ(row2[0], 0xFF);
+    ASSERT_EQ(row2[1 * 4 + 1], 0xFF);
+    ASSERT_EQ(row2[2 * 4 + 2], 0xFF);
+    ASSERT_EQ(row2[9 * 4 + 2], 0xFF);
+    ASSERT_EQ(row2[9 * 4 + 3], 0xFF);
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+TEST_CASE(PICT, ParsePatternFills)
+{
+    uint8_t *data = calloc(1024, 1);
+    uint8_t *p = put_header(data, 20, 10);
+
+    // Paint the top rows with a checkerboard pen pattern.
+    p = put16(p, 0x0009);
+    for (int i = 0; i < 8; ++i) {
+        *p++ = (i & 1) ? 0x55 : 0xAA;
+    }
+    p = put16(p, 0x0031);
+    p = put_rect(p, 0, 0, 4, 20);
+
+    // Fill the left of the middle rows with a solid red PixPat.
+    p = put16(p, 0x0014);
+    p = put16(p, 2);
+    p = put32(p, 0); p = put32(p, 0);
+    p = put16(p, 0xFFFF); p = put16(p, 0x0000); p = put16(p, 0x0000);
+    p = put16(p, 0x0034);
+    p = put_rect(p, 4, 0, 8, 10);
+
+    // Fill the right of the middle rows with an 8x8 color PixPat, in which the
+    // first four pixels of each row are blue and the rest are white.
+    p = put16(p, 0x0014);
+    p = put16(p, 1);
+    p = put32(p, 0); p = put32(p, 0);
+    p = put_indexed_pixmap(p, 2, 8, 8, 1);
+    p = put32(p, 0);
+    p = put16(p, 0);
+    p = put16(p, 1);
+    p = put16(p, 0); p = put16(p, 0xFFFF); p = put16(p, 0xFFFF); p = put16(p, 0xFFFF);
+    p = put16(p, 1); p = put16(p, 0x0000); p = put16(p, 0x0000); p = put16(p, 0xFFFF);
+    for (int i = 0; i < 8; ++i) {
+        *p++ = 0xF0;
+        *p++ = 0x00;
+    }
+    p = put16(p, 0x0034);
+    p = put_rect(p, 4, 10, 8, 20);
+
+    // Frame the bottom rows, which are thin enough to be filled entirely, and then
+    // invert the first two pixels of the picture.
+    p = put16(p, 0x0030);
+    p = put_rect(p, 8, 0, 10, 20);
+    p = put16(p, 0x0033);
+    p = put_rect(p, 0, 0, 1, 2);
+    p = put16(p, 0x00FF);
+
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, buffer);
+    ASSERT_EQ(err, 0);
+
+    const uint8_t *px = pict->surface;
+    ASSERT_EQ(px[0], 0xFF);
+    ASSERT_EQ(px[1 * 4], 0x00);
+    ASSERT_EQ(px[2 * 4], 0x00);
+    ASSERT_EQ(px[3 * 4], 0xFF);
+    ASSERT_EQ(px[(1 * 20 + 0) * 4], 0xFF);
+    ASSERT_EQ(px[(1 * 20 + 1) * 4], 0x00);
+
+    const uint8_t *red = px + (5 * 20 + 3) * 4;
+    ASSERT_EQ(red[0], 0xFF);
+    ASSERT_EQ(red[1], 0x00);
+    ASSERT_EQ(red[2], 0x00);
+
+    const uint8_t *blue = px + (6 * 20 + 10) * 4;
+    ASSERT_EQ(blue[0], 0x00);
+    ASSERT_EQ(blue[2], 0xFF);
+    const uint8_t *white = px + (6 * 20 + 14) * 4;
+    ASSERT_EQ(white[0], 0xFF);
+    ASSERT_EQ(white[1], 0xFF);
+
+    ASSERT_EQ(px[(8 * 20 + 0) * 4], 0x00);
+    ASSERT_EQ(px[(8 * 20 + 1) * 4], 0xFF);
+    ASSERT_EQ(px[(9 * 20 + 1) * 4], 0x00);
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+TEST_CASE(PICT, ParseUnpackedDirectBitmaps)
+{
+    uint8_t *data = calloc(1024, 1);
+    uint8_t *p = put_header(data, 4, 3);
+
+    // Pack type 2: 32-bit pixels stored as RGB, without the pad byte.
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 16, 4, 0, 2, 32, 3);
+    const uint8_t rgb[12] = { 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0x10, 0x20, 0x30 };
+    memcpy(p, rgb, sizeof(rgb));
+    p += sizeof(rgb);
+
+    // Pack type 1: unpacked 16-bit pixels, even though the rows are wide enough
+    // to have been packed.
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 8, 4, 1, 1, 16, 3);
+    p = put16(p, 0x7C00); p = put16(p, 0x03E0); p = put16(p, 0x001F); p = put16(p, 0x7FFF);
+
+    // Pack type 1: unpacked 32-bit pixels, with a pad byte in place of alpha.
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 16, 4, 2, 1, 32, 3);
+    p = put32(p, 0x00FF0000); p = put32(p, 0x0000FF00); p = put32(p, 0x000000FF); p = put32(p, 0x00102030);
+    p = put16(p, 0x00FF);
+
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, buffer);
+    ASSERT_EQ(err, 0);
+
+    const uint8_t *px = pict->surface;
+    for (int y = 0; y < 3; ++y) {
+        const uint8_t *row = px + y * 4 * 4;
+        ASSERT_EQ(row[0], 0xFF);
+        ASSERT_EQ(row[1], 0x00);
+        ASSERT_EQ(row[4 + 1], 0xFF);
+        ASSERT_EQ(row[8 + 2], 0xFF);
+        ASSERT_EQ(row[8 + 3], 0xFF);
+        ASSERT_EQ(row[12 + 3], 0xFF);
+    }
+    ASSERT_EQ(px[12 + 0], 0x10);
+    ASSERT_EQ(px[12 + 2], 0x30);
+    ASSERT_EQ(px[16 + 12 + 0], 0xFF);
+    ASSERT_EQ(px[32 + 12 + 1], 0x20);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+
+    // Pack type 3 only packs 16-bit pixels, so 32-bit pixels with it are rejected
+    // rather than unpacked and converted as 16-bit pixels.
+    data = calloc(256, 1);
+    p = put_header(data, 4, 1);
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 16, 4, 0, 3, 32, 3);
+    *p++ = 2;
+    *p++ = 0xF1; *p++ = 0x00;
+    *p++ = 0;
+    p = put16(p, 0x00FF);
+    buffer = qd_buffer_create(data, p - data);
+    ASSERT_NEQ(qd_pict_parse(&pict, buffer), 0);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+TEST_CASE(PICT, ParseRejectsShortRows)
+{
+    uint8_t *data = calloc(256, 1);
+    uint8_t *p = put_header(data, 4, 1);
+
+    // Unpacked 32-bit rows of 4 bytes cannot hold 4 pixels, and are rejected
+    // rather than converted out of the buffer.
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 4, 4, 0, 1, 32, 3);
+    p = put32(p, 0x00FF0000);
+    p = put16(p, 0x00FF);
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+
+    struct qd_error error = { 0 };
+    struct qd_pict_options options = { .error = &error };
+    struct qd_pict *pict = NULL;
+    ASSERT_NEQ(qd_pict_parse_with_options(&pict, buffer, &options), 0);
+    ASSERT_EQ(error.code, qd_err_invalid);
+    ASSERT_EQ(error.opcode, 0x009A);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+
+    // Packed planar rows of 8 bytes cannot hold 3 components of 100 pixels, even
+    // though the runs of each row unpack within its 8 bytes.
+    qd_error_clear(&error);
+    data = calloc(256, 1);
+    p = put_header(data, 100, 1);
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 8, 100, 0, 4, 32, 3);
+    *p++ = 2;
+    *p++ = 0xF9; *p++ = 0x10;
+    p = put16(p, 0x00FF);
+    buffer = qd_buffer_create(data, p - data);
+    ASSERT_NEQ(qd_pict_parse_with_options(&pict, buffer, &options), 0);
+    ASSERT_EQ(error.code, qd_err_invalid);
+    ASSERT_EQ(error.opcode, 0x009A);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+static uint8_t *put_strip_pict(uint8_t *data)
+{
+    uint8_t *p = put_header(data, 16, 8);
+
+    // A picture made of eight packed strips, one row each, with a black rect
+    // painted over the left of the first six rows after the fourth strip.
+    for (int y = 0; y < 8; ++y) {
+        if (y == 4) {
+            p = put16(p, 0x0031);
+            p = put_rect(p, 0, 0, 6, 2);
+        }
+
+        p = put16(p, 0x009A);
+        p = put_direct_pixmap(p, 64, 16, y, 4, 32, 3);
+        *p++ = 6;
+        *p++ = 0xF1; *p++ = (uint8_t)(y << 4);
+        *p++ = 0xF1; *p++ = (uint8_t)(0xFF - (y << 4));
+        *p++ = 0xF1; *p++ = (uint8_t)y;
+        if ((p - data) & 1) {
+            *p++ = 0;
+        }
+    }
+
+    return put16(p, 0x00FF);
+}
+
+TEST_CASE(PICT, ParseStripBitmapsInParallel)
+{
+    uint8_t *data = calloc(2048, 1);
+    uint8_t *end = put_strip_pict(data);
+    struct qd_buffer *buffer = qd_buffer_create(data, end - data);
+
+    struct qd_pict *pict = NULL;
+    struct qd_pict_options options = { .threads = 4 };
+    int err = qd_pict_parse_with_options(&pict, buffer, &options);
+    ASSERT_EQ(err, 0);
+
+    // Every strip keeps its own PixMap.
+    ASSERT_EQ(pict->pixmap_count, 8);
+    ASSERT_EQ(pict->pm, pict->pixmaps[7]);
+    ASSERT_EQ(pict->pixmaps[3]->bounds.top, 3);
+
+    // Strips drawn before the rect are painted over, and those after it are not.
+    const uint8_t *px = pict->surface;
+    for (int y = 0; y < 8; ++y) {
+        const uint8_t *row = px + y * 16 * 4;
+        int painted = y < 4;
+        ASSERT_EQ(row[0], painted ? 0 : (uint8_t)(y << 4));
+        ASSERT_EQ(row[4 + 1], painted ? 0 : (uint8_t)(0xFF - (y << 4)));
+        ASSERT_EQ(row[8 + 0], (uint8_t)(y << 4));
+        ASSERT_EQ(row[60 + 1], (uint8_t)(0xFF - (y << 4)));
+        ASSERT_EQ(row[60 + 2], (uint8_t)y);
+    }
+
+    // Decoding on the calling thread alone produces the same picture.
+    struct qd_pict *serial = NULL;
+    options.threads = 1;
+    err = qd_pict_parse_with_options(&serial, buffer, &options);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(memcmp(serial->surface, pict->surface, pict->size), 0);
+
+    qd_pict_free(serial);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+static void count_errors(void *context, const struct qd_error *error)
+{
+    ++*(int *)context;
+}
+
+TEST_CASE(PICT, ParseRaisesErrors)
+{
+    uint8_t *data = calloc(2048, 1);
+    uint8_t *p = put_header(data, 16, 8);
+    long offset = p - data;
+    p = put16(p, 0x0020);
+    p = put16(p, 0x00FF);
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+
+    // An opcode that is not supported is reported along with where it was found.
+    int logged = 0;
+    struct qd_error error = { .log = count_errors, .log_context = &logged };
+    struct qd_pict_options options = { .error = &error };
+    struct qd_pict *pict = NULL;
+    ASSERT_NEQ(qd_pict_parse_with_options(&pict, buffer, &options), 0);
+    ASSERT_EQ(error.code, qd_err_unsupported);
+    ASSERT_EQ(error.opcode, 0x0020);
+    ASSERT_EQ(error.offset, offset + 2);
+    ASSERT_EQ(logged, 1);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+
+    // Strips that are cut short are reported as truncated, with the opcode of the
+    // strip, and only the first error is kept.
+    qd_error_clear(&error);
+    data = calloc(2048, 1);
+    uint8_t *end = put_strip_pict(data);
+    buffer = qd_buffer_create(data, (end - data) - 8);
+    options.threads = 4;
+    ASSERT_NEQ(qd_pict_parse_with_options(&pict, buffer, &options), 0);
+    ASSERT_EQ(error.code, qd_err_truncated);
+    ASSERT_EQ(error.opcode, 0x009A);
+    ASSERT_NEQ(error.offset, QD_ERROR_NO_OFFSET);
+    ASSERT_EQ(logged, 2);
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+TEST_CASE(PICT, ParseRejectsRunsBeyondTheRow)
+{
+    uint8_t *data = calloc(256, 1);
+    uint8_t *p = put_header(data, 16, 1);
+
+    // A packed row whose second run of 129 pixels unpacks beyond the 64 bytes of
+    // the row is rejected before it is decoded.
+    p = put16(p, 0x009A);
+    p = put_direct_pixmap(p, 64, 16, 0, 4, 32, 3);
+    *p++ = 6;
+    *p++ = 0xF1; *p++ = 0x10;
+    *p++ = 0x80; *p++ = 0x20;
+    *p++ = 0xF1; *p++ = 0x30;
+    if ((p - data) & 1) {
+        *p++ = 0;
+    }
+    p = put16(p, 0x00FF);
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+
+    struct qd_error error = { 0 };
+    struct qd_pict_options options = { .error = &error };
+    struct qd_pict *pict = NULL;
+    ASSERT_NEQ(qd_pict_parse_with_options(&pict, buffer, &options), 0);
+    ASSERT_EQ(error.code, qd_err_truncated);
+    ASSERT_EQ(error.opcode, 0x009A);
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+static int compare_pixels(const struct qd_pict *a, const struct qd_pict *b)
+{
+    size_t row_bytes = (size_t)a->width * sizeof(uint32_t);
+    uint8_t *pa = malloc(row_bytes * a->height);
+    uint8_t *pb = malloc(row_bytes * a->height);
+    int result = qd_pict_read_pixels(a, 0, 0, a->width, a->height, pa, row_bytes)
+        || qd_pict_read_pixels(b, 0, 0, b->width, b->height, pb, row_bytes)
+        || memcmp(pa, pb, row_bytes * a->height);
+    free(pa);
+    free(pb);
+    return result;
+}
+
+TEST_CASE(PICT, ParseIntoTiles)
+{
+    uint8_t *data = calloc(2048, 1);
+    uint8_t *end = put_strip_pict(data);
+    struct qd_buffer *buffer = qd_buffer_create(data, end - data);
+
+    // Bitmaps and fills drawn into tiles give the same pixels as drawn in one piece.
+    struct qd_pict *linear = NULL;
+    struct qd_pict *tiled = NULL;
+    struct qd_pict_options options = { .tiled = 1 };
+    ASSERT_EQ(qd_pict_parse(&linear, buffer), 0);
+    ASSERT_EQ(qd_pict_parse_with_options(&tiled, buffer, &options), 0);
+    ASSERT_EQ(tiled->surface, NULL);
+    ASSERT_NEQ(tiled->tiles, NULL);
+    ASSERT_EQ(tiled->size, linear->size);
+    ASSERT_EQ(compare_pixels(linear, tiled), 0);
+    qd_pict_free(linear);
+    qd_pict_free(tiled);
+    qd_buffer_free(buffer);
+
+    // Only the tiles that are drawn into are allocated.
+    data = calloc(64, 1);
+    uint8_t *p = put_header(data, 300, 200);
+    p = put16(p, 0x0031);
+    p = put_rect(p, 100, 100, 130, 140);
+    p = put16(p, 0x00FF);
+    buffer = qd_buffer_create(data, p - data);
+    ASSERT_EQ(qd_pict_parse(&linear, buffer), 0);
+    ASSERT_EQ(qd_pict_parse_with_options(&tiled, buffer, &options), 0);
+    ASSERT_EQ(tiled->tiles->tile_count, 4);
+    ASSERT_EQ(compare_pixels(linear, tiled), 0);
+
+    uint32_t px[2];
+    ASSERT_EQ(qd_pict_read_pixels(tiled, 99, 100, 2, 1, px, sizeof(px)), 0);
+    ASSERT_EQ(px[0], 0xFFFFFFFF);
+    ASSERT_NEQ(px[1], 0xFFFFFFFF);
+
+    qd_pict_free(linear);
+    qd_pict_free(tiled);
+    qd_buffer_free(buffer);
+}
+
+#if defined(QD_ENABLE_STATS)
+
+struct trace_counts
+{
+    atomic_int begin[qd_pict_stage_count];
+    atomic_int end[qd_pict_stage_count];
+};
+
+static void trace_begin(void *context, enum qd_pict_stage stage, const struct qd_pict *pict)
+{
+    atomic_fetch_add(&((struct trace_counts *)context)->begin[stage], 1);
+}
+
+static void trace_end(void *context, enum qd_pict_stage stage, const struct qd_pict *pict)
+{
+    atomic_fetch_add(&((struct trace_counts *)context)->end[stage], 1);
+}
+
+TEST_CASE(PICT, ParseGathersStatistics)
+{
+    uint8_t *data = calloc(2048, 1);
+    uint8_t *end = put_strip_pict(data);
+    struct qd_buffer *buffer = qd_buffer_create(data, end - data);
+
+    struct trace_counts counts = { 0 };
+    struct qd_pict_trace trace = { trace_begin, trace_end, &counts };
+    struct qd_pict_stats stats = { 0 };
+    struct qd_pict_options options = { .threads = 4, .stats = &stats, .trace = &trace };
+
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse_with_options(&pict, buffer, &options);
+    ASSERT_EQ(err, 0);
+
+    // Opcodes are listed in the order they first appear.
+    ASSERT_EQ(stats.opcode_count, 3);
+    ASSERT_EQ(stats.opcodes[0].opcode, 0x009A);
+    ASSERT_EQ(stats.opcodes[0].count, 8);
+    ASSERT_EQ(stats.opcodes[1].opcode, 0x0031);
+    ASSERT_EQ(stats.opcodes[1].count, 1);
+    ASSERT_EQ(stats.opcodes[1].bytes, 10);
+    ASSERT_EQ(stats.opcodes[2].opcode, 0x00FF);
+
+    // Each strip is a single row of three runs behind a one byte count, which
+    // unpacks to the row bytes of its PixMap.
+    ASSERT_EQ(stats.rows_decoded, 8);
+    ASSERT_EQ(stats.compressed_bytes, 8 * 7);
+    ASSERT_EQ(stats.decompressed_bytes, 8 * 64);
+    ASSERT_NEQ(stats.allocations, 0);
+    ASSERT_NEQ(stats.stage_ns[qd_pict_stage_decode], 0);
+
+    // The rect flushes the first four strips, and the end of the picture the rest.
+    ASSERT_EQ(counts.begin[qd_pict_stage_header], 1);
+    ASSERT_EQ(counts.end[qd_pict_stage_opcodes], 1);
+    ASSERT_EQ(counts.begin[qd_pict_stage_decode], 8);
+    ASSERT_EQ(counts.end[qd_pict_stage_decode], 8);
+    ASSERT_EQ(counts.begin[qd_pict_stage_composite], 2);
+    ASSERT_EQ(pict->stats, NULL);
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+#endif
+
+TEST_CASE(PICT, ParseCompressedQuickTime)
+{
+    uint8_t *data = calloc(1024, 1);
+    uint8_t *p = put_header(data, 16, 8);
+    const uint8_t jpeg[6] = { 0xFF, 0xD8, 0x01, 0x02, 0xFF, 0xD9 };
+
+    p = put16(p, 0x8200);
+    uint8_t *length = p;
+    p = put32(p, 0);
+    uint8_t *start = p;
+    p = put16(p, 0);                                        // version
+    p = put32(p, 0x00020000); p = put32(p, 0); p = put32(p, 0);
+    p = put32(p, 0); p = put32(p, 0x00020000); p = put32(p, 0);
+    p = put32(p, 0x00000000); p = put32(p, 0x00020000); p = put32(p, 0x40000000);
+    p = put32(p, 0);                                        // matte size
+    p = put_rect(p, 0, 0, 0, 0);                            // matte rect
+    p = put16(p, 0);                                        // mode
+    p = put_rect(p, 0, 0, 3, 6);                            // source rect
+    p = put32(p, 0);                                        // accuracy
+    p = put32(p, 0);                                        // mask size
+
+    p = put32(p, 86);                                       // image description size
+    p = put32(p, 0x6A706567);                               // 'jpeg'
+    p = put32(p, 0); p = put16(p, 0); p = put16(p, 0);
+    p = put16(p, 1); p = put16(p, 1);
+    p = put32(p, 0x6170706C);                               // 'appl'
+    p = put32(p, 0); p = put32(p, 0x00000200);
+    p = put16(p, 6); p = put16(p, 3);
+    p = put32(p, 0x00480000); p = put32(p, 0x00480000);
+    p = put32(p, sizeof(jpeg));
+    p = put16(p, 1);
+    *p = 4; memcpy(p + 1, "JPEG", 4); p += 32;
+    p = put16(p, 24); p = put16(p, -1);
+    memcpy(p, jpeg, sizeof(jpeg));
+    p += sizeof(jpeg);
+    put32(length, (uint32_t)(p - start));
+    p = put16(p, 0x00FF);
+
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, buffer);
+    ASSERT_EQ(err, 0);
+    ASSERT_EQ(pict->compressed_image_count, 1);
+
+    const struct qd_pict_compressed_image *image = &pict->compressed_images[0];
+    ASSERT_EQ(image->description.codec_type, 0x6A706567);
+    ASSERT_EQ(image->description.width, 6);
+    ASSERT_EQ(image->description.height, 3);
+    ASSERT_EQ(image->description.depth, 24);
+    ASSERT_EQ(strcmp(image->description.name, "JPEG"), 0);
+    ASSERT_EQ(image->destination_rect.bottom, 8);
+    ASSERT_EQ(image->destination_rect.right, 12);
+
+    // The payload is not copied out of the buffer.
+    ASSERT_EQ(image->data_size, sizeof(jpeg));
+    ASSERT_EQ(image->data, data + (p - data) - 2 - sizeof(jpeg));
+    ASSERT_EQ(memcmp(image->data, jpeg, sizeof(jpeg)), 0);
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+}
+
+#endif
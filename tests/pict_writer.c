@@ -0,0 +1,143 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal/pixel.h"
+#include "pict/pict.h"
+#include "pict/pict_writer.h"
+
+#if defined(UNIT_TEST)
+
+/* A surface of flat areas and gradients, made only of the 16 grays of the color
+ * table below so that every layout can hold it exactly. The grays are also exact
+ * in 5 bits per component. */
+static struct qd_color_spec gray_specs[16];
+static struct qd_color_table gray_table = { 0, 0, 15, gray_specs };
+
+static uint8_t gray_level(uint32_t i)
+{
+    uint32_t v = i * 2 + 1;
+    return (uint8_t)((v << 3) | (v >> 2));
+}
+
+static uint32_t *make_surface(struct qd_surface *surface, uint32_t width, uint32_t height, int alpha)
+{
+    for (int i = 0; i < 16; ++i) {
+        uint16_t level = (uint16_t)(gray_level(i) * 0x101);
+        gray_specs[i] = (struct qd_color_spec){ (unsigned short)i, { level, level, level } };
+    }
+
+    uint32_t *pixels = malloc((size_t)width * height * 4);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t level = gray_level((x < width / 2) ? 3 : (x + y) & 15);
+            pixels[y * width + x] = qd_pixel_pack(level, level, level, alpha ? (uint8_t)(x * 7 + y) : UINT8_MAX);
+        }
+    }
+    *surface = (struct qd_surface){ pixels, width, height, (size_t)width * 4 };
+    return pixels;
+}
+
+static int round_trips(const struct qd_surface *surface, const uint32_t *expected, short pixel_size, short pack_type, short cmp_count, unsigned int threads)
+{
+    struct qd_pixmap pm = { .pixel_size = pixel_size, .pack_type = pack_type, .cmp_count = cmp_count };
+    struct qd_pict_write_options options = { .pm = &pm, .clut = &gray_table, .threads = threads };
+    struct qd_buffer *buffer = NULL;
+    if (qd_pict_write(&buffer, surface, &options)) {
+        return 1;
+    }
+
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse(&pict, buffer);
+    if (!err) {
+        err = pict->width != surface->width || pict->height != surface->height
+            || memcmp(pict->surface, expected, (size_t)surface->row_bytes * surface->height) != 0;
+    }
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+    return err;
+}
+
+TEST_CASE(PICTWriter, RoundTripsEveryLayout)
+{
+    struct qd_surface surface;
+    uint32_t *pixels = make_surface(&surface, 300, 37, 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 4, 3, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 2, 3, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 1, 3, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 16, 3, 3, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 16, 1, 3, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 8, 0, 1, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 4, 0, 1, 4), 0);
+
+    // Colors that are not in the color table are written as the nearest of them.
+    uint32_t *expected = malloc((size_t)surface.row_bytes * surface.height);
+    memcpy(expected, pixels, (size_t)surface.row_bytes * surface.height);
+    pixels[5] = qd_pixel_pack(gray_level(3) + 2, gray_level(3) - 1, gray_level(3), UINT8_MAX);
+    ASSERT_EQ(round_trips(&surface, expected, 8, 0, 1, 4), 0);
+    free(expected);
+    free(pixels);
+
+    // Alpha is kept with a fourth component, and rows too narrow to be packed are
+    // written as they are.
+    pixels = make_surface(&surface, 300, 37, 1);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 4, 4, 4), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 1, 4, 4), 0);
+    free(pixels);
+
+    pixels = make_surface(&surface, 1, 5, 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 32, 4, 3, 1), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 16, 3, 3, 1), 0);
+    ASSERT_EQ(round_trips(&surface, pixels, 8, 0, 1, 1), 0);
+    free(pixels);
+}
+
+TEST_CASE(PICTWriter, EncodesRowsInParallel)
+{
+    // The picture is the same however many threads encode its rows.
+    struct qd_surface surface;
+    uint32_t *pixels = make_surface(&surface, 200, 150, 0);
+    struct qd_buffer *single = NULL;
+    struct qd_buffer *parallel = NULL;
+    struct qd_pict_write_options options = { .threads = 1 };
+    ASSERT_EQ(qd_pict_write(&single, &surface, &options), 0);
+    options.threads = 8;
+    ASSERT_EQ(qd_pict_write(&parallel, &surface, &options), 0);
+    ASSERT_EQ(single->size, parallel->size);
+    ASSERT_EQ(memcmp(single->data, parallel->data, (size_t)single->size), 0);
+
+    // Indexed pixels need a color table.
+    struct qd_error error = { 0 };
+    struct qd_pixmap pm = { .pixel_size = 8 };
+    struct qd_buffer *buffer = NULL;
+    options = (struct qd_pict_write_options){ .pm = &pm, .error = &error };
+    ASSERT_NEQ(qd_pict_write(&buffer, &surface, &options), 0);
+    ASSERT_EQ(buffer, NULL);
+    ASSERT_EQ(error.code, qd_err_argument);
+
+    qd_buffer_free(single);
+    qd_buffer_free(parallel);
+    free(pixels);
+}
+
+#endif
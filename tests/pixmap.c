@@ -20,6 +20,7 @@
  */
 
 #include <libUnit/unit.h>
+#include <stdlib.h>
 #include "common/pixmap.h"
 
 #if defined(UNIT_TEST)
@@ -51,4 +52,27 @@ TEST_CASE(PixMap, ParseResourceData)
     qd_buffer_free(pm_buffer);
 }
 
+TEST_CASE(PixMap, ParseBitsRejectsShortRows)
+{
+    // A BitMap of 20 pixels needs rows of 3 bytes, but claims rows of 2.
+    uint8_t *data = calloc(10, 1);
+    data[1] = 2;
+    data[7] = 1;
+    data[9] = 20;
+    struct qd_buffer *buffer = qd_buffer_create(data, 10);
+    struct qd_pixmap *pm = NULL;
+    int is_pixmap = 0;
+    ASSERT_NEQ(qd_pixmap_parse_bits(&pm, &is_pixmap, buffer), 0);
+
+    // The same BitMap with rows of 3 bytes is accepted.
+    qd_buffer_seek(buffer, 0, SEEK_SET);
+    data[1] = 3;
+    ASSERT_EQ(qd_pixmap_parse_bits(&pm, &is_pixmap, buffer), 0);
+    ASSERT_EQ(is_pixmap, 0);
+    ASSERT_EQ(pm->row_bytes, 3);
+
+    qd_pixmap_free(pm);
+    qd_buffer_free(buffer);
+}
+
 #endif
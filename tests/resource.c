@@ -0,0 +1,146 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <string.h>
+#include "common/color_table.h"
+#include "pict/pict.h"
+#include "resource/resource_file.h"
+
+#if defined(UNIT_TEST)
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++ = (uint8_t)(v >> 8);
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    return put16(put16(p, (uint16_t)(v >> 16)), (uint16_t)v);
+}
+
+static uint8_t *put_reference(uint8_t *p, int16_t id, uint16_t name_offset, uint32_t data_offset)
+{
+    p = put16(p, (uint16_t)id);
+    p = put16(p, name_offset);
+    p = put32(p, data_offset);
+    return put32(p, 0);
+}
+
+TEST_CASE(ResourceFile, IndexesResourcesByTypeAndId)
+{
+    struct qd_buffer *pict_buffer = qd_buffer_open("tests/test.pict");
+    struct qd_buffer *clut_buffer = qd_buffer_open("tests/test.clut");
+    uint32_t pict_size = (uint32_t)pict_buffer->size;
+    uint32_t clut_size = (uint32_t)clut_buffer->size;
+
+    // A resource fork with a named PICT and two clut resources sharing their data.
+    uint8_t *data = calloc(256 + pict_size + clut_size, 1);
+    uint8_t *p = data + 16;
+    p = put32(p, pict_size);
+    memcpy(p, pict_buffer->data, pict_size);
+    p += pict_size;
+    p = put32(p, clut_size);
+    memcpy(p, clut_buffer->data, clut_size);
+    p += clut_size;
+
+    uint32_t data_length = (uint32_t)(p - data) - 16;
+    uint8_t *map = p;
+    p += 22;
+    p = put16(p, 0);                            // attributes
+    p = put16(p, 28);                           // type list
+    p = put16(p, 28 + 54);                      // name list
+    p = put16(p, 1);
+    p = put32(p, QD_FOUR_CHAR_CODE('P', 'I', 'C', 'T')); p = put16(p, 0); p = put16(p, 18);
+    p = put32(p, QD_FOUR_CHAR_CODE('c', 'l', 'u', 't')); p = put16(p, 1); p = put16(p, 30);
+    p = put_reference(p, 128, 0, 0);
+    p = put_reference(p, 128, 0xFFFF, pict_size + 4);
+    p = put_reference(p, 129, 0xFFFF, pict_size + 4);
+    *p++ = 4;
+    memcpy(p, "Test", 4);
+    p += 4;
+
+    put32(put32(put32(put32(data, 16), (uint32_t)(map - data)), data_length), (uint32_t)(p - map));
+    struct qd_buffer *buffer = qd_buffer_create(data, p - data);
+    struct qd_resource_file *file = qd_resource_file_create(buffer, NULL);
+    ASSERT_NEQ(file, NULL);
+    ASSERT_EQ(qd_resource_file_count(file), 3);
+
+    // The data of a resource is a view onto the file, and parses as it is.
+    struct qd_resource resource = { 0 };
+    ASSERT_EQ(qd_resource_file_get(file, QD_FOUR_CHAR_CODE('P', 'I', 'C', 'T'), 128, &resource), 0);
+    ASSERT_EQ(resource.data.size, pict_size);
+    ASSERT_EQ(resource.data.data, data + 20);
+    ASSERT_EQ(resource.name[0], 4);
+    ASSERT_EQ(memcmp(resource.name + 1, "Test", 4), 0);
+
+    struct qd_pict *pict = NULL;
+    ASSERT_EQ(qd_pict_parse(&pict, &resource.data), 0);
+    ASSERT_EQ(pict->frame.right, 126);
+    ASSERT_EQ(pict->frame.bottom, 149);
+    qd_pict_free(pict);
+
+    ASSERT_EQ(qd_resource_file_get(file, QD_FOUR_CHAR_CODE('c', 'l', 'u', 't'), 129, &resource), 0);
+    ASSERT_EQ(resource.name, NULL);
+    struct qd_color_table *clut = qd_color_table_parse(&resource.data);
+    ASSERT_EQ(clut->ct_size, 0x0002);
+    qd_color_table_free(clut);
+
+    ASSERT_EQ(qd_resource_file_get(file, QD_FOUR_CHAR_CODE('c', 'l', 'u', 't'), 130, &resource), 1);
+    ASSERT_EQ(qd_resource_file_get(file, QD_FOUR_CHAR_CODE('P', 'I', 'C', 'T'), 129, &resource), 1);
+
+    ASSERT_EQ(qd_resource_file_get_index(file, 1, &resource), 0);
+    ASSERT_EQ(resource.type, QD_FOUR_CHAR_CODE('c', 'l', 'u', 't'));
+    ASSERT_EQ(resource.id, 128);
+
+    // A type that claims more references than its list holds is rejected before
+    // anything is allocated for them.
+    qd_resource_file_free(file);
+    put16(map + 28 + 2 + 8 + 4, 0xFFFE);
+    struct qd_error error = { 0 };
+    ASSERT_EQ(qd_resource_file_create(buffer, &error), NULL);
+    ASSERT_EQ(error.code, qd_err_invalid);
+
+    qd_buffer_free(buffer);
+    qd_buffer_free(pict_buffer);
+    qd_buffer_free(clut_buffer);
+}
+
+TEST_CASE(Buffer, MapFile)
+{
+    struct qd_buffer *read = qd_buffer_open("tests/test.pict");
+    struct qd_buffer *mapped = qd_buffer_map("tests/test.pict");
+    ASSERT_NEQ(mapped, NULL);
+    ASSERT_EQ(mapped->size, read->size);
+    ASSERT_EQ(memcmp(mapped->data, read->data, read->size), 0);
+
+    struct qd_buffer view = { 0 };
+    ASSERT_EQ(qd_buffer_view(&view, mapped, 2, 8), 0);
+    ASSERT_EQ(view.data, (uint8_t *)mapped->data + 2);
+    ASSERT_EQ(qd_buffer_view(&view, mapped, mapped->size - 4, 8), 1);
+
+    qd_buffer_free(mapped);
+    qd_buffer_free(read);
+}
+
+#endif
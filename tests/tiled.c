@@ -0,0 +1,80 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libUnit/unit.h>
+#include <stdlib.h>
+#include "common/blit.h"
+#include "common/tiled_surface.h"
+
+#if defined(UNIT_TEST)
+
+static int fill_tile(void *context, struct qd_surface *tile, long left, long top)
+{
+    // Fill the part of the rect that lies within the tile with its coordinates.
+    const struct qd_rect *rect = context;
+    for (long y = 0; y < (long)tile->height; ++y) {
+        uint32_t *row = (uint32_t *)((uint8_t *)tile->data + y * tile->row_bytes);
+        for (long x = 0; x < (long)tile->width; ++x) {
+            long sx = left + x;
+            long sy = top + y;
+            if (sx >= rect->left && sx < rect->right && sy >= rect->top && sy < rect->bottom) {
+                row[x] = (uint32_t)(sy << 16 | sx);
+            }
+        }
+    }
+    return 0;
+}
+
+TEST_CASE(TiledSurface, AllocatesTilesAsDrawn)
+{
+    struct qd_tiled_surface surface;
+    ASSERT_EQ(qd_tiled_surface_init(&surface, 1000, 300, 0xFFFFFFFF), 0);
+    ASSERT_EQ(surface.columns, 16);
+    ASSERT_EQ(surface.rows, 5);
+    ASSERT_EQ(surface.tile_count, 0);
+
+    // A rect that straddles the corners of four tiles allocates only those four.
+    struct qd_rect rect = { 60, 120, 70, 130 };
+    ASSERT_EQ(qd_tiled_surface_draw(&surface, rect, fill_tile, &rect), 0);
+    ASSERT_EQ(surface.tile_count, 4);
+
+    // Reading an area back gathers it from the tiles, and areas without tiles read
+    // as the background.
+    uint32_t *pixels = malloc(20 * 20 * sizeof(uint32_t));
+    ASSERT_EQ(qd_tiled_surface_read(&surface, 115, 55, 20, 20, pixels, 20 * sizeof(uint32_t)), 0);
+    ASSERT_EQ(pixels[0], 0xFFFFFFFF);
+    ASSERT_EQ(pixels[5 * 20 + 5], (uint32_t)(60 << 16 | 120));
+    ASSERT_EQ(pixels[14 * 20 + 14], (uint32_t)(69 << 16 | 129));
+    ASSERT_EQ(pixels[15 * 20 + 15], 0xFFFFFFFF);
+    ASSERT_NEQ(qd_tiled_surface_read(&surface, 990, 0, 20, 1, pixels, 20 * sizeof(uint32_t)), 0);
+    free(pixels);
+
+    // The tiles on the right edge are cut down to the surface.
+    struct qd_surface tile;
+    ASSERT_EQ(qd_tiled_surface_get_tile(&surface, 15, 4, &tile), 0);
+    ASSERT_EQ(tile.width, 1000 - 15 * 64);
+    ASSERT_EQ(tile.height, 300 - 4 * 64);
+    ASSERT_EQ(surface.tile_count, 5);
+
+    qd_tiled_surface_destroy(&surface);
+}
+
+#endif
@@ -0,0 +1,156 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache/baked_file.h"
+#include "pict/pict.h"
+#include "resource/resource_file.h"
+
+/* Bakes decoded pictures into a file that can be loaded with qd_baked_file_open.
+ *
+ *   qdbake [-s scale] output picture... [-r resource-file]...
+ *
+ * Pictures given as files are named by their path. The PICT resources of a
+ * resource file are named by the path of the file and the resource id, such as
+ * "data.rsrc#128". */
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: qdbake [-s scale] output picture... [-r resource-file]...\n");
+}
+
+static void report(const char *action, const char *name, struct qd_error *error)
+{
+    fprintf(stderr, "qdbake: failed to %s '%s'", action, name);
+    if (error->code != qd_err_none) {
+        fprintf(stderr, ": %s", error->message);
+        if (error->opcode != QD_ERROR_NO_OPCODE) {
+            fprintf(stderr, " (opcode 0x%04x)", (unsigned int)error->opcode);
+        }
+        if (error->offset != QD_ERROR_NO_OFFSET) {
+            fprintf(stderr, " at offset %ld", error->offset);
+        }
+    }
+    fprintf(stderr, "\n");
+    qd_error_clear(error);
+}
+
+static int bake_picture(struct qd_baked_writer *writer, const char *name, struct qd_buffer *buffer, const struct qd_pict_options *options)
+{
+    struct qd_pict *pict = NULL;
+    int err = qd_pict_parse_with_options(&pict, buffer, options);
+    if (err || !pict) {
+        report("decode", name, options->error);
+        err = 1;
+    }
+    else if ((err = qd_baked_writer_add(writer, name, pict))) {
+        report("bake", name, options->error);
+    }
+
+    qd_pict_free(pict);
+    return err;
+}
+
+static int bake_resource_file(struct qd_baked_writer *writer, const char *path, const struct qd_pict_options *options)
+{
+    struct qd_resource_file *file = qd_resource_file_open(path, options->error);
+    if (!file) {
+        report("open resource file", path, options->error);
+        return 1;
+    }
+
+    int err = 0;
+    size_t count = qd_resource_file_count(file);
+    for (size_t n = 0; n < count; ++n) {
+        struct qd_resource resource = { 0 };
+        if (qd_resource_file_get_index(file, n, &resource)) {
+            err = 1;
+            continue;
+        }
+        if (resource.type != QD_FOUR_CHAR_CODE('P', 'I', 'C', 'T')) {
+            continue;
+        }
+
+        char name[4096];
+        snprintf(name, sizeof(name), "%s#%d", path, resource.id);
+        err |= bake_picture(writer, name, &resource.data, options);
+    }
+
+    qd_resource_file_free(file);
+    return err;
+}
+
+int main(int argc, const char **argv)
+{
+    struct qd_error error = { 0 };
+    struct qd_pict_options options = { .error = &error };
+    const char *output = NULL;
+    int err = 0;
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-s") == 0) {
+        options.scale = (unsigned int)strtoul(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+    if (arg < argc) {
+        output = argv[arg++];
+    }
+    if (!output || arg == argc) {
+        usage();
+        return 1;
+    }
+
+    struct qd_baked_writer *writer = qd_baked_writer_open(output, &error);
+    if (!writer) {
+        report("create", output, &error);
+        return 1;
+    }
+
+    for (; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-r") == 0) {
+            if (++arg == argc) {
+                usage();
+                err = 1;
+                break;
+            }
+            err |= bake_resource_file(writer, argv[arg], &options);
+            continue;
+        }
+
+        struct qd_buffer *buffer = qd_buffer_map(argv[arg]);
+        if (!buffer) {
+            fprintf(stderr, "qdbake: failed to read '%s'\n", argv[arg]);
+            err = 1;
+            continue;
+        }
+        err |= bake_picture(writer, argv[arg], buffer, &options);
+        qd_buffer_free(buffer);
+    }
+
+    if (qd_baked_writer_close(writer)) {
+        report("write", output, &error);
+        return 1;
+    }
+
+    return err;
+}
@@ -0,0 +1,523 @@
+/* Copyright (c) 2019 Tom Hancocks, The Diamond Project
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "common/geometry.h"
+#include "common/pixmap.h"
+#include "pict/pict.h"
+
+/* Lists what pictures are made of, or what they cost to decode.
+ *
+ *   qdinfo [-p | --profile] [-t threads] [-s scale] path...
+ *
+ * Each opcode of a picture is listed with its offset, length and arguments, along
+ * with the PixMap and color table of each bitmap. With --profile, the time taken
+ * by each bitmap is listed instead, followed by the time taken by each kind of
+ * opcode. Profiling decodes bitmaps on the calling thread, so that each is timed
+ * by the opcode that reads it. The first opcode includes the picture header.
+ *
+ * Directories are searched for .pict, .pct and .pic files, each of which is
+ * summarised on a single line. The total throughput is given at the end. */
+
+#define QDINFO_MAX_OPCODE_KINDS 256
+
+struct opcode_profile
+{
+    uint16_t opcode;
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t ns;
+};
+
+struct info
+{
+    struct qd_pict_options options;
+    int profile;
+    int summary;
+
+    // The picture being decoded.
+    struct qd_buffer *buffer;
+    uint64_t last_ns;
+    size_t opcode_count;
+
+    // Totals across every picture.
+    struct opcode_profile opcodes[QDINFO_MAX_OPCODE_KINDS];
+    size_t opcode_kinds;
+    size_t pictures;
+    size_t failed;
+    uint64_t bytes;
+    uint64_t pixels;
+    uint64_t ns;
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: qdinfo [-p | --profile] [-t threads] [-s scale] path...\n");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static const char *opcode_name(uint16_t opcode)
+{
+    switch (opcode) {
+        case 0x0000: return "NOP";
+        case 0x0001: return "Clip";
+        case 0x0002: return "BkPat";
+        case 0x0007: return "PnSize";
+        case 0x0008: return "PnMode";
+        case 0x0009: return "PnPat";
+        case 0x000A: return "FillPat";
+        case 0x0011: return "VersionOp";
+        case 0x0012: return "BkPixPat";
+        case 0x0013: return "PnPixPat";
+        case 0x0014: return "FillPixPat";
+        case 0x001A: return "RGBFgCol";
+        case 0x001B: return "RGBBkCol";
+        case 0x001E: return "DefHilite";
+        case 0x001F: return "OpColor";
+        case 0x0030: return "frameRect";
+        case 0x0031: return "paintRect";
+        case 0x0032: return "eraseRect";
+        case 0x0033: return "invertRect";
+        case 0x0034: return "fillRect";
+        case 0x0038: return "frameSameRect";
+        case 0x0039: return "paintSameRect";
+        case 0x003A: return "eraseSameRect";
+        case 0x003B: return "invertSameRect";
+        case 0x003C: return "fillSameRect";
+        case 0x0090: return "BitsRect";
+        case 0x0098: return "PackBitsRect";
+        case 0x009A: return "DirectBitsRect";
+        case 0x00A1: return "LongComment";
+        case 0x00FF: return "OpEndPic";
+        case 0x0C00: return "HeaderOp";
+        case 0x8200: return "CompressedQuickTime";
+        default: return "?";
+    }
+}
+
+static int is_bitmap_opcode(uint16_t opcode)
+{
+    return opcode == 0x0090 || opcode == 0x0098 || opcode == 0x009A;
+}
+
+// MARK: - Disassembly
+
+static int16_t read16(struct qd_buffer *args)
+{
+    int16_t value = 0;
+    qd_buffer_read(&value, sizeof(value), 1, args);
+    return value;
+}
+
+static int32_t read32(struct qd_buffer *args)
+{
+    int32_t value = 0;
+    qd_buffer_read(&value, sizeof(value), 1, args);
+    return value;
+}
+
+static void print_rect(const char *label, struct qd_buffer *args)
+{
+    int16_t r[4] = { 0 };
+    qd_buffer_read(r, sizeof(int16_t), 4, args);
+    printf(" %s(%d,%d,%d,%d)", label, r[0], r[1], r[2], r[3]);
+}
+
+static void print_bitmap(uint16_t opcode, struct qd_buffer *args)
+{
+    struct qd_pixmap *pm = NULL;
+    int is_pixmap = 1;
+    int err = (opcode == 0x009A) ? qd_pixmap_parse(&pm, args) : qd_pixmap_parse_bits(&pm, &is_pixmap, args);
+    if (err) {
+        // The PixMap has already been freed.
+        printf("\n            <invalid pixmap>\n");
+        return;
+    }
+
+    printf("\n            %s bounds(%d,%d,%d,%d) row_bytes=%d", is_pixmap ? "PixMap" : "BitMap",
+           pm->bounds.top, pm->bounds.left, pm->bounds.bottom, pm->bounds.right, pm->row_bytes);
+    if (is_pixmap) {
+        printf(" version=%d pack_type=%d pack_size=%d res=%gx%g pixel_type=%d pixel_size=%d cmp=%dx%d",
+               pm->pm_version, pm->pack_type, pm->pack_size, pm->h_res, pm->v_res,
+               pm->pixel_type, pm->pixel_size, pm->cmp_count, pm->cmp_size);
+    }
+
+    // The bitmap opcodes carry a color table for a PixMap, which direct pixels lack.
+    if (is_pixmap && opcode != 0x009A) {
+        int32_t seed = read32(args);
+        int16_t flags = read16(args);
+        int16_t size = read16(args);
+        printf("\n            clut seed=%d flags=0x%04x entries=%d", seed, (uint16_t)flags, size + 1);
+        qd_buffer_seek(args, (long)(size + 1) * 8, SEEK_CUR);
+    }
+
+    printf("\n           ");
+    print_rect("src", args);
+    print_rect("dst", args);
+    printf(" mode=%d", read16(args));
+    long data = (long)args->size - qd_buffer_tell(args);
+    printf(" data=%ld\n", data > 0 ? data : 0);
+    qd_pixmap_free(pm);
+}
+
+static void print_opcode(struct info *info, uint16_t opcode, long offset, long length)
+{
+    printf("%08lx %6ld  %04x %-16s", offset, length, opcode, opcode_name(opcode));
+
+    struct qd_buffer args = { 0 };
+    if (length < 2 || qd_buffer_view(&args, info->buffer, offset + 2, length - 2)) {
+        printf("\n");
+        return;
+    }
+
+    switch (opcode) {
+        case 0x0001:
+            printf(" size=%d", read16(&args));
+            print_rect("", &args);
+            break;
+
+        case 0x0002:
+        case 0x0009:
+        case 0x000A:
+            printf(" ");
+            for (int n = 0; n < 8; ++n) {
+                uint8_t byte = 0;
+                qd_buffer_read(&byte, 1, 1, &args);
+                printf("%02x", byte);
+            }
+            break;
+
+        case 0x0007: {
+            int16_t v = read16(&args);
+            printf(" %dx%d", read16(&args), v);
+            break;
+        }
+
+        case 0x0008:
+            printf(" mode=%d", read16(&args));
+            break;
+
+        case 0x0012:
+        case 0x0013:
+        case 0x0014:
+            printf(" type=%d", read16(&args));
+            break;
+
+        case 0x001A:
+        case 0x001B:
+        case 0x001F: {
+            uint16_t rgb[3] = { 0 };
+            qd_buffer_read(rgb, sizeof(uint16_t), 3, &args);
+            printf(" rgb(%04x,%04x,%04x)", rgb[0], rgb[1], rgb[2]);
+            break;
+        }
+
+        case 0x0030:
+        case 0x0031:
+        case 0x0032:
+        case 0x0033:
+        case 0x0034:
+            print_rect("", &args);
+            break;
+
+        case 0x0090:
+        case 0x0098:
+        case 0x009A:
+            print_bitmap(opcode, &args);
+            return;
+
+        case 0x00A1: {
+            int16_t kind = read16(&args);
+            printf(" kind=%d size=%d", kind, read16(&args));
+            break;
+        }
+
+        case 0x8200:
+            printf(" size=%d", read32(&args));
+            break;
+    }
+
+    printf("\n");
+}
+
+// MARK: - Profiling
+
+static void record_opcode(struct info *info, uint16_t opcode, long length, uint64_t ns)
+{
+    size_t n = 0;
+    while (n < info->opcode_kinds && info->opcodes[n].opcode != opcode) {
+        ++n;
+    }
+    if (n == QDINFO_MAX_OPCODE_KINDS) {
+        return;
+    }
+    if (n == info->opcode_kinds) {
+        info->opcodes[info->opcode_kinds++].opcode = opcode;
+    }
+
+    info->opcodes[n].count++;
+    info->opcodes[n].bytes += (uint64_t)length;
+    info->opcodes[n].ns += ns;
+}
+
+static void print_bitmap_profile(uint16_t opcode, long offset, long length, uint64_t ns, const struct qd_pict *pict)
+{
+    const struct qd_pixmap *pm = pict->pm;
+    uint64_t pixels = pm ? (uint64_t)qd_rect_get_width(pm->bounds) * qd_rect_get_height(pm->bounds) : 0;
+    double seconds = (double)ns / 1e9;
+
+    printf("%08lx %6ld  %-16s %5dx%-5d %2d-bit pack_type=%d %10.3f ms %9.2f MB/s %9.2f Mpixels/s\n",
+           offset, length, opcode_name(opcode),
+           pm ? qd_rect_get_width(pm->bounds) : 0, pm ? qd_rect_get_height(pm->bounds) : 0,
+           pm ? pm->pixel_size : 0, pm ? pm->pack_type : 0, seconds * 1e3,
+           seconds > 0 ? (double)length / seconds / 1e6 : 0.0,
+           seconds > 0 ? (double)pixels / seconds / 1e6 : 0.0);
+}
+
+static int compare_opcode_time(const void *lhs, const void *rhs)
+{
+    const struct opcode_profile *a = lhs;
+    const struct opcode_profile *b = rhs;
+    return (a->ns < b->ns) - (a->ns > b->ns);
+}
+
+static void print_profile(struct info *info)
+{
+    uint64_t total = 0;
+    for (size_t n = 0; n < info->opcode_kinds; ++n) {
+        total += info->opcodes[n].ns;
+    }
+    qsort(info->opcodes, info->opcode_kinds, sizeof(info->opcodes[0]), compare_opcode_time);
+
+    printf("\nopcode                      count        bytes         time\n");
+    for (size_t n = 0; n < info->opcode_kinds; ++n) {
+        const struct opcode_profile *op = &info->opcodes[n];
+        printf("%04x %-16s %10llu %12llu %10.3f ms %5.1f%%\n",
+               op->opcode, opcode_name(op->opcode),
+               (unsigned long long)op->count, (unsigned long long)op->bytes,
+               (double)op->ns / 1e6, total ? 100.0 * (double)op->ns / (double)total : 0.0);
+    }
+}
+
+// MARK: - Pictures
+
+static void on_opcode(void *context, uint16_t opcode, long offset, long length, const struct qd_pict *pict)
+{
+    struct info *info = context;
+    uint64_t now = now_ns();
+    uint64_t ns = now - info->last_ns;
+    info->last_ns = now;
+    info->opcode_count++;
+
+    if (info->profile) {
+        record_opcode(info, opcode, length, ns);
+        if (!info->summary && is_bitmap_opcode(opcode)) {
+            print_bitmap_profile(opcode, offset, length, ns, pict);
+        }
+    }
+    else if (!info->summary) {
+        print_opcode(info, opcode, offset, length);
+    }
+}
+
+static int show_picture(struct info *info, const char *path)
+{
+    struct qd_buffer *buffer = qd_buffer_map(path);
+    if (!buffer) {
+        printf("%s: failed to read\n", path);
+        info->failed++;
+        return 1;
+    }
+
+    if (!info->summary) {
+        int16_t frame[4] = { 0 };
+        qd_buffer_seek(buffer, 2, SEEK_SET);
+        qd_buffer_read(frame, sizeof(int16_t), 4, buffer);
+        printf("%s: %llu bytes, frame (%d,%d,%d,%d)\n", path, (unsigned long long)buffer->size,
+               frame[0], frame[1], frame[2], frame[3]);
+        qd_buffer_seek(buffer, 0, SEEK_SET);
+    }
+
+    struct qd_pict_listener listener = { on_opcode, info };
+    struct qd_error error = { 0 };
+    struct qd_pict_options options = info->options;
+    options.listener = &listener;
+    options.error = &error;
+    info->buffer = buffer;
+    info->opcode_count = 0;
+
+    struct qd_pict *pict = NULL;
+    uint64_t start = now_ns();
+    info->last_ns = start;
+    int err = qd_pict_parse_with_options(&pict, buffer, &options);
+    uint64_t ns = now_ns() - start;
+
+    if (err || !pict) {
+        printf("%s: failed after %zu opcodes", path, info->opcode_count);
+        if (error.code != qd_err_none) {
+            printf(": %s: %s", qd_err_string(error.code), error.message);
+            if (error.opcode != QD_ERROR_NO_OPCODE) {
+                printf(" (opcode 0x%04x)", (unsigned int)error.opcode);
+            }
+            if (error.offset != QD_ERROR_NO_OFFSET) {
+                printf(" at offset %ld", error.offset);
+            }
+        }
+        printf("\n");
+        info->failed++;
+        err = 1;
+    }
+    else {
+        uint64_t pixels = (uint64_t)pict->width * pict->height;
+        info->pictures++;
+        info->bytes += buffer->size;
+        info->pixels += pixels;
+        info->ns += ns;
+
+        if (info->summary) {
+            printf("%s: %llu bytes, %ux%u, %zu opcodes, %.3f ms\n", path, (unsigned long long)buffer->size,
+                   pict->width, pict->height, info->opcode_count, (double)ns / 1e6);
+        }
+        else {
+            printf("%s: decoded %ux%u at 1/%u scale from %zu opcodes, %zu pixmaps, in %.3f ms\n", path,
+                   pict->width, pict->height, pict->scale, info->opcode_count, pict->pixmap_count, (double)ns / 1e6);
+        }
+    }
+
+    qd_pict_free(pict);
+    qd_buffer_free(buffer);
+    info->buffer = NULL;
+    return err;
+}
+
+static int is_picture_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    return ext && (strcasecmp(ext, ".pict") == 0 || strcasecmp(ext, ".pct") == 0 || strcasecmp(ext, ".pic") == 0);
+}
+
+static int show_directory(struct info *info, const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "qdinfo: failed to open directory '%s'\n", path);
+        return 1;
+    }
+
+    int err = 0;
+    struct dirent *entry = NULL;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char child[4096];
+        struct stat st;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st)) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            err |= show_directory(info, child);
+        }
+        else if (S_ISREG(st.st_mode) && is_picture_name(entry->d_name)) {
+            err |= show_picture(info, child);
+        }
+    }
+
+    closedir(dir);
+    return err;
+}
+
+int main(int argc, const char **argv)
+{
+    struct info *info = calloc(1, sizeof(*info));
+    int threads = -1;
+    int err = 0;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-p") == 0 || strcmp(argv[arg], "--profile") == 0) {
+            info->profile = 1;
+        }
+        else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            threads = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+            info->options.scale = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        }
+        else {
+            usage();
+            free(info);
+            return 1;
+        }
+    }
+    if (arg == argc) {
+        usage();
+        free(info);
+        return 1;
+    }
+
+    // Bitmaps are only timed by their own opcodes when decoded on this thread.
+    info->options.threads = (threads >= 0) ? (unsigned int)threads : (info->profile ? 1 : 0);
+
+    for (; arg < argc; ++arg) {
+        struct stat st;
+        if (stat(argv[arg], &st)) {
+            fprintf(stderr, "qdinfo: no such file or directory '%s'\n", argv[arg]);
+            err = 1;
+            continue;
+        }
+
+        info->summary = S_ISDIR(st.st_mode);
+        err |= info->summary ? show_directory(info, argv[arg]) : show_picture(info, argv[arg]);
+    }
+
+    if (info->profile) {
+        print_profile(info);
+    }
+
+    if (info->pictures + info->failed > 1) {
+        double seconds = (double)info->ns / 1e9;
+        printf("\n%zu pictures, %zu failed, %.2f MB in %.3f ms: %.2f MB/s, %.2f Mpixels/s\n",
+               info->pictures, info->failed, (double)info->bytes / 1e6, seconds * 1e3,
+               seconds > 0 ? (double)info->bytes / seconds / 1e6 : 0.0,
+               seconds > 0 ? (double)info->pixels / seconds / 1e6 : 0.0);
+    }
+
+    free(info);
+    return err;
+}